@@ -18,8 +18,58 @@ public:
 
 } // namespace
 
+std::vector<std::string> DocReaderCache::get_keys(const std::string &) const
+{
+    return {};
+}
+
+void DocReaderCache::erase(const std::string &, const std::string &)
+{
+}
+
+std::optional<std::filesystem::path> DocReaderCache::get_file_dir(const std::string &)
+{
+    return std::nullopt;
+}
+
 bool DocReader::open()
 {
-    NullCache cache;
+    static NullCache cache;
     return open(cache);
 }
+
+bool DocReader::is_progress_estimated() const
+{
+    return false;
+}
+
+bool DocReader::run_background_task()
+{
+    return false;
+}
+
+void DocReader::set_background_func(background_func)
+{
+}
+
+ResourceData DocReader::load_resource_data(const std::filesystem::path &path) const
+{
+    return ResourceData(load_resource(path));
+}
+
+std::vector<char> DocReader::load_resource_prefix(const std::filesystem::path &path, size_t max_bytes) const
+{
+    auto data = load_resource(path);
+    if (data.size() > max_bytes)
+    {
+        data.resize(max_bytes);
+    }
+    return data;
+}
+
+std::optional<ImageSize> DocReader::get_image_size(const std::filesystem::path &path) const
+{
+    return probe_image_size([this, &path](size_t max_bytes) {
+        return load_resource_prefix(path, max_bytes);
+    });
+}
@@ -1,7 +1,10 @@
 #ifndef DOC_READER_H_
 #define DOC_READER_H_
 
+#include "./resource_data.h"
 #include "./token_iter.h"
+#include "util/image_probe.h"
+#include "util/task_queue.h"
 
 #include <filesystem>
 #include <memory>
@@ -21,12 +24,32 @@ struct TocPosition
     uint32_t progress_percent;
 };
 
+// Identifying details of a document, read without fully opening it
+struct DocMetadata
+{
+    std::string id;         // as returned by DocReader::get_id
+    std::string title;
+    std::string author;
+};
+
+// Encoded cover image of a document
+struct DocCover
+{
+    std::vector<char> data;
+    std::string format;     // image file extension, e.g. "jpg"
+};
+
 // Allow readers to cache arbitrary data
 class DocReaderCache
 {
 public:
     virtual std::optional<std::string> read(const std::string &book_id, const std::string &key) const = 0;
     virtual void write(const std::string &book_id, const std::string &key, const std::string &value) = 0;
+    // Keys stored for the book, for dropping superseded entries
+    virtual std::vector<std::string> get_keys(const std::string &book_id) const;
+    virtual void erase(const std::string &book_id, const std::string &key);
+    // Directory for larger per-book cache files, if the cache has one
+    virtual std::optional<std::filesystem::path> get_file_dir(const std::string &book_id);
 };
 
 // Interface for interacting with a particular document format.
@@ -35,6 +58,7 @@ class DocReader
 public:
     virtual ~DocReader() = default;
 
+    // The cache must outlive the reader. Readers may write to it after open returns.
     bool open();
     virtual bool open(DocReaderCache &cache) = 0;
     virtual bool is_open() const = 0;
@@ -46,10 +70,31 @@ public:
     virtual DocAddr get_toc_item_address(uint32_t toc_item_index) const = 0;
 
     virtual uint32_t get_global_progress_percent(const DocAddr &address) const = 0;
+    // True while global progress is approximate, pending background work
+    virtual bool is_progress_estimated() const;
+
+    // Perform a small unit of deferred work (e.g. measuring unvisited chapters).
+    // Return true if more work remains.
+    virtual bool run_background_task();
+
+    // Allow work such as parsing upcoming sections to run on another thread.
+    virtual void set_background_func(background_func run_in_background);
 
     virtual std::shared_ptr<TokenIter> get_iter(DocAddr address = 0) const = 0;
+    // Iterator from the start of the book for a worker thread, reading through
+    // handles of its own rather than the reader's caches. It and its clones
+    // must be used from one thread at a time, and may outlive the reader. Null
+    // if the book can't be read.
+    virtual std::shared_ptr<TokenIter> get_worker_iter() const = 0;
 
     virtual std::vector<char> load_resource(const std::filesystem::path &path) const = 0;
+    // Resource bytes, shared rather than copied where the format allows.
+    virtual ResourceData load_resource_data(const std::filesystem::path &path) const;
+    // Read at most max_bytes from the start of a resource.
+    virtual std::vector<char> load_resource_prefix(const std::filesystem::path &path, size_t max_bytes) const;
+
+    // Dimensions of an image resource, read from its header without decoding.
+    virtual std::optional<ImageSize> get_image_size(const std::filesystem::path &path) const;
 };
 
 #endif
@@ -3,10 +3,12 @@
 
 #include "./doc_addr.h"
 
+#include <cstdint>
 #include <filesystem>
 #include <string>
+#include <string_view>
 
-enum class TokenType
+enum class TokenType : uint8_t
 {
     Text,
     Header,
@@ -14,54 +16,23 @@ enum class TokenType
     ListItem,
 };
 
+// Lightweight view of a token. Text is not owned, it usually points into
+// the TokenArena the token was read from.
 struct DocToken
 {
     TokenType type;
     DocAddr address;
+    std::string_view text;    // Image tokens hold the image path
+    int nest_level = 0;       // ListItem only
 
-    DocToken(TokenType type, DocAddr address);
-    virtual bool operator==(const DocToken &other) const;
-    virtual std::string to_string() const = 0;
+    DocToken() = default;
+    DocToken(TokenType type, DocAddr address, std::string_view text, int nest_level = 0);
 
-protected:
-    std::string common_to_string(std::string data) const;
-};
-
-struct TextDocToken : public DocToken
-{
-    std::string text;
-
-    TextDocToken(DocAddr address, const std::string &text);
-    bool operator==(const DocToken &other) const override;
-    std::string to_string() const override;
-};
-
-struct HeaderDocToken : public DocToken
-{
-    std::string text;
-
-    HeaderDocToken(DocAddr address, const std::string &text);
-    bool operator==(const DocToken &other) const override;
-    std::string to_string() const override;
-};
-
-struct ImageDocToken : public DocToken
-{
-    std::filesystem::path path;
-
-    ImageDocToken(DocAddr address, const std::filesystem::path &path);
-    bool operator==(const DocToken &other) const override;
-    std::string to_string() const override;
-};
-
-struct ListItemDocToken : public DocToken
-{
-    std::string text;
-    int nest_level;
+    std::filesystem::path path() const;
 
-    ListItemDocToken(DocAddr address, const std::string &text, int nest_level);
-    bool operator==(const DocToken &other) const override;
-    std::string to_string() const override;
+    bool operator==(const DocToken &other) const;
+    bool operator!=(const DocToken &other) const;
+    std::string to_string() const;
 };
 
 std::string to_string(TokenType type);
@@ -0,0 +1,49 @@
+#ifndef RESOURCE_DATA_H_
+#define RESOURCE_DATA_H_
+
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+// Read-only bytes of a document resource. Either holds its own buffer, or
+// views memory kept alive by owner, such as an uncompressed entry in a mapped
+// epub. Copies share the same bytes.
+class ResourceData
+{
+    std::shared_ptr<const void> owner;
+    const char *bytes = nullptr;
+    size_t length = 0;
+
+public:
+    ResourceData() = default;
+
+    explicit ResourceData(std::vector<char> buffer)
+    {
+        auto owned = std::make_shared<const std::vector<char>>(std::move(buffer));
+        bytes = owned->data();
+        length = owned->size();
+        owner = std::move(owned);
+    }
+
+    ResourceData(std::shared_ptr<const void> owner, const char *data, size_t size)
+        : owner(std::move(owner)), bytes(data), length(size)
+    {
+    }
+
+    const char *data() const
+    {
+        return bytes;
+    }
+
+    size_t size() const
+    {
+        return length;
+    }
+
+    bool empty() const
+    {
+        return length == 0;
+    }
+};
+
+#endif
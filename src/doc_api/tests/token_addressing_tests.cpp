@@ -1,7 +1,45 @@
 #include "../token_addressing.h"
+#include "util/str_utils.h"
+#include "util/utf8.h"
 
 #include <gtest/gtest.h>
 
+#include <random>
+
+namespace {
+
+// The original per-character walks, which define persisted addresses
+uint32_t reference_address_width(const char *str)
+{
+    uint32_t count = 0;
+    for (; *str; str = utf8_step(str))
+    {
+        if (!is_whitespace(*str))
+        {
+            ++count;
+        }
+    }
+    return count;
+}
+
+uint32_t reference_address_width(std::string_view str)
+{
+    const char *s = str.data();
+    const char *end = s + str.size();
+
+    uint32_t count = 0;
+    for (; s < end; s = utf8_step(s, end))
+    {
+        if (!is_whitespace(*s))
+        {
+            ++count;
+        }
+    }
+    return count;
+}
+
+} // namespace
+
 TEST(TOKEN_ADDRESSING, get_address_width)
 {
     EXPECT_EQ(get_address_width(""), 0);
@@ -9,3 +47,40 @@ TEST(TOKEN_ADDRESSING, get_address_width)
     EXPECT_EQ(get_address_width("asdf"), 4);
     EXPECT_EQ(get_address_width("\tasdf λv\n\r"), 6);
 }
+
+TEST(TOKEN_ADDRESSING, get_address_width_malformed)
+{
+    // Leading continuation bytes count once, stray ones are skipped
+    EXPECT_EQ(get_address_width("\x80\x80 a"), 2);
+    EXPECT_EQ(get_address_width("a\xBF\xBF b"), 2);
+    EXPECT_EQ(get_address_width(std::string_view("a\0b", 3)), 3);
+    EXPECT_EQ(get_address_width(std::string("a\0b", 3)), 1);
+}
+
+TEST(TOKEN_ADDRESSING, get_address_width_fuzz)
+{
+    // Bytes that matter to the count, plus arbitrary ones
+    const char interesting[] = {
+        ' ', '\t', '\r', '\n', 'a', '.', '\x7F', '\x80', '\xBF', '\xC0', '\xC3', '\xE2', '\xF0', '\xFF', '\x01'
+    };
+
+    std::mt19937 rng(1234);
+    std::vector<char> buffer(1024);
+    for (int iteration = 0; iteration < 20000; ++iteration)
+    {
+        uint32_t len = rng() % (iteration % 10 ? 80 : buffer.size() - 32);
+        uint32_t offset = rng() % 32;
+        bool arbitrary = rng() % 2;
+        for (uint32_t i = 0; i < len; ++i)
+        {
+            buffer[offset + i] = arbitrary ? static_cast<char>(rng()) : interesting[rng() % sizeof(interesting)];
+        }
+
+        std::string_view str(buffer.data() + offset, len);
+        ASSERT_EQ(get_address_width(str), reference_address_width(str)) << "iteration " << iteration;
+
+        std::string c_str(str);
+        ASSERT_EQ(get_address_width(c_str.c_str()), reference_address_width(c_str.c_str())) << "iteration " << iteration;
+        ASSERT_EQ(get_address_width(c_str), reference_address_width(c_str.c_str())) << "iteration " << iteration;
+    }
+}
@@ -0,0 +1,55 @@
+#include "../token_arena.h"
+
+#include <gtest/gtest.h>
+
+TEST(TOKEN_ARENA, push_and_read)
+{
+    TokenArena arena;
+    arena.push_back(TokenType::Text, 0, "text");
+    arena.push_back(TokenType::Header, 4, "header");
+    arena.push_back(TokenType::Image, 10, "/image.png");
+    arena.push_back(TokenType::ListItem, 11, "item", 2);
+    arena.push_back(TokenType::Text, 15, "");
+
+    ASSERT_EQ(arena.size(), 5);
+    EXPECT_EQ(arena[0], DocToken(TokenType::Text, 0, "text"));
+    EXPECT_EQ(arena[1], DocToken(TokenType::Header, 4, "header"));
+    EXPECT_EQ(arena[2].path(), "/image.png");
+    EXPECT_EQ(arena[3], DocToken(TokenType::ListItem, 11, "item", 2));
+    EXPECT_EQ(arena.back(), DocToken(TokenType::Text, 15, ""));
+    EXPECT_EQ(arena.address(3), 11);
+}
+
+TEST(TOKEN_ARENA, equality)
+{
+    TokenArena a;
+    TokenArena b;
+    EXPECT_EQ(a, b);
+
+    a.push_back(TokenType::Text, 0, "ab");
+    a.push_back(TokenType::Text, 2, "c");
+    b.push_back(TokenType::Text, 0, "a");
+    b.push_back(TokenType::Text, 2, "bc");
+    EXPECT_NE(a, b);
+
+    a.clear();
+    EXPECT_TRUE(a.empty());
+}
+
+TEST(TOKEN_ARENA, seek_index)
+{
+    TokenArena arena;
+    EXPECT_EQ(arena.seek_index(5), 0);
+
+    arena.push_back(TokenType::Text, 2, "");
+    arena.push_back(TokenType::Text, 2, "ab");
+    arena.push_back(TokenType::Text, 4, "");
+    arena.push_back(TokenType::Text, 4, "");
+    arena.push_back(TokenType::Text, 4, "cdef");
+
+    EXPECT_EQ(arena.seek_index(0), 0);
+    EXPECT_EQ(arena.seek_index(2), 0);
+    EXPECT_EQ(arena.seek_index(3), 1);
+    EXPECT_EQ(arena.seek_index(4), 2);
+    EXPECT_EQ(arena.seek_index(100), 4);
+}
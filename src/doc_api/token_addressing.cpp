@@ -1,6 +1,13 @@
 #include "./token_addressing.h"
 #include "util/str_utils.h"
-#include "util/utf8.h"
+
+#include <cstring>
+
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
 
 namespace {
 
@@ -8,31 +15,151 @@ namespace {
 // Note: for address backwards compatibility, this function cannot change.
 // Also need to ensure any changes to xhtml whitespace compaction and
 // text-wrapping whitespace breaking are not altering the address calculations.
+// The vector paths below mirror this test and must change along with it.
 inline bool char_has_width(char c)
 {
     return !is_whitespace(c);
 }
 
-} // namespace
+inline bool is_utf8_continuation(char c)
+{
+    return (c & 0xC0) == 0x80;
+}
 
-uint32_t get_address_width(const char *str)
+// Count bytes that start a character with width. Whitespace is never a
+// continuation byte, so stepping by character and testing the first byte
+// counts exactly these bytes.
+uint32_t count_width_bytes_scalar(const char *s, const char *end)
 {
-    if (!str)
+    uint32_t count = 0;
+    for (; s < end; ++s)
     {
-        return 0;
+        if (!is_utf8_continuation(*s) && char_has_width(*s))
+        {
+            ++count;
+        }
+    }
+    return count;
+}
+
+#if defined(__AVX2__)
+
+uint32_t count_width_bytes(const char *s, const char *end)
+{
+    // Continuation bytes 0x80-0xBF are the signed values below -64
+    const __m256i cont_limit = _mm256_set1_epi8(-64);
+    const __m256i space = _mm256_set1_epi8(' ');
+    const __m256i tab = _mm256_set1_epi8('\t');
+    const __m256i cr = _mm256_set1_epi8('\r');
+    const __m256i lf = _mm256_set1_epi8('\n');
+    const __m256i ones = _mm256_set1_epi8(1);
+
+    __m256i sums = _mm256_setzero_si256();
+    for (; end - s >= 32; s += 32)
+    {
+        __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(s));
+        __m256i skip = _mm256_or_si256(
+            _mm256_or_si256(_mm256_cmpgt_epi8(cont_limit, v), _mm256_cmpeq_epi8(v, space)),
+            _mm256_or_si256(_mm256_cmpeq_epi8(v, tab), _mm256_or_si256(_mm256_cmpeq_epi8(v, cr), _mm256_cmpeq_epi8(v, lf)))
+        );
+        __m256i keep = _mm256_andnot_si256(skip, ones);
+        sums = _mm256_add_epi64(sums, _mm256_sad_epu8(keep, _mm256_setzero_si256()));
     }
 
+    uint64_t lanes[4];
+    _mm256_storeu_si256(reinterpret_cast<__m256i *>(lanes), sums);
+    return lanes[0] + lanes[1] + lanes[2] + lanes[3] + count_width_bytes_scalar(s, end);
+}
+
+#elif defined(__SSE2__)
+
+uint32_t count_width_bytes(const char *s, const char *end)
+{
+    // Continuation bytes 0x80-0xBF are the signed values below -64
+    const __m128i cont_limit = _mm_set1_epi8(-64);
+    const __m128i space = _mm_set1_epi8(' ');
+    const __m128i tab = _mm_set1_epi8('\t');
+    const __m128i cr = _mm_set1_epi8('\r');
+    const __m128i lf = _mm_set1_epi8('\n');
+    const __m128i ones = _mm_set1_epi8(1);
+
+    __m128i sums = _mm_setzero_si128();
+    for (; end - s >= 16; s += 16)
+    {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(s));
+        __m128i skip = _mm_or_si128(
+            _mm_or_si128(_mm_cmplt_epi8(v, cont_limit), _mm_cmpeq_epi8(v, space)),
+            _mm_or_si128(_mm_cmpeq_epi8(v, tab), _mm_or_si128(_mm_cmpeq_epi8(v, cr), _mm_cmpeq_epi8(v, lf)))
+        );
+        __m128i keep = _mm_andnot_si128(skip, ones);
+        sums = _mm_add_epi64(sums, _mm_sad_epu8(keep, _mm_setzero_si128()));
+    }
+
+    uint64_t lanes[2];
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(lanes), sums);
+    return lanes[0] + lanes[1] + count_width_bytes_scalar(s, end);
+}
+
+#elif defined(__ARM_NEON)
+
+uint32_t count_width_bytes(const char *s, const char *end)
+{
+    // Continuation bytes 0x80-0xBF are the signed values below -64
+    const int8x16_t cont_limit = vdupq_n_s8(-64);
+    const uint8x16_t space = vdupq_n_u8(' ');
+    const uint8x16_t tab = vdupq_n_u8('\t');
+    const uint8x16_t cr = vdupq_n_u8('\r');
+    const uint8x16_t lf = vdupq_n_u8('\n');
+
     uint32_t count = 0;
-    char c;
-    while ((c = *str))
+    while (end - s >= 16)
     {
-        if (char_has_width(c))
+        // Byte lane counters hold at most 255 blocks before widening
+        uint8x16_t lane_counts = vdupq_n_u8(0);
+        for (int block = 0; block < 255 && end - s >= 16; ++block, s += 16)
         {
-            ++count;
+            uint8x16_t v = vld1q_u8(reinterpret_cast<const uint8_t *>(s));
+            uint8x16_t skip = vorrq_u8(
+                vorrq_u8(vcltq_s8(vreinterpretq_s8_u8(v), cont_limit), vceqq_u8(v, space)),
+                vorrq_u8(vceqq_u8(v, tab), vorrq_u8(vceqq_u8(v, cr), vceqq_u8(v, lf)))
+            );
+            // Kept lanes are 0xFF, so subtracting adds one
+            lane_counts = vsubq_u8(lane_counts, vmvnq_u8(skip));
         }
-        str = utf8_step(str);
+        uint64x2_t sums = vpaddlq_u32(vpaddlq_u16(vpaddlq_u8(lane_counts)));
+        count += vgetq_lane_u64(sums, 0) + vgetq_lane_u64(sums, 1);
     }
-    return count;
+    return count + count_width_bytes_scalar(s, end);
+}
+
+#else
+
+uint32_t count_width_bytes(const char *s, const char *end)
+{
+    return count_width_bytes_scalar(s, end);
+}
+
+#endif
+
+uint32_t get_address_width(const char *s, const char *end)
+{
+    if (s == end)
+    {
+        return 0;
+    }
+    // A string starting mid-character still counts its first byte
+    return is_utf8_continuation(*s) + count_width_bytes(s, end);
+}
+
+} // namespace
+
+uint32_t get_address_width(const char *str)
+{
+    if (!str)
+    {
+        return 0;
+    }
+    return get_address_width(str, str + std::strlen(str));
 }
 
 uint32_t get_address_width(const std::string &str)
@@ -40,19 +167,16 @@ uint32_t get_address_width(const std::string &str)
     return get_address_width(str.c_str());
 }
 
+uint32_t get_address_width(std::string_view str)
+{
+    return get_address_width(str.data(), str.data() + str.size());
+}
+
 uint32_t get_address_width(const DocToken &token)
 {
-    switch (token.type)
+    if (token.type == TokenType::Image)
     {
-        case TokenType::Text:
-            return get_address_width(static_cast<const TextDocToken &>(token).text);
-        case TokenType::Header:
-            return get_address_width(static_cast<const HeaderDocToken &>(token).text);
-        case TokenType::Image:
-            return 1;
-        case TokenType::ListItem:
-            return get_address_width(static_cast<const ListItemDocToken &>(token).text);
-        default:
-            throw std::runtime_error("Unknown token type");
+        return 1;
     }
+    return get_address_width(token.text);
 }
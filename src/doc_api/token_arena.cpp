@@ -0,0 +1,111 @@
+#include "./token_arena.h"
+
+#include <algorithm>
+#include <limits>
+
+void TokenArena::push_back(TokenType type, DocAddr address, std::string_view token_text, int nest_level)
+{
+    records.push_back({
+        address,
+        static_cast<uint32_t>(text.size()),
+        static_cast<uint32_t>(token_text.size()),
+        type,
+        static_cast<uint8_t>(std::clamp(nest_level, 0, static_cast<int>(std::numeric_limits<uint8_t>::max())))
+    });
+    text.append(token_text);
+}
+
+void TokenArena::push_back(const DocToken &token)
+{
+    push_back(token.type, token.address, token.text, token.nest_level);
+}
+
+DocToken TokenArena::operator[](size_t i) const
+{
+    const Record &record = records[i];
+    return DocToken(
+        record.type,
+        record.address,
+        std::string_view(text.data() + record.offset, record.length),
+        record.nest_level
+    );
+}
+
+DocToken TokenArena::back() const
+{
+    return (*this)[records.size() - 1];
+}
+
+DocAddr TokenArena::address(size_t i) const
+{
+    return records[i].address;
+}
+
+size_t TokenArena::seek_index(DocAddr address) const
+{
+    auto it = std::lower_bound(
+        records.begin(),
+        records.end(),
+        address,
+        [](const Record &record, DocAddr address) { return record.address < address; }
+    );
+    if (it != records.end() && it->address == address)
+    {
+        return it - records.begin();
+    }
+    return it == records.begin() ? 0 : it - records.begin() - 1;
+}
+
+size_t TokenArena::size() const
+{
+    return records.size();
+}
+
+bool TokenArena::empty() const
+{
+    return records.empty();
+}
+
+void TokenArena::clear()
+{
+    std::string().swap(text);
+    std::vector<Record>().swap(records);
+}
+
+void TokenArena::shrink_to_fit()
+{
+    text.shrink_to_fit();
+    records.shrink_to_fit();
+}
+
+void TokenArena::reserve(size_t num_tokens, size_t text_bytes)
+{
+    records.reserve(num_tokens);
+    text.reserve(text_bytes);
+}
+
+size_t TokenArena::size_bytes() const
+{
+    return text.capacity() + records.capacity() * sizeof(Record);
+}
+
+bool TokenArena::operator==(const TokenArena &other) const
+{
+    if (size() != other.size())
+    {
+        return false;
+    }
+    for (size_t i = 0; i < size(); ++i)
+    {
+        if ((*this)[i] != other[i])
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool TokenArena::operator!=(const TokenArena &other) const
+{
+    return !(*this == other);
+}
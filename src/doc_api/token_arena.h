@@ -0,0 +1,53 @@
+#ifndef TOKEN_ARENA_H_
+#define TOKEN_ARENA_H_
+
+#include "./doc_token.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Packed storage for a sequence of tokens. Text for all tokens is kept in a
+// single buffer, tokens read from the arena are views into that buffer and
+// are invalidated when the arena is modified.
+class TokenArena
+{
+    struct Record
+    {
+        DocAddr address;
+        uint32_t offset;
+        uint32_t length;
+        TokenType type;
+        uint8_t nest_level;
+    };
+
+    std::string text;
+    std::vector<Record> records;
+
+public:
+    void push_back(TokenType type, DocAddr address, std::string_view token_text, int nest_level = 0);
+    void push_back(const DocToken &token);
+
+    DocToken operator[](size_t i) const;
+    DocToken back() const;
+    DocAddr address(size_t i) const;
+    // Index of the first token at address, or the last token before it.
+    // Tokens must be in address order.
+    size_t seek_index(DocAddr address) const;
+
+    size_t size() const;
+    bool empty() const;
+    void clear();
+    void shrink_to_fit();
+    void reserve(size_t num_tokens, size_t text_bytes);
+
+    // Approximate heap memory held by the arena
+    size_t size_bytes() const;
+
+    bool operator==(const TokenArena &other) const;
+    bool operator!=(const TokenArena &other) const;
+};
+
+#endif
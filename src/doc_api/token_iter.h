@@ -10,6 +10,8 @@
 class TokenIter
 {
 public:
+    // Returns nullptr at either end of the stream. The returned token is only
+    // valid until the next call on this iterator.
     virtual const DocToken *read(int direction) = 0;
     virtual void seek(DocAddr address) = 0;
     virtual ~TokenIter() = default;
@@ -1,23 +1,218 @@
 #include "./epub_doc_index.h"
 
 #include "./epub_doc_addr.h"
+#include "./epub_token_cache.h"
 #include "./xhtml_parser.h"
 #include "doc_api/token_addressing.h"
-#include "util/zip_utils.h"
+#include "util/zip_archive.h"
 
 #include <iostream>
+#include <mutex>
 
 #define DEBUG 0
 
-Document::Document() : cache_is_valid(true) {}
+namespace
+{
+
+// Read tokens back from the token cache, or else inflate and parse the
+// document, caching the result for next time if store_parsed is set
+bool load_document(
+    const ZipArchive &archive,
+    const EpubTokenCache *token_cache,
+    const std::filesystem::path &zip_path,
+    uint32_t spine_index,
+    std::vector<char> &bytes,
+    TokenArena &tokens_out,
+    std::unordered_map<std::string, DocAddr> &id_to_addr_out,
+    bool store_parsed
+)
+{
+    if (token_cache && token_cache->load(spine_index, tokens_out, id_to_addr_out))
+    {
+        return true;
+    }
+
+    #if DEBUG
+    std::cerr << "Loading " << zip_path << std::endl;
+    #endif
+    if (!archive.read(zip_path, bytes))
+    {
+        std::cerr << "Unable to read item " << zip_path << std::endl;
+        return false;
+    }
+
+    parse_xhtml_tokens(
+        bytes.data(),
+        zip_path,
+        spine_index,
+        tokens_out,
+        id_to_addr_out
+    );
+
+    if (token_cache && store_parsed)
+    {
+        token_cache->store(spine_index, tokens_out, id_to_addr_out);
+    }
+    return true;
+}
+
+} // namespace
+
+// Zip handles used by background parsing. libzip handles are not thread-safe,
+// so each job borrows its own, opened over the shared mapping on first use
+// and returned to the pool with its read buffer for the next job.
+struct ArchivePool
+{
+    struct Handle
+    {
+        ZipArchive archive;
+        std::vector<char> buffer;
+    };
+
+    std::shared_ptr<const MappedFile> mapping;
+    std::mutex mutex;
+    std::vector<std::unique_ptr<Handle>> idle_handles;
+
+    ArchivePool(std::shared_ptr<const MappedFile> mapping) : mapping(std::move(mapping)) {}
+
+    std::unique_ptr<Handle> acquire()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (!idle_handles.empty())
+            {
+                auto handle = std::move(idle_handles.back());
+                idle_handles.pop_back();
+                return handle;
+            }
+        }
+
+        auto handle = std::make_unique<Handle>();
+        if (!handle->archive.open(mapping))
+        {
+            std::cerr << "Failed to open epub for background parsing" << std::endl;
+            return nullptr;
+        }
+        return handle;
+    }
+
+    void release(std::unique_ptr<Handle> handle)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        idle_handles.push_back(std::move(handle));
+    }
+
+    // Load a document on the calling thread
+    bool parse(
+        const EpubTokenCache *token_cache,
+        const std::filesystem::path &zip_path,
+        uint32_t spine_index,
+        TokenArena &tokens_out,
+        std::unordered_map<std::string, DocAddr> &id_to_addr_out,
+        bool store_parsed
+    )
+    {
+        auto handle = acquire();
+        if (!handle)
+        {
+            return false;
+        }
+
+        bool ok = load_document(handle->archive, token_cache, zip_path, spine_index, handle->buffer, tokens_out, id_to_addr_out, store_parsed);
+        release(std::move(handle));
+        return ok;
+    }
+};
+
+// Entries read for a worker iterator, parsed through the pool. Only the last
+// entry read is kept.
+struct WorkerDocuments: public EpubTokenSource
+{
+    std::shared_ptr<ArchivePool> pool;
+    std::shared_ptr<const EpubTokenCache> token_cache;
+    std::vector<std::filesystem::path> zip_paths;
+
+    mutable uint32_t held_spine_index = -1;
+    mutable TokenArena held_tokens;
+
+    WorkerDocuments(std::shared_ptr<ArchivePool> pool, std::shared_ptr<const EpubTokenCache> token_cache, std::vector<std::filesystem::path> zip_paths)
+        : pool(std::move(pool)), token_cache(std::move(token_cache)), zip_paths(std::move(zip_paths)) {}
+
+    uint32_t spine_size() const override
+    {
+        return zip_paths.size();
+    }
+
+    uint32_t token_count(uint32_t spine_index) const override
+    {
+        return tokens(spine_index).size();
+    }
+
+    // Unreadable entries read as empty, as they do through the index
+    const TokenArena &tokens(uint32_t spine_index) const override
+    {
+        if (spine_index != held_spine_index && spine_index < zip_paths.size())
+        {
+            held_tokens.clear();
+            std::unordered_map<std::string, DocAddr> id_to_addr;
+            if (!pool->parse(token_cache.get(), zip_paths[spine_index], spine_index, held_tokens, id_to_addr, false))
+            {
+                held_tokens.clear();
+            }
+            held_spine_index = spine_index;
+        }
+        return held_tokens;
+    }
+};
+
+struct PrefetchResult
+{
+    bool ok = false;
+    TokenArena tokens;
+    std::unordered_map<std::string, DocAddr> id_to_addr;
+};
+
+struct WidthResult
+{
+    bool ok = false;
+    uint32_t width = 0;
+    std::unordered_map<std::string, DocAddr> id_to_addr;
+};
+
+Document::Document() : cache_is_valid(true), ids_are_valid(true) {}
 
 Document::Document(std::filesystem::path zip_path)
-    : zip_path(zip_path), cache_is_valid(false)
+    : zip_path(zip_path), cache_is_valid(false), ids_are_valid(false)
 {}
 
-const std::vector<std::unique_ptr<DocToken>> &EpubDocIndex::ensure_cached(uint32_t spine_index) const
+namespace
+{
+
+uint32_t document_width(uint32_t spine_index, const TokenArena &tokens)
+{
+    if (tokens.size() == 0)
+    {
+        return 0;
+    }
+    DocToken last_token = tokens.back();
+    return last_token.address + get_address_width(last_token) - make_address(spine_index);
+}
+
+size_t estimate_size_bytes(const Document &document)
+{
+    size_t size = document.tokens_cache.size_bytes();
+    for (const auto &[id, address] : document.id_to_addr_cache)
+    {
+        size += sizeof(std::pair<std::string, DocAddr>) + sizeof(void *) * 2 + id.capacity();
+    }
+    return size;
+}
+
+} // namespace
+
+const TokenArena &EpubDocIndex::ensure_cached(uint32_t spine_index) const
 {
-    static const std::vector<std::unique_ptr<DocToken>> empty_tokens;
+    static const TokenArena empty_tokens;
 
     if (spine_index >= spine_entries.size())
     {
@@ -28,32 +223,193 @@ const std::vector<std::unique_ptr<DocToken>> &EpubDocIndex::ensure_cached(uint32
     auto &document = spine_entries[spine_index];
     if (!document.cache_is_valid)
     {
+        ++cache_stats.misses;
+        document.id_to_addr_cache.clear();
+        if (!load_document(archive, token_cache.get(), document.zip_path, spine_index, read_buffer, document.tokens_cache, document.id_to_addr_cache, true))
+        {
+            return empty_tokens;
+        }
+        last_accessed_spine_index = spine_index;
+        add_to_cache(spine_index);
+        prefetch_neighbors(spine_index);
+    }
+    else if (spine_index == last_accessed_spine_index)
+    {
+        ++cache_stats.hits;
+    }
+    else if (cached_spine_sizes.has(spine_index))
+    {
+        ++cache_stats.hits;
+        cached_spine_sizes[spine_index];  // mark as recently used
+        last_accessed_spine_index = spine_index;
+        prefetch_neighbors(spine_index);
+    }
+
+    return document.tokens_cache;
+}
+
+// Account for freshly parsed tokens held by the document
+void EpubDocIndex::add_to_cache(uint32_t spine_index) const
+{
+    auto &document = spine_entries[spine_index];
+    document.tokens_cache.shrink_to_fit();
+    document.cache_is_valid = true;
+    document.ids_are_valid = true;
+    set_address_width(spine_index, document.tokens_cache);
+
+    size_t size_bytes = estimate_size_bytes(document);
+    cached_spine_sizes.put(spine_index, size_bytes);
+    cache_stats.size_bytes += size_bytes;
+
+    evict_to_budget(last_accessed_spine_index);
+}
+
+void EpubDocIndex::prefetch_neighbors(uint32_t spine_index) const
+{
+    if (!run_in_background)
+    {
+        return;
+    }
+
+    for (uint32_t neighbor : {spine_index + 1, spine_index - 1})
+    {
+        if (
+            neighbor >= spine_entries.size() ||
+            spine_entries[neighbor].cache_is_valid ||
+            prefetch_pending[neighbor]
+        )
+        {
+            continue;
+        }
+        prefetch_pending[neighbor] = true;
+
         #if DEBUG
-        std::cerr << "Loading " << document.zip_path << std::endl;
+        std::cerr << "Prefetching " << spine_entries[neighbor].zip_path << std::endl;
         #endif
-        auto bytes = read_zip_file_str(zip, document.zip_path);
 
-        if (bytes.empty())
+        auto pool = archive_pool;
+        auto cache = token_cache;
+        auto zip_path = spine_entries[neighbor].zip_path;
+        auto result = std::make_shared<PrefetchResult>();
+
+        run_in_background(
+            [pool, cache, zip_path, neighbor, result]() {
+                result->ok = pool->parse(cache.get(), zip_path, neighbor, result->tokens, result->id_to_addr, true);
+            },
+            [this, alive = std::weak_ptr<bool>(alive_token), neighbor, result]() {
+                if (!alive.lock())
+                {
+                    return;
+                }
+                prefetch_pending[neighbor] = false;
+
+                // Discard if the entry was parsed on demand in the meantime
+                auto &document = spine_entries[neighbor];
+                if (!result->ok || document.cache_is_valid)
+                {
+                    return;
+                }
+
+                document.tokens_cache = std::move(result->tokens);
+                document.id_to_addr_cache = std::move(result->id_to_addr);
+                add_to_cache(neighbor);
+            }
+        );
+    }
+}
+
+// Parse an entry on a worker only to measure it. The tokens are dropped on the
+// worker, and not cached as the chapter may never be opened. The width and
+// element ids are merged on this thread.
+void EpubDocIndex::measure_in_background(uint32_t spine_index)
+{
+    ++num_width_jobs;
+
+    auto pool = archive_pool;
+    auto cache = token_cache;
+    auto zip_path = spine_entries[spine_index].zip_path;
+    auto result = std::make_shared<WidthResult>();
+
+    run_in_background(
+        [pool, cache, zip_path, spine_index, result]() {
+            TokenArena tokens;
+            result->ok = pool->parse(cache.get(), zip_path, spine_index, tokens, result->id_to_addr, false);
+            result->width = document_width(spine_index, tokens);
+        },
+        [this, alive = std::weak_ptr<bool>(alive_token), spine_index, result]() {
+            if (!alive.lock())
+            {
+                return;
+            }
+            --num_width_jobs;
+
+            // Failed reads are measured as empty, as when parsing in place
+            record_address_width(spine_index, result->width);
+
+            auto &document = spine_entries[spine_index];
+            if (result->ok && !document.ids_are_valid)
+            {
+                document.id_to_addr_cache = std::move(result->id_to_addr);
+                document.ids_are_valid = true;
+            }
+        }
+    );
+}
+
+void EpubDocIndex::evict_to_budget(uint32_t keep_spine_index) const
+{
+    while (cached_spine_sizes.size() && cache_stats.size_bytes > cache_budget_bytes)
+    {
+        uint32_t spine_index = cached_spine_sizes.back_key();
+        if (spine_index == keep_spine_index)
         {
-            std::cerr << "Unable to read item " << document.zip_path << std::endl;
-            return empty_tokens;
+            break;
         }
 
-        parse_xhtml_tokens(
-            bytes.data(),
-            document.zip_path,
-            spine_index,
-            document.tokens_cache,
-            document.id_to_addr_cache
-        );
-        document.cache_is_valid = true;
+        #if DEBUG
+        std::cerr << "Evicting " << spine_entries[spine_index].zip_path << std::endl;
+        #endif
+
+        // Element ids are small and kept, so toc anchors resolve without reparsing
+        auto &document = spine_entries[spine_index];
+        document.tokens_cache.clear();
+        document.cache_is_valid = false;
+
+        cache_stats.size_bytes -= cached_spine_sizes.back_value();
+        cached_spine_sizes.pop();
+        ++cache_stats.evictions;
     }
+}
 
-    return document.tokens_cache;
+void EpubDocIndex::set_address_width(uint32_t spine_index, const TokenArena &tokens) const
+{
+    if (!doc_widths_cache[spine_index])
+    {
+        record_address_width(spine_index, document_width(spine_index, tokens));
+    }
+}
+
+void EpubDocIndex::record_address_width(uint32_t spine_index, uint32_t width) const
+{
+    if (doc_widths_cache[spine_index])
+    {
+        return;
+    }
+
+    doc_widths_cache[spine_index] = width;
+    ++num_doc_widths_known;
+
+    if (spine_entries[spine_index].byte_size)
+    {
+        known_widths_sum += width;
+        known_byte_size_sum += spine_entries[spine_index].byte_size;
+    }
 }
 
-EpubDocIndex::EpubDocIndex(const PackageContents &package, zip_t *zip, std::vector<uint32_t> _doc_widths_cache)
-    : zip(zip), doc_widths_cache(package.spine_ids.size())
+EpubDocIndex::EpubDocIndex(const PackageContents &package, const ZipArchive &archive, std::vector<uint32_t> _doc_widths_cache)
+    : archive(archive),
+      doc_widths_cache(package.spine_ids.size()),
+      prefetch_pending(package.spine_ids.size())
 {
     uint32_t num_spine_entries = package.spine_ids.size();
     bool cache_is_valid = num_spine_entries == _doc_widths_cache.size();
@@ -65,6 +421,7 @@ EpubDocIndex::EpubDocIndex(const PackageContents &package, zip_t *zip, std::vect
         if (item_it != package.id_to_manifest_item.end() && item_it->second.media_type == APPLICATION_XHTML_XML)
         {
             spine_entries.emplace_back(item_it->second.href_absolute);
+            spine_entries.back().byte_size = archive.file_size(item_it->second.href_absolute);
         }
         else
         {
@@ -77,6 +434,11 @@ EpubDocIndex::EpubDocIndex(const PackageContents &package, zip_t *zip, std::vect
             doc_widths_cache[spine_index] = _doc_widths_cache[spine_index];
         }
     }
+
+    if (cache_is_valid)
+    {
+        num_doc_widths_known = num_spine_entries;
+    }
 }
 
 uint32_t EpubDocIndex::spine_size() const
@@ -100,34 +462,169 @@ bool EpubDocIndex::empty(uint32_t spine_index) const
 
 uint32_t EpubDocIndex::address_width(uint32_t spine_index) const
 {
-    uint32_t width = 0;
-    if (spine_index < spine_size())
+    if (spine_index >= spine_size())
     {
-        if (doc_widths_cache[spine_index])
+        return 0;
+    }
+
+    if (!doc_widths_cache[spine_index])
+    {
+        auto &document = spine_entries[spine_index];
+        if (document.cache_is_valid)
         {
-            width = *doc_widths_cache[spine_index];
+            set_address_width(spine_index, document.tokens_cache);
         }
         else
         {
-            const auto &_tokens = ensure_cached(spine_index);
-            if (_tokens.size())
+            // Only need the width and element ids, don't hold on to the tokens
+            TokenArena tokens;
+            std::unordered_map<std::string, DocAddr> id_to_addr;
+            if (load_document(archive, token_cache.get(), document.zip_path, spine_index, read_buffer, tokens, id_to_addr, false) && !document.ids_are_valid)
             {
-                const auto &last_token = _tokens[_tokens.size() - 1];
-                width = last_token->address + get_address_width(*last_token) - make_address(spine_index);
+                document.id_to_addr_cache = std::move(id_to_addr);
+                document.ids_are_valid = true;
             }
-            doc_widths_cache[spine_index] = width;
+            set_address_width(spine_index, tokens);
         }
     }
-    return width;
+
+    return *doc_widths_cache[spine_index];
+}
+
+uint32_t EpubDocIndex::estimated_address_width(uint32_t spine_index) const
+{
+    if (spine_index >= spine_size())
+    {
+        return 0;
+    }
+
+    if (doc_widths_cache[spine_index])
+    {
+        return *doc_widths_cache[spine_index];
+    }
+
+    // Scale by the ratio of address width to file size seen in known documents
+    uint64_t byte_size = spine_entries[spine_index].byte_size;
+    if (known_byte_size_sum == 0)
+    {
+        return byte_size / 2;
+    }
+    return byte_size * known_widths_sum / known_byte_size_sum;
 }
 
-const std::vector<std::unique_ptr<DocToken>> &EpubDocIndex::tokens(uint32_t spine_index) const
+uint32_t EpubDocIndex::num_known_address_widths() const
+{
+    return num_doc_widths_known;
+}
+
+bool EpubDocIndex::address_widths_complete() const
+{
+    return num_doc_widths_known == spine_size();
+}
+
+bool EpubDocIndex::compute_next_address_width()
+{
+    if (!run_in_background)
+    {
+        while (next_width_to_compute < spine_size() && doc_widths_cache[next_width_to_compute])
+        {
+            ++next_width_to_compute;
+        }
+
+        if (next_width_to_compute < spine_size())
+        {
+            address_width(next_width_to_compute++);
+        }
+
+        return !address_widths_complete();
+    }
+
+    // Keep a few entries in flight so every worker has one to parse, without
+    // queueing so many that prefetches of the reading position wait behind them
+    while (num_width_jobs < MAX_PARALLEL_WIDTH_JOBS && next_width_to_compute < spine_size())
+    {
+        uint32_t spine_index = next_width_to_compute++;
+        if (doc_widths_cache[spine_index])
+        {
+            continue;
+        }
+
+        const auto &document = spine_entries[spine_index];
+        if (document.cache_is_valid)
+        {
+            set_address_width(spine_index, document.tokens_cache);
+        }
+        else
+        {
+            measure_in_background(spine_index);
+        }
+    }
+
+    return !address_widths_complete();
+}
+
+std::vector<uint32_t> EpubDocIndex::address_widths() const
+{
+    std::vector<uint32_t> widths;
+    widths.reserve(spine_size());
+    for (uint32_t i = 0; i < spine_size(); ++i)
+    {
+        widths.emplace_back(address_width(i));
+    }
+    return widths;
+}
+
+void EpubDocIndex::set_cache_budget(size_t budget_bytes)
+{
+    cache_budget_bytes = budget_bytes;
+    evict_to_budget(last_accessed_spine_index);
+}
+
+const TokenCacheStats &EpubDocIndex::get_cache_stats() const
+{
+    return cache_stats;
+}
+
+void EpubDocIndex::enable_background_parsing(background_func run_in_background)
+{
+    archive_pool = std::make_shared<ArchivePool>(archive.get_mapping());
+    this->run_in_background = run_in_background;
+}
+
+std::shared_ptr<TokenIter> EpubDocIndex::get_worker_iter() const
+{
+    auto pool = archive_pool ? archive_pool : std::make_shared<ArchivePool>(archive.get_mapping());
+    std::vector<std::filesystem::path> zip_paths;
+    for (const auto &document : spine_entries)
+    {
+        zip_paths.push_back(document.zip_path);
+    }
+    return std::make_shared<EPubTokenIter>(std::make_shared<WorkerDocuments>(pool, token_cache, std::move(zip_paths)));
+}
+
+void EpubDocIndex::set_token_cache(std::shared_ptr<const EpubTokenCache> token_cache)
+{
+    this->token_cache = token_cache;
+}
+
+const TokenArena &EpubDocIndex::tokens(uint32_t spine_index) const
 {
     return ensure_cached(spine_index);
 }
 
 const std::unordered_map<std::string, DocAddr> &EpubDocIndex::elem_id_to_address(uint32_t spine_index) const
 {
-    ensure_cached(spine_index);
-    return spine_entries[spine_index].id_to_addr_cache;
+    static const std::unordered_map<std::string, DocAddr> empty_ids;
+
+    if (spine_index >= spine_size())
+    {
+        return empty_ids;
+    }
+
+    auto &document = spine_entries[spine_index];
+    if (!document.ids_are_valid)
+    {
+        ensure_cached(spine_index);
+    }
+    return document.id_to_addr_cache;
 }
@@ -2,54 +2,130 @@
 #define EPUB_DOC_INDEX_H_
 
 #include "./epub_metadata.h"
-#include "doc_api/doc_token.h"
-
-#include <zip.h>
+#include "./epub_token_iter.h"
+#include "doc_api/token_arena.h"
+#include "doc_api/token_iter.h"
+#include "util/lru_cache.h"
+#include "util/task_queue.h"
 
+#include <cstddef>
 #include <filesystem>
+#include <memory>
 #include <unordered_map>
 #include <optional>
 #include <vector>
 
+#define DEFAULT_TOKEN_CACHE_BUDGET_BYTES (8 * 1024 * 1024)
+
+// Entries measured at once when computing widths in the background
+#define MAX_PARALLEL_WIDTH_JOBS 4
+
+struct TokenCacheStats
+{
+    uint32_t hits = 0;
+    uint32_t misses = 0;
+    uint32_t evictions = 0;
+    size_t size_bytes = 0;    // approximate memory held by parsed documents
+};
+
 struct Document
 {
     std::filesystem::path zip_path;
+    uint64_t byte_size = 0;  // uncompressed size in zip
 
     bool cache_is_valid;
-    std::vector<std::unique_ptr<DocToken>> tokens_cache;
+    TokenArena tokens_cache;
+    // Kept when tokens are evicted, and also collected when only measuring
+    bool ids_are_valid;
     std::unordered_map<std::string, DocAddr> id_to_addr_cache;
 
     Document();
     Document(std::filesystem::path zip_path);
 };
 
+struct ArchivePool;
+class EpubTokenCache;
+class ZipArchive;
+
 // Provide access to documents listed in the spine.
 // Documents are addressed by spine index. Lazy load from zip.
-class EpubDocIndex
+// Parsed documents are kept within a memory budget, least recently used are evicted first.
+class EpubDocIndex: public EpubTokenSource
 {
-    zip_t *zip;
+    const ZipArchive &archive;
+    mutable std::vector<char> read_buffer;  // reused across documents
     mutable std::vector<Document> spine_entries;
+
+    size_t cache_budget_bytes = DEFAULT_TOKEN_CACHE_BUDGET_BYTES;
+    mutable LRUCache<uint32_t, size_t> cached_spine_sizes;  // spine index -> size in bytes
+    mutable uint32_t last_accessed_spine_index = -1;
+    mutable TokenCacheStats cache_stats;
     mutable std::vector<std::optional<uint32_t>> doc_widths_cache;
+    mutable uint32_t num_doc_widths_known = 0;
+    mutable uint64_t known_widths_sum = 0;       // for estimating unknown widths
+    mutable uint64_t known_byte_size_sum = 0;
+    uint32_t next_width_to_compute = 0;
+    uint32_t num_width_jobs = 0;
+
+    std::shared_ptr<const EpubTokenCache> token_cache;
+    background_func run_in_background;
+    std::shared_ptr<ArchivePool> archive_pool;
+    std::shared_ptr<bool> alive_token = std::make_shared<bool>(true);
+    mutable std::vector<bool> prefetch_pending;
 
-    const std::vector<std::unique_ptr<DocToken>> &ensure_cached(uint32_t spine_index) const;
+    const TokenArena &ensure_cached(uint32_t spine_index) const;
+    void set_address_width(uint32_t spine_index, const TokenArena &tokens) const;
+    void record_address_width(uint32_t spine_index, uint32_t width) const;
+    void evict_to_budget(uint32_t keep_spine_index) const;
+    void add_to_cache(uint32_t spine_index) const;
+    void prefetch_neighbors(uint32_t spine_index) const;
+    void measure_in_background(uint32_t spine_index);
 
 public:
-    EpubDocIndex(const PackageContents &package, zip_t *zip, std::vector<uint32_t> doc_widths_cache);
+    EpubDocIndex(const PackageContents &package, const ZipArchive &archive, std::vector<uint32_t> doc_widths_cache);
     EpubDocIndex(const EpubDocIndex &) = delete;
     EpubDocIndex &operator=(const EpubDocIndex &) = delete;
 
     // Number of spine entries
-    uint32_t spine_size() const;
+    uint32_t spine_size() const override;
 
     // Number of tokens in spine entry
-    uint32_t token_count(uint32_t spine_index) const;
+    uint32_t token_count(uint32_t spine_index) const override;
     // True if spine has no tokens
     bool empty(uint32_t spine_index) const;
 
-    // Address space consumed by spine entry
+    // Address space consumed by spine entry. Parses the entry if the width is not yet known.
     uint32_t address_width(uint32_t spine_index) const;
+    // Exact width if known, otherwise a guess based on the size of the entry.
+    uint32_t estimated_address_width(uint32_t spine_index) const;
+
+    // Number of spine entries with a known address width
+    uint32_t num_known_address_widths() const;
+    bool address_widths_complete() const;
+    // Compute the width of one entry that is not yet known, or with background
+    // parsing enabled, hand several to the workers. Return true if more remain.
+    bool compute_next_address_width();
+    std::vector<uint32_t> address_widths() const;
+
+    // Memory budget for parsed documents. The most recently used document is always kept.
+    void set_cache_budget(size_t budget_bytes);
+    const TokenCacheStats &get_cache_stats() const;
+
+    // Parse the entries around the one being read, and measure widths, in the
+    // background. Each job reads through its own handle on the archive's mapping.
+    void enable_background_parsing(background_func run_in_background);
+
+    // Iterator for a worker, reading entries through a handle of its own rather
+    // than the document cache. Holds one parsed entry at a time, and may
+    // outlive the index.
+    std::shared_ptr<TokenIter> get_worker_iter() const;
+
+    // Keep documents parsed for reading on disk, and read them back instead of
+    // parsing. Documents parsed only to be measured or walked are not kept.
+    void set_token_cache(std::shared_ptr<const EpubTokenCache> token_cache);
 
-    const std::vector<std::unique_ptr<DocToken>> &tokens(uint32_t spine_index) const;
+    // Tokens may be evicted when another document is loaded
+    const TokenArena &tokens(uint32_t spine_index) const override;
     const std::unordered_map<std::string, DocAddr> &elem_id_to_address(uint32_t spine_index) const;
 };
 
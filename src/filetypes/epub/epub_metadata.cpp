@@ -9,6 +9,7 @@
 #include <filesystem>
 #include <iostream>
 #include <optional>
+#include <sstream>
 
 NavPoint::NavPoint(const std::string &label)
     : NavPoint(label, "", "")
@@ -129,6 +130,64 @@ std::vector<std::string> parse_package_spine(xmlNodePtr node)
     return spine_ids;
 }
 
+std::string node_text(xmlNodePtr node)
+{
+    std::string text;
+    xmlChar *content = node ? xmlNodeGetContent(node) : nullptr;
+    if (content)
+    {
+        text = strip_whitespace((const char*)content);
+        xmlFree(content);
+    }
+    return text;
+}
+
+void parse_package_metadata(xmlNodePtr node, PackageContents &out_package)
+{
+    node = elem_first_child(elem_first_by_name(node, BAD_CAST "package"));
+    node = elem_first_child(elem_first_by_name(node, BAD_CAST "metadata"));
+
+    out_package.title = node_text(elem_first_by_name(node, BAD_CAST "title"));
+    out_package.author = node_text(elem_first_by_name(node, BAD_CAST "creator"));
+
+    // EPUB 2 names the cover in <meta name="cover" content="manifest id"/>
+    node = elem_first_by_name(node, BAD_CAST "meta");
+    while (node)
+    {
+        xmlChar *name = xmlGetProp(node, BAD_CAST "name");
+        xmlChar *content = xmlGetProp(node, BAD_CAST "content");
+        if (name && content && xmlStrcmp(name, BAD_CAST "cover") == 0)
+        {
+            out_package.cover_id = (const char*)content;
+        }
+        xmlFree(name);
+        xmlFree(content);
+        if (!out_package.cover_id.empty())
+        {
+            break;
+        }
+        node = elem_next_by_name(node, BAD_CAST "meta");
+    }
+}
+
+// EPUB 3 marks the cover with the cover-image manifest property
+std::string find_cover_image_id(const std::unordered_map<std::string, ManifestItem> &manifest)
+{
+    for (const auto &[id, item] : manifest)
+    {
+        std::istringstream properties(item.properties);
+        std::string property;
+        while (properties >> property)
+        {
+            if (property == "cover-image")
+            {
+                return id;
+            }
+        }
+    }
+    return {};
+}
+
 }  // namespace parse_package
 
 bool epub_parse_package_contents(const std::string &rootfile_path, const char *package_xml, PackageContents &out_package)
@@ -145,6 +204,13 @@ bool epub_parse_package_contents(const std::string &rootfile_path, const char *p
 
     out_package.id_to_manifest_item = parse_package::parse_package_manifest(base_path, node);
     out_package.spine_ids = parse_package::parse_package_spine(node);
+    parse_package::parse_package_metadata(node, out_package);
+
+    std::string cover_image_id = parse_package::find_cover_image_id(out_package.id_to_manifest_item);
+    if (!cover_image_id.empty())
+    {
+        out_package.cover_id = cover_image_id;
+    }
 
     // get toc id from spine
     {
@@ -38,6 +38,9 @@ struct PackageContents
     std::unordered_map<std::string, ManifestItem> id_to_manifest_item;
     std::vector<std::string> spine_ids;
     std::string toc_id;
+    std::string title;
+    std::string author;     // first creator listed
+    std::string cover_id;   // manifest id of the cover image, empty if none
 };
 
 std::string epub_parse_rootfile_path(const char *container_xml);
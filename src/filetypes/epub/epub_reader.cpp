@@ -3,18 +3,21 @@
 #include "./epub_doc_index.h"
 #include "./epub_metadata.h"
 #include "./epub_toc_index.h"
+#include "./epub_token_cache.h"
 #include "./epub_token_iter.h"
 #include "util/string_serialization.h"
-#include "util/zip_utils.h"
+#include "util/zip_archive.h"
 
 #include "extern/hash-library/md5.h"
 
 #include <algorithm>
 #include <iostream>
-#include <zip.h>
+#include <sstream>
+#include <unordered_map>
 
 #define DEBUG 0
 #define DOC_WIDTHS_CACHE_KEY "doc_widths"
+#define IMAGE_SIZES_CACHE_KEY "image_sizes"
 
 namespace
 {
@@ -39,22 +42,169 @@ uint32_t fraction_to_progress_percent( std::pair<uint32_t, uint32_t> fraction)
     return percent;
 }
 
+// "<width> <height> <path>" entries separated by '|'. Kept on one line since
+// the reader cache is stored as a key value file.
+std::string encode_image_sizes(const std::unordered_map<std::string, ImageSize> &image_sizes)
+{
+    std::ostringstream ss;
+    for (const auto &[path, size] : image_sizes)
+    {
+        if (path.find('|') == std::string::npos)
+        {
+            ss << size.width << " " << size.height << " " << path << "|";
+        }
+    }
+    return ss.str();
+}
+
+bool try_decode_image_sizes(const std::string &encoded, std::unordered_map<std::string, ImageSize> &out)
+{
+    std::istringstream stream(encoded);
+    std::string entry;
+    while (std::getline(stream, entry, '|'))
+    {
+        std::istringstream entry_stream(entry);
+        ImageSize size;
+        std::string path;
+        if (!(entry_stream >> size.width >> size.height) || !std::getline(entry_stream >> std::ws, path))
+        {
+            return false;
+        }
+        out[path] = size;
+    }
+    return true;
+}
+
+// Parse the package document found through container.xml. Its md5 identifies the book.
+bool read_package(const ZipArchive &archive, PackageContents &package, std::string &package_md5)
+{
+    // read container.xml
+    std::string rootfile_path;
+    {
+        auto container_xml = archive.read(EPUB_CONTAINER_PATH);
+        if (container_xml.empty())
+        {
+            std::cerr << "Failed to read epub container" << std::endl;
+            return false;
+        }
+
+        rootfile_path = epub_parse_rootfile_path(container_xml.data());
+        if (rootfile_path.empty())
+        {
+            std::cerr << "Unable to get docroot path" << std::endl;
+            return false;
+        }
+    }
+
+    // read package document
+    auto package_xml = archive.read(rootfile_path);
+    if (package_xml.empty())
+    {
+        std::cerr << "Failed to open " << rootfile_path << std::endl;
+        return false;
+    }
+
+    package_md5 = MD5()(package_xml.data(), package_xml.size());
+
+    if (!epub_parse_package_contents(rootfile_path, package_xml.data(), package))
+    {
+        std::cerr << "Failed to parse " << rootfile_path << std::endl;
+        return false;
+    }
+
+    return true;
+}
+
 } // namespace
 
 struct EpubReaderState
 {
     std::filesystem::path path;
-    zip_t *zip = nullptr;
+    ZipArchive archive;
+    DocReaderCache *cache = nullptr;
 
     std::string package_md5;
+    bool doc_widths_are_cached = false;
+    size_t token_cache_budget = DEFAULT_TOKEN_CACHE_BUDGET_BYTES;
+    background_func run_in_background;
 
     std::unique_ptr<EpubDocIndex> doc_index;
     std::unique_ptr<EpubTocIndex> toc_index;
     std::vector<TocItem> user_toc;
 
+    // Probed sizes are written back in one go rather than per image
+    mutable std::unordered_map<std::string, ImageSize> image_sizes;
+    mutable bool image_sizes_dirty = false;
+
+    void save_image_sizes()
+    {
+        if (image_sizes_dirty && cache)
+        {
+            cache->write(package_md5, IMAGE_SIZES_CACHE_KEY, encode_image_sizes(image_sizes));
+            image_sizes_dirty = false;
+        }
+    }
+
     EpubReaderState(std::string path) : path(std::move(path)) {}
 };
 
+std::optional<DocMetadata> epub_read_metadata(const std::filesystem::path &path)
+{
+    ZipArchive archive;
+    if (!archive.open(path))
+    {
+        std::cerr << "Failed to open epub " << path << std::endl;
+        return std::nullopt;
+    }
+
+    PackageContents package;
+    DocMetadata metadata;
+    if (!read_package(archive, package, metadata.id))
+    {
+        return std::nullopt;
+    }
+    metadata.title = package.title;
+    metadata.author = package.author;
+
+    return metadata;
+}
+
+std::optional<DocCover> epub_read_cover(const std::filesystem::path &path)
+{
+    ZipArchive archive;
+    if (!archive.open(path))
+    {
+        std::cerr << "Failed to open epub " << path << std::endl;
+        return std::nullopt;
+    }
+
+    PackageContents package;
+    std::string package_md5;
+    if (!read_package(archive, package, package_md5) || package.cover_id.empty())
+    {
+        return std::nullopt;
+    }
+
+    auto item = package.id_to_manifest_item.find(package.cover_id);
+    if (item == package.id_to_manifest_item.end())
+    {
+        std::cerr << "Failed to find cover id " << package.cover_id << std::endl;
+        return std::nullopt;
+    }
+
+    DocCover cover;
+    if (!archive.read(item->second.href_absolute, cover.data) || cover.data.size() <= 1)
+    {
+        std::cerr << "Failed to read cover " << item->second.href_absolute << std::endl;
+        return std::nullopt;
+    }
+    cover.data.pop_back(); // null terminator
+    std::string ext = std::filesystem::path(item->second.href).extension();
+    cover.format = ext.empty() ? ext : ext.substr(1);
+
+    return cover;
+}
+
 EPubReader::EPubReader(std::filesystem::path path)
     : state(std::make_unique<EpubReaderState>(std::move(path)))
 {
@@ -62,67 +212,29 @@ EPubReader::EPubReader(std::filesystem::path path)
 
 EPubReader::~EPubReader()
 {
-    if (!state->zip)
-    {
-        zip_close(state->zip);
-    }
+    state->save_image_sizes();
 }
 
 bool EPubReader::open(DocReaderCache &cache)
 {
-    if (state->zip)
+    if (state->archive.is_open())
     {
         return true;
     }
 
-    // open zip
-    {
-        int err = 0;
-        state->zip = zip_open(state->path.c_str(), ZIP_RDONLY, &err);
-        if (state->zip == nullptr)
-        {
-            std::cerr << "Failed to epub " << state->path
-                << " code: " << err
-                << std::endl;
-            return false;
-        }
-    }
+    state->cache = &cache;
 
-    // read container.xml
-    std::string rootfile_path;
+    // open zip
+    if (!state->archive.open(state->path))
     {
-        auto container_xml = read_zip_file_str(state->zip, EPUB_CONTAINER_PATH);
-        if (container_xml.empty())
-        {
-            std::cerr << "Failed to read epub container" << std::endl;
-            return false;
-        }
-
-        rootfile_path = epub_parse_rootfile_path(container_xml.data());
-        if (rootfile_path.empty())
-        {
-            std::cerr << "Unable to get docroot path" << std::endl;
-            return false;
-        }
+        std::cerr << "Failed to open epub " << state->path << std::endl;
+        return false;
     }
 
-    // read package document
     PackageContents package;
+    if (!read_package(state->archive, package, state->package_md5))
     {
-        auto package_xml = read_zip_file_str(state->zip, rootfile_path);
-        if (package_xml.empty())
-        {
-            std::cerr << "Failed to open " << rootfile_path << std::endl;
-            return false;
-        }
-
-        state->package_md5 = MD5()(package_xml.data(), package_xml.size());
-
-        if (!epub_parse_package_contents(rootfile_path, package_xml.data(), package))
-        {
-            std::cerr << "Failed to parse " << rootfile_path << std::endl;
-            return false;
-        }
+        return false;
     }
 
     std::vector<NavPoint> navmap;
@@ -134,7 +246,7 @@ bool EPubReader::open(DocReaderCache &cache)
         if (item != package.id_to_manifest_item.end() && item->second.media_type == APPLICATION_X_DTBNCX_XML)
         {
             auto ncx_path = item->second.href_absolute;
-            auto ncx_xml = read_zip_file_str(state->zip, ncx_path);
+            auto ncx_xml = state->archive.read(ncx_path);
 
             epub_parse_ncx(ncx_path, ncx_xml.data(), navmap);
         }
@@ -157,7 +269,7 @@ bool EPubReader::open(DocReaderCache &cache)
         if (nav_item != package.id_to_manifest_item.end())
         {
             auto nav_path = nav_item->second.href_absolute;
-            auto nav_xml = read_zip_file_str(state->zip, nav_path);
+            auto nav_xml = state->archive.read(nav_path);
 
             epub_parse_nav(nav_path, nav_xml.data(), navmap);
         }
@@ -178,19 +290,27 @@ bool EPubReader::open(DocReaderCache &cache)
             doc_widths_cache.clear();
         }
 
-        state->doc_index = std::make_unique<EpubDocIndex>(package, state->zip, doc_widths_cache);
+        // Without cached widths, documents are measured lazily. See run_background_task.
+        state->doc_index = std::make_unique<EpubDocIndex>(package, state->archive, doc_widths_cache);
+        state->doc_index->set_cache_budget(state->token_cache_budget);
+        if (auto file_dir = cache.get_file_dir(state->package_md5))
+        {
+            state->doc_index->set_token_cache(std::make_shared<EpubTokenCache>(*file_dir, state->package_md5));
+        }
+        if (state->run_in_background)
+        {
+            state->doc_index->enable_background_parsing(state->run_in_background);
+        }
         state->toc_index = std::make_unique<EpubTocIndex>(package, navmap, *state->doc_index.get());
+        state->doc_widths_are_cached = cache_is_valid;
+    }
 
-        if (!cache_is_valid)
+    // Image sizes probed in earlier sessions
+    {
+        auto cache_opt = cache.read(state->package_md5, IMAGE_SIZES_CACHE_KEY);
+        if (cache_opt && !try_decode_image_sizes(*cache_opt, state->image_sizes))
         {
-            uint32_t num_spine_entries = state->doc_index->spine_size();
-            doc_widths_cache.reserve(num_spine_entries);
-            for (uint32_t i = 0; i < num_spine_entries; ++i)
-            {
-                doc_widths_cache.emplace_back(state->doc_index->address_width(i));
-            }
-
-            cache.write(state->package_md5, DOC_WIDTHS_CACHE_KEY, encode_uint_vector(doc_widths_cache));
+            state->image_sizes.clear();
         }
     }
 
@@ -209,7 +329,7 @@ bool EPubReader::open(DocReaderCache &cache)
 
 bool EPubReader::is_open() const
 {
-    return state->zip != nullptr;
+    return state->archive.is_open();
 }
 
 std::string EPubReader::get_id() const
@@ -246,6 +366,42 @@ uint32_t EPubReader::get_global_progress_percent(const DocAddr &address) const
     );
 }
 
+bool EPubReader::is_progress_estimated() const
+{
+    return state->toc_index && state->toc_index->global_progress_is_estimate();
+}
+
+bool EPubReader::run_background_task()
+{
+    // Sizes found laying out the current page
+    state->save_image_sizes();
+
+    if (!state->doc_index || state->doc_widths_are_cached)
+    {
+        return false;
+    }
+
+    auto &doc_index = *state->doc_index;
+    if (doc_index.compute_next_address_width())
+    {
+        return true;
+    }
+
+    state->cache->write(state->package_md5, DOC_WIDTHS_CACHE_KEY, encode_uint_vector(doc_index.address_widths()));
+    state->doc_widths_are_cached = true;
+
+    return false;
+}
+
+void EPubReader::set_background_func(background_func run_in_background)
+{
+    state->run_in_background = run_in_background;
+    if (state->doc_index)
+    {
+        state->doc_index->enable_background_parsing(run_in_background);
+    }
+}
+
 std::shared_ptr<TokenIter> EPubReader::get_iter(DocAddr address) const
 {
     return std::make_shared<EPubTokenIter>(
@@ -254,7 +410,70 @@ std::shared_ptr<TokenIter> EPubReader::get_iter(DocAddr address) const
     );
 }
 
+std::shared_ptr<TokenIter> EPubReader::get_worker_iter() const
+{
+    if (!state->doc_index)
+    {
+        return nullptr;
+    }
+    return state->doc_index->get_worker_iter();
+}
+
 std::vector<char> EPubReader::load_resource(const std::filesystem::path &path) const
 {
-    return read_zip_file_str(state->zip, path);
+    return state->archive.read(path);
+}
+
+ResourceData EPubReader::load_resource_data(const std::filesystem::path &path) const
+{
+    // Stored entries, typical for images, are read straight from the mapping
+    auto stored = state->archive.view_stored(path);
+    if (stored)
+    {
+        return ResourceData(state->archive.get_mapping(), stored->data(), stored->size());
+    }
+
+    auto buffer = state->archive.read(path);
+    if (!buffer.empty())
+    {
+        buffer.pop_back(); // null terminator
+    }
+    return ResourceData(std::move(buffer));
+}
+
+std::vector<char> EPubReader::load_resource_prefix(const std::filesystem::path &path, size_t max_bytes) const
+{
+    return state->archive.read_prefix(path, max_bytes);
+}
+
+std::optional<ImageSize> EPubReader::get_image_size(const std::filesystem::path &path) const
+{
+    auto it = state->image_sizes.find(path);
+    if (it != state->image_sizes.end())
+    {
+        return it->second;
+    }
+
+    auto size = DocReader::get_image_size(path);
+    if (size)
+    {
+        state->image_sizes.emplace(path, *size);
+        state->image_sizes_dirty = true;
+    }
+    return size;
+}
+
+void EPubReader::set_token_cache_budget(size_t budget_bytes)
+{
+    state->token_cache_budget = budget_bytes;
+    if (state->doc_index)
+    {
+        state->doc_index->set_cache_budget(budget_bytes);
+    }
+}
+
+const TokenCacheStats &EPubReader::get_token_cache_stats() const
+{
+    static const TokenCacheStats empty_stats;
+    return state->doc_index ? state->doc_index->get_cache_stats() : empty_stats;
 }
@@ -5,6 +5,7 @@
 #include "./epub_doc_addr.h"
 
 struct EpubReaderState;
+struct TokenCacheStats;
 
 class EPubReader: public DocReader
 {
@@ -28,10 +29,27 @@ public:
     DocAddr get_toc_item_address(uint32_t toc_item_index) const override;
 
     uint32_t get_global_progress_percent(const DocAddr &address) const override;
+    bool is_progress_estimated() const override;
+
+    bool run_background_task() override;
+    void set_background_func(background_func run_in_background) override;
 
     std::shared_ptr<TokenIter> get_iter(DocAddr address = make_address()) const override;
+    std::shared_ptr<TokenIter> get_worker_iter() const override;
 
     std::vector<char> load_resource(const std::filesystem::path &path) const override;
+    ResourceData load_resource_data(const std::filesystem::path &path) const override;
+    std::vector<char> load_resource_prefix(const std::filesystem::path &path, size_t max_bytes) const override;
+    std::optional<ImageSize> get_image_size(const std::filesystem::path &path) const override;
+
+    // Memory budget for parsed chapters
+    void set_token_cache_budget(size_t budget_bytes);
+    const TokenCacheStats &get_token_cache_stats() const;
 };
 
+// Reads only the container and package documents
+std::optional<DocMetadata> epub_read_metadata(const std::filesystem::path &path);
+// Cover image named by the package document, if any
+std::optional<DocCover> epub_read_cover(const std::filesystem::path &path);
+
 #endif
@@ -36,8 +36,10 @@ struct EpubTocIndexState
     EpubDocIndex &doc_index;
     std::vector<TocItemCache> toc;
 
-    std::vector<uint32_t> spine_to_offset;
-    uint32_t book_width = 0;
+    // Global progress lookup. Rebuilt as more document widths become known.
+    mutable std::vector<uint32_t> spine_to_offset;
+    mutable uint32_t book_width = 0;
+    mutable uint32_t num_widths_at_build = -1;
 
     mutable uint32_t cached_toc_index = 0;
     mutable DocAddr cached_toc_index_start_address = -1;
@@ -165,6 +167,26 @@ void fallback_convert_spine_to_toc(
     }
 }
 
+// Build global progress lookup using exact document widths where known
+void ensure_spine_offsets(const EpubTocIndexState &state)
+{
+    const auto &doc_index = state.doc_index;
+    if (state.num_widths_at_build == doc_index.num_known_address_widths())
+    {
+        return;
+    }
+
+    state.spine_to_offset.clear();
+    uint32_t offset = 0;
+    for (uint32_t i = 0; i < doc_index.spine_size(); ++i)
+    {
+        state.spine_to_offset.emplace_back(offset);
+        offset += doc_index.estimated_address_width(i);
+    }
+    state.book_width = offset;
+    state.num_widths_at_build = doc_index.num_known_address_widths();
+}
+
 // Address above all documents.
 DocAddr spine_upper_address(const EpubDocIndex &doc_index)
 {
@@ -299,17 +321,6 @@ EpubTocIndex::EpubTocIndex(const PackageContents &package, const std::vector<Nav
         fallback_convert_spine_to_toc(package, toc);
     }
 
-    // Compile global progress lookup
-    {
-        uint32_t offset = 0;
-        for (uint32_t i = 0; i < doc_index.spine_size(); ++i)
-        {
-            state->spine_to_offset.emplace_back(offset);
-            offset += doc_index.address_width(i);
-        }
-        state->book_width = offset;
-    }
-
     #if DEBUG
     {
         std::cerr << "TOC:" << std::endl;
@@ -448,8 +459,15 @@ std::pair<uint32_t, uint32_t> EpubTocIndex::get_global_progress(const DocAddr &a
         return {0, 0};
     }
 
+    ensure_spine_offsets(*state);
+
     return {
         state->spine_to_offset[cur_spine] + (address - make_address(cur_spine)),
         state->book_width
     };
 }
+
+bool EpubTocIndex::global_progress_is_estimate() const
+{
+    return !state->doc_index.address_widths_complete();
+}
@@ -36,6 +36,8 @@ public:
     std::pair<uint32_t, uint32_t> get_toc_item_progress(const DocAddr &address) const;
     // Return (pos inside, size of) the book in units of address space.
     std::pair<uint32_t, uint32_t> get_global_progress(const DocAddr &address) const;
+    // True until the widths of all documents are known
+    bool global_progress_is_estimate() const;
 };
 
 #endif
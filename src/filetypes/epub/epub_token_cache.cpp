@@ -0,0 +1,179 @@
+#include "./epub_token_cache.h"
+
+#include "./xhtml_parser.h"
+#include "sys/mapped_file.h"
+#include "util/checksum.h"
+#include "util/string_serialization.h"
+
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <thread>
+
+#define DEBUG 0
+
+namespace
+{
+
+constexpr char FILE_MAGIC[4] = {'P', 'X', 'T', 'C'};
+constexpr uint32_t FILE_VERSION = 1;
+
+// address, text size, type, nest level
+constexpr size_t TOKEN_RECORD_SIZE = 14;
+constexpr size_t CHECKSUM_SIZE = 4;
+
+// Everything that must match for a file to be used
+std::string file_header(const std::string &package_md5, uint32_t spine_index)
+{
+    std::string header(FILE_MAGIC, sizeof(FILE_MAGIC));
+    put_u32(header, FILE_VERSION);
+    put_u32(header, XHTML_PARSER_VERSION);
+    put_u32(header, spine_index);
+    put_u32(header, package_md5.size());
+    header += package_md5;
+    return header;
+}
+
+} // namespace
+
+EpubTokenCache::EpubTokenCache(std::filesystem::path dir, std::string package_md5)
+    : dir(dir), package_md5(package_md5)
+{
+}
+
+std::filesystem::path EpubTokenCache::file_path(uint32_t spine_index) const
+{
+    return dir / ("tokens." + std::to_string(spine_index));
+}
+
+bool EpubTokenCache::load(uint32_t spine_index, TokenArena &tokens_out, std::unordered_map<std::string, DocAddr> &id_to_addr_out) const
+{
+    MappedFile file;
+    if (!file.open(file_path(spine_index)))
+    {
+        return false;
+    }
+
+    std::string expected_header = file_header(package_md5, spine_index);
+    if (
+        file.size() < expected_header.size() + CHECKSUM_SIZE ||
+        expected_header.compare(0, expected_header.size(), file.data(), expected_header.size()) != 0
+    )
+    {
+        #if DEBUG
+        std::cerr << "Stale token cache for spine entry " << spine_index << std::endl;
+        #endif
+        return false;
+    }
+
+    size_t body_size = file.size() - CHECKSUM_SIZE;
+    ByteReader checksum_reader = {file.data() + body_size, file.data() + file.size()};
+    if (crc32(file.data(), body_size) != checksum_reader.get(4))
+    {
+        std::cerr << "Corrupt token cache for spine entry " << spine_index << std::endl;
+        return false;
+    }
+
+    ByteReader reader = {file.data() + expected_header.size(), file.data() + body_size};
+    uint32_t num_tokens = reader.get(4);
+    uint32_t text_size = reader.get(4);
+
+    // Token text follows the records
+    ByteReader records = reader;
+    if (!reader.has(static_cast<size_t>(num_tokens) * TOKEN_RECORD_SIZE))
+    {
+        return false;
+    }
+    ByteReader text = {reader.pos + num_tokens * TOKEN_RECORD_SIZE, reader.end};
+    const char *text_start = text.pos;
+
+    bool types_ok = true;
+    tokens_out.reserve(num_tokens, text_size);
+    for (uint32_t i = 0; i < num_tokens && text.ok; ++i)
+    {
+        DocAddr address = records.get(8);
+        uint32_t size = records.get(4);
+        uint8_t type = records.get(1);
+        int nest_level = records.get(1);
+        types_ok = types_ok && type <= static_cast<uint8_t>(TokenType::ListItem);
+        tokens_out.push_back(static_cast<TokenType>(type), address, text.get_bytes(size), nest_level);
+    }
+    bool text_ok = types_ok && static_cast<size_t>(text.pos - text_start) == text_size;
+
+    reader = text;
+    uint32_t num_ids = reader.get(4);
+    for (uint32_t i = 0; i < num_ids && reader.ok; ++i)
+    {
+        std::string_view id = reader.get_bytes(reader.get(4));
+        DocAddr address = reader.get(8);
+        id_to_addr_out.emplace(id, address);
+    }
+
+    if (!reader.ok || !text_ok || reader.pos != reader.end)
+    {
+        std::cerr << "Malformed token cache for spine entry " << spine_index << std::endl;
+        tokens_out.clear();
+        id_to_addr_out.clear();
+        return false;
+    }
+
+    return true;
+}
+
+bool EpubTokenCache::store(uint32_t spine_index, const TokenArena &tokens, const std::unordered_map<std::string, DocAddr> &id_to_addr) const
+{
+    std::string records, text;
+    records.reserve(tokens.size() * TOKEN_RECORD_SIZE);
+    for (size_t i = 0; i < tokens.size(); ++i)
+    {
+        DocToken token = tokens[i];
+        put_u64(records, token.address);
+        put_u32(records, token.text.size());
+        records.push_back(static_cast<char>(token.type));
+        records.push_back(static_cast<char>(token.nest_level));
+        text += token.text;
+    }
+
+    std::string contents = file_header(package_md5, spine_index);
+    put_u32(contents, tokens.size());
+    put_u32(contents, text.size());
+    contents += records;
+    contents += text;
+
+    put_u32(contents, id_to_addr.size());
+    for (const auto &[id, address] : id_to_addr)
+    {
+        put_u32(contents, id.size());
+        contents += id;
+        put_u64(contents, address);
+    }
+    put_u32(contents, crc32(contents.data(), contents.size()));
+
+    // Not synced, the checksum catches a torn write. The temp name is per
+    // thread since the same entry can be stored by two jobs at once.
+    auto path = file_path(spine_index);
+    auto tmp_path = path.string() + ".tmp" + std::to_string(std::hash<std::thread::id>()(std::this_thread::get_id()));
+    {
+        std::ofstream file(tmp_path, std::ios::binary | std::ios::trunc);
+        file.write(contents.data(), contents.size());
+        if (!file.good())
+        {
+            std::cerr << "Unable to write token cache " << tmp_path << std::endl;
+            file.close();
+            std::error_code ec;
+            std::filesystem::remove(tmp_path, ec);
+            return false;
+        }
+    }
+
+    std::error_code ec;
+    std::filesystem::rename(tmp_path, path, ec);
+    if (ec)
+    {
+        std::cerr << "Unable to write token cache " << path << std::endl;
+        std::filesystem::remove(tmp_path, ec);
+        return false;
+    }
+
+    return true;
+}
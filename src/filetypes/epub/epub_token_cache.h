@@ -0,0 +1,33 @@
+#ifndef EPUB_TOKEN_CACHE_H_
+#define EPUB_TOKEN_CACHE_H_
+
+#include "doc_api/token_arena.h"
+
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <unordered_map>
+
+// Parsed spine entries kept on disk, one file per entry, so reopening a book
+// maps the tokens back in instead of inflating and parsing its xhtml.
+//
+// Files are stamped with the package md5 and parser version, and checksummed.
+// Files that are stale or damaged are treated as missing and rewritten on the
+// next parse. The directory is trimmed with the rest of the book's files by
+// the state store. Safe to use from several threads.
+class EpubTokenCache
+{
+    std::filesystem::path dir;
+    std::string package_md5;
+
+    std::filesystem::path file_path(uint32_t spine_index) const;
+
+public:
+    EpubTokenCache(std::filesystem::path dir, std::string package_md5);
+
+    // False if the entry is not cached, outputs are left empty
+    bool load(uint32_t spine_index, TokenArena &tokens_out, std::unordered_map<std::string, DocAddr> &id_to_addr_out) const;
+    bool store(uint32_t spine_index, const TokenArena &tokens, const std::unordered_map<std::string, DocAddr> &id_to_addr) const;
+};
+
+#endif
@@ -1,26 +1,35 @@
 #include "./epub_token_iter.h"
 
 #include "./epub_doc_addr.h"
-#include "./epub_doc_index.h"
 
-EPubTokenIter::EPubTokenIter(EpubDocIndex *index, DocAddr address)
-    : index(index)
+#include <algorithm>
+
+EPubTokenIter::EPubTokenIter(const EpubTokenSource *source, DocAddr address)
+    : source(source)
 {
     seek(address);
 }
 
+EPubTokenIter::EPubTokenIter(std::shared_ptr<const EpubTokenSource> source)
+    : owned_source(source)
+    , source(source.get())
+{
+}
+
 EPubTokenIter::EPubTokenIter(const EPubTokenIter &other)
-    : index(other.index)
+    : owned_source(other.owned_source)
+    , source(other.source)
     , current_spine_idx(other.current_spine_idx)
     , current_token_idx(other.current_token_idx)
+    , current_token(other.current_token)
 {
 }
 
 bool EPubTokenIter::seek_to_first()
 {
-    while (current_spine_idx < index->spine_size())
+    while (current_spine_idx < source->spine_size())
     {
-        if (current_token_idx < index->token_count(current_spine_idx))
+        if (current_token_idx < source->token_count(current_spine_idx))
         {
             return true;
         }
@@ -42,9 +51,9 @@ bool EPubTokenIter::seek_to_prev()
 
     while (current_spine_idx > 0)
     {
-        if (--current_spine_idx < index->spine_size())
+        if (--current_spine_idx < source->spine_size())
         {
-            uint32_t token_count = index->token_count(current_spine_idx);
+            uint32_t token_count = source->token_count(current_spine_idx);
             if (token_count)
             {
                 current_token_idx = token_count - 1;
@@ -58,49 +67,36 @@ bool EPubTokenIter::seek_to_prev()
 
 const DocToken *EPubTokenIter::read(int direction)
 {
-    const DocToken *token = nullptr;
-
     if (direction < 0)
     {
         if (seek_to_prev())
         {
-            token = index->tokens(current_spine_idx)[current_token_idx].get();
+            current_token = source->tokens(current_spine_idx)[current_token_idx];
+            return &current_token;
         }
     }
     else
     {
         if (seek_to_first())
         {
-            token = index->tokens(current_spine_idx)[current_token_idx++].get();
+            current_token = source->tokens(current_spine_idx)[current_token_idx++];
+            return &current_token;
         }
     }
 
-    return token;
+    return nullptr;
 }
 
 void EPubTokenIter::seek(DocAddr address)
 {
     uint32_t new_spine_idx = std::min(
         get_chapter_number(address),
-        index->spine_size()
+        source->spine_size()
     );
     uint32_t new_token_idx = 0;
-    if (new_spine_idx < index->spine_size())
+    if (new_spine_idx < source->spine_size())
     {
-        const auto &tokens = index->tokens(new_spine_idx);
-        uint32_t token_idx = 0;
-        for (const auto &token: tokens)
-        {
-            if (token->address <= address)
-            {
-                new_token_idx = token_idx;
-            }
-            if (token->address >= address)
-            {
-                break;
-            }
-            ++token_idx;
-        }
+        new_token_idx = source->tokens(new_spine_idx).seek_index(address);
     }
 
     current_spine_idx = new_spine_idx;
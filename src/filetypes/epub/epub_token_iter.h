@@ -1,21 +1,39 @@
 #ifndef EPUB_TOKEN_ITER_H_
 #define EPUB_TOKEN_ITER_H_
 
+#include "doc_api/token_arena.h"
 #include "doc_api/token_iter.h"
 
-struct EpubDocIndex;
+#include <cstdint>
+#include <memory>
+
+// Tokens of the documents listed in the spine, as read by EPubTokenIter
+class EpubTokenSource
+{
+public:
+    virtual ~EpubTokenSource() = default;
+
+    virtual uint32_t spine_size() const = 0;
+    virtual uint32_t token_count(uint32_t spine_index) const = 0;
+    // May be invalidated when another document is read
+    virtual const TokenArena &tokens(uint32_t spine_index) const = 0;
+};
 
 class EPubTokenIter: public TokenIter
 {
-    EpubDocIndex *index;
+    std::shared_ptr<const EpubTokenSource> owned_source;
+    const EpubTokenSource *source;
     uint32_t current_spine_idx = 0;
     uint32_t current_token_idx = 0;
+    DocToken current_token;
 
     bool seek_to_first();
     bool seek_to_prev();
 
 public:
-    EPubTokenIter(EpubDocIndex *index, DocAddr address);
+    EPubTokenIter(const EpubTokenSource *source, DocAddr address);
+    // Starts at the beginning without reading any document
+    EPubTokenIter(std::shared_ptr<const EpubTokenSource> source);
     EPubTokenIter(const EPubTokenIter &);
 
     const DocToken *read(int direction) override;
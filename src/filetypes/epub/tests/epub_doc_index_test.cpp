@@ -0,0 +1,149 @@
+#include "../epub_doc_index.h"
+#include "util/task_queue.h"
+#include "util/tests/stored_zip.h"
+#include "util/zip_archive.h"
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <string>
+
+namespace
+{
+
+const uint32_t NUM_CHAPTERS = 9;
+
+std::string chapter_xhtml(uint32_t chapter)
+{
+    std::string body;
+    for (uint32_t i = 0; i <= chapter * 3; ++i)
+    {
+        body += "<p id=\"p" + std::to_string(i) + "\">Paragraph " + std::to_string(i) + " of the chapter, with some text.</p>";
+    }
+    return (
+        "<?xml version=\"1.0\"?>"
+        "<html xmlns=\"http://www.w3.org/1999/xhtml\"><head><title>Chapter</title></head>"
+        "<body>" + body + "</body></html>"
+    );
+}
+
+// Spine of chapters, with an entry missing from the manifest in the middle
+PackageContents write_chapters(const std::string &zip_name, ZipArchive &archive)
+{
+    PackageContents package;
+    std::vector<std::pair<std::string, std::string>> files;
+    for (uint32_t i = 0; i < NUM_CHAPTERS; ++i)
+    {
+        std::string id = "c" + std::to_string(i);
+        std::string path = "OEBPS/" + id + ".xhtml";
+        package.spine_ids.push_back(id);
+        if (i == NUM_CHAPTERS / 2)
+        {
+            continue;
+        }
+        package.id_to_manifest_item[id] = {id + ".xhtml", path, APPLICATION_XHTML_XML, ""};
+        files.emplace_back(path, chapter_xhtml(i));
+    }
+
+    EXPECT_TRUE(archive.open(write_stored_zip(zip_name, files)));
+    return package;
+}
+
+void compute_widths_in_background(EpubDocIndex &doc_index, TaskQueue &task_queue)
+{
+    doc_index.enable_background_parsing(
+        [&task_queue](task_func work, task_func on_done) { task_queue.submit_background(work, on_done); }
+    );
+    while (doc_index.compute_next_address_width())
+    {
+        task_queue.drain();
+    }
+}
+
+} // namespace
+
+TEST(EPUB_DOC_INDEX, parallel_widths_match_serial)
+{
+    ZipArchive archive;
+    auto package = write_chapters("epub_doc_index_widths.epub", archive);
+
+    EpubDocIndex serial(package, archive, {});
+    while (serial.compute_next_address_width());
+
+    EpubDocIndex parallel(package, archive, {});
+    TaskQueue task_queue(3);
+    compute_widths_in_background(parallel, task_queue);
+
+    ASSERT_TRUE(parallel.address_widths_complete());
+    ASSERT_EQ(parallel.address_widths(), serial.address_widths());
+    ASSERT_EQ(parallel.address_width(NUM_CHAPTERS / 2), 0);
+
+    // Element ids were collected while measuring, so looking them up does not parse
+    for (uint32_t i = 0; i < NUM_CHAPTERS; ++i)
+    {
+        ASSERT_EQ(parallel.elem_id_to_address(i), serial.elem_id_to_address(i));
+    }
+    ASSERT_EQ(parallel.elem_id_to_address(2).size(), 7);
+    ASSERT_EQ(parallel.get_cache_stats().misses, 0);
+}
+
+TEST(EPUB_DOC_INDEX, ids_kept_after_eviction)
+{
+    ZipArchive archive;
+    auto package = write_chapters("epub_doc_index_eviction.epub", archive);
+
+    EpubDocIndex doc_index(package, archive, {});
+    doc_index.set_cache_budget(0);
+
+    ASSERT_GT(doc_index.tokens(1).size(), 0);
+    auto ids = doc_index.elem_id_to_address(1);
+    ASSERT_EQ(ids.size(), 4);
+
+    ASSERT_GT(doc_index.tokens(2).size(), 0);
+    ASSERT_EQ(doc_index.get_cache_stats().evictions, 1);
+
+    ASSERT_EQ(doc_index.elem_id_to_address(1), ids);
+    ASSERT_EQ(doc_index.get_cache_stats().misses, 2);
+}
+
+TEST(EPUB_DOC_INDEX, worker_iter_leaves_cache_alone)
+{
+    ZipArchive archive;
+    auto package = write_chapters("epub_doc_index_worker_iter.epub", archive);
+
+    EpubDocIndex doc_index(package, archive, {});
+    auto it = doc_index.get_worker_iter();
+    std::vector<std::string> read;
+    std::vector<DocAddr> addresses;
+    while (const DocToken *token = it->read(1))
+    {
+        read.push_back(token->to_string());
+        addresses.push_back(token->address);
+    }
+    ASSERT_EQ(doc_index.get_cache_stats().misses, 0);
+
+    std::vector<std::string> expected;
+    for (uint32_t i = 0; i < NUM_CHAPTERS; ++i)
+    {
+        const auto &tokens = doc_index.tokens(i);
+        for (size_t j = 0; j < tokens.size(); ++j)
+        {
+            expected.push_back(tokens[j].to_string());
+        }
+    }
+    ASSERT_GT(expected.size(), 0);
+    ASSERT_EQ(read, expected);
+
+    // Seeks to the first token at an address, and reads back across entries
+    size_t middle = std::find(addresses.begin(), addresses.end(), addresses[addresses.size() / 2]) - addresses.begin();
+    it->seek(addresses[middle]);
+    const DocToken *token = it->read(1);
+    ASSERT_TRUE(token);
+    ASSERT_EQ(token->to_string(), read[middle]);
+    for (size_t i = middle; i > 0; --i)
+    {
+        token = it->read(-1);
+        ASSERT_TRUE(token);
+        ASSERT_EQ(token->to_string(), read[i]);
+    }
+}
@@ -249,3 +249,75 @@ TEST(EPUB_METADATA, epub_parse_nav__nested)
     ASSERT_TRUE(epub_parse_nav("root/nav.xhtml", xml, navmap));
     ASSERT_EQ(navmap, expected_navmap);
 }
+
+TEST(EPUB_METADATA, epub_parse_package_contents__title_and_author)
+{
+    const char *xml = (
+        "<?xml version='1.0' encoding='utf-8'?>"
+        "<package xmlns='http://www.idpf.org/2007/opf' version='2.0'>"
+          "<metadata xmlns:dc='http://purl.org/dc/elements/1.1/'>"
+            "<dc:title>\n  A Title  </dc:title>"
+            "<dc:creator>First Author</dc:creator>"
+            "<dc:creator>Second Author</dc:creator>"
+          "</metadata>"
+          "<manifest>"
+            "<item id='c1' href='text/c1.xhtml' media-type='application/xhtml+xml'/>"
+          "</manifest>"
+          "<spine toc='ncx'>"
+            "<itemref idref='c1'/>"
+          "</spine>"
+        "</package>"
+    );
+    PackageContents package;
+    ASSERT_TRUE(epub_parse_package_contents("OEBPS/content.opf", xml, package));
+    ASSERT_EQ(package.title, "A Title");
+    ASSERT_EQ(package.author, "First Author");
+    ASSERT_EQ(package.spine_ids, std::vector<std::string>({"c1"}));
+    ASSERT_EQ(package.id_to_manifest_item.at("c1").href_absolute, "OEBPS/text/c1.xhtml");
+    ASSERT_EQ(package.toc_id, "ncx");
+}
+
+TEST(EPUB_METADATA, epub_parse_package_contents__cover)
+{
+    const char *epub2_xml = (
+        "<?xml version='1.0' encoding='utf-8'?>"
+        "<package xmlns='http://www.idpf.org/2007/opf' version='2.0'>"
+          "<metadata>"
+            "<meta name='calibre:series' content='c1'/>"
+            "<meta name='cover' content='cover-jpg'/>"
+          "</metadata>"
+          "<manifest>"
+            "<item id='cover-jpg' href='images/cover.jpg' media-type='image/jpeg'/>"
+          "</manifest>"
+        "</package>"
+    );
+    PackageContents package;
+    ASSERT_TRUE(epub_parse_package_contents("OEBPS/content.opf", epub2_xml, package));
+    ASSERT_EQ(package.cover_id, "cover-jpg");
+
+    const char *epub3_xml = (
+        "<?xml version='1.0' encoding='utf-8'?>"
+        "<package xmlns='http://www.idpf.org/2007/opf' version='3.0'>"
+          "<metadata/>"
+          "<manifest>"
+            "<item id='c1' href='text/c1.xhtml' media-type='application/xhtml+xml'/>"
+            "<item id='img' href='cover.png' media-type='image/png' properties='svg cover-image'/>"
+          "</manifest>"
+        "</package>"
+    );
+    package = {};
+    ASSERT_TRUE(epub_parse_package_contents("content.opf", epub3_xml, package));
+    ASSERT_EQ(package.cover_id, "img");
+
+    const char *no_cover_xml = (
+        "<?xml version='1.0' encoding='utf-8'?>"
+        "<package xmlns='http://www.idpf.org/2007/opf' version='3.0'>"
+          "<manifest>"
+            "<item id='c1' href='text/c1.xhtml' media-type='application/xhtml+xml'/>"
+          "</manifest>"
+        "</package>"
+    );
+    package = {};
+    ASSERT_TRUE(epub_parse_package_contents("content.opf", no_cover_xml, package));
+    ASSERT_TRUE(package.cover_id.empty());
+}
@@ -0,0 +1,160 @@
+#include "../epub_doc_index.h"
+#include "../epub_token_cache.h"
+#include "util/tests/stored_zip.h"
+#include "util/task_queue.h"
+#include "util/tests/temp_path.h"
+#include "util/zip_archive.h"
+
+#include <gtest/gtest.h>
+
+#include <fstream>
+
+namespace
+{
+
+std::filesystem::path make_cache_dir(const std::string &name)
+{
+    auto dir = fresh_temp_path(name);
+    std::filesystem::create_directories(dir);
+    return dir;
+}
+
+TokenArena sample_tokens()
+{
+    TokenArena tokens;
+    tokens.push_back(TokenType::Header, 0x500000000ull, "Chapter");
+    tokens.push_back(TokenType::Text, 0x500000007ull, "Some text, with unicode \xe2\x80\x94 and more.");
+    tokens.push_back(TokenType::ListItem, 0x500000040ull, "Item", 2);
+    tokens.push_back(TokenType::Image, 0x500000044ull, "OEBPS/images/cover.jpg");
+    tokens.push_back(TokenType::Text, 0x500000045ull, "");
+    return tokens;
+}
+
+} // namespace
+
+TEST(EPUB_TOKEN_CACHE, round_trip)
+{
+    auto dir = make_cache_dir("epub_token_cache_round_trip");
+    EpubTokenCache cache(dir, "0123456789abcdef");
+
+    std::unordered_map<std::string, DocAddr> ids = {{"start", 0x500000000ull}, {"item", 0x500000040ull}};
+    ASSERT_TRUE(cache.store(5, sample_tokens(), ids));
+
+    TokenArena tokens;
+    std::unordered_map<std::string, DocAddr> loaded_ids;
+    ASSERT_TRUE(cache.load(5, tokens, loaded_ids));
+    ASSERT_EQ(tokens, sample_tokens());
+    ASSERT_EQ(tokens[2].nest_level, 2);
+    ASSERT_EQ(loaded_ids, ids);
+
+    ASSERT_FALSE(cache.load(6, tokens, loaded_ids));
+}
+
+TEST(EPUB_TOKEN_CACHE, stale_entries_ignored)
+{
+    auto dir = make_cache_dir("epub_token_cache_stale");
+    ASSERT_TRUE(EpubTokenCache(dir, "old package").store(0, sample_tokens(), {}));
+
+    TokenArena tokens;
+    std::unordered_map<std::string, DocAddr> ids;
+    ASSERT_FALSE(EpubTokenCache(dir, "new package").load(0, tokens, ids));
+    ASSERT_TRUE(tokens.empty());
+
+    // Replaced on the next store
+    ASSERT_TRUE(EpubTokenCache(dir, "new package").store(0, sample_tokens(), {}));
+    ASSERT_TRUE(EpubTokenCache(dir, "new package").load(0, tokens, ids));
+}
+
+TEST(EPUB_TOKEN_CACHE, damaged_entries_ignored)
+{
+    auto dir = make_cache_dir("epub_token_cache_damaged");
+    EpubTokenCache cache(dir, "package");
+    ASSERT_TRUE(cache.store(0, sample_tokens(), {{"id", 0}}));
+
+    auto path = dir / "tokens.0";
+    auto size = std::filesystem::file_size(path);
+    {
+        std::fstream file(path, std::ios::binary | std::ios::in | std::ios::out);
+        file.seekp(size / 2);
+        file.put('\xFF');
+    }
+
+    TokenArena tokens;
+    std::unordered_map<std::string, DocAddr> ids;
+    ASSERT_FALSE(cache.load(0, tokens, ids));
+    ASSERT_TRUE(tokens.empty());
+    ASSERT_TRUE(ids.empty());
+
+    // Torn write
+    ASSERT_TRUE(cache.store(0, sample_tokens(), {{"id", 0}}));
+    std::filesystem::resize_file(path, size - 3);
+    ASSERT_FALSE(cache.load(0, tokens, ids));
+}
+
+TEST(EPUB_TOKEN_CACHE, doc_index_reads_cached_tokens)
+{
+    auto dir = make_cache_dir("epub_token_cache_doc_index");
+    auto token_cache = std::make_shared<EpubTokenCache>(dir, "package");
+
+    PackageContents package;
+    package.spine_ids = {"c0"};
+    package.id_to_manifest_item["c0"] = {"c0.xhtml", "OEBPS/c0.xhtml", APPLICATION_XHTML_XML, ""};
+
+    ZipArchive archive;
+    ASSERT_TRUE(archive.open(write_stored_zip("epub_token_cache_doc_index.epub", {
+        {"OEBPS/c0.xhtml", "<html><body><p id=\"first\">First paragraph.</p><p>Second.</p></body></html>"},
+    })));
+
+    TokenArena parsed;
+    {
+        EpubDocIndex doc_index(package, archive, {});
+        doc_index.set_token_cache(token_cache);
+        parsed = doc_index.tokens(0);
+        ASSERT_GT(parsed.size(), 0);
+    }
+
+    // The document is gone from this archive, so only the cache can provide it
+    ZipArchive other_archive;
+    ASSERT_TRUE(other_archive.open(write_stored_zip("epub_token_cache_doc_index_other.epub", {
+        {"other.txt", "other"},
+    })));
+
+    EpubDocIndex doc_index(package, other_archive, {});
+    doc_index.set_token_cache(token_cache);
+    ASSERT_EQ(doc_index.tokens(0), parsed);
+    ASSERT_EQ(doc_index.elem_id_to_address(0).at("first"), parsed[0].address);
+}
+
+TEST(EPUB_TOKEN_CACHE, measured_documents_not_stored)
+{
+    auto dir = make_cache_dir("epub_token_cache_measured");
+
+    PackageContents package;
+    std::vector<std::pair<std::string, std::string>> files;
+    for (std::string id : {"c0", "c1", "c2"})
+    {
+        package.spine_ids.push_back(id);
+        package.id_to_manifest_item[id] = {id + ".xhtml", "OEBPS/" + id + ".xhtml", APPLICATION_XHTML_XML, ""};
+        files.emplace_back("OEBPS/" + id + ".xhtml", "<html><body><p>Text of " + id + ".</p></body></html>");
+    }
+
+    ZipArchive archive;
+    ASSERT_TRUE(archive.open(write_stored_zip("epub_token_cache_measured.epub", files)));
+
+    TaskQueue task_queue;
+    EpubDocIndex doc_index(package, archive, {});
+    doc_index.set_token_cache(std::make_shared<EpubTokenCache>(dir, "package"));
+    doc_index.enable_background_parsing(
+        [&task_queue](task_func work, task_func on_done) { task_queue.submit_background(work, on_done); }
+    );
+    while (doc_index.compute_next_address_width())
+    {
+        task_queue.drain();
+    }
+    ASSERT_TRUE(std::filesystem::is_empty(dir));
+
+    // Opening a document stores it, along with its prefetched neighbor
+    ASSERT_GT(doc_index.tokens(0).size(), 0);
+    task_queue.drain();
+    ASSERT_EQ(std::distance(std::filesystem::directory_iterator(dir), std::filesystem::directory_iterator()), 2);
+}
@@ -2,31 +2,24 @@
 
 #include <gtest/gtest.h>
 
-static void ASSERT_TOKENS_EQ(const std::vector<std::unique_ptr<DocToken>> &actual_tokens, const std::vector<std::unique_ptr<DocToken>> &expected_tokens)
+static void ASSERT_TOKENS_EQ(const TokenArena &actual_tokens, const TokenArena &expected_tokens)
 {
-    auto actual_it = actual_tokens.begin();
-    auto expected_it = expected_tokens.begin();
-    int i = 0;
-    while (actual_it != actual_tokens.end() && expected_it != expected_tokens.end())
+    for (size_t i = 0; i < actual_tokens.size() && i < expected_tokens.size(); ++i)
     {
-        const auto &actual = *actual_it;
-        const auto &expected = *expected_it;
+        DocToken actual = actual_tokens[i];
+        DocToken expected = expected_tokens[i];
     
-        EXPECT_EQ(actual->type, expected->type) << i << ": Type didn't match";
-        EXPECT_EQ(actual->address, expected->address) << i << ": Address didn't match";
-        ASSERT_EQ(*actual.get(), *expected.get()) << i << ": Token didn't match";
-    
-        ++actual_it;
-        ++expected_it;
-        ++i;
+        EXPECT_EQ(actual.type, expected.type) << i << ": Type didn't match";
+        EXPECT_EQ(actual.address, expected.address) << i << ": Address didn't match";
+        ASSERT_EQ(actual, expected) << i << ": Token didn't match";
     }
 
     ASSERT_EQ(actual_tokens.size(), expected_tokens.size());
 }
 
-static std::vector<std::unique_ptr<DocToken>> _parse_xhtml_tokens(const char *xml)
+static TokenArena _parse_xhtml_tokens(const char *xml)
 {
-    std::vector<std::unique_ptr<DocToken>> tokens;
+    TokenArena tokens;
     std::unordered_map<std::string, DocAddr> ids;
     parse_xhtml_tokens(xml, "/base/file.xhtml", 0, tokens, ids);
     return tokens;
@@ -47,8 +40,8 @@ TEST(XHTML_PARSER, basic_text_valid_xhtml)
         "</html>"
     );
   
-    std::vector<std::unique_ptr<DocToken>> expected_tokens;
-    expected_tokens.push_back(std::make_unique<TextDocToken>(0, "Text"));
+    TokenArena expected_tokens;
+    expected_tokens.push_back(TokenType::Text, 0, "Text");
   
     ASSERT_TOKENS_EQ(
         _parse_xhtml_tokens(xml),
@@ -64,8 +57,8 @@ TEST(XHTML_PARSER, whitespace_compaction)
         "</body></html>"
     );
   
-    std::vector<std::unique_ptr<DocToken>> expected_tokens;
-    expected_tokens.push_back(std::make_unique<TextDocToken>(0, "This has some extra white space"));
+    TokenArena expected_tokens;
+    expected_tokens.push_back(TokenType::Text, 0, "This has some extra white space");
   
     ASSERT_TOKENS_EQ(
         _parse_xhtml_tokens(xml),
@@ -82,9 +75,9 @@ TEST(XHTML_PARSER, line_break)
         "</body></html>"
     );
   
-    std::vector<std::unique_ptr<DocToken>> expected_tokens;
-    expected_tokens.push_back(std::make_unique<TextDocToken>(0, "Line 1"));
-    expected_tokens.push_back(std::make_unique<TextDocToken>(5, "Line 2"));
+    TokenArena expected_tokens;
+    expected_tokens.push_back(TokenType::Text, 0, "Line 1");
+    expected_tokens.push_back(TokenType::Text, 5, "Line 2");
   
     ASSERT_TOKENS_EQ(
         _parse_xhtml_tokens(xml),
@@ -109,12 +102,12 @@ TEST(XHTML_PARSER, section_compaction)
         "</body></html>"
     );
   
-    std::vector<std::unique_ptr<DocToken>> expected_tokens;
-    expected_tokens.push_back(std::make_unique<TextDocToken>(0,  ""          ));
-    expected_tokens.push_back(std::make_unique<TextDocToken>(0,  "Some text."));
-    expected_tokens.push_back(std::make_unique<TextDocToken>(9,  ""          ));
-    expected_tokens.push_back(std::make_unique<TextDocToken>(9,  "Some more."));
-    expected_tokens.push_back(std::make_unique<TextDocToken>(18, ""          ));
+    TokenArena expected_tokens;
+    expected_tokens.push_back(TokenType::Text, 0,  ""          );
+    expected_tokens.push_back(TokenType::Text, 0,  "Some text.");
+    expected_tokens.push_back(TokenType::Text, 9,  ""          );
+    expected_tokens.push_back(TokenType::Text, 9,  "Some more.");
+    expected_tokens.push_back(TokenType::Text, 18, ""          );
   
     ASSERT_TOKENS_EQ(
         _parse_xhtml_tokens(xml),
@@ -135,16 +128,16 @@ TEST(XHTML_PARSER, header_elems)
         "</body></html>"
     );
 
-    std::vector<std::unique_ptr<DocToken>> expected_tokens;
-    expected_tokens.push_back(std::make_unique<TextDocToken>(0, ""));
-    expected_tokens.push_back(std::make_unique<HeaderDocToken>(0, "heading 1"));
-    expected_tokens.push_back(std::make_unique<TextDocToken>(8, ""));
-    expected_tokens.push_back(std::make_unique<HeaderDocToken>(8, "heading 2"));
-    expected_tokens.push_back(std::make_unique<TextDocToken>(16, ""));
-    expected_tokens.push_back(std::make_unique<HeaderDocToken>(16, "heading 3"));
-    expected_tokens.push_back(std::make_unique<TextDocToken>(24, ""));
-    expected_tokens.push_back(std::make_unique<TextDocToken>(24, "Some text"));
-    expected_tokens.push_back(std::make_unique<TextDocToken>(32, ""));
+    TokenArena expected_tokens;
+    expected_tokens.push_back(TokenType::Text, 0, "");
+    expected_tokens.push_back(TokenType::Header, 0, "heading 1");
+    expected_tokens.push_back(TokenType::Text, 8, "");
+    expected_tokens.push_back(TokenType::Header, 8, "heading 2");
+    expected_tokens.push_back(TokenType::Text, 16, "");
+    expected_tokens.push_back(TokenType::Header, 16, "heading 3");
+    expected_tokens.push_back(TokenType::Text, 24, "");
+    expected_tokens.push_back(TokenType::Text, 24, "Some text");
+    expected_tokens.push_back(TokenType::Text, 32, "");
 
     ASSERT_TOKENS_EQ(
         _parse_xhtml_tokens(xml),
@@ -168,14 +161,14 @@ TEST(XHTML_PARSER, pre_elems)
         "</body></html>"
     );
 
-    std::vector<std::unique_ptr<DocToken>> expected_tokens;
-    expected_tokens.push_back(std::make_unique<TextDocToken>(0, "start"              ));
-    expected_tokens.push_back(std::make_unique<TextDocToken>(5, ""                   ));
-    expected_tokens.push_back(std::make_unique<TextDocToken>(5, "line1\nline2\nline3"));
-    expected_tokens.push_back(std::make_unique<TextDocToken>(20, ""                  ));
-    expected_tokens.push_back(std::make_unique<TextDocToken>(20, "line4"             ));
-    expected_tokens.push_back(std::make_unique<TextDocToken>(25, ""                  ));
-    expected_tokens.push_back(std::make_unique<TextDocToken>(25, "end"               ));
+    TokenArena expected_tokens;
+    expected_tokens.push_back(TokenType::Text, 0, "start"              );
+    expected_tokens.push_back(TokenType::Text, 5, ""                   );
+    expected_tokens.push_back(TokenType::Text, 5, "line1\nline2\nline3");
+    expected_tokens.push_back(TokenType::Text, 20, ""                  );
+    expected_tokens.push_back(TokenType::Text, 20, "line4"             );
+    expected_tokens.push_back(TokenType::Text, 25, ""                  );
+    expected_tokens.push_back(TokenType::Text, 25, "end"               );
 
     ASSERT_TOKENS_EQ(
         _parse_xhtml_tokens(xml),
@@ -193,10 +186,10 @@ TEST(XHTML_PARSER, image_elems)
         "</body></html>"
     );
 
-    std::vector<std::unique_ptr<DocToken>> expected_tokens;
-    expected_tokens.push_back(std::make_unique<ImageDocToken>(0, "/base/foo.png"));
-    expected_tokens.push_back(std::make_unique<ImageDocToken>(1, "/bar.png"));
-    expected_tokens.push_back(std::make_unique<TextDocToken>(2, "Line 2"));
+    TokenArena expected_tokens;
+    expected_tokens.push_back(TokenType::Image, 0, "/base/foo.png");
+    expected_tokens.push_back(TokenType::Image, 1, "/bar.png");
+    expected_tokens.push_back(TokenType::Text, 2, "Line 2");
 
     ASSERT_TOKENS_EQ(
         _parse_xhtml_tokens(xml),
@@ -218,9 +211,26 @@ TEST(XHTML_PARSER, capture_ids)
         {"id2", 5},
     };
   
-    std::vector<std::unique_ptr<DocToken>> tokens;
+    TokenArena tokens;
     std::unordered_map<std::string, DocAddr> ids;
     ASSERT_TRUE(parse_xhtml_tokens(xml, "", 0, tokens, ids));
 
     ASSERT_EQ(expected_ids, ids);
 }
+
+TEST(XHTML_PARSER, recover_malformed)
+{
+    const char *xml = (
+        "<html><body>"
+        "Unclosed <b>tag</i> text"
+        "</body></html>"
+    );
+
+    TokenArena expected_tokens;
+    expected_tokens.push_back(TokenType::Text, 0, "Unclosed tag text");
+
+    ASSERT_TOKENS_EQ(
+        _parse_xhtml_tokens(xml),
+        expected_tokens
+    );
+}
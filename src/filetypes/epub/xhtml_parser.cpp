@@ -8,6 +8,7 @@
 #include "doc_api/token_addressing.h"
 
 #include <libxml/parser.h>
+#include <libxml/xmlreader.h>
 
 #include <cstring>
 #include <filesystem>
@@ -20,7 +21,7 @@
 
 namespace {
 
-const std::string SPACE = " ";
+const char *SPACE = " ";
 
 bool element_is_blocking(const xmlChar *name)
 {
@@ -103,8 +104,7 @@ std::string escape_newlines(const xmlChar *str)
     return result;
 }
 
-// Decorate xml nodes with additional context. Intermediate structure to
-// assist conversion between xml nodes and DocTokens.
+// Intermediate events to assist conversion between xml nodes and DocTokens.
 struct Node
 {
     enum class Type
@@ -120,19 +120,9 @@ struct Node
 
     Type type;
     DocAddr address;
-    xmlNodePtr node;
-    std::string text;
+    const char *text;
     int list_depth;
 
-    Node(Type type, DocAddr address, xmlNodePtr node, std::string text, int list_depth)
-        : type(type)
-        , address(address)
-        , node(node)
-        , text(std::move(text))
-        , list_depth(list_depth)
-    {
-    }
-
     bool is_inline() const
     {
         return type == Type::InlineText
@@ -174,6 +164,146 @@ struct Node
     }
 };
 
+// Element details needed by the node processor
+struct ElementInfo
+{
+    const xmlChar *name = nullptr;
+    const xmlChar *id = nullptr;
+    const xmlChar *image_path = nullptr;
+};
+
+// Merge consecutive inline nodes of the same type, emit DocTokens
+class TokenGenerator
+{
+    const std::filesystem::path &base_path;
+    TokenArena &tokens_out;
+
+    bool separator_allowed = true;
+
+    // Inline group being accumulated
+    bool has_group = false;
+    Node::Type group_type = Node::Type::InlineText;
+    DocAddr group_address = 0;
+    int group_list_depth = 0;
+    std::string group_text;
+
+    void flush_group()
+    {
+        if (!has_group)
+        {
+            return;
+        }
+        has_group = false;
+
+        if (group_type != Node::Type::InlinePre)
+        {
+            compact_strings_finish(group_text);
+        }
+
+        if (group_text.size())
+        {
+            switch (group_type)
+            {
+                case Node::Type::InlineText:
+                case Node::Type::InlinePre:
+                    tokens_out.push_back(TokenType::Text, group_address, group_text);
+                    break;
+                case Node::Type::InlineHeader:
+                    tokens_out.push_back(TokenType::Header, group_address, group_text);
+                    break;
+                case Node::Type::InlineList:
+                    tokens_out.push_back(TokenType::ListItem, group_address, group_text, group_list_depth);
+                    break;
+                default:
+                    throw std::runtime_error("Unexpected node type in inline group");
+            }
+
+            separator_allowed = true;
+        }
+        group_text.clear();
+    }
+
+public:
+    TokenGenerator(
+        const std::filesystem::path &base_path,
+        TokenArena &tokens_out
+    ) : base_path(base_path), tokens_out(tokens_out)
+    {
+    }
+
+    void on_node(const Node &node, const xmlChar *image_path)
+    {
+        if (has_group && node.type != group_type)
+        {
+            flush_group();
+        }
+
+        if (node.is_inline())
+        {
+            if (!has_group)
+            {
+                has_group = true;
+                group_type = node.type;
+                group_address = node.address;
+                group_list_depth = node.list_depth;
+            }
+
+            if (node.type == Node::Type::InlinePre)
+            {
+                for (const char *c = node.text; *c; ++c)
+                {
+                    if (*c != '\r')
+                    {
+                        group_text.push_back(*c);
+                    }
+                }
+            }
+            else
+            {
+                compact_strings_append(group_text, node.text);
+            }
+            return;
+        }
+
+        switch (node.type)
+        {
+            case Node::Type::Image:
+                if (image_path)
+                {
+                    tokens_out.push_back(
+                        TokenType::Image,
+                        node.address,
+                        (base_path / (const char*)image_path).lexically_normal().native()
+                    );
+                }
+                else
+                {
+                    std::cerr << "Unable to get link from image" << std::endl;
+                }
+
+                separator_allowed = true;
+                break;
+            case Node::Type::SectionSeparator:
+                if (separator_allowed)
+                {
+                    tokens_out.push_back(TokenType::Text, node.address, "");
+
+                    separator_allowed = false;
+                }
+                break;
+            case Node::Type::InlineBreak:
+                break;
+            default:
+                throw std::runtime_error("Unknown node type");
+        }
+    }
+
+    void finish()
+    {
+        flush_group();
+    }
+};
+
 class NodeProcessor
 {
     int list_depth = 0;     // depth inside ul/ol tags
@@ -183,9 +313,9 @@ class NodeProcessor
 
     DocAddr current_address;
 
-    std::vector<Node> nodes;
     std::set<std::string> unattached_ids;
     std::unordered_map<std::string, DocAddr> &id_to_addr;
+    TokenGenerator &generator;
 
     void attach_pending_ids(DocAddr address)
     {
@@ -196,26 +326,28 @@ class NodeProcessor
         unattached_ids.clear();
     }
 
-    void emit_node(int node_depth, Node::Type type, xmlNodePtr node, std::string text = "")
+    void emit_node(int node_depth, Node::Type type, const char *text = "", const xmlChar *image_path = nullptr)
     {
         attach_pending_ids(current_address);
-        nodes.emplace_back(type, current_address, node, std::move(text), list_depth);
-        DEBUG_LOG("[node: " << nodes.back().to_string() << "]");
+        Node node {type, current_address, text, list_depth};
+        DEBUG_LOG("[node: " << node.to_string() << "]");
+        generator.on_node(node, image_path);
     }
 
 public:
     NodeProcessor(
         DocAddr current_address,
-        std::unordered_map<std::string, DocAddr> &id_to_addr
-    ) : current_address(current_address), id_to_addr(id_to_addr)
+        std::unordered_map<std::string, DocAddr> &id_to_addr,
+        TokenGenerator &generator
+    ) : current_address(current_address), id_to_addr(id_to_addr), generator(generator)
     {
     }
 
-    void on_text_node(xmlNodePtr node, int node_depth)
+    void on_text_node(const xmlChar *content, int node_depth)
     {
-        DEBUG_LOG("\"" << escape_newlines(node->content) << "\"");
+        DEBUG_LOG("\"" << escape_newlines(content) << "\"");
 
-        if (node->content && xmlStrlen(node->content))
+        if (content && xmlStrlen(content))
         {
             Node::Type type;
             if (pre_depth > 0)
@@ -238,43 +370,39 @@ public:
             emit_node(
                 node_depth,
                 type,
-                node,
-                (const char*)node->content
+                (const char*)content
             );
 
-            current_address += get_address_width((const char*)node->content);
+            current_address += get_address_width((const char*)content);
         }
     }
 
-    void on_enter_element_node(xmlNodePtr node, int node_depth)
+    void on_enter_element_node(const ElementInfo &elem, int node_depth)
     {
-        DEBUG_LOG("<node name=\"" << node->name << "\">");
+        DEBUG_LOG("<node name=\"" << elem.name << "\">");
 
         // Look for id
+        if (elem.id && xmlStrlen(elem.id) > 0)
         {
-            const xmlChar *elem_id = xmlGetProp(node, BAD_CAST "id");
-            if (elem_id && xmlStrlen(elem_id) > 0)
-            {
-                unattached_ids.insert((const char*)elem_id);
-            }
+            unattached_ids.insert((const char*)elem.id);
         }
 
-        if (element_is_blocking(node->name))
+        if (element_is_blocking(elem.name))
         {
-            emit_node(node_depth, Node::Type::InlineBreak, node);
+            emit_node(node_depth, Node::Type::InlineBreak);
         }
 
-        switch (elem_name_to_enum(node->name))
+        switch (elem_name_to_enum(elem.name))
         {
             case ElementType::H:
-                emit_node(node_depth, Node::Type::SectionSeparator, node);
+                emit_node(node_depth, Node::Type::SectionSeparator);
                 ++header_depth;
                 break;
             case ElementType::Ol:
             case ElementType::Ul:
                 if (list_depth == 0)
                 {
-                    emit_node(node_depth, Node::Type::SectionSeparator, node);
+                    emit_node(node_depth, Node::Type::SectionSeparator);
                 }
                 ++list_depth;
                 break;
@@ -283,35 +411,35 @@ public:
                     bool suppress_blocking = table_depth > 0 || list_depth > 0;
                     if (!suppress_blocking)
                     {
-                        emit_node(node_depth, Node::Type::SectionSeparator, node);
+                        emit_node(node_depth, Node::Type::SectionSeparator);
                     }
                 }
                 break;
             case ElementType::Pre:
-                emit_node(node_depth, Node::Type::SectionSeparator, node);
+                emit_node(node_depth, Node::Type::SectionSeparator);
                 ++pre_depth;
                 break;
             case ElementType::Table:
-                emit_node(node_depth, Node::Type::SectionSeparator, node);
+                emit_node(node_depth, Node::Type::SectionSeparator);
                 ++table_depth;
                 break;
             case ElementType::Image:
-                emit_node(node_depth, Node::Type::Image, node);
+                emit_node(node_depth, Node::Type::Image, "", elem.image_path);
                 break;
             default:
                 break;
         }
     }
 
-    void on_exit_element_node(xmlNodePtr node, int node_depth)
+    void on_exit_element_node(const xmlChar *name, int node_depth)
     {
-        DEBUG_LOG("</node name=\"" << node->name << "\">");
+        DEBUG_LOG("</node name=\"" << name << "\">");
 
-        ElementType elem_type = elem_name_to_enum(node->name);
+        ElementType elem_type = elem_name_to_enum(name);
         switch (elem_type)
         {
             case ElementType::H:
-                emit_node(node_depth, Node::Type::SectionSeparator, node);
+                emit_node(node_depth, Node::Type::SectionSeparator);
                 --header_depth;
                 break;
             case ElementType::Ol:
@@ -319,7 +447,7 @@ public:
                 --list_depth;
                 if (list_depth == 0)
                 {
-                    emit_node(node_depth, Node::Type::SectionSeparator, node);
+                    emit_node(node_depth, Node::Type::SectionSeparator);
                 }
                 break;
             case ElementType::P:
@@ -327,31 +455,31 @@ public:
                     bool suppress_blocking = table_depth > 0 || list_depth > 0;
                     if (!suppress_blocking)
                     {
-                        emit_node(node_depth, Node::Type::SectionSeparator, node);
+                        emit_node(node_depth, Node::Type::SectionSeparator);
                     }
                 }
                 break;
             case ElementType::Pre:
-                emit_node(node_depth, Node::Type::SectionSeparator, node);
+                emit_node(node_depth, Node::Type::SectionSeparator);
                 --pre_depth;
                 break;
             case ElementType::Table:
-                emit_node(node_depth, Node::Type::SectionSeparator, node);
+                emit_node(node_depth, Node::Type::SectionSeparator);
                 --table_depth;
                 break;
             case ElementType::Tr:
-                emit_node(node_depth, Node::Type::InlineBreak, node);
+                emit_node(node_depth, Node::Type::InlineBreak);
                 break;
             case ElementType::Td:
-                emit_node(node_depth, Node::Type::InlineText, node, SPACE);
+                emit_node(node_depth, Node::Type::InlineText, SPACE);
                 break;
             default:
                 break;
         }
 
-        if (element_is_blocking(node->name))
+        if (element_is_blocking(name))
         {
-            emit_node(node_depth, Node::Type::InlineBreak, node);
+            emit_node(node_depth, Node::Type::InlineBreak);
         }
 
         if (elem_type == ElementType::Image)
@@ -359,202 +487,275 @@ public:
             ++current_address;
         }
     }
+};
+
+ElementInfo get_element_info(xmlNodePtr node)
+{
+    auto get_prop = [node](const char *name) -> const xmlChar* {
+        for (xmlAttrPtr attr = node->properties; attr; attr = attr->next)
+        {
+            if (xmlStrEqual(attr->name, BAD_CAST name))
+            {
+                return attr->children ? attr->children->content : nullptr;
+            }
+        }
+        return nullptr;
+    };
 
-    const std::vector<Node> &get_nodes() const
+    ElementInfo elem;
+    elem.name = node->name;
+    elem.id = get_prop("id");
+    elem.image_path = get_prop("href");
+    if (!elem.image_path)
     {
-        return nodes;
+        elem.image_path = get_prop("src");
     }
-};
+    return elem;
+}
 
+// Visit a DOM subtree. Used for entity reference content, which the reader does not expand,
+// and for documents the reader cannot stream.
 void visit_nodes(xmlNodePtr node, NodeProcessor &processor, int node_depth = 0)
 {
     while (node)
     {
-        // Enter handlers
         if (node->type == XML_TEXT_NODE)
         {
-            processor.on_text_node(node, node_depth);
+            processor.on_text_node(node->content, node_depth);
         }
         else if (node->type == XML_ELEMENT_NODE)
         {
-            processor.on_enter_element_node(node, node_depth);
+            processor.on_enter_element_node(get_element_info(node), node_depth);
         }
 
-        // Descend
         visit_nodes(node->children, processor, node_depth + 1);
 
-        // Exit handlers
         if (node->type == XML_ELEMENT_NODE)
         {
-            processor.on_exit_element_node(node, node_depth);
+            processor.on_exit_element_node(node->name, node_depth);
         }
 
         node = node->next;
     }
 }
 
-// Merge inline text types, emit DocTokens
-void generate_doc_tokens(
-    const std::vector<Node> &nodes,
-    const std::filesystem::path &base_path,
-    std::vector<std::unique_ptr<DocToken>> &tokens_out
-)
+// Read the attributes of the current element. Values are valid until the reader advances.
+ElementInfo read_element_info(xmlTextReaderPtr reader)
 {
-    auto get_group_size = [&nodes](uint32_t i) -> uint32_t {
-        const auto &head = nodes[i];
-        if (head.is_inline())
+    ElementInfo elem;
+    elem.name = xmlTextReaderConstLocalName(reader);
+
+    const xmlChar *href = nullptr;
+    const xmlChar *src = nullptr;
+
+    if (xmlTextReaderMoveToFirstAttribute(reader) == 1)
+    {
+        do
         {
-            Node::Type head_type = head.type;
+            if (xmlTextReaderIsNamespaceDecl(reader) == 1)
+            {
+                continue;
+            }
 
-            uint32_t size = 1;
-            while (++i < nodes.size() && nodes[i].type == head_type)
+            const xmlChar *attr_name = xmlTextReaderConstLocalName(reader);
+            if (!elem.id && xmlStrEqual(attr_name, BAD_CAST "id"))
             {
-                ++size;
+                elem.id = xmlTextReaderConstValue(reader);
             }
-            return size;
-        }
-        return 1;
-    };
+            else if (!href && xmlStrEqual(attr_name, BAD_CAST "href"))
+            {
+                href = xmlTextReaderConstValue(reader);
+            }
+            else if (!src && xmlStrEqual(attr_name, BAD_CAST "src"))
+            {
+                src = xmlTextReaderConstValue(reader);
+            }
+        } while (xmlTextReaderMoveToNextAttribute(reader) == 1);
 
-    uint32_t n = nodes.size();
-    tokens_out.reserve(n);
+        xmlTextReaderMoveToElement(reader);
+    }
 
-    bool separator_allowed = true;
-    uint32_t i = 0;
-    while (i < n)
+    elem.image_path = href ? href : src;
+    return elem;
+}
+
+enum class StreamResult
+{
+    Ok,
+    Malformed,
+    Failed,
+};
+
+constexpr int XML_PARSE_OPTIONS = XML_PARSE_NOERROR | XML_PARSE_NOWARNING | XML_PARSE_RECOVER;
+
+// Stream through the document, only processing the contents of <html><body>
+StreamResult stream_xhtml(
+    const char *xml_str,
+    const std::filesystem::path &base_path,
+    DocAddr start_address,
+    TokenArena &tokens_out,
+    std::unordered_map<std::string, DocAddr> &id_to_addr_out
+)
+{
+    xmlTextReaderPtr reader = xmlReaderForMemory(xml_str, strlen(xml_str), nullptr, nullptr, XML_PARSE_OPTIONS);
+    if (reader == nullptr)
     {
-        uint32_t group_size = get_group_size(i);
-        const Node &head = nodes[i];
-        DocAddr address = head.address;
+        return StreamResult::Failed;
+    }
+
+    TokenGenerator generator(base_path, tokens_out);
+    NodeProcessor processor(start_address, id_to_addr_out, generator);
 
-        switch (head.type)
+    constexpr int body_depth = 1;
+    bool found_root = false;
+    bool in_body = false;
+
+    int ret;
+    while ((ret = xmlTextReaderRead(reader)) == 1)
+    {
+        int depth = xmlTextReaderDepth(reader);
+        int node_type = xmlTextReaderNodeType(reader);
+
+        if (!in_body)
         {
-            case Node::Type::InlineText:
-            case Node::Type::InlineHeader:
-            case Node::Type::InlineList:
+            if (node_type == XML_READER_TYPE_ELEMENT)
+            {
+                const xmlChar *name = xmlTextReaderConstLocalName(reader);
+                if (depth == 0)
                 {
-                    std::vector<const char*> substrings;
-                    substrings.reserve(group_size);
-                    for (uint32_t j = i; j < i + group_size; ++j)
+                    found_root = true;
+                    if (!xmlStrEqual(name, BAD_CAST "html"))
                     {
-                        substrings.push_back(nodes[j].text.c_str());
-                    }
-
-                    std::string text = compact_strings(substrings);
-                    if (text.size())
-                    {
-                        if (head.type == Node::Type::InlineText)
-                        {
-                            tokens_out.push_back(std::make_unique<TextDocToken>(
-                                address,
-                                text
-                            ));
-                        }
-                        else if (head.type == Node::Type::InlineHeader)
-                        {
-                            tokens_out.push_back(std::make_unique<HeaderDocToken>(
-                                address,
-                                text
-                            ));
-                        }
-                        else
-                        {
-                            tokens_out.push_back(std::make_unique<ListItemDocToken>(
-                                address,
-                                text,
-                                head.list_depth
-                            ));
-                        }
-
-                        separator_allowed = true;
+                        break;
                     }
                 }
-                break;
-            case Node::Type::InlinePre:
+                if (depth == body_depth && xmlStrEqual(name, BAD_CAST "body"))
                 {
-                    std::vector<const char *> substrings;
-                    substrings.reserve(group_size);
-                    for (uint32_t j = i; j < i + group_size; ++j)
+                    if (xmlTextReaderIsEmptyElement(reader))
                     {
-                        substrings.push_back(nodes[j].text.c_str());
+                        break;
                     }
+                    in_body = true;
+                }
+            }
+            continue;
+        }
 
-                    std::string text = remove_carriage_returns(join_strings(substrings));
-                    if (text.size())
+        if (depth <= body_depth)
+        {
+            break;
+        }
+
+        int node_depth = depth - body_depth - 1;
+        switch (node_type)
+        {
+            case XML_READER_TYPE_ELEMENT:
+                {
+                    bool is_empty = xmlTextReaderIsEmptyElement(reader);
+                    ElementInfo elem = read_element_info(reader);
+                    processor.on_enter_element_node(elem, node_depth);
+                    if (is_empty)
                     {
-                        tokens_out.push_back(std::make_unique<TextDocToken>(
-                            address,
-                            text
-                        ));
-                        separator_allowed = true;
+                        processor.on_exit_element_node(elem.name, node_depth);
                     }
                 }
                 break;
-            case Node::Type::Image:
+            case XML_READER_TYPE_END_ELEMENT:
+                processor.on_exit_element_node(xmlTextReaderConstLocalName(reader), node_depth);
+                break;
+            case XML_READER_TYPE_TEXT:
+            case XML_READER_TYPE_WHITESPACE:
+            case XML_READER_TYPE_SIGNIFICANT_WHITESPACE:
+                processor.on_text_node(xmlTextReaderConstValue(reader), node_depth);
+                break;
+            case XML_READER_TYPE_ENTITY_REFERENCE:
                 {
-                    xmlNodePtr node = head.node;
-                    const xmlChar *img_path = xmlGetProp(node, BAD_CAST "href");
-                    if (!img_path) img_path = xmlGetProp(node, BAD_CAST "src");
-                    if (img_path)
+                    xmlNodePtr node = xmlTextReaderCurrentNode(reader);
+                    if (node)
                     {
-                        tokens_out.push_back(std::make_unique<ImageDocToken>(
-                            address,
-                            (base_path / (const char*)img_path).lexically_normal()
-                        ));
+                        visit_nodes(node->children, processor, node_depth + 1);
                     }
-                    else
-                    {
-                        std::cerr << "Unable to get link from image" << std::endl;
-                    }
-
-                    separator_allowed = true;
                 }
                 break;
-            case Node::Type::SectionSeparator:
-                if (separator_allowed)
-                {
-                    tokens_out.push_back(std::make_unique<TextDocToken>(
-                        address,
-                        ""
-                    ));
-
-                    separator_allowed = false;
-                }
-                break;
-            case Node::Type::InlineBreak:
-                break;
             default:
-                throw std::runtime_error("Unknown node type");
+                break;
         }
-        i += group_size;
     }
-}
 
-} // namespace
+    generator.finish();
+    xmlFreeTextReader(reader);
+
+    if (ret < 0)
+    {
+        return StreamResult::Malformed;
+    }
+    return found_root ? StreamResult::Ok : StreamResult::Failed;
+}
 
-bool parse_xhtml_tokens(const char *xml_str, std::filesystem::path file_path, uint32_t chapter_number, std::vector<std::unique_ptr<DocToken>> &tokens_out, std::unordered_map<std::string, DocAddr> &id_to_addr_out)
+// Parse the whole document into a DOM, which tolerates more malformed markup than the reader
+StreamResult walk_xhtml_dom(
+    const char *xml_str,
+    const std::filesystem::path &base_path,
+    DocAddr start_address,
+    TokenArena &tokens_out,
+    std::unordered_map<std::string, DocAddr> &id_to_addr_out
+)
 {
-    xmlDocPtr doc = xmlReadMemory(xml_str, strlen(xml_str), nullptr, nullptr, XML_PARSE_NOERROR | XML_PARSE_NOWARNING | XML_PARSE_RECOVER);
+    xmlDocPtr doc = xmlReadMemory(xml_str, strlen(xml_str), nullptr, nullptr, XML_PARSE_OPTIONS);
     if (doc == nullptr)
     {
-        std::cerr << "Unable to parse " << file_path << " as xml" << std::endl;
-        return false;
+        return StreamResult::Failed;
     }
 
     xmlNodePtr node = xmlDocGetRootElement(doc);
-
     node = elem_first_child(elem_first_by_name(node, BAD_CAST "html"));
     node = elem_first_child(elem_first_by_name(node, BAD_CAST "body"));
 
-    NodeProcessor processor(
-        make_address(chapter_number),
-        id_to_addr_out
-    );
+    TokenGenerator generator(base_path, tokens_out);
+    NodeProcessor processor(start_address, id_to_addr_out, generator);
     visit_nodes(node, processor);
-
-    generate_doc_tokens(processor.get_nodes(), file_path.parent_path(), tokens_out);
+    generator.finish();
 
     xmlFreeDoc(doc);
 
+    return StreamResult::Ok;
+}
+
+} // namespace
+
+bool parse_xhtml_tokens(const char *xml_str, std::filesystem::path file_path, uint32_t chapter_number, TokenArena &tokens_out, std::unordered_map<std::string, DocAddr> &id_to_addr_out)
+{
+    auto base_path = file_path.parent_path();
+    TokenArena tokens;
+    std::unordered_map<std::string, DocAddr> id_to_addr;
+
+    StreamResult result = stream_xhtml(xml_str, base_path, make_address(chapter_number), tokens, id_to_addr);
+    if (result == StreamResult::Malformed)
+    {
+        // The reader gives up on the first well-formedness error, fall back to a recovering DOM parse
+        tokens.clear();
+        id_to_addr.clear();
+        result = walk_xhtml_dom(xml_str, base_path, make_address(chapter_number), tokens, id_to_addr);
+    }
+
+    if (result != StreamResult::Ok)
+    {
+        std::cerr << "Unable to parse " << file_path << " as xml" << std::endl;
+        return false;
+    }
+
+    if (tokens_out.empty())
+    {
+        tokens_out = std::move(tokens);
+    }
+    else
+    {
+        for (size_t i = 0; i < tokens.size(); ++i)
+        {
+            tokens_out.push_back(tokens[i]);
+        }
+    }
+    id_to_addr_out.merge(id_to_addr);
+
     return true;
 }
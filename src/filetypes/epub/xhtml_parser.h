@@ -1,13 +1,16 @@
 #ifndef XHTML_PARSER_H_
 #define XHTML_PARSER_H_
 
-#include "doc_api/doc_token.h"
+#include "doc_api/token_arena.h"
 
 #include <filesystem>
 #include <string>
 #include <unordered_map>
-#include <vector>
 
-bool parse_xhtml_tokens(const char *xml_str, std::filesystem::path file_path, uint32_t chapter_number, std::vector<std::unique_ptr<DocToken>> &tokens_out, std::unordered_map<std::string, DocAddr> &id_to_addr_out);
+// Bump when parsed tokens or their addresses change, so tokens persisted by
+// earlier versions are parsed again
+#define XHTML_PARSER_VERSION 1
+
+bool parse_xhtml_tokens(const char *xml_str, std::filesystem::path file_path, uint32_t chapter_number, TokenArena &tokens_out, std::unordered_map<std::string, DocAddr> &id_to_addr_out);
 
 #endif
@@ -46,26 +46,38 @@ std::string compact_strings(const std::vector<const char*> &strings)
 
     for (const char *str : strings)
     {
-        std::string substring = compact_whitespace(str);
+        compact_strings_append(result, str);
+    }
+    compact_strings_finish(result);
 
-        if (result.empty())
+    return result;
+}
+
+void compact_strings_append(std::string &result, const char *str)
+{
+    char c;
+    for (; (c = *str); ++str)
+    {
+        if (is_whitespace(c))
         {
-            substring = strip_whitespace_left(substring);
+            // Never lead with whitespace, limit consecutive whitespace to one space
+            if (result.empty() || result.back() == ' ')
+            {
+                continue;
+            }
+            result.push_back(' ');
         }
-
-        bool space_left = result.empty() ? false : is_whitespace(result[result.size() - 1]);
-        bool space_right = substring.empty() ? false : is_whitespace(substring[0]);
-        if (space_left && space_right)
+        else
         {
-            substring = strip_whitespace_left(substring);
+            result.push_back(c);
         }
-
-        result.append(substring);
     }
+}
 
-    if (!result.empty() && is_whitespace(result[result.size() - 1]))
+void compact_strings_finish(std::string &result)
+{
+    if (!result.empty() && result.back() == ' ')
     {
-        result = strip_whitespace_right(result);
+        result.pop_back();
     }
-    return result;
 }
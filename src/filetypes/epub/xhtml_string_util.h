@@ -10,4 +10,8 @@ std::string compact_whitespace(const char *str);
 // Join multiple strings, applying html whitespace rules
 std::string compact_strings(const std::vector<const char*> &strings);
 
+// Incremental form of compact_strings. Append each string, then finish once.
+void compact_strings_append(std::string &result, const char *str);
+void compact_strings_finish(std::string &result);
+
 #endif
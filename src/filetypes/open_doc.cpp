@@ -46,3 +46,26 @@ std::shared_ptr<DocReader> create_doc_reader(const std::filesystem::path &path)
     std::cerr << "Unsupported file type: " << path.string() << std::endl;
     return nullptr;
 }
+
+std::optional<DocMetadata> read_doc_metadata(const std::filesystem::path &path)
+{
+    auto ext = norm_extension(path);
+    if (ext == EPUB_EXT)
+    {
+        return epub_read_metadata(path);
+    }
+    if (TEXT_EXTS.count(ext) > 0)
+    {
+        return txt_read_metadata(path);
+    }
+    return std::nullopt;
+}
+
+std::optional<DocCover> read_doc_cover(const std::filesystem::path &path)
+{
+    if (norm_extension(path) == EPUB_EXT)
+    {
+        return epub_read_cover(path);
+    }
+    return std::nullopt;
+}
@@ -8,5 +8,9 @@
 
 bool file_type_is_supported(const std::filesystem::path &path);
 std::shared_ptr<DocReader> create_doc_reader(const std::filesystem::path &path);
+// Safe to call from any thread
+std::optional<DocMetadata> read_doc_metadata(const std::filesystem::path &path);
+// Safe to call from any thread, null if the document has no cover
+std::optional<DocCover> read_doc_cover(const std::filesystem::path &path);
 
 #endif
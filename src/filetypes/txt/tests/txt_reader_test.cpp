@@ -0,0 +1,151 @@
+#include "../txt_reader.h"
+
+#include <gtest/gtest.h>
+
+#include <fstream>
+#include <vector>
+
+namespace
+{
+
+class NullCache: public DocReaderCache
+{
+public:
+    std::optional<std::string> read(const std::string &, const std::string &) const override { return {}; }
+    void write(const std::string &, const std::string &, const std::string &) override {}
+};
+
+std::filesystem::path write_temp_file(const std::string &name, const std::string &contents)
+{
+    auto path = std::filesystem::temp_directory_path() / name;
+    std::ofstream file(path, std::ios::binary);
+    file << contents;
+    return path;
+}
+
+std::vector<DocAddr> read_all(TokenIter &it, int direction, std::vector<std::string> &text_out)
+{
+    std::vector<DocAddr> addresses;
+    const DocToken *token;
+    while ((token = it.read(direction)))
+    {
+        text_out.emplace_back(token->text);
+        addresses.push_back(token->address);
+    }
+    return addresses;
+}
+
+} // namespace
+
+TEST(TXT_READER, read_lines)
+{
+    auto path = write_temp_file("txt_reader_test_lines.txt", "one two\r\n\tthree \n\n\nfour");
+    NullCache cache;
+    TxtReader reader(path);
+    ASSERT_TRUE(reader.open(cache));
+
+    std::vector<std::string> text;
+    auto it = reader.get_iter();
+    auto addresses = read_all(*it, 1, text);
+
+    std::vector<std::string> expected_text = {"one two", "    three", "", "", "four"};
+    std::vector<DocAddr> expected_addresses = {0, 6, 11, 11, 11};
+    EXPECT_EQ(text, expected_text);
+    EXPECT_EQ(addresses, expected_addresses);
+
+    std::vector<std::string> backward_text;
+    read_all(*it, -1, backward_text);
+    EXPECT_EQ(backward_text, std::vector<std::string>(expected_text.rbegin(), expected_text.rend()));
+
+    std::filesystem::remove(path);
+}
+
+TEST(TXT_READER, worker_iter)
+{
+    auto path = write_temp_file("txt_reader_test_worker_iter.txt", "one two\r\n\tthree \n\n\nfour");
+    NullCache cache;
+    TxtReader reader(path);
+    ASSERT_TRUE(reader.open(cache));
+
+    auto worker_it = reader.get_worker_iter();
+    ASSERT_TRUE(worker_it);
+    std::vector<std::string> text;
+    auto addresses = read_all(*worker_it, 1, text);
+
+    std::vector<std::string> iter_text;
+    auto it = reader.get_iter();
+    EXPECT_EQ(addresses, read_all(*it, 1, iter_text));
+    EXPECT_EQ(text, iter_text);
+
+    // Seeks within its own index
+    worker_it->seek(6);
+    const DocToken *token = worker_it->read(1);
+    ASSERT_TRUE(token);
+    EXPECT_EQ(token->text, "    three");
+
+    std::filesystem::remove(path);
+    ASSERT_FALSE(reader.get_worker_iter());
+}
+
+TEST(TXT_READER, seek)
+{
+    auto path = write_temp_file("txt_reader_test_seek.txt", "abc\n\n\ndef\n");
+    NullCache cache;
+    TxtReader reader(path);
+    ASSERT_TRUE(reader.open(cache));
+
+    // Exact match picks the first line with the address
+    auto it = reader.get_iter(3);
+    const DocToken *token = it->read(1);
+    ASSERT_TRUE(token);
+    EXPECT_EQ(token->address, 3);
+    EXPECT_EQ(token->text, "");
+
+    // Otherwise the last line before it
+    it->seek(5);
+    token = it->read(1);
+    ASSERT_TRUE(token);
+    EXPECT_EQ(token->address, 3);
+    EXPECT_EQ(token->text, "def");
+
+    it->seek(100);
+    token = it->read(1);
+    ASSERT_TRUE(token);
+    EXPECT_EQ(token->text, "def");
+    EXPECT_EQ(it->read(1), nullptr);
+
+    std::filesystem::remove(path);
+}
+
+TEST(TXT_READER, seek_across_chunks)
+{
+    std::string contents;
+    for (int i = 0; i < 20000; ++i)
+    {
+        contents += (i % 3 == 0) ? "\n" : "word" + std::to_string(i) + "\n";
+    }
+    auto path = write_temp_file("txt_reader_test_chunks.txt", contents);
+    NullCache cache;
+    TxtReader reader(path);
+    ASSERT_TRUE(reader.open(cache));
+    EXPECT_TRUE(reader.is_progress_estimated());
+
+    std::vector<std::string> text;
+    auto it = reader.get_iter();
+    auto addresses = read_all(*it, 1, text);
+    ASSERT_EQ(addresses.size(), 20000);
+
+    for (uint32_t i = 0; i < addresses.size(); i += 997)
+    {
+        auto seek_it = reader.get_iter(addresses[i]);
+        const DocToken *token = seek_it->read(1);
+        ASSERT_TRUE(token);
+        EXPECT_EQ(token->address, addresses[i]);
+    }
+
+    while (reader.run_background_task());
+    EXPECT_FALSE(reader.is_progress_estimated());
+    EXPECT_EQ(reader.get_global_progress_percent(addresses.back()), 99);
+
+    std::filesystem::remove(path);
+}
@@ -0,0 +1,181 @@
+#include "./txt_line_index.h"
+
+#include "doc_api/token_addressing.h"
+#include "util/str_utils.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace
+{
+
+// Seeks scan at most one chunk of lines past the closest checkpoint
+constexpr uint64_t CHUNK_BYTES = 16 * 1024;
+constexpr uint32_t SPACES_PER_TAB = 4;
+
+} // namespace
+
+bool TxtLineIndex::open(const std::filesystem::path &path)
+{
+    chunks.clear();
+    indexed_bytes = 0;
+    indexed_address = 0;
+    return file.open(path);
+}
+
+const char *TxtLineIndex::data() const
+{
+    return file.data();
+}
+
+uint64_t TxtLineIndex::size() const
+{
+    return file.size();
+}
+
+bool TxtLineIndex::index_next_chunk()
+{
+    if (complete())
+    {
+        return false;
+    }
+
+    chunks.push_back({indexed_bytes, indexed_address});
+
+    uint64_t offset = indexed_bytes;
+    while (offset < size() && offset - chunks.back().offset < CHUNK_BYTES)
+    {
+        read_line(offset, line_buffer);
+        indexed_address += get_address_width(line_buffer);
+        offset = next_line(offset);
+    }
+    indexed_bytes = offset;
+
+    return !complete();
+}
+
+bool TxtLineIndex::complete() const
+{
+    return indexed_bytes >= size();
+}
+
+uint64_t TxtLineIndex::num_indexed_bytes() const
+{
+    return indexed_bytes;
+}
+
+DocAddr TxtLineIndex::num_indexed_address() const
+{
+    return indexed_address;
+}
+
+uint64_t TxtLineIndex::find_line(DocAddr address, DocAddr &line_address_out)
+{
+    while (!complete() && indexed_address < address)
+    {
+        index_next_chunk();
+    }
+
+    // Start from the last chunk before address, so the first of any lines
+    // sharing the address is found
+    uint64_t offset = 0;
+    DocAddr line_address = 0;
+    auto it = std::lower_bound(
+        chunks.begin(),
+        chunks.end(),
+        address,
+        [](const Chunk &chunk, DocAddr address) { return chunk.address < address; }
+    );
+    if (it != chunks.begin())
+    {
+        --it;
+        offset = it->offset;
+        line_address = it->address;
+    }
+
+    uint64_t best_offset = offset;
+    DocAddr best_address = line_address;
+    while (offset < size())
+    {
+        if (line_address > address)
+        {
+            break;
+        }
+
+        best_offset = offset;
+        best_address = line_address;
+        if (line_address == address)
+        {
+            break;
+        }
+
+        read_line(offset, line_buffer);
+        line_address += get_address_width(line_buffer);
+        offset = next_line(offset);
+    }
+
+    line_address_out = best_address;
+    return best_offset;
+}
+
+uint64_t TxtLineIndex::next_line(uint64_t offset) const
+{
+    if (offset >= size())
+    {
+        return size();
+    }
+    const char *newline = static_cast<const char *>(memchr(data() + offset, '\n', size() - offset));
+    return newline ? newline - data() + 1 : size();
+}
+
+uint64_t TxtLineIndex::prev_line(uint64_t offset) const
+{
+    uint64_t end = std::min(offset, size());
+    if (end > 0 && data()[end - 1] == '\n')
+    {
+        --end;
+    }
+
+    while (end > 0 && data()[end - 1] != '\n')
+    {
+        --end;
+    }
+    return end;
+}
+
+void TxtLineIndex::read_line(uint64_t offset, std::string &line_out) const
+{
+    line_out.clear();
+    if (offset >= size())
+    {
+        return;
+    }
+
+    const char *c = data() + offset;
+    const char *end = data() + next_line(offset);
+    for (; c < end && *c != '\n'; ++c)
+    {
+        if (*c == '\0')
+        {
+            // Lines used to be stripped as C strings
+            break;
+        }
+        else if (*c == '\r')
+        {
+            continue;
+        }
+        else if (*c == '\t')
+        {
+            line_out.append(SPACES_PER_TAB, ' ');
+        }
+        else
+        {
+            line_out.push_back(*c);
+        }
+    }
+
+    while (!line_out.empty() && is_whitespace(line_out.back()))
+    {
+        line_out.pop_back();
+    }
+}
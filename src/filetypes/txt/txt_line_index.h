@@ -0,0 +1,55 @@
+#ifndef TXT_LINE_INDEX_H_
+#define TXT_LINE_INDEX_H_
+
+#include "doc_api/doc_addr.h"
+#include "sys/mapped_file.h"
+
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+// Line oriented access to a memory mapped text file. Each line is one token.
+// Line addresses are indexed in chunks as needed, so opening a file and
+// reading near the start does not require scanning the whole file.
+class TxtLineIndex
+{
+    struct Chunk
+    {
+        uint64_t offset;    // byte offset of first line in chunk
+        DocAddr address;    // address of first line in chunk
+    };
+
+    MappedFile file;
+    std::vector<Chunk> chunks;
+    uint64_t indexed_bytes = 0;     // end of indexed lines
+    DocAddr indexed_address = 0;    // address of the line at indexed_bytes
+    std::string line_buffer;
+
+public:
+    bool open(const std::filesystem::path &path);
+
+    const char *data() const;
+    uint64_t size() const;
+
+    // Index one chunk of lines. Return true if more remain.
+    bool index_next_chunk();
+    bool complete() const;
+    // Bytes and address width covered by the index so far
+    uint64_t num_indexed_bytes() const;
+    DocAddr num_indexed_address() const;
+
+    // Locate the line containing address, indexing further if needed. Picks the
+    // first line at address if several share it, the last line before it otherwise.
+    uint64_t find_line(DocAddr address, DocAddr &line_address_out);
+
+    // Offset of the line after the one starting at offset
+    uint64_t next_line(uint64_t offset) const;
+    // Offset of the line before the one starting at offset, which must be > 0
+    uint64_t prev_line(uint64_t offset) const;
+
+    // Display text of the line starting at offset
+    void read_line(uint64_t offset, std::string &line_out) const;
+};
+
+#endif
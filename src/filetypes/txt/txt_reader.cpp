@@ -1,50 +1,44 @@
 #include "./txt_reader.h"
+#include "./txt_line_index.h"
 #include "./txt_token_iter.h"
 #include "doc_api/token_addressing.h"
-#include "util/str_utils.h"
 
 #include "extern/hash-library/md5.h"
 
-#include <fstream>
 #include <iostream>
+#include <string>
 
 namespace
 {
 
-constexpr uint32_t SPACES_PER_TAB = 4;
+// Files up to this size are identified by a hash of their full contents
+constexpr uint64_t FULL_HASH_MAX_BYTES = 16 * 1024 * 1024;
+constexpr uint64_t SAMPLE_HASH_BYTES = 1024 * 1024;
 
-bool tokenize_text_file(const std::filesystem::path &path, std::vector<std::unique_ptr<DocToken>> &tokens_out, std::string &md5_out)
+// Chunks of lines to index per background task
+constexpr uint32_t INDEX_CHUNKS_PER_TASK = 64;
+
+std::string compute_id(const char *data, uint64_t size)
 {
-    std::ifstream file(path);
-    if (!file.is_open())
+    MD5 md5;
+    if (size <= FULL_HASH_MAX_BYTES)
     {
-        return false;
+        // Hash of every line terminated by a newline, as files were originally read
+        md5.add(data, size);
+        if (size && data[size - 1] != '\n')
+        {
+            md5.add("\n", 1);
+        }
     }
-
-    DocAddr cur_address = 0;
-
-    std::string line;
-    MD5 md5;
-    while (std::getline(file, line))
+    else
     {
-        md5.add(line.c_str(), line.size());
-        md5.add("\n", 1);
-
-        line = strip_whitespace_right(
-            convert_tabs_to_space(
-                remove_carriage_returns(line),
-                SPACES_PER_TAB 
-            )
-        );
-
-        tokens_out.emplace_back(std::make_unique<TextDocToken>(cur_address, line));
-
-        cur_address += get_address_width(*tokens_out.back().get());
+        // Hashing everything would dominate open time, sample the ends instead
+        std::string header = "sampled:" + std::to_string(size) + "\n";
+        md5.add(header.c_str(), header.size());
+        md5.add(data, SAMPLE_HASH_BYTES);
+        md5.add(data + size - SAMPLE_HASH_BYTES, SAMPLE_HASH_BYTES);
     }
-
-    md5_out = md5.getHash();
-
-    return true;
+    return md5.getHash();
 }
 
 } // namespace
@@ -53,17 +47,44 @@ struct TxtReaderState
 {
     std::filesystem::path path;
     std::vector<TocItem> toc;
-    std::vector<std::unique_ptr<DocToken>> tokens;
+    TxtLineIndex index;
     std::string md5;
     bool is_open = false;
-    uint32_t total_address_width = 0;
 
     TxtReaderState(const std::filesystem::path &path)
         : path(path)
     {
     }
+
+    // Total address width, estimated from the indexed portion until indexing completes
+    uint64_t total_address_width() const
+    {
+        if (index.complete())
+        {
+            return index.num_indexed_address();
+        }
+        if (index.num_indexed_bytes() == 0)
+        {
+            return index.size() / 2;
+        }
+        return index.num_indexed_address() * index.size() / index.num_indexed_bytes();
+    }
 };
 
+std::optional<DocMetadata> txt_read_metadata(const std::filesystem::path &path)
+{
+    TxtLineIndex index;
+    if (!index.open(path))
+    {
+        return std::nullopt;
+    }
+
+    DocMetadata metadata;
+    metadata.id = compute_id(index.data(), index.size());
+    metadata.title = path.stem();
+    return metadata;
+}
+
 TxtReader::TxtReader(const std::filesystem::path &path)
     : state(std::make_unique<TxtReaderState>(path))
 {
@@ -79,12 +100,15 @@ bool TxtReader::open(DocReaderCache &)
     {
         return true;
     }
-    state->is_open = tokenize_text_file(state->path, state->tokens, state->md5);
-    if (state->is_open && state->tokens.size())
+
+    if (!state->index.open(state->path))
     {
-        const auto *last_token = state->tokens.back().get();
-        state->total_address_width = last_token->address + get_address_width(*last_token);
+        return false;
     }
+    state->md5 = compute_id(state->index.data(), state->index.size());
+    // Small files are fully indexed up front
+    state->index.index_next_chunk();
+    state->is_open = true;
 
     return state->is_open;
 }
@@ -111,8 +135,8 @@ TocPosition TxtReader::get_toc_position(const DocAddr &address) const
 
 uint32_t TxtReader::get_global_progress_percent(const DocAddr &address) const
 {
-    uint32_t pos = address;
-    uint32_t size = state->total_address_width;
+    uint64_t pos = address;
+    uint64_t size = state->total_address_width();
 
     if (!size)
     {
@@ -122,6 +146,23 @@ uint32_t TxtReader::get_global_progress_percent(const DocAddr &address) const
     return std::min(pos, size) * 100 / size;
 }
 
+bool TxtReader::is_progress_estimated() const
+{
+    return !state->index.complete();
+}
+
+bool TxtReader::run_background_task()
+{
+    for (uint32_t i = 0; i < INDEX_CHUNKS_PER_TASK; ++i)
+    {
+        if (!state->index.index_next_chunk())
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
 DocAddr TxtReader::get_toc_item_address(uint32_t) const
 {
     return 0;
@@ -129,7 +170,18 @@ DocAddr TxtReader::get_toc_item_address(uint32_t) const
 
 std::shared_ptr<TokenIter> TxtReader::get_iter(DocAddr address) const
 {
-    return std::make_shared<TxtTokenIter>(state->tokens, address);
+    return std::make_shared<TxtTokenIter>(state->index, address);
+}
+
+std::shared_ptr<TokenIter> TxtReader::get_worker_iter() const
+{
+    // Lines are read from a mapping and index of its own
+    auto index = std::make_shared<TxtLineIndex>();
+    if (!index->open(state->path))
+    {
+        return nullptr;
+    }
+    return std::make_shared<TxtTokenIter>(index);
 }
 
 std::vector<char> TxtReader::load_resource(const std::filesystem::path &) const
@@ -29,10 +29,16 @@ public:
     DocAddr get_toc_item_address(uint32_t toc_item_index) const override;
 
     uint32_t get_global_progress_percent(const DocAddr &address) const override;
+    bool is_progress_estimated() const override;
+    bool run_background_task() override;
 
     std::shared_ptr<TokenIter> get_iter(DocAddr address = 0) const override;
+    std::shared_ptr<TokenIter> get_worker_iter() const override;
 
     std::vector<char> load_resource(const std::filesystem::path &path) const override;
 };
 
+// Title from the file name. Hashes the file to identify it, as open does.
+std::optional<DocMetadata> txt_read_metadata(const std::filesystem::path &path);
+
 #endif
@@ -1,65 +1,59 @@
 #include "./txt_token_iter.h"
 
-TxtTokenIter::TxtTokenIter(const std::vector<std::unique_ptr<DocToken>> &tokens, DocAddr address)
-    : tokens(tokens)
+#include "./txt_line_index.h"
+#include "doc_api/token_addressing.h"
+
+TxtTokenIter::TxtTokenIter(TxtLineIndex &index, DocAddr address)
+    : index(index)
 {
     seek(address);
 }
 
+TxtTokenIter::TxtTokenIter(std::shared_ptr<TxtLineIndex> index)
+    : owned_index(index)
+    , index(*index)
+{
+}
+
 TxtTokenIter::TxtTokenIter(const TxtTokenIter &other)
-    : i(other.i)
-    , tokens(other.tokens)
+    : owned_index(other.owned_index)
+    , index(other.index)
+    , offset(other.offset)
+    , address(other.address)
 {
 }
 
 const DocToken *TxtTokenIter::read(int direction)
 {
-    uint32_t read_pos;
-
     if (direction < 0)
     {
-        if (i == 0)
+        if (offset == 0)
         {
             return nullptr;
         }
-        read_pos = --i;
+        offset = index.prev_line(offset);
+        index.read_line(offset, line);
+        address -= get_address_width(line);
+        current_token = DocToken(TokenType::Text, address, line);
     }
     else
     {
-        if (i >= tokens.size())
+        if (offset >= index.size())
         {
             return nullptr;
         }
-        read_pos = i++;
-    }
-
-    if (read_pos >= tokens.size())
-    {
-        return nullptr;
+        index.read_line(offset, line);
+        current_token = DocToken(TokenType::Text, address, line);
+        address += get_address_width(line);
+        offset = index.next_line(offset);
     }
 
-    return tokens[read_pos].get();
+    return &current_token;
 }
 
 void TxtTokenIter::seek(DocAddr address)
 {
-    for (uint32_t j = 0; j < tokens.size(); ++j)
-    {
-        DocAddr other_address = tokens[j]->address;
-        if (other_address <= address)
-        {
-            i = j;
-            // stop at first match in case of duplicates
-            if (other_address == address)
-            {
-                break;
-            }
-        }
-        else
-        {
-            break;
-        }
-    }
+    offset = index.find_line(address, this->address);
 }
 
 std::shared_ptr<TokenIter> TxtTokenIter::clone() const
@@ -3,15 +3,26 @@
 
 #include "doc_api/token_iter.h"
 
-#include <vector>
+#include <memory>
+#include <string>
 
+class TxtLineIndex;
+
+// Reads one token per line directly from the mapped file
 class TxtTokenIter: public TokenIter
 {
-    uint32_t i = 0;
-    const std::vector<std::unique_ptr<DocToken>> &tokens;
+    std::shared_ptr<TxtLineIndex> owned_index;
+    TxtLineIndex &index;
+    uint64_t offset = 0;    // next line read going forward
+    DocAddr address = 0;    // address of that line
+
+    std::string line;
+    DocToken current_token;
 
 public:
-    TxtTokenIter(const std::vector<std::unique_ptr<DocToken>> &tokens, DocAddr address);
+    TxtTokenIter(TxtLineIndex &index, DocAddr address);
+    // Starts at the beginning of an index of its own
+    TxtTokenIter(std::shared_ptr<TxtLineIndex> index);
     TxtTokenIter(const TxtTokenIter &);
 
     const DocToken *read(int direction) override;
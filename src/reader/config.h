@@ -5,6 +5,41 @@
 
 #define IDLE_SAVE_TIME_SEC 60
 
+// Reading position changes are synced to disk at most this often
+#define ADDRESS_SYNC_INTERVAL_MS 2000
+
+// Threads for background work such as parsing upcoming chapters. One per
+// core, up to this many.
+#define MAX_WORKER_THREADS 4
+
+// Books read for titles at once while indexing the file browser
+#define LIBRARY_INDEX_JOBS_IN_FLIGHT 2
+
+// Cover thumbnails in the file browser, as tall as this fraction of the
+// screen. Decoding a cover is memory heavy, so one is made at a time.
+#define COVER_THUMBS_PER_SCREEN 10
+#define COVER_THUMB_JOBS_IN_FLIGHT 1
+#define COVER_CACHE_MAX_ENTRIES 1024
+
+// Laid out lines kept around the reading position
+#define MAX_BUFFERED_DISPLAY_LINES 2048
+
+// Lines laid out per background step when building the page map, from
+// tokens read on a worker in batches
+#define PAGE_MAP_LINES_PER_STEP 256
+#define PAGE_MAP_TOKENS_PER_BATCH 512
+#define PAGE_MAP_CACHE_KEY_PREFIX "page_map_"
+#define READING_WORDS_PER_MINUTE 250
+
+// Parsed chapters and search indexes kept on disk, across all books. Books
+// opened least recently are dropped first.
+#define BOOK_FILES_MAX_BYTES (64ull << 20)
+
+#define SEARCH_INDEX_FILE_NAME "search_index"
+#define SEARCH_INDEX_TOKENS_PER_BATCH 1024
+#define SEARCH_MAX_RESULTS 100
+#define SEARCH_SNIPPET_CHARS 48
+
 #ifndef USER_FONTS
 #define FONT_DIR            "resources/fonts"
 #define EXTRA_FONT_DIR      ""
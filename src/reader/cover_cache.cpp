@@ -0,0 +1,376 @@
+#include "./cover_cache.h"
+
+#include "doc_api/doc_reader.h"
+#include "util/checksum.h"
+#include "util/jpeg_decode.h"
+#include "util/sdl_utils.h"
+#include "util/string_serialization.h"
+#include "util/str_utils.h"
+
+#include "extern/rotozoom/SDL_rotozoom.h"
+
+#include <SDL/SDL_video.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+
+#define DEBUG 0
+
+namespace
+{
+
+constexpr char FILE_MAGIC[4] = {'P', 'X', 'C', 'A'};
+constexpr uint32_t FILE_VERSION = 1;
+
+// checksum, key, sequence, width, height
+constexpr uint32_t SLOT_HEADER_SIZE = 44;
+constexpr uint32_t KEY_SIZE = 32;
+constexpr uint32_t KEY_OFFSET = 4;
+constexpr uint32_t SEQUENCE_OFFSET = KEY_OFFSET + KEY_SIZE;
+constexpr uint32_t SIZE_OFFSET = SEQUENCE_OFFSET + 4;
+
+bool read_exact(int fd, char *out, size_t size, uint64_t offset)
+{
+    while (size)
+    {
+        ssize_t n = pread(fd, out, size, offset);
+        if (n <= 0)
+        {
+            return false;
+        }
+        out += n;
+        size -= n;
+        offset += n;
+    }
+    return true;
+}
+
+bool write_exact(int fd, const char *data, size_t size, uint64_t offset)
+{
+    while (size)
+    {
+        ssize_t n = pwrite(fd, data, size, offset);
+        if (n <= 0)
+        {
+            return false;
+        }
+        data += n;
+        size -= n;
+        offset += n;
+    }
+    return true;
+}
+
+// Everything that must match for the slots to be used
+std::string atlas_header(uint32_t width, uint32_t height, const SDL_PixelFormat *format)
+{
+    std::string header(FILE_MAGIC, sizeof(FILE_MAGIC));
+    put_u32(header, FILE_VERSION);
+    put_u32(header, width);
+    put_u32(header, height);
+    put_u32(header, format->BitsPerPixel);
+    put_u32(header, format->Rmask);
+    put_u32(header, format->Gmask);
+    put_u32(header, format->Bmask);
+    put_u32(header, format->Amask);
+    return header;
+}
+
+std::string slot_key(const char *slot)
+{
+    const char *key = slot + KEY_OFFSET;
+    return std::string(key, strnlen(key, KEY_SIZE));
+}
+
+} // namespace
+
+surface_unique_ptr make_cover_thumbnail(const DocCover &cover, uint32_t max_width, uint32_t max_height, SDL_PixelFormat *format)
+{
+    std::string img_format = to_lower(cover.format);
+
+    // Covers are often large JPEGs, let the decoder do most of the scaling
+    surface_unique_ptr image;
+    if (img_format == "jpg" || img_format == "jpeg")
+    {
+        auto decoded = decode_jpeg_downscaled(cover.data.data(), cover.data.size(), max_width);
+        if (decoded)
+        {
+            image = surface_unique_ptr { SDL_ConvertSurface(decoded.get(), format, 0) };
+        }
+    }
+    if (!image)
+    {
+        image = load_surface_from_ptr(cover.data.data(), cover.data.size(), img_format, format);
+    }
+    if (!image || image->w <= 0 || image->h <= 0)
+    {
+        return nullptr;
+    }
+
+    double scale = std::min(
+        max_width / static_cast<double>(image->w),
+        max_height / static_cast<double>(image->h)
+    );
+    int w = std::max(1, static_cast<int>(image->w * scale));
+    int h = std::max(1, static_cast<int>(image->h * scale));
+    auto zoomed = surface_unique_ptr { zoomSurface(image.get(), (w + 0.5) / image->w, (h + 0.5) / image->h, 1) };
+    if (!zoomed)
+    {
+        return nullptr;
+    }
+
+    // zoomSurface outputs 32 bit pixels for most source depths
+    return surface_unique_ptr { SDL_ConvertSurface(zoomed.get(), format, 0) };
+}
+
+CoverCache::CoverCache(std::filesystem::path path, uint32_t width, uint32_t height, const SDL_PixelFormat *format, uint32_t max_slots)
+    : path(path),
+      width(width),
+      height(height),
+      bytes_per_pixel(format->BytesPerPixel),
+      rmask(format->Rmask),
+      gmask(format->Gmask),
+      bmask(format->Bmask),
+      amask(format->Amask),
+      file_header(atlas_header(width, height, format)),
+      max_slots(max_slots)
+{
+    open_atlas();
+}
+
+CoverCache::~CoverCache()
+{
+    if (fd >= 0)
+    {
+        ::close(fd);
+    }
+}
+
+uint32_t CoverCache::slot_size() const
+{
+    return SLOT_HEADER_SIZE + width * height * bytes_per_pixel;
+}
+
+uint64_t CoverCache::slot_offset(uint32_t slot) const
+{
+    return file_header.size() + static_cast<uint64_t>(slot) * slot_size();
+}
+
+void CoverCache::open_atlas()
+{
+    fd = ::open(path.c_str(), O_RDWR | O_CREAT, 0644);
+    if (fd < 0)
+    {
+        std::cerr << "Unable to open cover cache " << path << std::endl;
+        return;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0)
+    {
+        ::close(fd);
+        fd = -1;
+        return;
+    }
+    uint64_t disk_size = st.st_size;
+
+    std::string header(file_header.size(), 0);
+    if (
+        disk_size < file_header.size() ||
+        !read_exact(fd, header.data(), header.size(), 0) ||
+        header != file_header
+    )
+    {
+        // Thumbnails are only a cache, start over
+        #if DEBUG
+        std::cerr << "Starting new cover cache " << path << std::endl;
+        #endif
+        if (ftruncate(fd, 0) != 0 || !write_exact(fd, file_header.data(), file_header.size(), 0))
+        {
+            std::cerr << "Unable to write cover cache " << path << std::endl;
+            ::close(fd);
+            fd = -1;
+        }
+        return;
+    }
+
+    // Only slot headers are read here, pixels are checked when loaded
+    uint32_t num_slots = std::min<uint64_t>((disk_size - file_header.size()) / slot_size(), max_slots);
+    slot_keys.resize(num_slots);
+    slot_sequences.resize(num_slots, 0);
+    for (uint32_t slot = 0; slot < num_slots; ++slot)
+    {
+        char slot_header[SLOT_HEADER_SIZE];
+        if (!read_exact(fd, slot_header, SLOT_HEADER_SIZE, slot_offset(slot)))
+        {
+            break;
+        }
+
+        std::string key = slot_key(slot_header);
+        uint32_t sequence = get_u32(slot_header + SEQUENCE_OFFSET);
+        if (key.empty())
+        {
+            continue;
+        }
+        next_sequence = std::max(next_sequence, sequence + 1);
+
+        // A book thumbnailed again after its slot was found damaged is in two
+        // slots. The newer wins, and the other is left free to be reused.
+        auto it = key_to_slot.find(key);
+        if (it != key_to_slot.end())
+        {
+            if (slot_sequences[it->second] > sequence)
+            {
+                continue;
+            }
+            slot_keys[it->second].clear();
+            slot_sequences[it->second] = 0;
+        }
+        key_to_slot[key] = slot;
+        slot_keys[slot] = key;
+        slot_sequences[slot] = sequence;
+    }
+}
+
+uint32_t CoverCache::thumbnail_width() const
+{
+    return width;
+}
+
+uint32_t CoverCache::thumbnail_height() const
+{
+    return height;
+}
+
+uint32_t CoverCache::slot_to_replace() const
+{
+    if (slot_keys.size() < max_slots)
+    {
+        return slot_keys.size();
+    }
+    return std::min_element(slot_sequences.begin(), slot_sequences.end()) - slot_sequences.begin();
+}
+
+bool CoverCache::load(const std::string &book_id, surface_unique_ptr &thumbnail_out)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    thumbnail_out.reset();
+
+    auto it = key_to_slot.find(book_id);
+    if (fd < 0 || it == key_to_slot.end())
+    {
+        return false;
+    }
+    uint32_t slot = it->second;
+
+    std::vector<char> data(slot_size());
+    bool ok = read_exact(fd, data.data(), data.size(), slot_offset(slot));
+    uint32_t w = get_u32(data.data() + SIZE_OFFSET, 2);
+    uint32_t h = get_u32(data.data() + SIZE_OFFSET + 2, 2);
+    uint32_t row_size = w * bytes_per_pixel;
+    ok = (
+        ok &&
+        w <= width && h <= height &&
+        slot_key(data.data()) == book_id &&
+        get_u32(data.data()) == crc32(data.data() + KEY_OFFSET, SLOT_HEADER_SIZE - KEY_OFFSET + row_size * h)
+    );
+    if (!ok)
+    {
+        std::cerr << "Damaged cover thumbnail for " << book_id << std::endl;
+        key_to_slot.erase(it);
+        slot_keys[slot].clear();
+        slot_sequences[slot] = 0;
+        return false;
+    }
+
+    if (w == 0 || h == 0)
+    {
+        return true;
+    }
+
+    thumbnail_out = surface_unique_ptr { SDL_CreateRGBSurface(
+        SDL_SWSURFACE,
+        w,
+        h,
+        bytes_per_pixel * 8,
+        rmask,
+        gmask,
+        bmask,
+        amask
+    ) };
+    if (!thumbnail_out)
+    {
+        return false;
+    }
+    const char *pixels = data.data() + SLOT_HEADER_SIZE;
+    for (uint32_t y = 0; y < h; ++y)
+    {
+        std::memcpy(static_cast<char *>(thumbnail_out->pixels) + y * thumbnail_out->pitch, pixels + y * row_size, row_size);
+    }
+
+    return true;
+}
+
+bool CoverCache::store(const std::string &book_id, const SDL_Surface *thumbnail)
+{
+    if (book_id.empty() || book_id.size() > KEY_SIZE)
+    {
+        return false;
+    }
+
+    uint32_t w = thumbnail ? std::min<uint32_t>(thumbnail->w, width) : 0;
+    uint32_t h = thumbnail ? std::min<uint32_t>(thumbnail->h, height) : 0;
+    uint32_t row_size = w * bytes_per_pixel;
+
+    // Whole slots are written so the file always ends on a slot boundary
+    std::vector<char> data(slot_size(), 0);
+    std::memcpy(data.data() + KEY_OFFSET, book_id.data(), book_id.size());
+    data[SIZE_OFFSET] = static_cast<char>(w & 0xFF);
+    data[SIZE_OFFSET + 1] = static_cast<char>(w >> 8);
+    data[SIZE_OFFSET + 2] = static_cast<char>(h & 0xFF);
+    data[SIZE_OFFSET + 3] = static_cast<char>(h >> 8);
+    for (uint32_t y = 0; y < h; ++y)
+    {
+        std::memcpy(data.data() + SLOT_HEADER_SIZE + y * row_size, static_cast<const char *>(thumbnail->pixels) + y * thumbnail->pitch, row_size);
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+    if (fd < 0)
+    {
+        return false;
+    }
+
+    auto it = key_to_slot.find(book_id);
+    uint32_t slot = it != key_to_slot.end() ? it->second : slot_to_replace();
+    uint32_t sequence = next_sequence++;
+    set_u32(data.data() + SEQUENCE_OFFSET, sequence);
+    set_u32(data.data(), crc32(data.data() + KEY_OFFSET, SLOT_HEADER_SIZE - KEY_OFFSET + row_size * h));
+
+    if (slot == slot_keys.size())
+    {
+        slot_keys.emplace_back();
+        slot_sequences.push_back(0);
+    }
+    else if (!slot_keys[slot].empty())
+    {
+        key_to_slot.erase(slot_keys[slot]);
+    }
+    slot_keys[slot].clear();
+    slot_sequences[slot] = 0;
+
+    if (!write_exact(fd, data.data(), data.size(), slot_offset(slot)))
+    {
+        std::cerr << "Unable to write cover cache " << path << std::endl;
+        return false;
+    }
+
+    key_to_slot[book_id] = slot;
+    slot_keys[slot] = book_id;
+    slot_sequences[slot] = sequence;
+
+    return true;
+}
@@ -0,0 +1,68 @@
+#ifndef COVER_CACHE_H_
+#define COVER_CACHE_H_
+
+#include "util/sdl_pointer.h"
+
+#include <cstdint>
+#include <filesystem>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+struct DocCover;
+struct SDL_PixelFormat;
+
+// Decode a cover and scale it to fit within max_width x max_height, converted
+// to format. Safe to call from a worker thread.
+surface_unique_ptr make_cover_thumbnail(const DocCover &cover, uint32_t max_width, uint32_t max_height, SDL_PixelFormat *format);
+
+// Cover thumbnails of books in the file browser, scaled and converted to the
+// screen format ahead of time so showing one only copies its pixels.
+//
+// Thumbnails are packed into the fixed size slots of one atlas file, keyed by
+// book id. A slot can also record that a book has no cover, so it isn't looked
+// for again. Slots are checksummed but not synced, damaged ones read as
+// missing. The atlas starts over if the thumbnail size or pixel format
+// changes, and once full the oldest slots are reused. Safe to use from
+// several threads.
+class CoverCache
+{
+    std::filesystem::path path;
+    uint32_t width;
+    uint32_t height;
+    uint32_t bytes_per_pixel;
+    uint32_t rmask, gmask, bmask, amask;
+    std::string file_header;
+    uint32_t max_slots;
+
+    std::mutex mutex;
+    int fd = -1;
+    std::unordered_map<std::string, uint32_t> key_to_slot;
+    std::vector<std::string> slot_keys;
+    std::vector<uint32_t> slot_sequences;
+    uint32_t next_sequence = 1;
+
+    void open_atlas();
+    uint32_t slot_size() const;
+    uint64_t slot_offset(uint32_t slot) const;
+    uint32_t slot_to_replace() const;
+
+public:
+    CoverCache(std::filesystem::path path, uint32_t width, uint32_t height, const SDL_PixelFormat *format, uint32_t max_slots);
+    CoverCache(const CoverCache &) = delete;
+    CoverCache &operator=(const CoverCache &) = delete;
+    ~CoverCache();
+
+    uint32_t thumbnail_width() const;
+    uint32_t thumbnail_height() const;
+
+    // False if the book is not cached. Otherwise thumbnail_out is its cover,
+    // or null if it has none.
+    bool load(const std::string &book_id, surface_unique_ptr &thumbnail_out);
+    // A null thumbnail records that the book has no cover. Thumbnails must be
+    // in the cache's format and are cropped to its size.
+    bool store(const std::string &book_id, const SDL_Surface *thumbnail);
+};
+
+#endif
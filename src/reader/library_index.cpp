@@ -0,0 +1,113 @@
+#include "./library_index.h"
+
+#include "util/string_serialization.h"
+
+#include <sys/stat.h>
+
+#include <iostream>
+
+namespace
+{
+
+void put_string(std::string &buf, const std::string &str)
+{
+    put_u32(buf, str.size());
+    buf += str;
+}
+
+// size, mtime, book id, title, author
+std::string encode_entry(const FileFingerprint &fingerprint, const LibraryEntry &entry)
+{
+    std::string value;
+    put_u64(value, fingerprint.size);
+    put_u64(value, fingerprint.mtime);
+    put_string(value, entry.book_id);
+    put_string(value, entry.title);
+    put_string(value, entry.author);
+    return value;
+}
+
+bool decode_entry(const std::string &value, FileFingerprint &fingerprint, LibraryEntry &entry)
+{
+    ByteReader reader(value);
+    fingerprint.size = reader.get(8);
+    fingerprint.mtime = static_cast<int64_t>(reader.get(8));
+    entry.book_id = reader.get_bytes(reader.get(4));
+    entry.title = reader.get_bytes(reader.get(4));
+    entry.author = reader.get_bytes(reader.get(4));
+    return reader.ok && reader.pos == reader.end;
+}
+
+} // namespace
+
+bool FileFingerprint::operator==(const FileFingerprint &other) const
+{
+    return size == other.size && mtime == other.mtime;
+}
+
+std::optional<FileFingerprint> get_file_fingerprint(const std::filesystem::path &path)
+{
+    struct stat st;
+    if (stat(path.c_str(), &st) != 0)
+    {
+        return std::nullopt;
+    }
+    int64_t mtime_ns = static_cast<int64_t>(st.st_mtim.tv_sec) * 1000000000 + st.st_mtim.tv_nsec;
+    return FileFingerprint{static_cast<uint64_t>(st.st_size), mtime_ns};
+}
+
+LibraryIndex::LibraryIndex(std::filesystem::path path)
+    : store(path)
+{
+}
+
+std::optional<LibraryEntry> LibraryIndex::get(const std::filesystem::path &path, const FileFingerprint &fingerprint) const
+{
+    auto value = store.get(path.parent_path(), path.filename());
+    if (!value)
+    {
+        return std::nullopt;
+    }
+
+    FileFingerprint indexed_fingerprint;
+    LibraryEntry entry;
+    if (!decode_entry(*value, indexed_fingerprint, entry))
+    {
+        std::cerr << "Invalid library entry for " << path << std::endl;
+        return std::nullopt;
+    }
+    if (!(indexed_fingerprint == fingerprint))
+    {
+        return std::nullopt;
+    }
+    return entry;
+}
+
+void LibraryIndex::put(const std::filesystem::path &path, const FileFingerprint &fingerprint, const LibraryEntry &entry)
+{
+    store.put(path.parent_path(), path.filename(), encode_entry(fingerprint, entry));
+}
+
+void LibraryIndex::retain(const std::filesystem::path &dir, const std::set<std::string> &names)
+{
+    for (const auto &name : store.get_keys(dir))
+    {
+        if (names.count(name) == 0)
+        {
+            store.erase(dir, name);
+        }
+    }
+}
+
+bool LibraryIndex::flush()
+{
+    if (!store.flush())
+    {
+        return false;
+    }
+    if (store.should_compact())
+    {
+        store.compact();
+    }
+    return true;
+}
@@ -0,0 +1,50 @@
+#ifndef LIBRARY_INDEX_H_
+#define LIBRARY_INDEX_H_
+
+#include "util/record_store.h"
+
+#include <cstdint>
+#include <filesystem>
+#include <optional>
+#include <set>
+#include <string>
+
+// Identifies a version of a file without reading it
+struct FileFingerprint
+{
+    uint64_t size;
+    int64_t mtime;
+
+    bool operator==(const FileFingerprint &other) const;
+};
+
+std::optional<FileFingerprint> get_file_fingerprint(const std::filesystem::path &path);
+
+struct LibraryEntry
+{
+    std::string book_id;    // empty if the book could not be read
+    std::string title;
+    std::string author;
+};
+
+// Metadata of books seen in the file browser, kept on disk so that listing a
+// directory doesn't open every book. Entries are grouped by directory, keyed
+// by file name, and only used while the file's fingerprint matches the one
+// it was indexed with.
+class LibraryIndex
+{
+    mutable RecordStore store;
+
+public:
+    LibraryIndex(std::filesystem::path path);
+
+    std::optional<LibraryEntry> get(const std::filesystem::path &path, const FileFingerprint &fingerprint) const;
+    // Buffered until flush
+    void put(const std::filesystem::path &path, const FileFingerprint &fingerprint, const LibraryEntry &entry);
+    // Forget files in dir that are not in names
+    void retain(const std::filesystem::path &dir, const std::set<std::string> &names);
+
+    bool flush();
+};
+
+#endif
@@ -1,7 +1,10 @@
 #include "./config.h"
+#include "./cover_cache.h"
 #include "./font_catalog.h"
+#include "./library_index.h"
 #include "./settings_store.h"
 #include "./shoulder_keymap.h"
+#include "./ss_doc_reader_cache.h"
 #include "./state_store.h"
 #include "./system_styling.h"
 #include "./color_theme_def.h"
@@ -18,6 +21,8 @@
 #include "util/key_value_file.h"
 #include "util/math.h"
 #include "util/sdl_font_cache.h"
+#include "util/sdl_image_cache.h"
+#include "util/string_serialization.h"
 #include "util/task_queue.h"
 #include "util/timer.h"
 
@@ -26,11 +31,12 @@
 
 #include <csignal>
 #include <iostream>
+#include <thread>
 
 namespace
 {
 
-void initialize_views(ViewStack &view_stack, StateStore &state_store, SystemStyling &sys_styling, TokenViewStyling &token_view_styling, TaskQueue &task_queue, int argc, char **argv)
+void initialize_views(ViewStack &view_stack, StateStore &state_store, LibraryIndex &library_index, CoverCache &cover_cache, DocReaderCache &reader_cache, SystemStyling &sys_styling, TokenViewStyling &token_view_styling, TaskQueue &task_queue, int argc, char **argv)
 {
     std::string strPath = "";
     if (argc == 2)
@@ -42,10 +48,14 @@ void initialize_views(ViewStack &view_stack, StateStore &state_store, SystemStyl
     auto browse_path = state_store.get_current_browse_path().value_or(DEFAULT_BROWSE_PATH);
     std::shared_ptr<FileSelector> fs = std::make_shared<FileSelector>(
         browse_path,
-        sys_styling
+        sys_styling,
+        library_index,
+        cover_cache,
+        state_store,
+        [&task_queue](task_func work, task_func on_done){ task_queue.submit_background(work, on_done); }
     );
 
-    auto load_book = [&view_stack, &state_store, &sys_styling, &token_view_styling, &task_queue, &argc, &argv](std::filesystem::path path) {
+    auto load_book = [&view_stack, &state_store, &reader_cache, &sys_styling, &token_view_styling, &task_queue, &argc, &argv](std::filesystem::path path) {
         if (argc < 2 && (!std::filesystem::exists(path) || !file_type_is_supported(path)))
         {
             return;
@@ -57,7 +67,9 @@ void initialize_views(ViewStack &view_stack, StateStore &state_store, SystemStyl
                 token_view_styling,
                 view_stack,
                 state_store,
-                [&task_queue](task_func task){ task_queue.submit(task); }
+                reader_cache,
+                [&task_queue](task_func task){ task_queue.submit(task); },
+                [&task_queue](task_func work, task_func on_done){ task_queue.submit_background(work, on_done); }
             )
         );
     };
@@ -154,6 +166,8 @@ void signal_handler(int)
 }
 
 const char *CONFIG_KEY_STORE_PATH = "store_path";
+const char *CONFIG_KEY_IMAGE_CACHE_MB = "image_cache_mb";
+const char *CONFIG_KEY_IMAGE_CACHE_POLICY = "image_cache_policy";
 
 std::unordered_map<std::string, std::string> load_config_with_defaults()
 {
@@ -162,6 +176,42 @@ std::unordered_map<std::string, std::string> load_config_with_defaults()
     return config;
 }
 
+void apply_image_cache_config(const std::unordered_map<std::string, std::string> &config)
+{
+    uint64_t budget_bytes = DEFAULT_IMAGE_CACHE_SIZE_BYTES;
+    ImageCachePolicy policy = ImageCachePolicy::LeastRecentlyUsed;
+
+    auto it = config.find(CONFIG_KEY_IMAGE_CACHE_MB);
+    if (it != config.end())
+    {
+        auto megabytes = try_decode_uint(it->second);
+        if (megabytes && *megabytes > 0)
+        {
+            budget_bytes = static_cast<uint64_t>(*megabytes) * 1024 * 1024;
+        }
+        else
+        {
+            std::cerr << "Invalid " << CONFIG_KEY_IMAGE_CACHE_MB << ": " << it->second << std::endl;
+        }
+    }
+
+    it = config.find(CONFIG_KEY_IMAGE_CACHE_POLICY);
+    if (it != config.end())
+    {
+        auto configured_policy = image_cache_policy_from_string(it->second);
+        if (configured_policy)
+        {
+            policy = *configured_policy;
+        }
+        else
+        {
+            std::cerr << "Invalid " << CONFIG_KEY_IMAGE_CACHE_POLICY << ": " << it->second << std::endl;
+        }
+    }
+
+    set_image_cache_defaults(budget_bytes, policy);
+}
+
 } // namespace
 
 int main(int argc, char **argv)
@@ -183,6 +233,9 @@ int main(int argc, char **argv)
 
     std::cout << "Screen Size: " << SCREEN_WIDTH << "x" << SCREEN_HEIGHT << std::endl;
 
+    // Initialize libxml2 before worker threads use it
+    xmlInitParser();
+
     // SDL Init
     SDL_Init(SDL_INIT_VIDEO);
     SDL_ShowCursor(SDL_DISABLE);
@@ -195,6 +248,16 @@ int main(int argc, char **argv)
 
     auto config = load_config_with_defaults();
     StateStore state_store(config[CONFIG_KEY_STORE_PATH]);
+    SSDocReaderCache reader_cache(state_store);
+    LibraryIndex library_index(std::filesystem::path(config[CONFIG_KEY_STORE_PATH]) / "library_index");
+    CoverCache cover_cache(
+        std::filesystem::path(config[CONFIG_KEY_STORE_PATH]) / "cover_thumbnails",
+        SCREEN_HEIGHT / COVER_THUMBS_PER_SCREEN * 3 / 4,
+        SCREEN_HEIGHT / COVER_THUMBS_PER_SCREEN,
+        screen->format,
+        COVER_CACHE_MAX_ENTRIES
+    );
+    apply_image_cache_config(config);
 
     // Preload & check fonts
     auto init_font_name = get_valid_font_name(settings_get_font_name(state_store).value_or(DEFAULT_FONT_NAME));
@@ -235,9 +298,9 @@ int main(int argc, char **argv)
     });
 
     // Setup views
-    TaskQueue task_queue;
+    TaskQueue task_queue(bound(std::thread::hardware_concurrency(), 1, MAX_WORKER_THREADS));
     ViewStack view_stack;
-    initialize_views(view_stack, state_store, sys_styling, token_view_styling, task_queue, argc, argv);
+    initialize_views(view_stack, state_store, library_index, cover_cache, reader_cache, sys_styling, token_view_styling, task_queue, argc, argv);
 
     std::shared_ptr<SettingsView> settings_view = std::make_shared<SettingsView>(
         sys_styling,
@@ -370,7 +433,17 @@ int main(int argc, char **argv)
 
             if (view_stack.render(screen, force_render))
             {
-                SDL_BlitSurface(screen, NULL, video, NULL);
+                // Only copy the areas that changed, when the view reports them
+                auto dirty_rects = view_stack.get_dirty_rects();
+                if (dirty_rects.empty())
+                {
+                    SDL_BlitSurface(screen, NULL, video, NULL);
+                }
+                for (auto &rect : dirty_rects)
+                {
+                    SDL_Rect dest_rect = rect;
+                    SDL_BlitSurface(screen, &rect, video, &dest_rect);
+                }
                 SDL_Flip(video);
             }
         }
@@ -380,6 +453,9 @@ int main(int argc, char **argv)
             limit_fps();
         }
 
+        // Sync the last reading position once scrolling settles
+        state_store.sync_book_addresses();
+
         if (idle_timer.elapsed_sec() >= IDLE_SAVE_TIME_SEC)
         {
             // Make sure state is saved in case device auto-powers down. Don't seem
@@ -390,7 +466,9 @@ int main(int argc, char **argv)
     }
 
     view_stack.shutdown();
+    task_queue.stop_workers();
     state_store.flush();
+    library_index.flush();
 
     SDL_FreeSurface(screen);
     SDL_Quit();
@@ -0,0 +1,119 @@
+#include "./page_map.h"
+
+#include <algorithm>
+#include <sstream>
+
+#define PAGE_MAP_ENCODING_VERSION "1"
+
+PageMap::PageMap(std::vector<DocAddr> line_addresses, uint32_t num_words)
+    : line_addresses(std::move(line_addresses)), num_words(num_words)
+{
+}
+
+uint32_t PageMap::num_lines() const
+{
+    return line_addresses.size();
+}
+
+uint32_t PageMap::num_pages(uint32_t lines_per_page) const
+{
+    if (!lines_per_page)
+    {
+        return 0;
+    }
+    return (num_lines() + lines_per_page - 1) / lines_per_page;
+}
+
+uint32_t PageMap::line_for_address(DocAddr address) const
+{
+    auto it = std::upper_bound(line_addresses.begin(), line_addresses.end(), address);
+    if (it == line_addresses.begin())
+    {
+        return 0;
+    }
+    return (it - line_addresses.begin()) - 1;
+}
+
+uint32_t PageMap::page_for_line(uint32_t line, uint32_t lines_per_page) const
+{
+    if (!lines_per_page || !num_lines())
+    {
+        return 0;
+    }
+    return std::min(line, num_lines() - 1) / lines_per_page;
+}
+
+DocAddr PageMap::page_address(uint32_t page, uint32_t lines_per_page) const
+{
+    if (line_addresses.empty())
+    {
+        return 0;
+    }
+    uint64_t line = static_cast<uint64_t>(page) * lines_per_page;
+    return line_addresses[std::min<uint64_t>(line, line_addresses.size() - 1)];
+}
+
+uint32_t PageMap::minutes_left(uint32_t line, uint32_t words_per_minute) const
+{
+    if (!words_per_minute || line >= num_lines())
+    {
+        return 0;
+    }
+    uint64_t words_left = static_cast<uint64_t>(num_words) * (num_lines() - line) / num_lines();
+    return (words_left + words_per_minute - 1) / words_per_minute;
+}
+
+// "<version> <num_words> <addr0>,<addr1 - addr0>,..." with addresses as hex deltas
+std::string PageMap::encode() const
+{
+    std::ostringstream ss;
+    ss << PAGE_MAP_ENCODING_VERSION << " " << num_words << " " << std::hex;
+
+    DocAddr prev = 0;
+    for (size_t i = 0; i < line_addresses.size(); ++i)
+    {
+        if (i)
+        {
+            ss << ',';
+        }
+        ss << line_addresses[i] - prev;
+        prev = line_addresses[i];
+    }
+
+    return ss.str();
+}
+
+std::optional<PageMap> PageMap::decode(const std::string &encoded)
+{
+    std::istringstream ss(encoded);
+    std::string version;
+    uint32_t num_words;
+    if (!(ss >> version >> num_words) || version != PAGE_MAP_ENCODING_VERSION)
+    {
+        return std::nullopt;
+    }
+
+    std::vector<DocAddr> line_addresses;
+    DocAddr address = 0;
+    std::string delta_str;
+    ss >> std::ws;
+    while (std::getline(ss, delta_str, ','))
+    {
+        size_t parsed = 0;
+        try
+        {
+            address += std::stoull(delta_str, &parsed, 16);
+        }
+        catch (const std::exception &)
+        {
+            return std::nullopt;
+        }
+        if (parsed != delta_str.size())
+        {
+            return std::nullopt;
+        }
+        line_addresses.push_back(address);
+    }
+
+    return PageMap(std::move(line_addresses), num_words);
+}
@@ -0,0 +1,39 @@
+#ifndef PAGE_MAP_H_
+#define PAGE_MAP_H_
+
+#include "doc_api/doc_addr.h"
+
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <vector>
+
+// Address of every display line in a book for one layout (font, size and
+// screen width). Pages are runs of lines_per_page lines from the start.
+class PageMap
+{
+    std::vector<DocAddr> line_addresses;
+    uint32_t num_words = 0;
+
+public:
+    PageMap() = default;
+    // Line addresses must be non-decreasing
+    PageMap(std::vector<DocAddr> line_addresses, uint32_t num_words);
+
+    uint32_t num_lines() const;
+    uint32_t num_pages(uint32_t lines_per_page) const;
+
+    // Last line starting at or before address
+    uint32_t line_for_address(DocAddr address) const;
+    // Zero based page holding the line
+    uint32_t page_for_line(uint32_t line, uint32_t lines_per_page) const;
+    DocAddr page_address(uint32_t page, uint32_t lines_per_page) const;
+
+    // Reading time for the lines after line, assuming words are spread evenly
+    uint32_t minutes_left(uint32_t line, uint32_t words_per_minute) const;
+
+    std::string encode() const;
+    static std::optional<PageMap> decode(const std::string &encoded);
+};
+
+#endif
@@ -6,10 +6,12 @@
 
 enum class ProgressReporting {
     CHAPTER_PERCENT,
-    GLOBAL_PERCENT
+    GLOBAL_PERCENT,
+    PAGE_NUMBER
 };
 
 ProgressReporting get_next_progress_reporting(ProgressReporting progress_reporting);
+const char *get_progress_reporting_display_name(ProgressReporting progress_reporting);
 
 std::optional<ProgressReporting> decode_progress_reporting(std::string progress_reporting);
 std::string encode_progress_reporting(ProgressReporting progress_reporting);
@@ -0,0 +1,478 @@
+#include "./search_index.h"
+
+#include "doc_api/token_addressing.h"
+#include "sys/mapped_file.h"
+#include "util/checksum.h"
+#include "util/str_utils.h"
+#include "util/string_serialization.h"
+#include "util/utf8.h"
+
+#include <algorithm>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <thread>
+#include <unordered_map>
+
+// Longer words are indexed by their prefix
+#define MAX_WORD_BYTES 32
+
+// Address units allowed between consecutive query words, for punctuation
+#define MAX_WORD_GAP 3
+
+namespace
+{
+
+uint32_t decode_code_point(const char *s, const char *end)
+{
+    unsigned char c = *s;
+    int num_continuation = c >= 0xF0 ? 3 : c >= 0xE0 ? 2 : c >= 0xC0 ? 1 : 0;
+    uint32_t code_point = c & (0x3F >> num_continuation);
+    for (int i = 1; i <= num_continuation && s + i < end; ++i)
+    {
+        code_point = (code_point << 6) | (s[i] & 0x3F);
+    }
+    return code_point;
+}
+
+bool is_word_char(const char *s, const char *end)
+{
+    char c = *s;
+    if (!(c & 0x80))
+    {
+        return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9');
+    }
+
+    // Non-ASCII text is part of words, apart from common punctuation such as
+    // curly quotes, dashes and non-breaking spaces
+    uint32_t code_point = decode_code_point(s, end);
+    return !(
+        (code_point >= 0x00A0 && code_point <= 0x00BF) ||
+        (code_point >= 0x2000 && code_point <= 0x206F) ||
+        (code_point >= 0x3000 && code_point <= 0x303F)
+    );
+}
+
+char to_lower_ascii(char c)
+{
+    return (c >= 'A' && c <= 'Z') ? c - 'A' + 'a' : c;
+}
+
+constexpr char FILE_MAGIC[4] = {'P', 'X', 'S', 'I'};
+constexpr uint32_t FILE_VERSION = 1;
+constexpr size_t CHECKSUM_SIZE = 4;
+
+// Addresses of one word, in document order
+struct Postings
+{
+    const DocAddr *begin;
+    const DocAddr *end;
+};
+
+// First address in [lower, upper]
+bool has_address_in_range(const Postings &postings, DocAddr lower, DocAddr upper)
+{
+    auto it = std::lower_bound(postings.begin, postings.end, lower);
+    return it != postings.end && *it <= upper;
+}
+
+// Address deltas are mostly small, so are stored 7 bits per byte
+void put_varint(std::string &buf, uint64_t value)
+{
+    while (value >= 0x80)
+    {
+        buf.push_back(static_cast<char>((value & 0x7F) | 0x80));
+        value >>= 7;
+    }
+    buf.push_back(static_cast<char>(value));
+}
+
+uint64_t get_varint(ByteReader &reader)
+{
+    uint64_t value = 0;
+    for (int shift = 0; shift < 64 && reader.has(1); shift += 7)
+    {
+        uint8_t byte = reader.get(1);
+        value |= static_cast<uint64_t>(byte & 0x7F) << shift;
+        if (!(byte & 0x80))
+        {
+            return value;
+        }
+    }
+    reader.ok = false;
+    return 0;
+}
+
+} // namespace
+
+std::vector<SearchWord> split_search_words(std::string_view text)
+{
+    std::vector<SearchWord> words;
+
+    const char *s = text.data();
+    const char *end = s + text.size();
+    uint32_t offset = 0;
+    bool in_word = false;
+    while (s < end)
+    {
+        const char *next = utf8_step(s, end);
+        if (is_word_char(s, end))
+        {
+            if (!in_word)
+            {
+                words.push_back({"", offset});
+                in_word = true;
+            }
+            std::string &word = words.back().word;
+            if (word.size() + (next - s) <= MAX_WORD_BYTES)
+            {
+                for (const char *c = s; c < next; ++c)
+                {
+                    word.push_back(to_lower_ascii(*c));
+                }
+            }
+        }
+        else
+        {
+            in_word = false;
+        }
+
+        if (!is_whitespace(*s))
+        {
+            ++offset;
+        }
+        s = next;
+    }
+
+    return words;
+}
+
+std::string search_snippet(std::string_view text, uint32_t offset, uint32_t max_chars)
+{
+    const char *begin = text.data();
+    const char *end = begin + text.size();
+
+    // Character positions, so the snippet doesn't split a character
+    std::vector<const char *> chars;
+    size_t target = 0;
+    uint32_t address = 0;
+    for (const char *s = begin; s < end; s = utf8_step(s, end))
+    {
+        if (address <= offset)
+        {
+            target = chars.size();
+        }
+        chars.push_back(s);
+        if (!is_whitespace(*s))
+        {
+            ++address;
+        }
+    }
+    chars.push_back(end);
+
+    size_t num_chars = chars.size() - 1;
+    size_t first = target > max_chars / 4 ? target - max_chars / 4 : 0;
+    size_t last = std::min(num_chars, first + max_chars);
+
+    // Drop words cut off at either end
+    while (first > 0 && first < target && !is_whitespace(*chars[first - 1]))
+    {
+        ++first;
+    }
+    while (last < num_chars && last > target + 1 && !is_whitespace(*chars[last]))
+    {
+        --last;
+    }
+
+    std::string snippet(chars[first], chars[last]);
+    std::replace_if(snippet.begin(), snippet.end(), is_whitespace, ' ');
+    snippet = strip_whitespace(snippet);
+    if (first > 0)
+    {
+        snippet = "..." + snippet;
+    }
+    if (last < num_chars)
+    {
+        snippet += "...";
+    }
+    return snippet;
+}
+
+SearchIndex SearchIndex::build(const TokenArena &tokens)
+{
+    std::unordered_map<std::string, std::vector<DocAddr>> word_addresses;
+    for (size_t i = 0; i < tokens.size(); ++i)
+    {
+        DocToken token = tokens[i];
+        if (token.type == TokenType::Image)
+        {
+            continue;
+        }
+        for (const auto &[word, offset] : split_search_words(token.text))
+        {
+            word_addresses[word].push_back(token.address + offset);
+        }
+    }
+
+    SearchIndex index;
+    index.words.reserve(word_addresses.size());
+    size_t num_addresses = 0;
+    for (const auto &[word, addresses] : word_addresses)
+    {
+        index.words.push_back(word);
+        num_addresses += addresses.size();
+    }
+    std::sort(index.words.begin(), index.words.end());
+
+    index.word_starts.reserve(index.words.size() + 1);
+    index.addresses.reserve(num_addresses);
+    for (const auto &word : index.words)
+    {
+        auto it = word_addresses.find(word);
+        index.word_starts.push_back(index.addresses.size());
+        index.addresses.insert(index.addresses.end(), it->second.begin(), it->second.end());
+        word_addresses.erase(it);
+    }
+    index.word_starts.push_back(index.addresses.size());
+
+    return index;
+}
+
+SearchIndex SearchIndex::merge(const std::vector<const SearchIndex *> &parts)
+{
+    SearchIndex index;
+    size_t num_words = 0;
+    size_t num_addresses = 0;
+    for (const SearchIndex *part : parts)
+    {
+        num_words += part->words.size();
+        num_addresses += part->addresses.size();
+    }
+    index.words.reserve(num_words);
+    index.addresses.reserve(num_addresses);
+
+    for (const SearchIndex *part : parts)
+    {
+        index.words.insert(index.words.end(), part->words.begin(), part->words.end());
+    }
+    std::sort(index.words.begin(), index.words.end());
+    index.words.erase(std::unique(index.words.begin(), index.words.end()), index.words.end());
+    index.word_starts.reserve(index.words.size() + 1);
+
+    // Words are visited in order, so each part is read through once. Later
+    // parts hold later addresses, so appending keeps addresses in order.
+    std::vector<size_t> part_words(parts.size(), 0);
+    for (const auto &word : index.words)
+    {
+        index.word_starts.push_back(index.addresses.size());
+        for (size_t i = 0; i < parts.size(); ++i)
+        {
+            const SearchIndex &part = *parts[i];
+            size_t &part_word = part_words[i];
+            if (part_word < part.words.size() && part.words[part_word] == word)
+            {
+                index.addresses.insert(
+                    index.addresses.end(),
+                    part.addresses.begin() + part.word_starts[part_word],
+                    part.addresses.begin() + part.word_starts[part_word + 1]
+                );
+                ++part_word;
+            }
+        }
+    }
+    index.word_starts.push_back(index.addresses.size());
+    index.addresses.shrink_to_fit();
+
+    return index;
+}
+
+std::vector<DocAddr> SearchIndex::search(const std::string &query, uint32_t max_hits) const
+{
+    std::vector<SearchWord> query_words = split_search_words(query);
+    if (query_words.empty())
+    {
+        return {};
+    }
+
+    auto word_postings_at = [this](size_t i) {
+        return Postings {addresses.data() + word_starts[i], addresses.data() + word_starts[i + 1]};
+    };
+
+    // Addresses of each query word. The last word may match several index words.
+    std::vector<std::vector<Postings>> word_postings;
+    for (size_t i = 0; i < query_words.size(); ++i)
+    {
+        const std::string &word = query_words[i].word;
+        std::vector<Postings> postings;
+        auto it = std::lower_bound(words.begin(), words.end(), word);
+        if (i + 1 < query_words.size())
+        {
+            if (it != words.end() && *it == word)
+            {
+                postings.push_back(word_postings_at(it - words.begin()));
+            }
+        }
+        else
+        {
+            for (; it != words.end() && it->compare(0, word.size(), word) == 0; ++it)
+            {
+                postings.push_back(word_postings_at(it - words.begin()));
+            }
+        }
+
+        if (postings.empty())
+        {
+            return {};
+        }
+        word_postings.push_back(std::move(postings));
+    }
+
+    std::vector<DocAddr> candidates;
+    for (const Postings &postings : word_postings[0])
+    {
+        candidates.insert(candidates.end(), postings.begin, postings.end);
+    }
+    if (word_postings[0].size() > 1)
+    {
+        std::sort(candidates.begin(), candidates.end());
+    }
+
+    std::vector<DocAddr> hits;
+    for (DocAddr start : candidates)
+    {
+        // Each following word must start shortly after the previous one ends
+        DocAddr address = start;
+        bool matched = true;
+        for (size_t i = 1; i < query_words.size() && matched; ++i)
+        {
+            DocAddr next = address + get_address_width(query_words[i - 1].word);
+            matched = std::any_of(word_postings[i].begin(), word_postings[i].end(), [next](const Postings &postings) {
+                return has_address_in_range(postings, next, next + MAX_WORD_GAP);
+            });
+            if (matched && i + 1 < query_words.size())
+            {
+                address = *std::lower_bound(word_postings[i][0].begin, word_postings[i][0].end, next);
+            }
+        }
+
+        if (matched)
+        {
+            hits.push_back(start);
+            if (hits.size() >= max_hits)
+            {
+                break;
+            }
+        }
+    }
+
+    return hits;
+}
+
+// magic, version, word count, then per word its size and bytes, address
+// count and address deltas
+std::string SearchIndex::encode() const
+{
+    std::string encoded(FILE_MAGIC, sizeof(FILE_MAGIC));
+    put_u32(encoded, FILE_VERSION);
+    put_u32(encoded, words.size());
+    for (size_t i = 0; i < words.size(); ++i)
+    {
+        encoded.push_back(static_cast<char>(words[i].size()));
+        encoded += words[i];
+        put_varint(encoded, word_starts[i + 1] - word_starts[i]);
+
+        DocAddr prev = 0;
+        for (uint32_t j = word_starts[i]; j < word_starts[i + 1]; ++j)
+        {
+            put_varint(encoded, addresses[j] - prev);
+            prev = addresses[j];
+        }
+    }
+    return encoded;
+}
+
+std::optional<SearchIndex> SearchIndex::decode(std::string_view encoded)
+{
+    ByteReader reader(encoded);
+    if (reader.get_bytes(sizeof(FILE_MAGIC)) != std::string_view(FILE_MAGIC, sizeof(FILE_MAGIC)) || reader.get(4) != FILE_VERSION)
+    {
+        return std::nullopt;
+    }
+
+    SearchIndex index;
+    uint32_t num_words = reader.get(4);
+    for (uint32_t i = 0; i < num_words && reader.ok; ++i)
+    {
+        std::string_view word = reader.get_bytes(reader.get(1));
+        uint64_t num_addresses = get_varint(reader);
+        // Words must be sorted for lookups, and each address takes a byte
+        if (word.empty() || (i && word <= index.words.back()) || !reader.has(num_addresses))
+        {
+            return std::nullopt;
+        }
+
+        index.words.emplace_back(word);
+        index.word_starts.push_back(index.addresses.size());
+        DocAddr address = 0;
+        for (uint64_t j = 0; j < num_addresses; ++j)
+        {
+            address += get_varint(reader);
+            index.addresses.push_back(address);
+        }
+    }
+    index.word_starts.push_back(index.addresses.size());
+
+    if (!reader.ok || reader.pos != reader.end)
+    {
+        return std::nullopt;
+    }
+    return index;
+}
+
+bool SearchIndex::save(const std::filesystem::path &path) const
+{
+    std::string contents = encode();
+    put_u32(contents, crc32(contents.data(), contents.size()));
+
+    // The same book can be indexed by two jobs at once
+    auto tmp_path = path.string() + ".tmp" + std::to_string(std::hash<std::thread::id>()(std::this_thread::get_id()));
+    {
+        std::ofstream file(tmp_path, std::ios::binary | std::ios::trunc);
+        file.write(contents.data(), contents.size());
+        if (!file.good())
+        {
+            std::cerr << "Unable to write search index " << tmp_path << std::endl;
+            file.close();
+            std::error_code ec;
+            std::filesystem::remove(tmp_path, ec);
+            return false;
+        }
+    }
+
+    std::error_code ec;
+    std::filesystem::rename(tmp_path, path, ec);
+    if (ec)
+    {
+        std::cerr << "Unable to write search index " << path << std::endl;
+        std::filesystem::remove(tmp_path, ec);
+        return false;
+    }
+    return true;
+}
+
+std::optional<SearchIndex> SearchIndex::load(const std::filesystem::path &path)
+{
+    MappedFile file;
+    if (!file.open(path) || file.size() < CHECKSUM_SIZE)
+    {
+        return std::nullopt;
+    }
+
+    size_t body_size = file.size() - CHECKSUM_SIZE;
+    if (crc32(file.data(), body_size) != get_u32(file.data() + body_size))
+    {
+        std::cerr << "Corrupt search index " << path << std::endl;
+        return std::nullopt;
+    }
+    return decode(std::string_view(file.data(), body_size));
+}
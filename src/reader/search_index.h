@@ -0,0 +1,52 @@
+#ifndef SEARCH_INDEX_H_
+#define SEARCH_INDEX_H_
+
+#include "doc_api/token_arena.h"
+
+#include <cstdint>
+#include <filesystem>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+struct SearchWord
+{
+    std::string word;       // ASCII lower cased
+    uint32_t offset;        // address offset within the text
+};
+
+// Split text into searchable words. Runs of letters, digits and non-ASCII
+// characters form words; everything else separates them.
+std::vector<SearchWord> split_search_words(std::string_view text);
+
+// Around max_chars characters of text centered on the character at address offset
+std::string search_snippet(std::string_view text, uint32_t offset, uint32_t max_chars);
+
+// Inverted index of a book's words, kept as sorted words and their address
+// lists packed into one array.
+class SearchIndex
+{
+    std::vector<std::string> words;
+    std::vector<uint32_t> word_starts;  // word i's addresses start here, plus an end entry
+    std::vector<DocAddr> addresses;
+
+public:
+    // Index a batch of tokens. Safe to run on a worker thread.
+    static SearchIndex build(const TokenArena &tokens);
+    // Join the indexes of consecutive batches, given in document order
+    static SearchIndex merge(const std::vector<const SearchIndex *> &parts);
+
+    // Addresses where the query words appear in sequence, in document order.
+    // The last word matches as a prefix.
+    std::vector<DocAddr> search(const std::string &query, uint32_t max_hits) const;
+
+    std::string encode() const;
+    static std::optional<SearchIndex> decode(std::string_view encoded);
+
+    // Checksummed file of the encoded index. Not synced, damaged files fail to load.
+    bool save(const std::filesystem::path &path) const;
+    static std::optional<SearchIndex> load(const std::filesystem::path &path);
+};
+
+#endif
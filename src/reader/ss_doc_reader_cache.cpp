@@ -7,21 +7,25 @@ SSDocReaderCache::SSDocReaderCache(StateStore &store): store(store)
 
 std::optional<std::string> SSDocReaderCache::read(const std::string &book_id, const std::string &key) const
 {
-    const auto &kv = store.get_reader_cache(book_id);
-    const auto it = kv.find(key);
-    if (it == kv.end())
-    {
-        return {};
-    }
-    return it->second;
+    return store.get_reader_cache_entry(book_id, key);
+}
+
+std::optional<std::filesystem::path> SSDocReaderCache::get_file_dir(const std::string &book_id)
+{
+    return store.get_book_file_dir(book_id);
 }
 
 void SSDocReaderCache::write(const std::string &book_id, const std::string &key, const std::string &value)
 {
-    if (read(book_id, key) != value)
-    {
-        auto kv = store.get_reader_cache(book_id);
-        kv[key] = value;
-        store.set_reader_cache(book_id, kv);
-    }
+    store.set_reader_cache_entry(book_id, key, value);
+}
+
+std::vector<std::string> SSDocReaderCache::get_keys(const std::string &book_id) const
+{
+    return store.get_reader_cache_keys(book_id);
+}
+
+void SSDocReaderCache::erase(const std::string &book_id, const std::string &key)
+{
+    store.erase_reader_cache_entry(book_id, key);
 }
@@ -14,6 +14,9 @@ public:
 
     std::optional<std::string> read(const std::string &book_id, const std::string &key) const override;
     void write(const std::string &book_id, const std::string &key, const std::string &value) override;
+    std::vector<std::string> get_keys(const std::string &book_id) const override;
+    void erase(const std::string &book_id, const std::string &key) override;
+    std::optional<std::filesystem::path> get_file_dir(const std::string &book_id) override;
 };
 
 #endif
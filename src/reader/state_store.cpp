@@ -1,20 +1,34 @@
 #include "./state_store.h"
+#include "./config.h"
 #include "util/key_value_file.h"
+#include "util/string_serialization.h"
 
+#include <algorithm>
 #include <fstream>
+#include <iostream>
 #include <unordered_map>
 
+#define DEBUG 0
+
 namespace
 {
 
 constexpr const char *ACTIVITY_KEY_BROWSER_PATH = "browser_path";
 constexpr const char *ACTIVITY_KEY_BOOK_PATH = "book_path";
 constexpr const char *ADDRESS_KEY = "address";
+constexpr const char *PROGRESS_KEY = "progress";
+constexpr const char *READER_CACHE_KEY_PREFIX = "cache.";
+
+std::filesystem::path create_store_dir(const std::filesystem::path &base_dir)
+{
+    std::filesystem::create_directories(base_dir);
+    return base_dir;
+}
 
 /////////////////////////////////////
 // Activity Store
 
-void write_activity_store(const std::filesystem::path &path, const StateStore &store)
+bool write_activity_store(const std::filesystem::path &path, const StateStore &store)
 {
     string_unordered_map kv;
 
@@ -30,7 +44,7 @@ void write_activity_store(const std::filesystem::path &path, const StateStore &s
         kv[ACTIVITY_KEY_BOOK_PATH] = book_path.value().string();
     }
 
-    write_key_value(path, kv);
+    return write_key_value(path, kv);
 }
 
 std::pair<std::optional<std::string>, std::optional<std::string>> load_activity_store(const std::filesystem::path &path)
@@ -57,22 +71,44 @@ std::pair<std::optional<std::string>, std::optional<std::string>> load_activity_
 /////////////////////////////////////
 // Address Store
 
-std::filesystem::path address_store_path_for_book(const std::filesystem::path &base_path, const std::string &book_id)
+// Little endian, fixed width
+std::string encode_address_record(DocAddr address)
 {
-    return base_path / (book_id + ".address");
+    std::string value(sizeof(DocAddr), '\0');
+    for (size_t i = 0; i < value.size(); ++i)
+    {
+        value[i] = static_cast<char>((address >> (8 * i)) & 0xFF);
+    }
+    return value;
 }
 
-void write_book_address(const std::filesystem::path &path, const DocAddr &address)
+std::optional<DocAddr> decode_address_record(const std::string &value)
 {
-    string_unordered_map kv = {
-        {ADDRESS_KEY, encode_address(address)}
-    };
+    if (value.size() != sizeof(DocAddr))
+    {
+        return std::nullopt;
+    }
+
+    DocAddr address = 0;
+    for (size_t i = 0; i < value.size(); ++i)
+    {
+        address |= static_cast<DocAddr>(static_cast<uint8_t>(value[i])) << (8 * i);
+    }
+    return address;
+}
 
-    write_key_value(path, kv);
+std::filesystem::path legacy_address_path_for_book(const std::filesystem::path &base_path, const std::string &book_id)
+{
+    return base_path / (book_id + ".address");
 }
 
-std::optional<DocAddr> load_book_address(const std::filesystem::path &path)
+std::optional<DocAddr> load_legacy_book_address(const std::filesystem::path &path)
 {
+    if (!std::filesystem::exists(path))
+    {
+        return std::nullopt;
+    }
+
     auto kv = load_key_value(path);
     auto it = kv.find(ADDRESS_KEY);
     if (it == kv.end())
@@ -85,21 +121,50 @@ std::optional<DocAddr> load_book_address(const std::filesystem::path &path)
 /////////////////////////////////////
 // Reader Cache Store
 
-std::filesystem::path reader_cache_store_path_for_book(const std::filesystem::path &base_path, const std::string &book_id)
+std::filesystem::path legacy_reader_cache_path_for_book(const std::filesystem::path &base_path, const std::string &book_id)
 {
     return base_path / (book_id + ".cache");
 }
 
+uint64_t directory_size_bytes(const std::filesystem::path &dir)
+{
+    uint64_t size_bytes = 0;
+    std::error_code ec;
+    for (const auto &file : std::filesystem::recursive_directory_iterator(dir, ec))
+    {
+        uint64_t file_size = file.is_regular_file(ec) ? file.file_size(ec) : 0;
+        if (!ec)
+        {
+            size_bytes += file_size;
+        }
+    }
+    return size_bytes;
+}
+
 } // namespace
 
 StateStore::StateStore(std::filesystem::path base_dir)
+    : StateStore(base_dir, ADDRESS_SYNC_INTERVAL_MS)
+{
+}
+
+StateStore::StateStore(std::filesystem::path base_dir, uint32_t address_sync_interval_ms)
+    : StateStore(base_dir, address_sync_interval_ms, BOOK_FILES_MAX_BYTES)
+{
+}
+
+StateStore::StateStore(std::filesystem::path base_dir, uint32_t address_sync_interval_ms, uint64_t book_files_max_bytes)
     : activity_store_path(base_dir / "activity"),
-      book_data_root_path(base_dir / "books"),
+      book_data(create_store_dir(base_dir) / "book_data"),
+      address_journal(base_dir / "address_journal"),
+      address_sync_interval(address_sync_interval_ms),
+      last_address_sync(std::chrono::steady_clock::now() - address_sync_interval),
+      book_files_path(base_dir / "book_files"),
+      book_files_max_bytes(book_files_max_bytes),
+      legacy_book_data_path(base_dir / "books"),
       settings_store_path(base_dir / "settings"),
       settings(load_key_value(settings_store_path))
 {
-    std::filesystem::create_directories(base_dir);
-    std::filesystem::create_directories(book_data_root_path);
 
     auto [browse_path, book_path] = load_activity_store(activity_store_path);
     current_browse_path = browse_path;
@@ -158,55 +223,194 @@ void StateStore::remove_current_book_path()
 
 std::optional<DocAddr> StateStore::get_book_address(const std::string &book_id) const
 {
-    auto it = book_addresses.find(book_id);
-    if (it != book_addresses.end())
+    auto value = address_journal.get(book_id, ADDRESS_KEY);
+    if (!value)
     {
-        return it->second;
+        value = book_data.get(book_id, ADDRESS_KEY);
+    }
+    if (value)
+    {
+        return decode_address_record(*value);
     }
 
-    auto cache = load_book_address(
-        address_store_path_for_book(book_data_root_path, book_id)
-    );
-    if (cache)
+    auto legacy_path = legacy_address_path_for_book(legacy_book_data_path, book_id);
+    auto address = load_legacy_book_address(legacy_path);
+    if (address)
     {
-        book_addresses[book_id] = *cache;
+        book_data.put(book_id, ADDRESS_KEY, encode_address_record(*address));
+        migrated_legacy_files.insert(legacy_path);
     }
 
-    return cache;
+    return address;
 }
 
 void StateStore::set_book_address(const std::string &book_id, DocAddr address)
 {
-    auto it = book_addresses.find(book_id);
-    if (it == book_addresses.end() || it->second != address)
+    if (get_book_address(book_id) != address)
     {
-        book_addresses[book_id] = address;
+        address_journal.put(book_id, ADDRESS_KEY, encode_address_record(address));
+        sync_book_addresses();
     }
 }
 
-const string_unordered_map &StateStore::get_reader_cache(const std::string &book_id) const
+void StateStore::sync_book_addresses()
 {
-    auto it = book_reader_caches.find(book_id);
-    if (it != book_reader_caches.end())
+    // A single small synced append, but scrolling line by line changes the
+    // address many times a second
+    auto now = std::chrono::steady_clock::now();
+    if (address_journal.has_pending_writes() && now - last_address_sync >= address_sync_interval)
     {
-        return it->second;
+        address_journal.flush();
+        last_address_sync = now;
+    }
+}
+
+std::optional<uint32_t> StateStore::get_book_progress(const std::string &book_id) const
+{
+    auto value = book_data.get(book_id, PROGRESS_KEY);
+    return value ? try_decode_uint(*value) : std::nullopt;
+}
+
+void StateStore::set_book_progress(const std::string &book_id, uint32_t percent)
+{
+    if (get_book_progress(book_id) != percent)
+    {
+        book_data.put(book_id, PROGRESS_KEY, std::to_string(percent));
+    }
+}
+
+// Caches from older versions are copied into book_data the first time the
+// book's cache is used
+void StateStore::migrate_legacy_reader_cache(const std::string &book_id) const
+{
+    if (!legacy_cache_checked_books.insert(book_id).second)
+    {
+        return;
+    }
+
+    auto legacy_path = legacy_reader_cache_path_for_book(legacy_book_data_path, book_id);
+    if (!std::filesystem::exists(legacy_path))
+    {
+        return;
     }
 
-    book_reader_caches[book_id] = load_key_value(
-        reader_cache_store_path_for_book(book_data_root_path, book_id)
-    );
+    for (const auto &[key, value] : load_key_value(legacy_path))
+    {
+        if (!book_data.get(book_id, READER_CACHE_KEY_PREFIX + key))
+        {
+            book_data.put(book_id, READER_CACHE_KEY_PREFIX + key, value);
+        }
+    }
+    migrated_legacy_files.insert(legacy_path);
+}
 
-    return book_reader_caches[book_id];
+std::optional<std::string> StateStore::get_reader_cache_entry(const std::string &book_id, const std::string &key) const
+{
+    migrate_legacy_reader_cache(book_id);
+    return book_data.get(book_id, READER_CACHE_KEY_PREFIX + key);
 }
 
-void StateStore::set_reader_cache(const std::string &book_id, const string_unordered_map &new_cache)
+std::vector<std::string> StateStore::get_reader_cache_keys(const std::string &book_id) const
 {
-    const auto &cur_cache = get_reader_cache(book_id);
+    migrate_legacy_reader_cache(book_id);
 
-    if (cur_cache != new_cache)
+    std::vector<std::string> keys;
+    std::string prefix = READER_CACHE_KEY_PREFIX;
+    for (const auto &key : book_data.get_keys(book_id))
+    {
+        if (key.compare(0, prefix.size(), prefix) == 0)
+        {
+            keys.push_back(key.substr(prefix.size()));
+        }
+    }
+    return keys;
+}
+
+void StateStore::set_reader_cache_entry(const std::string &book_id, const std::string &key, const std::string &value)
+{
+    if (get_reader_cache_entry(book_id, key) != value)
     {
-        book_reader_caches[book_id] = new_cache;
-        reader_cache_dirty.emplace(book_id);
+        book_data.put(book_id, READER_CACHE_KEY_PREFIX + key, value);
+    }
+}
+
+void StateStore::erase_reader_cache_entry(const std::string &book_id, const std::string &key)
+{
+    migrate_legacy_reader_cache(book_id);
+    book_data.erase(book_id, READER_CACHE_KEY_PREFIX + key);
+}
+
+std::optional<std::filesystem::path> StateStore::get_book_file_dir(const std::string &book_id) const
+{
+    if (book_id.empty())
+    {
+        return std::nullopt;
+    }
+
+    auto dir = book_files_path / book_id;
+    std::error_code ec;
+    std::filesystem::create_directories(dir, ec);
+    if (ec)
+    {
+        std::cerr << "Unable to create " << dir << std::endl;
+        return std::nullopt;
+    }
+
+    // The first request each run marks the book as recently opened
+    if (opened_book_file_dirs.insert(book_id).second)
+    {
+        std::filesystem::last_write_time(dir, std::filesystem::file_time_type::clock::now(), ec);
+        trim_book_files(book_id);
+    }
+    return dir;
+}
+
+void StateStore::trim_book_files(const std::string &keep_book_id) const
+{
+    struct BookFiles
+    {
+        std::filesystem::path dir;
+        std::filesystem::file_time_type opened;
+        uint64_t size_bytes = 0;
+    };
+
+    std::vector<BookFiles> books;
+    uint64_t total_bytes = 0;
+    std::error_code ec;
+    for (const auto &entry : std::filesystem::directory_iterator(book_files_path, ec))
+    {
+        if (!entry.is_directory(ec) || entry.path().filename() == keep_book_id)
+        {
+            continue;
+        }
+
+        BookFiles book {entry.path(), entry.last_write_time(ec), directory_size_bytes(entry.path())};
+        total_bytes += book.size_bytes;
+        books.push_back(std::move(book));
+    }
+
+    total_bytes += directory_size_bytes(book_files_path / keep_book_id);
+
+    std::sort(books.begin(), books.end(), [](const BookFiles &a, const BookFiles &b) {
+        return a.opened < b.opened;
+    });
+    for (const auto &book : books)
+    {
+        if (total_bytes <= book_files_max_bytes)
+        {
+            break;
+        }
+
+        #if DEBUG
+        std::cerr << "Removing cached files " << book.dir << std::endl;
+        #endif
+        std::filesystem::remove_all(book.dir, ec);
+        if (ec)
+        {
+            std::cerr << "Unable to remove " << book.dir << std::endl;
+            continue;
+        }
+        total_bytes -= book.size_bytes;
     }
 }
 
@@ -234,38 +438,43 @@ void StateStore::flush() const
 {
     if (activity_dirty)
     {
-        write_activity_store(activity_store_path, *this);
-        activity_dirty = false;
+        activity_dirty = !write_activity_store(activity_store_path, *this);
     }
 
-    // book addresses
+    // Fold journaled addresses into the book store. The journal is only
+    // cleared once they are saved, so a crash in between replays them.
+    auto journaled_books = address_journal.get_groups();
+    for (const auto &book_id : journaled_books)
     {
-        for (const auto &[book_id, address] : book_addresses)
+        auto value = address_journal.get(book_id, ADDRESS_KEY);
+        if (value)
         {
-            write_book_address(
-                address_store_path_for_book(book_data_root_path, book_id),
-                address
-            );
+            book_data.put(book_id, ADDRESS_KEY, *value);
         }
-        book_addresses.clear();
     }
 
-    // book cache
+    // book addresses and caches
+    if (book_data.flush())
     {
-        for (const auto &book_id : reader_cache_dirty)
+        if (book_data.should_compact())
+        {
+            book_data.compact();
+        }
+        if (!journaled_books.empty())
+        {
+            address_journal.clear();
+        }
+
+        std::error_code ec;
+        for (const auto &path : migrated_legacy_files)
         {
-            const auto &cache = book_reader_caches[book_id];
-            write_key_value(
-                reader_cache_store_path_for_book(book_data_root_path, book_id),
-                cache
-            );
+            std::filesystem::remove(path, ec);
         }
-        reader_cache_dirty.clear();
+        migrated_legacy_files.clear();
     }
 
     if (settings_dirty)
     {
-        write_key_value(settings_store_path, settings);
-        settings_dirty = false;
+        settings_dirty = !write_key_value(settings_store_path, settings);
     }
 }
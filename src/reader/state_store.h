@@ -2,11 +2,14 @@
 #define STATE_STORE_H_
 
 #include "doc_api/doc_addr.h"
+#include "util/record_store.h"
 
+#include <chrono>
 #include <filesystem>
 #include <optional>
 #include <set>
 #include <unordered_map>
+#include <vector>
 
 using string_unordered_map = std::unordered_map<std::string, std::string>;
 
@@ -16,16 +19,30 @@ class StateStore {
 
     // activity
     std::filesystem::path activity_store_path;
-    mutable std::unordered_map<std::string, DocAddr> book_addresses; // using string key instead of path due to compile error on gcc 8.3.0
     std::optional<std::filesystem::path> current_browse_path;
     std::optional<std::filesystem::path> current_book_path;
 
-    // book addresses
-    std::filesystem::path book_data_root_path;
+    // book addresses and reader caches, grouped by book id
+    mutable RecordStore book_data;
 
-    // reader cache
-    mutable std::unordered_map<std::string, string_unordered_map> book_reader_caches;
-    mutable std::set<std::string> reader_cache_dirty;
+    // address changes, synced at most every address_sync_interval and folded
+    // into book_data on flush
+    mutable RecordStore address_journal;
+    std::chrono::milliseconds address_sync_interval;
+    std::chrono::steady_clock::time_point last_address_sync;
+
+    // directories of larger reader cache files, one per book. Once over
+    // budget, the least recently opened books' directories are removed.
+    std::filesystem::path book_files_path;
+    uint64_t book_files_max_bytes;
+    mutable std::set<std::string> opened_book_file_dirs;
+    void trim_book_files(const std::string &keep_book_id) const;
+
+    // per-book text files from older versions, removed once migrated
+    std::filesystem::path legacy_book_data_path;
+    mutable std::set<std::filesystem::path> migrated_legacy_files;
+    mutable std::set<std::string> legacy_cache_checked_books;
+    void migrate_legacy_reader_cache(const std::string &book_id) const;
 
     // settings
     std::filesystem::path settings_store_path;
@@ -33,6 +50,8 @@ class StateStore {
 
 public:
     StateStore(std::filesystem::path base_dir);
+    StateStore(std::filesystem::path base_dir, uint32_t address_sync_interval_ms);
+    StateStore(std::filesystem::path base_dir, uint32_t address_sync_interval_ms, uint64_t book_files_max_bytes);
     virtual ~StateStore();
 
     // activity
@@ -44,13 +63,23 @@ public:
     void set_current_book_path(std::filesystem::path path);
     void remove_current_book_path();
 
-    // book addresses
+    // book addresses, durable once synced. Changes between syncs are coalesced,
+    // call sync_book_addresses regularly so the last one is synced too.
     std::optional<DocAddr> get_book_address(const std::string &book_id) const;
     void set_book_address(const std::string &book_id, DocAddr address);
-
-    // reader cache
-    const string_unordered_map &get_reader_cache(const std::string &book_id) const;
-    void set_reader_cache(const std::string &book_id, const string_unordered_map &cache);
+    void sync_book_addresses();
+
+    // reading progress shown in the file browser, saved on flush
+    std::optional<uint32_t> get_book_progress(const std::string &book_id) const;
+    void set_book_progress(const std::string &book_id, uint32_t percent);
+
+    // reader cache, entries are read from disk when requested and saved on flush
+    std::optional<std::string> get_reader_cache_entry(const std::string &book_id, const std::string &key) const;
+    std::vector<std::string> get_reader_cache_keys(const std::string &book_id) const;
+    void set_reader_cache_entry(const std::string &book_id, const std::string &key, const std::string &value);
+    void erase_reader_cache_entry(const std::string &book_id, const std::string &key);
+    // created on request, nullopt if it could not be
+    std::optional<std::filesystem::path> get_book_file_dir(const std::string &book_id) const;
 
     // generic settings
     std::optional<std::string> get_setting(const std::string &name) const;
@@ -0,0 +1,204 @@
+#include "../cover_cache.h"
+#include "util/tests/temp_path.h"
+
+#include <SDL/SDL_video.h>
+#include <gtest/gtest.h>
+
+#include <cstring>
+#include <fstream>
+
+namespace
+{
+
+SDL_PixelFormat rgba_format()
+{
+    SDL_PixelFormat format = {};
+    format.BitsPerPixel = 32;
+    format.BytesPerPixel = 4;
+    format.Rmask = 0x00FF0000;
+    format.Gmask = 0x0000FF00;
+    format.Bmask = 0x000000FF;
+    return format;
+}
+
+surface_unique_ptr make_thumbnail(int w, int h, uint8_t seed)
+{
+    auto surface = surface_unique_ptr { SDL_CreateRGBSurface(SDL_SWSURFACE, w, h, 32, 0x00FF0000, 0x0000FF00, 0x000000FF, 0) };
+    auto *pixels = static_cast<uint8_t *>(surface->pixels);
+    for (int i = 0; i < surface->pitch * h; ++i)
+    {
+        pixels[i] = static_cast<uint8_t>(seed + i);
+    }
+    return surface;
+}
+
+bool same_pixels(const SDL_Surface *a, const SDL_Surface *b)
+{
+    if (a->w != b->w || a->h != b->h)
+    {
+        return false;
+    }
+    for (int y = 0; y < a->h; ++y)
+    {
+        if (std::memcmp(
+            static_cast<const char *>(a->pixels) + y * a->pitch,
+            static_cast<const char *>(b->pixels) + y * b->pitch,
+            a->w * 4
+        ) != 0)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+} // namespace
+
+TEST(COVER_CACHE, round_trip)
+{
+    auto path = fresh_temp_path("cover_cache_round_trip");
+    auto format = rgba_format();
+    auto wide = make_thumbnail(12, 9, 1);
+    {
+        CoverCache covers(path, 12, 16, &format, 8);
+        ASSERT_TRUE(covers.store("book-a", wide.get()));
+        ASSERT_TRUE(covers.store("book-b", nullptr));
+    }
+
+    CoverCache covers(path, 12, 16, &format, 8);
+    surface_unique_ptr thumbnail;
+    ASSERT_TRUE(covers.load("book-a", thumbnail));
+    ASSERT_TRUE(thumbnail);
+    ASSERT_TRUE(same_pixels(thumbnail.get(), wide.get()));
+
+    // Known to have no cover
+    ASSERT_TRUE(covers.load("book-b", thumbnail));
+    ASSERT_FALSE(thumbnail);
+
+    ASSERT_FALSE(covers.load("book-c", thumbnail));
+
+    // Replaced in place
+    auto size = std::filesystem::file_size(path);
+    auto tall = make_thumbnail(12, 16, 2);
+    ASSERT_TRUE(covers.store("book-b", tall.get()));
+    ASSERT_TRUE(covers.load("book-b", thumbnail));
+    ASSERT_TRUE(same_pixels(thumbnail.get(), tall.get()));
+    ASSERT_EQ(std::filesystem::file_size(path), size);
+}
+
+TEST(COVER_CACHE, format_change_starts_over)
+{
+    auto path = fresh_temp_path("cover_cache_format_change");
+    auto format = rgba_format();
+    auto image = make_thumbnail(12, 16, 3);
+    {
+        CoverCache covers(path, 12, 16, &format, 8);
+        ASSERT_TRUE(covers.store("book-a", image.get()));
+    }
+
+    surface_unique_ptr thumbnail;
+    ASSERT_FALSE(CoverCache(path, 24, 32, &format, 8).load("book-a", thumbnail));
+
+    auto other_format = rgba_format();
+    other_format.Rmask = 0x000000FF;
+    other_format.Bmask = 0x00FF0000;
+    {
+        CoverCache covers(path, 12, 16, &other_format, 8);
+        ASSERT_FALSE(covers.load("book-a", thumbnail));
+        ASSERT_TRUE(covers.store("book-a", image.get()));
+    }
+    ASSERT_TRUE(CoverCache(path, 12, 16, &other_format, 8).load("book-a", thumbnail));
+}
+
+TEST(COVER_CACHE, oldest_slots_reused_when_full)
+{
+    auto path = fresh_temp_path("cover_cache_full");
+    auto format = rgba_format();
+    auto image = make_thumbnail(4, 4, 4);
+    {
+        CoverCache covers(path, 4, 4, &format, 2);
+        ASSERT_TRUE(covers.store("book-a", image.get()));
+        ASSERT_TRUE(covers.store("book-b", image.get()));
+        ASSERT_TRUE(covers.store("book-c", image.get()));
+    }
+    auto full_size = std::filesystem::file_size(path);
+
+    CoverCache covers(path, 4, 4, &format, 2);
+    surface_unique_ptr thumbnail;
+    ASSERT_FALSE(covers.load("book-a", thumbnail));
+    ASSERT_TRUE(covers.load("book-b", thumbnail));
+    ASSERT_TRUE(covers.load("book-c", thumbnail));
+
+    // The slot order survives reopening
+    ASSERT_TRUE(covers.store("book-d", image.get()));
+    ASSERT_FALSE(covers.load("book-b", thumbnail));
+    ASSERT_TRUE(covers.load("book-c", thumbnail));
+    ASSERT_EQ(std::filesystem::file_size(path), full_size);
+}
+
+TEST(COVER_CACHE, damaged_slots_read_as_missing)
+{
+    auto path = fresh_temp_path("cover_cache_damaged");
+    auto format = rgba_format();
+    auto image = make_thumbnail(8, 8, 5);
+    {
+        CoverCache covers(path, 8, 8, &format, 4);
+        ASSERT_TRUE(covers.store("book-a", image.get()));
+        ASSERT_TRUE(covers.store("book-b", image.get()));
+    }
+
+    // Flip a pixel in the last slot
+    auto size = std::filesystem::file_size(path);
+    {
+        std::fstream file(path, std::ios::binary | std::ios::in | std::ios::out);
+        file.seekp(size - 10);
+        file.put('\xFF');
+    }
+
+    CoverCache covers(path, 8, 8, &format, 4);
+    surface_unique_ptr thumbnail;
+    ASSERT_TRUE(covers.load("book-a", thumbnail));
+    ASSERT_FALSE(covers.load("book-b", thumbnail));
+
+    // Thumbnailed again
+    ASSERT_TRUE(covers.store("book-b", image.get()));
+    ASSERT_TRUE(covers.load("book-b", thumbnail));
+    ASSERT_TRUE(same_pixels(thumbnail.get(), image.get()));
+}
+
+TEST(COVER_CACHE, superseded_slots_reused)
+{
+    auto path = fresh_temp_path("cover_cache_superseded");
+    auto format = rgba_format();
+    auto image = make_thumbnail(4, 4, 6);
+    uint64_t first_slot_end;
+    {
+        CoverCache covers(path, 4, 4, &format, 4);
+        ASSERT_TRUE(covers.store("book-a", image.get()));
+        first_slot_end = std::filesystem::file_size(path);
+        ASSERT_TRUE(covers.store("book-b", image.get()));
+    }
+
+    // Damage the first slot, so book-a is stored again in a new slot
+    {
+        std::fstream file(path, std::ios::binary | std::ios::in | std::ios::out);
+        file.seekp(first_slot_end - 10);
+        file.put('\xFF');
+    }
+    {
+        CoverCache covers(path, 4, 4, &format, 4);
+        surface_unique_ptr thumbnail;
+        ASSERT_FALSE(covers.load("book-a", thumbnail));
+        ASSERT_TRUE(covers.store("book-a", image.get()));
+    }
+
+    // The old slot is reused once full, without dropping book-a
+    CoverCache covers(path, 4, 4, &format, 4);
+    ASSERT_TRUE(covers.store("book-c", image.get()));
+    ASSERT_TRUE(covers.store("book-d", image.get()));
+    surface_unique_ptr thumbnail;
+    for (std::string book_id : {"book-a", "book-b", "book-c", "book-d"})
+    {
+        ASSERT_TRUE(covers.load(book_id, thumbnail)) << book_id;
+    }
+}
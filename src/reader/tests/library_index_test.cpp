@@ -0,0 +1,66 @@
+#include "../library_index.h"
+#include "filetypes/open_doc.h"
+#include "util/tests/temp_path.h"
+
+#include <gtest/gtest.h>
+
+#include <fstream>
+
+TEST(LIBRARY_INDEX, entries_match_fingerprint)
+{
+    auto path = fresh_temp_path("library_index_fingerprint");
+    FileFingerprint fingerprint = {1000, 1234567890};
+    {
+        LibraryIndex library(path);
+        library.put("/books/a.epub", fingerprint, {"id-a", "Title A", "Author A"});
+        ASSERT_TRUE(library.flush());
+    }
+
+    LibraryIndex library(path);
+    auto entry = library.get("/books/a.epub", fingerprint);
+    ASSERT_TRUE(entry);
+    ASSERT_EQ(entry->book_id, "id-a");
+    ASSERT_EQ(entry->title, "Title A");
+    ASSERT_EQ(entry->author, "Author A");
+
+    // Changed files need indexing again
+    ASSERT_FALSE(library.get("/books/a.epub", {1001, 1234567890}));
+    ASSERT_FALSE(library.get("/books/a.epub", {1000, 1234567891}));
+    ASSERT_FALSE(library.get("/books/b.epub", fingerprint));
+}
+
+TEST(LIBRARY_INDEX, retain_forgets_removed_files)
+{
+    LibraryIndex library(fresh_temp_path("library_index_retain"));
+    FileFingerprint fingerprint = {1, 2};
+    library.put("/books/a.epub", fingerprint, {"a", "A", ""});
+    library.put("/books/b.epub", fingerprint, {"b", "B", ""});
+    library.put("/other/c.epub", fingerprint, {"c", "C", ""});
+
+    library.retain("/books", {"b.epub"});
+    ASSERT_FALSE(library.get("/books/a.epub", fingerprint));
+    ASSERT_TRUE(library.get("/books/b.epub", fingerprint));
+    ASSERT_TRUE(library.get("/other/c.epub", fingerprint));
+}
+
+TEST(LIBRARY_INDEX, fingerprint_and_metadata_of_file)
+{
+    auto path = std::filesystem::temp_directory_path() / "library_index_book.txt";
+    {
+        std::ofstream file(path);
+        file << "Some text\n";
+    }
+
+    auto fingerprint = get_file_fingerprint(path);
+    ASSERT_TRUE(fingerprint);
+    ASSERT_EQ(fingerprint->size, 10);
+    ASSERT_FALSE(get_file_fingerprint(std::filesystem::temp_directory_path() / "library_index_missing.txt"));
+
+    auto metadata = read_doc_metadata(path);
+    ASSERT_TRUE(metadata);
+    ASSERT_EQ(metadata->title, "library_index_book");
+
+    auto reader = create_doc_reader(path);
+    ASSERT_TRUE(reader->open());
+    ASSERT_EQ(metadata->id, reader->get_id());
+}
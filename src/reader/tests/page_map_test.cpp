@@ -0,0 +1,80 @@
+#include "reader/page_map.h"
+
+#include <gtest/gtest.h>
+
+static PageMap make_page_map()
+{
+    // Two lines share address 20, e.g. an empty line before a paragraph
+    return PageMap({0, 10, 20, 20, 35, 50, 51}, 700);
+}
+
+TEST(PAGE_MAP, line_for_address)
+{
+    auto page_map = make_page_map();
+
+    ASSERT_EQ(page_map.num_lines(), 7);
+    ASSERT_EQ(page_map.line_for_address(0), 0);
+    ASSERT_EQ(page_map.line_for_address(15), 1);
+    ASSERT_EQ(page_map.line_for_address(20), 3);
+    ASSERT_EQ(page_map.line_for_address(49), 4);
+    ASSERT_EQ(page_map.line_for_address(1000), 6);
+}
+
+TEST(PAGE_MAP, pages)
+{
+    auto page_map = make_page_map();
+
+    ASSERT_EQ(page_map.num_pages(3), 3);
+    ASSERT_EQ(page_map.num_pages(7), 1);
+    ASSERT_EQ(page_map.page_for_line(2, 3), 0);
+    ASSERT_EQ(page_map.page_for_line(3, 3), 1);
+    ASSERT_EQ(page_map.page_for_line(100, 3), 2);
+
+    ASSERT_EQ(page_map.page_address(0, 3), 0);
+    ASSERT_EQ(page_map.page_address(1, 3), 20);
+    ASSERT_EQ(page_map.page_address(2, 3), 51);
+    ASSERT_EQ(page_map.page_address(5, 3), 51);
+}
+
+TEST(PAGE_MAP, minutes_left)
+{
+    auto page_map = make_page_map();
+
+    // 100 words per line
+    ASSERT_EQ(page_map.minutes_left(0, 100), 7);
+    ASSERT_EQ(page_map.minutes_left(5, 100), 2);
+    ASSERT_EQ(page_map.minutes_left(5, 300), 1);
+    ASSERT_EQ(page_map.minutes_left(7, 100), 0);
+}
+
+TEST(PAGE_MAP, empty)
+{
+    PageMap page_map;
+
+    ASSERT_EQ(page_map.num_pages(10), 0);
+    ASSERT_EQ(page_map.line_for_address(5), 0);
+    ASSERT_EQ(page_map.page_address(3, 10), 0);
+    ASSERT_EQ(page_map.minutes_left(0, 100), 0);
+}
+
+TEST(PAGE_MAP, encode_decode)
+{
+    auto page_map = PageMap({0, 10, 0x100000000, 0x100000010}, 42);
+    auto decoded = PageMap::decode(page_map.encode());
+
+    ASSERT_TRUE(decoded);
+    ASSERT_EQ(decoded->num_lines(), 4);
+    ASSERT_EQ(decoded->page_address(2, 1), 0x100000000);
+    ASSERT_EQ(decoded->page_address(3, 1), 0x100000010);
+    ASSERT_EQ(decoded->minutes_left(0, 42), 1);
+
+    ASSERT_EQ(PageMap::decode(PageMap().encode())->num_lines(), 0);
+}
+
+TEST(PAGE_MAP, decode_invalid)
+{
+    ASSERT_FALSE(PageMap::decode(""));
+    ASSERT_FALSE(PageMap::decode("0 10 0,1"));
+    ASSERT_FALSE(PageMap::decode("1 10 0,x"));
+    ASSERT_FALSE(PageMap::decode("1 10 0,,1"));
+}
@@ -0,0 +1,151 @@
+#include "reader/search_index.h"
+
+#include "util/tests/temp_path.h"
+
+#include <gtest/gtest.h>
+
+#include <fstream>
+
+namespace
+{
+
+TokenArena text_tokens(std::vector<std::pair<DocAddr, std::string>> texts)
+{
+    TokenArena tokens;
+    for (const auto &[address, text] : texts)
+    {
+        tokens.push_back(TokenType::Text, address, text);
+    }
+    return tokens;
+}
+
+SearchIndex build_index(std::vector<std::pair<DocAddr, std::string>> texts)
+{
+    return SearchIndex::build(text_tokens(texts));
+}
+
+} // namespace
+
+TEST(SEARCH_INDEX, split_words)
+{
+    auto words = split_search_words("The quick, \"Brown\" fox's\n\xE2\x80\x9C" "d\xC3\xA9j\xC3\xA0\xE2\x80\x9D vu");
+
+    std::vector<std::pair<std::string, uint32_t>> expected = {
+        {"the", 0},
+        {"quick", 3},
+        {"brown", 10},
+        {"fox", 16},
+        {"s", 20},
+        {"d\xC3\xA9j\xC3\xA0", 22},
+        {"vu", 27},
+    };
+
+    ASSERT_EQ(words.size(), expected.size());
+    for (size_t i = 0; i < expected.size(); ++i)
+    {
+        EXPECT_EQ(words[i].word, expected[i].first) << i;
+        EXPECT_EQ(words[i].offset, expected[i].second) << i;
+    }
+}
+
+TEST(SEARCH_INDEX, search_words_and_prefixes)
+{
+    auto index = build_index({
+        {0, "The quick brown fox"},
+        {100, "jumps over the lazy dog."},
+        {200, "Brownies, quickly."},
+    });
+
+    ASSERT_EQ(index.search("the", 10), std::vector<DocAddr>({0, 109}));
+    ASSERT_EQ(index.search("BROWN", 10), std::vector<DocAddr>({8, 200}));
+    ASSERT_EQ(index.search("quick", 1), std::vector<DocAddr>({3}));
+    ASSERT_EQ(index.search("cat", 10), std::vector<DocAddr>());
+    ASSERT_EQ(index.search("  ", 10), std::vector<DocAddr>());
+}
+
+TEST(SEARCH_INDEX, search_phrases)
+{
+    auto index = build_index({
+        {0, "The quick brown fox"},
+        {100, "the brown, quick fox; the quick... brown dog"},
+    });
+
+    ASSERT_EQ(index.search("quick brown", 10), std::vector<DocAddr>({3, 121}));
+    ASSERT_EQ(index.search("brown quick", 10), std::vector<DocAddr>({103}));
+    ASSERT_EQ(index.search("the quick bro", 10), std::vector<DocAddr>({0, 118}));
+    ASSERT_EQ(index.search("quick fox", 10), std::vector<DocAddr>({109}));
+    ASSERT_EQ(index.search("brown cat", 10), std::vector<DocAddr>());
+}
+
+TEST(SEARCH_INDEX, merge_batches)
+{
+    std::vector<std::pair<DocAddr, std::string>> texts = {
+        {0, "The quick brown fox"},
+        {100, "jumps over the lazy dog."},
+        {200, "Brownies, quickly."},
+        {300, "the quick... brown dog"},
+    };
+    auto whole = build_index(texts);
+    auto first = build_index({texts[0], texts[1]});
+    auto second = build_index({texts[2]});
+    auto third = build_index({texts[3]});
+    SearchIndex empty;
+
+    auto merged = SearchIndex::merge({&first, &empty, &second, &third});
+    ASSERT_EQ(merged.encode(), whole.encode());
+    ASSERT_EQ(merged.search("the quick", 10), std::vector<DocAddr>({0, 300}));
+    ASSERT_EQ(SearchIndex::merge({}).search("the", 10), std::vector<DocAddr>());
+}
+
+TEST(SEARCH_INDEX, encode_decode)
+{
+    auto index = build_index({
+        {0, "alpha beta"},
+        {0x100000000, "beta gamma"},
+    });
+
+    auto encoded = index.encode();
+    auto decoded = SearchIndex::decode(encoded);
+    ASSERT_TRUE(decoded);
+    ASSERT_EQ(decoded->search("beta", 10), std::vector<DocAddr>({5, 0x100000000}));
+    ASSERT_EQ(decoded->search("beta gam", 10), std::vector<DocAddr>({0x100000000}));
+
+    ASSERT_FALSE(SearchIndex::decode(""));
+    ASSERT_FALSE(SearchIndex::decode(encoded.substr(0, encoded.size() - 1)));
+    ASSERT_FALSE(SearchIndex::decode(encoded + "x"));
+}
+
+TEST(SEARCH_INDEX, save_load)
+{
+    auto path = fresh_temp_path("search_index_save_load");
+    auto index = build_index({
+        {0, "alpha beta"},
+        {100, "beta gamma"},
+    });
+    ASSERT_FALSE(SearchIndex::load(path));
+    ASSERT_TRUE(index.save(path));
+
+    auto loaded = SearchIndex::load(path);
+    ASSERT_TRUE(loaded);
+    ASSERT_EQ(loaded->search("beta", 10), std::vector<DocAddr>({5, 100}));
+
+    // Damaged files fail to load
+    auto size = std::filesystem::file_size(path);
+    {
+        std::fstream file(path, std::ios::binary | std::ios::in | std::ios::out);
+        file.seekp(size / 2);
+        file.put('\xFF');
+    }
+    ASSERT_FALSE(SearchIndex::load(path));
+}
+
+TEST(SEARCH_INDEX, snippet)
+{
+    std::string text = "The quick brown fox jumps over the lazy dog";
+
+    ASSERT_EQ(search_snippet(text, 0, 100), text);
+    ASSERT_EQ(search_snippet(text, 0, 9), "The quick...");
+    // "jumps" starts at address 16, "dog" at 32
+    ASSERT_EQ(search_snippet(text, 16, 20), "...fox jumps over the...");
+    ASSERT_EQ(search_snippet(text, 32, 20), "...lazy dog");
+}
@@ -0,0 +1,144 @@
+#include "../state_store.h"
+#include "util/tests/temp_path.h"
+
+#include <gtest/gtest.h>
+
+#include <fstream>
+#include <thread>
+
+TEST(STATE_STORE, address_durable_without_flush)
+{
+    auto dir = fresh_temp_path("state_store_journal");
+    {
+        StateStore store(dir, 0);
+        store.set_book_address("book", 10);
+        store.set_book_address("book", 20);
+        store.set_book_address("other", 5);
+        // No flush, as on sudden power loss
+    }
+
+    StateStore store(dir);
+    ASSERT_EQ(store.get_book_address("book"), 20);
+    ASSERT_EQ(store.get_book_address("other"), 5);
+    ASSERT_EQ(store.get_book_address("missing"), std::nullopt);
+}
+
+TEST(STATE_STORE, address_syncs_coalesced)
+{
+    auto dir = fresh_temp_path("state_store_coalesce");
+    auto journal_path = dir / "address_journal";
+    {
+        StateStore store(dir, 50);
+        store.set_book_address("book", 10);
+        auto journal_size = std::filesystem::file_size(journal_path);
+
+        // Within the interval, held until the next sync
+        store.set_book_address("book", 20);
+        store.set_book_address("book", 30);
+        store.sync_book_addresses();
+        ASSERT_EQ(std::filesystem::file_size(journal_path), journal_size);
+        ASSERT_EQ(store.get_book_address("book"), 30);
+    }
+    {
+        StateStore store(dir, 50);
+        ASSERT_EQ(store.get_book_address("book"), 10);
+
+        store.set_book_address("book", 20);
+        store.set_book_address("book", 30);
+        std::this_thread::sleep_for(std::chrono::milliseconds(60));
+        store.sync_book_addresses();
+    }
+
+    StateStore store(dir);
+    ASSERT_EQ(store.get_book_address("book"), 30);
+}
+
+TEST(STATE_STORE, flush_folds_journal)
+{
+    auto dir = fresh_temp_path("state_store_fold");
+    auto journal_path = dir / "address_journal";
+    {
+        StateStore store(dir, 0);
+        store.set_book_address("book", 10);
+        auto journal_size = std::filesystem::file_size(journal_path);
+
+        store.flush();
+        ASSERT_LT(std::filesystem::file_size(journal_path), journal_size);
+        ASSERT_EQ(store.get_book_address("book"), 10);
+
+        store.set_book_address("book", 30);
+    }
+
+    StateStore store(dir);
+    ASSERT_EQ(store.get_book_address("book"), 30);
+}
+
+TEST(STATE_STORE, reader_cache_round_trip)
+{
+    auto dir = fresh_temp_path("state_store_cache");
+    {
+        StateStore store(dir);
+        store.set_reader_cache_entry("book", "widths", "1,2");
+        store.set_reader_cache_entry("book", "page_map", "1 2 a,");
+        store.set_reader_cache_entry("book", "widths", "1,2,3");
+        store.erase_reader_cache_entry("book", "page_map");
+        store.flush();
+    }
+
+    StateStore store(dir);
+    ASSERT_EQ(store.get_reader_cache_entry("book", "widths"), "1,2,3");
+    ASSERT_EQ(store.get_reader_cache_entry("book", "page_map"), std::nullopt);
+    ASSERT_EQ(store.get_reader_cache_keys("book"), std::vector<std::string>({"widths"}));
+}
+
+TEST(STATE_STORE, legacy_reader_cache_migrated)
+{
+    auto dir = fresh_temp_path("state_store_legacy_cache");
+    auto legacy_path = dir / "books" / "book.cache";
+    std::filesystem::create_directories(legacy_path.parent_path());
+    {
+        std::ofstream file(legacy_path);
+        file << "widths=4,5\n";
+    }
+    {
+        StateStore store(dir);
+        ASSERT_EQ(store.get_reader_cache_entry("book", "widths"), "4,5");
+        store.flush();
+    }
+    ASSERT_FALSE(std::filesystem::exists(legacy_path));
+
+    StateStore store(dir);
+    ASSERT_EQ(store.get_reader_cache_entry("book", "widths"), "4,5");
+}
+
+TEST(STATE_STORE, book_files_trimmed_to_budget)
+{
+    auto dir = fresh_temp_path("state_store_book_files");
+    auto write_file = [](const std::filesystem::path &path, size_t size) {
+        std::ofstream file(path);
+        file << std::string(size, 'x');
+    };
+    {
+        StateStore store(dir, 0, 100);
+        auto a_dir = store.get_book_file_dir("a");
+        auto b_dir = store.get_book_file_dir("b");
+        ASSERT_TRUE(a_dir && b_dir);
+        write_file(*a_dir / "tokens", 60);
+        write_file(*b_dir / "tokens", 60);
+
+        // Still there while this run goes on
+        ASSERT_EQ(store.get_book_file_dir("a"), a_dir);
+        ASSERT_TRUE(std::filesystem::exists(*a_dir / "tokens"));
+
+        auto now = std::filesystem::file_time_type::clock::now();
+        std::filesystem::last_write_time(*a_dir, now - std::chrono::hours(2));
+        std::filesystem::last_write_time(*b_dir, now - std::chrono::hours(1));
+    }
+
+    StateStore store(dir, 0, 100);
+    auto c_dir = store.get_book_file_dir("c");
+    ASSERT_TRUE(c_dir);
+    ASSERT_TRUE(std::filesystem::exists(*c_dir));
+    ASSERT_FALSE(std::filesystem::exists(dir / "book_files" / "a"));
+    ASSERT_TRUE(std::filesystem::exists(dir / "book_files" / "b" / "tokens"));
+}
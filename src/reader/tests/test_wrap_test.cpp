@@ -132,3 +132,46 @@ TEST(TEXT_WRAP, limit_mac_char_len)
         (std::vector<std::string>{"123", "45", "789", "ABC", "D"})
     );
 }
+
+static std::vector<std::string> estimated_invocation(const char *str, std::function<bool(const char *, uint32_t)> probably_fits)
+{
+    std::vector<std::string> lines;
+    wrap_lines(
+        str,
+        fits_on_line_by_char,
+        probably_fits,
+        [&lines](const char *str, uint32_t len) {
+            lines.emplace_back(str, len);
+        },
+        100
+    );
+    return lines;
+}
+
+TEST(TEXT_WRAP, estimate_matches_exact)
+{
+    std::vector<std::function<bool(const char *, uint32_t)>> estimates = {
+        [](const char *, uint32_t len) { return len <= 12; },
+        [](const char *, uint32_t) { return true; },
+        [](const char *, uint32_t) { return false; },
+        [](const char *, uint32_t len) { return len <= 6; },
+        [](const char *, uint32_t len) { return len <= 20; },
+    };
+
+    const char *strings[] = {
+        "",
+        "1234",
+        "123456789abc",
+        "hello there, this is a longer string\nwith a newline",
+        "averyveryverylongwordthatneedsbreaking and some words",
+        "  leading and trailing  ",
+    };
+
+    for (const char *str : strings)
+    {
+        for (const auto &estimate : estimates)
+        {
+            EXPECT_EQ(estimated_invocation(str, estimate), default_invocation(str)) << str;
+        }
+    }
+}
@@ -5,6 +5,7 @@
 
 #include <cstring>
 #include <stdexcept>
+#include <vector>
 
 namespace {
 
@@ -22,60 +23,128 @@ const char *find_first_break(const char *pos, int max_search)
     return pos;
 }
 
-const char *find_last_whitespace(const char *start_pos, str_filter_func &fits_on_line, uint32_t max_line_search_chars)
+// Return the last candidate line end that fits, stopping at the first that doesn't.
+// With an estimate, the estimate locates the break and fits_on_line only confirms
+// the candidates around it. The results agree as long as fits_on_line never
+// accepts a longer prefix after rejecting a shorter one.
+const char *find_last_fitting(
+    const char *start_pos,
+    const std::function<const char *()> &next_candidate,
+    str_filter_func &fits_on_line,
+    str_filter_func *probably_fits
+)
 {
-    const char *best_candidate_pos = nullptr;
-    const char *cur_pos = start_pos;
-
-    while(true)
-    {
-        const char *candidate_pos = find_first_break(cur_pos, max_line_search_chars);
-        if (!candidate_pos)
+    std::vector<const char *> candidates;
+    auto get_candidate = [&](uint32_t i) -> const char * {
+        while (candidates.size() <= i)
         {
-            // no break within max search
-            break;
+            const char *candidate = next_candidate();
+            if (!candidate)
+            {
+                return nullptr;
+            }
+            candidates.push_back(candidate);
         }
+        return candidates[i];
+    };
+    auto fits = [&](const char *candidate) {
+        return fits_on_line(start_pos, candidate - start_pos);
+    };
 
-        if (!fits_on_line(start_pos, candidate_pos - start_pos))
+    if (!probably_fits)
+    {
+        const char *best_candidate_pos = nullptr;
+        const char *candidate_pos;
+        for (uint32_t i = 0; (candidate_pos = get_candidate(i)) && fits(candidate_pos); ++i)
         {
-            // overshot
-            break;
+            best_candidate_pos = candidate_pos;
         }
+        return best_candidate_pos;
+    }
 
-        best_candidate_pos = candidate_pos;
-        cur_pos = candidate_pos + 1;
+    if (!get_candidate(0))
+    {
+        return nullptr;
+    }
+
+    uint32_t i = 0;
+    while (get_candidate(i + 1) && (*probably_fits)(start_pos, candidates[i + 1] - start_pos))
+    {
+        ++i;
+    }
 
-        if (*candidate_pos == 0 || *candidate_pos == '\n')
+    if (fits(candidates[i]))
+    {
+        // estimate was short, or exact
+        while (get_candidate(i + 1) && fits(candidates[i + 1]))
         {
-            // break on literal newlines and end of string
-            break;
+            ++i;
         }
+        return candidates[i];
     }
 
-    return best_candidate_pos;
+    // estimate was long
+    while (i-- > 0)
+    {
+        if (fits(candidates[i]))
+        {
+            return candidates[i];
+        }
+    }
+    return nullptr;
 }
 
-const char *find_last_character(const char *start_pos, str_filter_func &fits_on_line, uint32_t max_line_search_chars)
+const char *find_last_whitespace(const char *start_pos, str_filter_func &fits_on_line, str_filter_func *probably_fits, uint32_t max_line_search_chars)
 {
     const char *cur_pos = start_pos;
-    while (*cur_pos && max_line_search_chars-- > 0)
-    {
-        const char *candidate_pos = utf8_step(cur_pos);
-        if (!fits_on_line(start_pos, candidate_pos - start_pos))
+    bool done = false;
+
+    auto next_candidate = [&]() -> const char * {
+        if (done)
         {
-            break;
+            return nullptr;
         }
-        cur_pos = candidate_pos;
-    }
-    return cur_pos;
+
+        const char *candidate_pos = find_first_break(cur_pos, max_line_search_chars);
+        if (!candidate_pos || *candidate_pos == 0 || *candidate_pos == '\n')
+        {
+            // no break within max search, or break on literal newlines and end of string
+            done = true;
+        }
+        else
+        {
+            cur_pos = candidate_pos + 1;
+        }
+        return candidate_pos;
+    };
+
+    return find_last_fitting(start_pos, next_candidate, fits_on_line, probably_fits);
 }
 
-} // namespace
+const char *find_last_character(const char *start_pos, str_filter_func &fits_on_line, str_filter_func *probably_fits, uint32_t max_line_search_chars)
+{
+    const char *cur_pos = start_pos;
+    bool done = false;
+
+    auto next_candidate = [&]() -> const char * {
+        if (done || !*cur_pos || max_line_search_chars-- == 0)
+        {
+            done = true;
+            return nullptr;
+        }
+        cur_pos = utf8_step(cur_pos);
+        return cur_pos;
+    };
+
+    const char *last_fit = find_last_fitting(start_pos, next_candidate, fits_on_line, probably_fits);
+    return last_fit ? last_fit : start_pos;
+}
 
 void wrap_lines(
     const char *str,
-    std::function<bool(const char *, uint32_t)> fits_on_line,
-    std::function<void(const char *, uint32_t)> on_next_line,
+    str_filter_func &fits_on_line,
+    str_filter_func *probably_fits,
+    std::function<void(const char *, uint32_t)> &on_next_line,
     uint32_t max_line_search_chars
 )
 {
@@ -91,12 +160,12 @@ void wrap_lines(
     while (cur_pos < string_end_pos)
     {
         const char *break_pos;
-        if ((break_pos = find_last_whitespace(cur_pos, fits_on_line, max_line_search_chars)))
+        if ((break_pos = find_last_whitespace(cur_pos, fits_on_line, probably_fits, max_line_search_chars)))
         {
             on_next_line(cur_pos, break_pos - cur_pos);
             cur_pos = break_pos + 1;
         }
-        else if ((break_pos = find_last_character(cur_pos, fits_on_line, max_line_search_chars)))
+        else if ((break_pos = find_last_character(cur_pos, fits_on_line, probably_fits, max_line_search_chars)))
         {
             on_next_line(cur_pos, break_pos - cur_pos);
             cur_pos = break_pos;
@@ -107,3 +176,26 @@ void wrap_lines(
         }
     }
 }
+
+} // namespace
+
+void wrap_lines(
+    const char *str,
+    std::function<bool(const char *, uint32_t)> fits_on_line,
+    std::function<void(const char *, uint32_t)> on_next_line,
+    uint32_t max_line_search_chars
+)
+{
+    wrap_lines(str, fits_on_line, nullptr, on_next_line, max_line_search_chars);
+}
+
+void wrap_lines(
+    const char *str,
+    std::function<bool(const char *, uint32_t)> fits_on_line,
+    std::function<bool(const char *, uint32_t)> probably_fits,
+    std::function<void(const char *, uint32_t)> on_next_line,
+    uint32_t max_line_search_chars
+)
+{
+    wrap_lines(str, fits_on_line, &probably_fits, on_next_line, max_line_search_chars);
+}
@@ -12,4 +12,15 @@ void wrap_lines(
     unsigned int max_line_search_chars = 1024
 );
 
+// Same result as above, for when fits_on_line is expensive. probably_fits is a
+// cheap approximation used to find the break, fits_on_line then only confirms
+// the candidates around it. fits_on_line must be monotonic in length.
+void wrap_lines(
+    const char *str,
+    std::function<bool(const char *, uint32_t)> fits_on_line,
+    std::function<bool(const char *, uint32_t)> probably_fits,
+    std::function<void(const char *, uint32_t)> on_next_line,
+    unsigned int max_line_search_chars = 1024
+);
+
 #endif
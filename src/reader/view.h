@@ -4,12 +4,21 @@
 #include <SDL/SDL_keysym.h>
 #include <SDL/SDL_video.h>
 
+#include <vector>
+
 class View
 {
 public:
     // Returns true if rendering was performed.
     virtual bool render(SDL_Surface *dest, bool force_render) = 0;
 
+    // Areas changed by the last render. Empty if the whole surface changed.
+    virtual const std::vector<SDL_Rect> &get_dirty_rects() const
+    {
+        static const std::vector<SDL_Rect> whole_surface;
+        return whole_surface;
+    }
+
     // Return true if the view is no longer needed.
     virtual bool is_done() = 0;
 
@@ -12,11 +12,13 @@ ViewStack::~ViewStack()
 bool ViewStack::render(SDL_Surface *dest, bool force_render)
 {
     bool rendered = false;
+    rendered_top_only = false;
     if (!views.empty())
     {
         if (!views.back()->is_modal())
         {
             rendered = views.back()->render(dest, force_render) || force_render;
+            rendered_top_only = !force_render;
         }
         else
         {
@@ -39,6 +41,15 @@ bool ViewStack::render(SDL_Surface *dest, bool force_render)
     return rendered;
 }
 
+const std::vector<SDL_Rect> &ViewStack::get_dirty_rects() const
+{
+    if (rendered_top_only)
+    {
+        return views.back()->get_dirty_rects();
+    }
+    return View::get_dirty_rects();
+}
+
 bool ViewStack::is_done()
 {
     return views.empty();
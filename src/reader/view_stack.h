@@ -9,11 +9,13 @@
 class ViewStack: public View
 {
     std::vector<std::shared_ptr<View>> views;
+    bool rendered_top_only = false;
 public:
     void push(std::shared_ptr<View> view);
     virtual ~ViewStack();
 
     bool render(SDL_Surface *dest, bool force_render) override;
+    const std::vector<SDL_Rect> &get_dirty_rects() const override;
     bool is_done() override;
 
     void on_keypress(SDLKey key) override;
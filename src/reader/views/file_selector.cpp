@@ -2,13 +2,26 @@
 
 #include "./selection_menu.h"
 #include "filetypes/open_doc.h"
+#include "reader/config.h"
+#include "reader/cover_cache.h"
+#include "reader/library_index.h"
+#include "reader/state_store.h"
 #include "reader/system_styling.h"
 #include "sys/filesystem.h"
+#include "sys/screen.h"
 
+#include <deque>
 #include <filesystem>
 #include <iostream>
+#include <set>
 #include <vector>
 
+struct EntryCover
+{
+    bool looked_up = false;
+    surface_unique_ptr thumbnail;
+};
+
 struct FSState
 {
     std::filesystem::path path;
@@ -17,16 +30,290 @@ struct FSState
     std::function<void(const std::filesystem::path &)> on_file_focus;
 
     SelectionMenu menu;
+    SystemStyling &styling;
+
+    LibraryIndex &library;
+    CoverCache &covers;
+    const StateStore &state_store;
+    background_func run_in_background;
+
+    // Indexed metadata of path_entries, and entries still to be indexed
+    std::vector<std::optional<LibraryEntry>> entry_metadata;
+    std::deque<uint32_t> unindexed_entries;
+    uint32_t listing_id = 0;
+    uint32_t num_index_jobs = 0;
+
+    // Thumbnails of path_entries, looked up as entries are first drawn, and
+    // entries still to be thumbnailed
+    std::vector<EntryCover> entry_covers;
+    std::deque<uint32_t> uncovered_entries;
+    uint32_t num_cover_jobs = 0;
+    bool covers_changed = false;
+
+    std::shared_ptr<bool> alive_token = std::make_shared<bool>(true);
 
-    FSState(std::filesystem::path path, SystemStyling &styling)
+    FSState(std::filesystem::path path, SystemStyling &styling, LibraryIndex &library, CoverCache &covers, const StateStore &state_store, background_func run_in_background)
         : path(path),
-          menu(styling)
+          menu(styling),
+          styling(styling),
+          library(library),
+          covers(covers),
+          state_store(state_store),
+          run_in_background(run_in_background)
     {
     }
 };
 
 namespace {
 
+struct IndexResult
+{
+    std::optional<FileFingerprint> fingerprint;
+    LibraryEntry entry;
+};
+
+// "Title - Author (progress%)" for indexed books, otherwise the file name
+std::string entry_label(const FSState *s, uint32_t index)
+{
+    const auto &entry = s->path_entries[index];
+    const auto &metadata = s->entry_metadata[index];
+    if (entry.is_dir || !metadata || metadata->title.empty())
+    {
+        return entry.name;
+    }
+
+    std::string label = metadata->title;
+    if (!metadata->author.empty())
+    {
+        label += " - " + metadata->author;
+    }
+    if (!metadata->book_id.empty())
+    {
+        auto progress = s->state_store.get_book_progress(metadata->book_id);
+        if (progress)
+        {
+            label += " (" + std::to_string(*progress) + "%)";
+        }
+    }
+    return label;
+}
+
+void index_next_entries(FSState *s)
+{
+    while (s->num_index_jobs < LIBRARY_INDEX_JOBS_IN_FLIGHT && !s->unindexed_entries.empty())
+    {
+        uint32_t index = s->unindexed_entries.front();
+        s->unindexed_entries.pop_front();
+
+        auto path = s->path / s->path_entries[index].name;
+        auto result = std::make_shared<IndexResult>();
+        ++s->num_index_jobs;
+
+        s->run_in_background(
+            [path, result]() {
+                // Taken first, so a file changed while reading is indexed again next time
+                result->fingerprint = get_file_fingerprint(path);
+                auto metadata = read_doc_metadata(path);
+                if (metadata)
+                {
+                    result->entry = {metadata->id, metadata->title, metadata->author};
+                }
+            },
+            [s, alive = std::weak_ptr<bool>(s->alive_token), listing_id = s->listing_id, index, path, result]() {
+                if (!alive.lock())
+                {
+                    return;
+                }
+                --s->num_index_jobs;
+
+                // Unreadable books are kept too, so they aren't retried until they change
+                if (result->fingerprint)
+                {
+                    s->library.put(path, *result->fingerprint, result->entry);
+                }
+
+                // The listing may have changed while the book was read
+                if (listing_id == s->listing_id)
+                {
+                    s->entry_metadata[index] = result->entry;
+                    s->menu.set_entry(index, entry_label(s, index));
+                }
+                index_next_entries(s);
+
+                if (s->num_index_jobs == 0 && s->unindexed_entries.empty())
+                {
+                    s->library.flush();
+                }
+            }
+        );
+    }
+}
+
+void make_next_thumbnails(FSState *s)
+{
+    while (s->num_cover_jobs < COVER_THUMB_JOBS_IN_FLIGHT && !s->uncovered_entries.empty())
+    {
+        uint32_t index = s->uncovered_entries.front();
+        s->uncovered_entries.pop_front();
+
+        auto path = s->path / s->path_entries[index].name;
+        auto book_id = s->entry_metadata[index]->book_id;
+        auto thumbnail = std::make_shared<surface_unique_ptr>();
+        ++s->num_cover_jobs;
+
+        s->run_in_background(
+            [&covers = s->covers, path, book_id, thumbnail]() {
+                auto cover = read_doc_cover(path);
+                if (cover)
+                {
+                    *thumbnail = make_cover_thumbnail(
+                        *cover,
+                        covers.thumbnail_width(),
+                        covers.thumbnail_height(),
+                        get_render_surface_format()
+                    );
+                }
+                // Books whose cover can't be read are stored as having none,
+                // so they aren't retried until they change
+                covers.store(book_id, thumbnail->get());
+            },
+            [s, alive = std::weak_ptr<bool>(s->alive_token), listing_id = s->listing_id, index, thumbnail]() {
+                if (!alive.lock())
+                {
+                    return;
+                }
+                --s->num_cover_jobs;
+
+                if (listing_id == s->listing_id)
+                {
+                    s->entry_covers[index].thumbnail = std::move(*thumbnail);
+                    s->covers_changed = true;
+                }
+                make_next_thumbnails(s);
+            }
+        );
+    }
+}
+
+void draw_placeholder(FSState *s, SDL_Surface *dest, SDL_Rect rect)
+{
+    const SDL_Color &color = s->styling.get_loaded_color_theme().secondary_text;
+    uint32_t outline_color = SDL_MapRGB(dest->format, color.r, color.g, color.b);
+
+    SDL_Rect edges[] = {
+        {rect.x, rect.y, rect.w, 1},
+        {rect.x, static_cast<Sint16>(rect.y + rect.h - 1), rect.w, 1},
+        {rect.x, rect.y, 1, rect.h},
+        {static_cast<Sint16>(rect.x + rect.w - 1), rect.y, 1, rect.h},
+    };
+    for (auto &edge : edges)
+    {
+        SDL_FillRect(dest, &edge, outline_color);
+    }
+}
+
+// Cover thumbnail of a book, or a placeholder until it is made. Thumbnails
+// are only queued once an entry is drawn, so visible books go first.
+void draw_entry_icon(FSState *s, uint32_t index, SDL_Surface *dest, SDL_Rect rect)
+{
+    if (s->path_entries[index].is_dir)
+    {
+        return;
+    }
+
+    auto &cover = s->entry_covers[index];
+    const auto &metadata = s->entry_metadata[index];
+    if (!cover.looked_up && metadata && !metadata->book_id.empty())
+    {
+        cover.looked_up = true;
+        if (!s->covers.load(metadata->book_id, cover.thumbnail) && s->run_in_background)
+        {
+            s->uncovered_entries.push_back(index);
+            make_next_thumbnails(s);
+        }
+    }
+
+    if (cover.thumbnail)
+    {
+        SDL_Rect thumbnail_rect = {
+            static_cast<Sint16>(rect.x + (rect.w - cover.thumbnail->w) / 2),
+            static_cast<Sint16>(rect.y + (rect.h - cover.thumbnail->h) / 2),
+            0, 0
+        };
+        SDL_BlitSurface(cover.thumbnail.get(), nullptr, dest, &thumbnail_rect);
+    }
+    else
+    {
+        draw_placeholder(s, dest, rect);
+    }
+}
+
+// Look up listed books in the library, queueing those not yet indexed
+void load_entry_metadata(FSState *s)
+{
+    ++s->listing_id;
+    s->unindexed_entries.clear();
+    s->entry_metadata.assign(s->path_entries.size(), std::nullopt);
+    s->uncovered_entries.clear();
+    s->entry_covers.clear();
+    s->entry_covers.resize(s->path_entries.size());
+
+    std::set<std::string> file_names;
+    for (uint32_t i = 0; i < s->path_entries.size(); ++i)
+    {
+        const auto &entry = s->path_entries[i];
+        if (entry.is_dir)
+        {
+            continue;
+        }
+        file_names.insert(entry.name);
+
+        auto fingerprint = get_file_fingerprint(s->path / entry.name);
+        if (fingerprint)
+        {
+            s->entry_metadata[i] = s->library.get(s->path / entry.name, *fingerprint);
+        }
+        if (!s->entry_metadata[i])
+        {
+            s->unindexed_entries.push_back(i);
+        }
+    }
+    s->library.retain(s->path, file_names);
+
+    if (s->run_in_background)
+    {
+        index_next_entries(s);
+    }
+    else
+    {
+        s->unindexed_entries.clear();
+    }
+    if (s->num_index_jobs == 0 && s->unindexed_entries.empty())
+    {
+        s->library.flush();
+    }
+}
+
+void refresh_entry_labels(FSState *s)
+{
+    for (uint32_t i = 0; i < s->path_entries.size(); ++i)
+    {
+        s->menu.set_entry(i, entry_label(s, i));
+    }
+}
+
+void set_cursor_to_entry(FSState *s, const std::string &name)
+{
+    for (uint32_t i = 0; i < s->path_entries.size(); ++i)
+    {
+        if (s->path_entries[i].name == name)
+        {
+            s->menu.set_cursor_pos(i);
+            break;
+        }
+    }
+}
+
 void refresh_path_entries(FSState *s)
 {
     s->path_entries.clear();
@@ -41,10 +328,12 @@ void refresh_path_entries(FSState *s)
         }
     }
 
+    load_entry_metadata(s);
+
     std::vector<std::string> menu_entries;
-    for (const auto &entry : s->path_entries)
+    for (uint32_t i = 0; i < s->path_entries.size(); ++i)
     {
-        menu_entries.push_back(entry.name);
+        menu_entries.push_back(entry_label(s, i));
     }
     s->menu.set_entries(menu_entries);
 }
@@ -65,7 +354,7 @@ void on_menu_entry_selected(FSState *s, uint32_t menu_index)
 
             s->path = s->path.parent_path();
             refresh_path_entries(s);
-            s->menu.set_cursor_pos(highlight_name);
+            set_cursor_to_entry(s, highlight_name);
         }
         else
         {
@@ -123,10 +412,20 @@ std::filesystem::path sanitize_starting_path(std::filesystem::path path)
 
 } // namespace
 
-FileSelector::FileSelector(std::filesystem::path path, SystemStyling &styling)
-    : state(std::make_unique<FSState>(
+FileSelector::FileSelector(
+    std::filesystem::path path,
+    SystemStyling &styling,
+    LibraryIndex &library,
+    CoverCache &covers,
+    const StateStore &state_store,
+    background_func run_in_background
+) : state(std::make_unique<FSState>(
           sanitize_starting_path(path),
-          styling
+          styling,
+          library,
+          covers,
+          state_store,
+          run_in_background
       ))
 {
     state->menu.set_on_selection([this](uint32_t menu_index) {
@@ -137,10 +436,18 @@ FileSelector::FileSelector(std::filesystem::path path, SystemStyling &styling)
         on_menu_entry_focused(this->state.get(), menu_index);
     });
 
+    state->menu.set_entry_icons(
+        covers.thumbnail_width(),
+        covers.thumbnail_height(),
+        [this](uint32_t menu_index, SDL_Surface *dest, SDL_Rect rect) {
+            draw_entry_icon(this->state.get(), menu_index, dest, rect);
+        }
+    );
+
     refresh_path_entries(state.get());
     if (path.has_filename())
     {
-        state->menu.set_cursor_pos(path.filename());
+        set_cursor_to_entry(state.get(), path.filename());
     }
     else
     {
@@ -154,7 +461,14 @@ FileSelector::~FileSelector()
 
 bool FileSelector::render(SDL_Surface *dest_surface, bool force_render)
 {
-    return state->menu.render(dest_surface, force_render);
+    if (force_render)
+    {
+        // Progress may have changed while a book was open
+        refresh_entry_labels(state.get());
+    }
+    bool covers_changed = state->covers_changed;
+    state->covers_changed = false;
+    return state->menu.render(dest_surface, force_render || covers_changed);
 }
 
 bool FileSelector::is_done()
@@ -2,6 +2,7 @@
 #define FILE_SELECTOR_H_
 
 #include "reader/view.h"
+#include "util/task_queue.h"
 
 #include <SDL/SDL_video.h>
 
@@ -11,6 +12,9 @@
 #include <string>
 
 struct FSState;
+class CoverCache;
+class LibraryIndex;
+class StateStore;
 struct SystemStyling;
 
 class FileSelector: public View
@@ -19,7 +23,16 @@ class FileSelector: public View
 
 public:
     // Expects to receive a path to a file, or directory with trailing separator.
-    FileSelector(std::filesystem::path path, SystemStyling &styling);
+    // Books are listed by title once indexed, and shown with their cover once
+    // it is thumbnailed. Both run in the background.
+    FileSelector(
+        std::filesystem::path path,
+        SystemStyling &styling,
+        LibraryIndex &library,
+        CoverCache &covers,
+        const StateStore &state_store,
+        background_func run_in_background
+    );
     virtual ~FileSelector();
 
     bool render(SDL_Surface *dest_surface, bool force_render) override;
@@ -3,8 +3,8 @@
 #include "./popup_view.h"
 #include "./reader_view.h"
 #include "filetypes/open_doc.h"
+#include "doc_api/doc_reader.h"
 #include "reader/config.h"
-#include "reader/ss_doc_reader_cache.h"
 #include "reader/state_store.h"
 #include "reader/system_styling.h"
 #include "reader/view_stack.h"
@@ -19,6 +19,9 @@ struct ReaderBootstrapViewState
     TokenViewStyling &token_view_styling;
     ViewStack &view_stack;
     StateStore &state_store;
+    DocReaderCache &reader_cache;
+    std::function<void(std::function<void()>)> async;
+    background_func run_in_background;
 
     bool is_done = false;
     bool needs_render = true;
@@ -28,17 +31,40 @@ struct ReaderBootstrapViewState
         SystemStyling &sys_styling,
         TokenViewStyling &token_view_styling,
         ViewStack &view_stack,
-        StateStore &state_store
+        StateStore &state_store,
+        DocReaderCache &reader_cache,
+        std::function<void(std::function<void()>)> async,
+        background_func run_in_background
     ) :
         book_path(book_path),
         sys_styling(sys_styling),
         token_view_styling(token_view_styling),
         view_stack(view_stack),
-        state_store(state_store)
+        state_store(state_store),
+        reader_cache(reader_cache),
+        async(async),
+        run_in_background(run_in_background)
     {
     }
 };
 
+namespace
+{
+
+// Run one step of reader background work per task until done or the view is closed
+void schedule_background_work(std::function<void(std::function<void()>)> async, std::weak_ptr<ReaderView> weak_reader_view)
+{
+    async([async, weak_reader_view]() {
+        auto reader_view = weak_reader_view.lock();
+        if (reader_view && !reader_view->is_done() && reader_view->run_background_task())
+        {
+            schedule_background_work(async, weak_reader_view);
+        }
+    });
+}
+
+} // namespace
+
 void ReaderBootstrapView::load_reader()
 {
     state->is_done = true;
@@ -50,8 +76,11 @@ void ReaderBootstrapView::load_reader()
     auto &state_store = state->state_store;
 
     std::shared_ptr<DocReader> reader = create_doc_reader(book_path);
-    SSDocReaderCache cache(state_store);
-    if (!reader || !reader->open(cache))
+    if (reader)
+    {
+        reader->set_background_func(state->run_in_background);
+    }
+    if (!reader || !reader->open(state->reader_cache))
     {
         std::cerr << "Failed to open " << book_path << std::endl;
         view_stack.push(std::make_shared<PopupView>("Error opening", SYSTEM_FONT, sys_styling));
@@ -64,20 +93,28 @@ void ReaderBootstrapView::load_reader()
     auto reader_view = std::make_shared<ReaderView>(
         book_path,
         reader,
+        state->reader_cache,
         state_store.get_book_address(book_id).value_or(0),
         sys_styling,
         token_view_styling,
-        view_stack
+        view_stack,
+        state->run_in_background
     );
 
-    reader_view->set_on_change_address([&state_store, book_id](DocAddr addr) {
+    reader_view->set_on_change_address([&state_store, reader, book_id](DocAddr addr) {
         state_store.set_book_address(book_id, addr);
+        state_store.set_book_progress(book_id, reader->get_global_progress_percent(addr));
     });
     reader_view->set_on_quit_requested([&state_store]() {
         state_store.remove_current_book_path();
     });
 
     view_stack.push(reader_view);
+
+    reader_view->set_on_background_work([async=state->async, weak_reader_view=std::weak_ptr<ReaderView>(reader_view)]() {
+        schedule_background_work(async, weak_reader_view);
+    });
+    schedule_background_work(state->async, reader_view);
 }
 
 ReaderBootstrapView::ReaderBootstrapView(
@@ -86,11 +123,13 @@ ReaderBootstrapView::ReaderBootstrapView(
     TokenViewStyling &token_view_styling,
     ViewStack &view_stack,
     StateStore &state_store,
-    std::function<void(std::function<void()>)> async
-) : state(std::make_unique<ReaderBootstrapViewState>(book_path, sys_styling, token_view_styling, view_stack, state_store))
+    DocReaderCache &reader_cache,
+    std::function<void(std::function<void()>)> async,
+    background_func run_in_background
+) : state(std::make_unique<ReaderBootstrapViewState>(book_path, sys_styling, token_view_styling, view_stack, state_store, reader_cache, async, run_in_background))
 {
     // Perform asynchronously so that rendering can continue
-    async([this](){ load_reader(); });
+    state->async([this](){ load_reader(); });
 }
 
 ReaderBootstrapView::~ReaderBootstrapView()
@@ -3,7 +3,9 @@
 
 #include "doc_api/doc_addr.h"
 #include "reader/view.h"
+#include "util/task_queue.h"
 
+struct DocReaderCache;
 struct ReaderBootstrapViewState;
 struct SystemStyling;
 struct TokenViewStyling;
@@ -28,7 +30,9 @@ public:
         TokenViewStyling &token_view_styling,
         ViewStack &view_stack,
         StateStore &state_store,
-        std::function<void(std::function<void()>)> async
+        DocReaderCache &reader_cache,
+        std::function<void(std::function<void()>)> async,
+        background_func run_in_background
     );
     virtual ~ReaderBootstrapView();
 
@@ -1,9 +1,12 @@
 #include "./reader_view.h"
 
+#include "./search_view.h"
 #include "./selection_menu.h"
 #include "./token_view/token_view.h"
 #include "./token_view/token_view_styling.h"
 
+#include "reader/config.h"
+#include "reader/search_index.h"
 #include "reader/system_styling.h"
 #include "reader/view_stack.h"
 
@@ -12,7 +15,9 @@
 #include "sys/screen.h"
 #include "util/sdl_font_cache.h"
 
+#include <algorithm>
 #include <iostream>
+#include <unordered_map>
 
 struct ReaderViewState
 {
@@ -20,9 +25,12 @@ struct ReaderViewState
 
     std::function<void()> on_quit;
     std::function<void(DocAddr)> on_change_address;
+    std::function<void()> on_background_work;
+    bool background_work_pending = true;
 
     std::string filename;
     std::shared_ptr<DocReader> reader;
+    DocReaderCache &reader_cache;
     SystemStyling &sys_styling;
     TokenViewStyling &token_view_styling;
     uint32_t token_view_styling_sub_id;
@@ -30,10 +38,29 @@ struct ReaderViewState
     ViewStack &view_stack;
 
     std::unique_ptr<TokenView> token_view;
-    
-    ReaderViewState(std::filesystem::path path, DocAddr seek_address, std::shared_ptr<DocReader> reader, SystemStyling &sys_styling, TokenViewStyling &token_view_styling, uint32_t token_view_styling_sub_id, ViewStack &view_stack)
+    // The page map is only laid out while page numbers are shown
+    bool page_map_enabled = false;
+
+    // Full text search. The index is loaded, or built in batches on a worker
+    // when first searched, and saved with the book's files. Until it is
+    // complete, searches run on the batches indexed so far.
+    background_func run_in_background;
+    std::optional<SearchIndex> search_index;
+    std::vector<std::shared_ptr<const SearchIndex>> search_index_parts;
+    bool search_index_pending = false;
+    // Text around hits, read on a worker
+    std::unordered_map<DocAddr, std::string> search_snippets;
+    std::shared_ptr<TokenIter> search_snippet_iter;
+    bool search_snippets_pending = false;
+    std::string search_query;
+    std::vector<DocAddr> search_hits;
+    std::weak_ptr<SelectionMenu> search_results_menu;
+    std::shared_ptr<bool> alive_token = std::make_shared<bool>(true);
+
+    ReaderViewState(std::filesystem::path path, DocAddr seek_address, std::shared_ptr<DocReader> reader, DocReaderCache &reader_cache, SystemStyling &sys_styling, TokenViewStyling &token_view_styling, uint32_t token_view_styling_sub_id, ViewStack &view_stack, background_func run_in_background)
         : filename(path.filename()),
           reader(reader),
+          reader_cache(reader_cache),
           sys_styling(sys_styling),
           token_view_styling(token_view_styling),
           token_view_styling_sub_id(token_view_styling_sub_id),
@@ -42,8 +69,10 @@ struct ReaderViewState
               reader,
               seek_address,
               sys_styling,
-              token_view_styling
-          ))
+              token_view_styling,
+              run_in_background
+          )),
+          run_in_background(run_in_background)
     {
     }
 
@@ -110,27 +139,400 @@ void open_toc_menu(ReaderView &reader_view, ReaderViewState &state)
     state.view_stack.push(toc_select_menu);
 }
 
+void update_page_map_enabled(ReaderViewState &state)
+{
+    bool enable = state.token_view_styling.get_progress_reporting() == ProgressReporting::PAGE_NUMBER;
+    if (enable == state.page_map_enabled)
+    {
+        return;
+    }
+    state.page_map_enabled = enable;
+
+    if (enable)
+    {
+        state.token_view->enable_page_map(state.reader_cache);
+    }
+    else
+    {
+        state.token_view->disable_page_map();
+    }
+}
+
+void open_page_menu(ReaderView &reader_view, ReaderViewState &state)
+{
+    auto page_progress = state.token_view->get_page_progress(get_current_address(state));
+    if (!page_progress)
+    {
+        return;
+    }
+
+    std::vector<std::string> menu_names;
+    for (uint32_t page = 1; page <= page_progress->num_pages; ++page)
+    {
+        menu_names.push_back("Page " + std::to_string(page) + " of " + std::to_string(page_progress->num_pages));
+    }
+
+    auto page_select_menu = std::make_shared<SelectionMenu>(
+        menu_names,
+        state.sys_styling
+    );
+    page_select_menu->set_on_selection([&reader_view, &state, last_page=page_progress->page](uint32_t menu_index) {
+        auto address = state.token_view->get_page_address(menu_index + 1);
+        if (address && menu_index + 1 != last_page)
+        {
+            reader_view.seek_to_address(*address);
+        }
+    });
+    page_select_menu->set_close_on_select();
+    page_select_menu->set_cursor_pos(page_progress->page - 1);
+
+    page_select_menu->set_default_on_keypress([](SDLKey key, SelectionMenu &menu) {
+        if (key == SW_BTN_START)
+        {
+            menu.close();
+        }
+    });
+
+    state.view_stack.push(page_select_menu);
+}
+
+void run_search_work(ReaderViewState &state, task_func work, task_func on_done)
+{
+    if (state.run_in_background)
+    {
+        state.run_in_background(work, on_done);
+    }
+    else
+    {
+        work();
+        on_done();
+    }
+}
+
+// Phrases across two batches are only found once indexing completes
+std::vector<DocAddr> find_search_hits(const ReaderViewState &state)
+{
+    if (state.search_index)
+    {
+        return state.search_index->search(state.search_query, SEARCH_MAX_RESULTS);
+    }
+
+    std::vector<DocAddr> hits;
+    for (const auto &part : state.search_index_parts)
+    {
+        auto part_hits = part->search(state.search_query, SEARCH_MAX_RESULTS - hits.size());
+        hits.insert(hits.end(), part_hits.begin(), part_hits.end());
+        if (hits.size() >= SEARCH_MAX_RESULTS)
+        {
+            break;
+        }
+    }
+    return hits;
+}
+
+void read_search_snippets(ReaderViewState &state);
+
+// Fill the open results menu with the hits found so far
+void update_search_results(ReaderViewState &state)
+{
+    auto menu = state.search_results_menu.lock();
+    if (!menu)
+    {
+        return;
+    }
+
+    state.search_hits = find_search_hits(state);
+    std::vector<std::string> entries;
+    for (DocAddr address : state.search_hits)
+    {
+        auto it = state.search_snippets.find(address);
+        entries.push_back(it != state.search_snippets.end() ? it->second : "...");
+    }
+    if (state.search_index_pending)
+    {
+        entries.push_back("Searching...");
+    }
+    else if (entries.empty())
+    {
+        entries.push_back("No results");
+    }
+
+    uint32_t cursor_pos = menu->get_cursor_pos();
+    menu->set_entries(entries);
+    menu->set_cursor_pos(std::min<uint32_t>(cursor_pos, entries.size() - 1));
+
+    read_search_snippets(state);
+}
+
+// Read the text around hits without a snippet yet. Hits are in document
+// order, so the worker's iterator reads each chapter once.
+void read_search_snippets(ReaderViewState &state)
+{
+    if (state.search_snippets_pending)
+    {
+        return;
+    }
+
+    std::vector<DocAddr> addresses;
+    for (DocAddr address : state.search_hits)
+    {
+        if (!state.search_snippets.count(address))
+        {
+            addresses.push_back(address);
+        }
+    }
+    if (addresses.empty())
+    {
+        return;
+    }
+
+    if (!state.search_snippet_iter)
+    {
+        state.search_snippet_iter = state.reader->get_worker_iter();
+        if (!state.search_snippet_iter)
+        {
+            return;
+        }
+    }
+    state.search_snippets_pending = true;
+
+    auto iter = state.search_snippet_iter;
+    auto snippets = std::make_shared<std::vector<std::string>>();
+    task_func work = [iter, addresses, snippets]() {
+        for (DocAddr address : addresses)
+        {
+            iter->seek(address);
+            const DocToken *token = iter->read(1);
+            if (!token || token->address > address)
+            {
+                snippets->push_back(to_string(address));
+            }
+            else
+            {
+                snippets->push_back(search_snippet(token->text, address - token->address, SEARCH_SNIPPET_CHARS));
+            }
+        }
+    };
+    task_func on_done = [&state, alive=std::weak_ptr<bool>(state.alive_token), addresses, snippets]() {
+        if (!alive.lock())
+        {
+            return;
+        }
+        state.search_snippets_pending = false;
+        for (size_t i = 0; i < addresses.size(); ++i)
+        {
+            state.search_snippets[addresses[i]] = (*snippets)[i];
+        }
+
+        auto menu = state.search_results_menu.lock();
+        if (!menu)
+        {
+            return;
+        }
+        for (size_t i = 0; i < state.search_hits.size(); ++i)
+        {
+            auto it = state.search_snippets.find(state.search_hits[i]);
+            if (it != state.search_snippets.end())
+            {
+                menu->set_entry(i, it->second);
+            }
+        }
+        // The query may have changed meanwhile
+        read_search_snippets(state);
+    };
+
+    run_search_work(state, work, on_done);
+}
+
+// Join the indexed batches into one index and save it, on a worker
+void finish_search_index(ReaderViewState &state)
+{
+    auto parts = state.search_index_parts;
+    auto file_dir = state.reader_cache.get_file_dir(state.reader->get_id());
+    auto path = file_dir ? std::make_optional(*file_dir / SEARCH_INDEX_FILE_NAME) : std::nullopt;
+    auto result = std::make_shared<SearchIndex>();
+
+    task_func work = [parts, path, result]() {
+        std::vector<const SearchIndex *> part_ptrs;
+        for (const auto &part : parts)
+        {
+            part_ptrs.push_back(part.get());
+        }
+        *result = SearchIndex::merge(part_ptrs);
+        if (path)
+        {
+            result->save(*path);
+        }
+    };
+    task_func on_done = [&state, alive=std::weak_ptr<bool>(state.alive_token), result]() {
+        if (!alive.lock())
+        {
+            return;
+        }
+        state.search_index = std::move(*result);
+        state.search_index_parts.clear();
+        state.search_index_pending = false;
+        update_search_results(state);
+    };
+
+    run_search_work(state, work, on_done);
+}
+
+// Index the next batch of tokens on a worker, showing hits found so far
+void index_next_search_batch(ReaderViewState &state, std::shared_ptr<TokenIter> iter)
+{
+    auto part = std::make_shared<SearchIndex>();
+    auto end_of_book = std::make_shared<bool>(false);
+
+    task_func work = [iter, part, end_of_book]() {
+        TokenArena tokens;
+        for (uint32_t i = 0; i < SEARCH_INDEX_TOKENS_PER_BATCH; ++i)
+        {
+            const DocToken *token = iter->read(1);
+            if (!token)
+            {
+                *end_of_book = true;
+                break;
+            }
+            tokens.push_back(*token);
+        }
+        *part = SearchIndex::build(tokens);
+    };
+    task_func on_done = [&state, alive=std::weak_ptr<bool>(state.alive_token), iter, part, end_of_book]() {
+        if (!alive.lock())
+        {
+            return;
+        }
+        state.search_index_parts.push_back(part);
+        if (*end_of_book)
+        {
+            finish_search_index(state);
+        }
+        else
+        {
+            index_next_search_batch(state, iter);
+        }
+        update_search_results(state);
+    };
+
+    run_search_work(state, work, on_done);
+}
+
+// Load the saved index on a worker, or else start indexing the book
+void start_search_index(ReaderViewState &state)
+{
+    if (state.search_index || state.search_index_pending)
+    {
+        return;
+    }
+    state.search_index_pending = true;
+
+    auto file_dir = state.reader_cache.get_file_dir(state.reader->get_id());
+    auto path = file_dir ? std::make_optional(*file_dir / SEARCH_INDEX_FILE_NAME) : std::nullopt;
+    auto result = std::make_shared<std::optional<SearchIndex>>();
+
+    task_func work = [path, result]() {
+        *result = path ? SearchIndex::load(*path) : std::nullopt;
+    };
+    task_func on_done = [&state, alive=std::weak_ptr<bool>(state.alive_token), result]() {
+        if (!alive.lock())
+        {
+            return;
+        }
+        if (*result)
+        {
+            state.search_index = std::move(*result);
+            state.search_index_pending = false;
+            update_search_results(state);
+            return;
+        }
+
+        auto iter = state.reader->get_worker_iter();
+        if (!iter)
+        {
+            // Searches of an unreadable book find nothing
+            std::cerr << "Unable to index " << state.filename << " for search" << std::endl;
+            state.search_index = SearchIndex();
+            state.search_index_pending = false;
+            update_search_results(state);
+            return;
+        }
+        index_next_search_batch(state, iter);
+    };
+
+    run_search_work(state, work, on_done);
+}
+
+void open_search(ReaderView &reader_view, ReaderViewState &state)
+{
+    start_search_index(state);
+
+    auto search_view = std::make_shared<SearchView>(state.search_query, state.sys_styling);
+    search_view->set_on_search([&reader_view, &state, weak_search_view=std::weak_ptr<SearchView>(search_view)](const std::string &query) {
+        state.search_query = query;
+
+        auto results_menu = std::make_shared<SelectionMenu>(state.sys_styling);
+        results_menu->set_on_selection([&reader_view, &state, weak_search_view](uint32_t index) {
+            if (index < state.search_hits.size())
+            {
+                if (auto search_view = weak_search_view.lock())
+                {
+                    search_view->close();
+                }
+                reader_view.seek_to_address(state.search_hits[index]);
+            }
+        });
+        results_menu->set_default_on_keypress([](SDLKey key, SelectionMenu &menu) {
+            if (key == SW_BTN_SELECT)
+            {
+                menu.close();
+            }
+        });
+        results_menu->set_close_on_select();
+
+        state.search_results_menu = results_menu;
+        update_search_results(state);
+        state.view_stack.push(results_menu);
+    });
+
+    state.view_stack.push(search_view);
+}
+
 } // namespace
 
 ReaderView::ReaderView(
     std::filesystem::path path,
     std::shared_ptr<DocReader> reader,
+    DocReaderCache &reader_cache,
     DocAddr seek_address,
     SystemStyling &sys_styling,
     TokenViewStyling &token_view_styling,
-    ViewStack &view_stack
+    ViewStack &view_stack,
+    background_func run_in_background
 ) : state(std::make_unique<ReaderViewState>(
         path,
         seek_address,
         reader,
+        reader_cache,
         sys_styling,
         token_view_styling,
         token_view_styling.subscribe_to_changes([this]() {
+            update_page_map_enabled(*state);
             update_token_view_title(get_current_address(*state));
         }),
-        view_stack
+        view_stack,
+        run_in_background
     ))
 {
+    state->token_view->set_on_page_map_pending([this]() {
+        if (!state->background_work_pending && state->on_background_work)
+        {
+            state->background_work_pending = true;
+            state->on_background_work();
+        }
+    });
+    update_page_map_enabled(*state);
+
     update_token_view_title(seek_address);
 
     // Update title info on scroll
@@ -165,12 +567,24 @@ void ReaderView::update_token_view_title(DocAddr address)
         state->token_view->set_title(state->filename);
     }
 
-    uint32_t progress_percent = (
-        state->token_view_styling.get_progress_reporting() == ProgressReporting::CHAPTER_PERCENT ?
-        toc_position.progress_percent :
-        state->reader->get_global_progress_percent(address)
-    );
-    state->token_view->set_title_progress(progress_percent);
+    auto progress_reporting = state->token_view_styling.get_progress_reporting();
+    auto page_progress = state->token_view->get_page_progress(address);
+    if (progress_reporting == ProgressReporting::CHAPTER_PERCENT)
+    {
+        state->token_view->set_title_progress(toc_position.progress_percent);
+    }
+    else if (progress_reporting == ProgressReporting::PAGE_NUMBER && page_progress)
+    {
+        state->token_view->set_title_progress(*page_progress);
+    }
+    else
+    {
+        // Page numbers show book percent until laid out
+        state->token_view->set_title_progress(
+            state->reader->get_global_progress_percent(address),
+            state->reader->is_progress_estimated()
+        );
+    }
 }
 
 bool ReaderView::render(SDL_Surface *dest_surface, bool force_render)
@@ -178,6 +592,11 @@ bool ReaderView::render(SDL_Surface *dest_surface, bool force_render)
     return state->token_view->render(dest_surface, force_render);
 }
 
+const std::vector<SDL_Rect> &ReaderView::get_dirty_rects() const
+{
+    return state->token_view->get_dirty_rects();
+}
+
 bool ReaderView::is_done()
 {
     return state->is_done;
@@ -204,6 +623,12 @@ void ReaderView::on_keypress(SDLKey key)
         case SW_BTN_SELECT:
             open_toc_menu(*this, *state);
             break;
+        case SW_BTN_Y:
+            open_search(*this, *state);
+            break;
+        case SW_BTN_START:
+            open_page_menu(*this, *state);
+            break;
         default:
             state->token_view->on_keypress(key);
             break;
@@ -225,6 +650,26 @@ void ReaderView::set_on_change_address(std::function<void(DocAddr)> callback)
     state->on_change_address = callback;
 }
 
+void ReaderView::set_on_background_work(std::function<void()> callback)
+{
+    state->on_background_work = callback;
+}
+
+bool ReaderView::run_background_task()
+{
+    bool more_work = state->reader->run_background_task();
+    if (!more_work)
+    {
+        more_work = state->token_view->build_page_map_step();
+    }
+
+    // Progress estimate may have been refined
+    update_token_view_title(get_current_address(*state));
+
+    state->background_work_pending = more_work;
+    return more_work;
+}
+
 void ReaderView::seek_to_toc_index(uint32_t toc_index)
 {
     auto address = state->reader->get_toc_item_address(toc_index);
@@ -3,11 +3,13 @@
 
 #include "doc_api/doc_addr.h"
 #include "reader/view.h"
+#include "util/task_queue.h"
 
 #include <filesystem>
 #include <functional>
 #include <string>
 
+class DocReaderCache;
 struct DocReader;
 struct ReaderViewState;
 struct SystemStyling;
@@ -24,16 +26,19 @@ public:
     ReaderView(
         std::filesystem::path path,
         std::shared_ptr<DocReader> reader,
+        DocReaderCache &reader_cache,
         DocAddr seek_address,
         SystemStyling &sys_styling,
         TokenViewStyling &token_view_styling,
-        ViewStack &view_stack
+        ViewStack &view_stack,
+        background_func run_in_background
     );
     ReaderView(const ReaderView &) = delete;
     ReaderView &operator=(const ReaderView &) = delete;
     virtual ~ReaderView();
 
     bool render(SDL_Surface *dest_surface, bool force_render) override;
+    const std::vector<SDL_Rect> &get_dirty_rects() const override;
     bool is_done() override;
 
     void on_keypress(SDLKey key) override;
@@ -41,6 +46,11 @@ public:
 
     void set_on_quit_requested(std::function<void()> callback);
     void set_on_change_address(std::function<void(DocAddr)> callback);
+    // Called when work becomes available after run_background_task returned false
+    void set_on_background_work(std::function<void()> callback);
+
+    // Run deferred reader work, then page layout. Return true if more remains.
+    bool run_background_task();
 
     void seek_to_toc_index(uint32_t toc_index);
     void seek_to_address(DocAddr address);
@@ -0,0 +1,235 @@
+#include "./search_view.h"
+
+#include "reader/system_styling.h"
+#include "sys/keymap.h"
+#include "sys/screen.h"
+#include "util/sdl_utils.h"
+
+#include <vector>
+
+namespace
+{
+
+#define KEY_SPACE  "spc"
+#define KEY_DELETE "del"
+#define KEY_SEARCH "go"
+
+const std::vector<std::vector<const char *>> KEYBOARD_ROWS = {
+    {"a", "b", "c", "d", "e", "f", "g", "h", "i", "j"},
+    {"k", "l", "m", "n", "o", "p", "q", "r", "s", "t"},
+    {"u", "v", "w", "x", "y", "z", "0", "1", "2", "3"},
+    {"4", "5", "6", "7", "8", "9", KEY_SPACE, KEY_DELETE, KEY_SEARCH},
+};
+
+const uint32_t KEYBOARD_COLUMNS = 10;
+
+int wrap(int value, int size)
+{
+    return (value % size + size) % size;
+}
+
+} // namespace
+
+SearchView::SearchView(const std::string &query, SystemStyling &styling)
+    : query(query),
+      styling(styling),
+      styling_sub_id(styling.subscribe_to_changes([this](SystemStyling::ChangeId) {
+          needs_render = true;
+      })),
+      scroll_throttle(250, 100)
+{
+}
+
+SearchView::~SearchView()
+{
+    styling.unsubscribe_from_changes(styling_sub_id);
+}
+
+void SearchView::set_on_search(std::function<void(const std::string &)> callback)
+{
+    on_search = callback;
+}
+
+void SearchView::close()
+{
+    _is_done = true;
+}
+
+void SearchView::move_cursor(int d_row, int d_col)
+{
+    cursor_row = wrap(cursor_row + d_row, KEYBOARD_ROWS.size());
+    const auto &row = KEYBOARD_ROWS[cursor_row];
+    cursor_col = d_col ? wrap(cursor_col + d_col, row.size()) : std::min<uint32_t>(cursor_col, row.size() - 1);
+    needs_render = true;
+}
+
+void SearchView::press_key()
+{
+    std::string key = KEYBOARD_ROWS[cursor_row][cursor_col];
+    if (key == KEY_SEARCH)
+    {
+        search();
+        return;
+    }
+
+    if (key == KEY_DELETE)
+    {
+        if (!query.empty())
+        {
+            query.pop_back();
+        }
+    }
+    else if (key == KEY_SPACE)
+    {
+        if (!query.empty() && query.back() != ' ')
+        {
+            query.push_back(' ');
+        }
+    }
+    else
+    {
+        query += key;
+    }
+    needs_render = true;
+}
+
+void SearchView::search()
+{
+    if (on_search && query.find_first_not_of(' ') != std::string::npos)
+    {
+        on_search(query);
+    }
+}
+
+bool SearchView::render(SDL_Surface *dest_surface, bool force_render)
+{
+    if (!needs_render && !force_render)
+    {
+        return false;
+    }
+    needs_render = false;
+
+    TTF_Font *font = styling.get_loaded_font();
+    const auto &theme = styling.get_loaded_color_theme();
+    const int line_height = detect_line_height(font) + line_padding;
+
+    auto fill = [dest_surface](SDL_Rect rect, const SDL_Color &color) {
+        SDL_FillRect(dest_surface, &rect, SDL_MapRGB(dest_surface->format, color.r, color.g, color.b));
+    };
+    auto draw_text = [dest_surface, font](const std::string &text, Sint16 x, Sint16 y, const SDL_Color &fg, const SDL_Color &bg) {
+        auto surface = surface_unique_ptr { TTF_RenderUTF8_Shaded(font, text.c_str(), fg, bg) };
+        SDL_Rect rect = {x, y, 0, 0};
+        SDL_BlitSurface(surface.get(), nullptr, dest_surface, &rect);
+        return surface->w;
+    };
+
+    // Clear screen
+    fill({0, 0, static_cast<Uint16>(SCREEN_WIDTH), static_cast<Uint16>(SCREEN_HEIGHT)}, theme.background);
+
+    // Query
+    Sint16 y = line_padding;
+    draw_text("Search: " + query + "_", line_padding, y + line_padding / 2, theme.main_text, theme.background);
+    y += line_height * 2;
+
+    // Keys
+    const Uint16 key_w = SCREEN_WIDTH / KEYBOARD_COLUMNS;
+    const Uint16 key_h = line_height + line_padding * 2;
+    for (uint32_t row = 0; row < KEYBOARD_ROWS.size(); ++row)
+    {
+        for (uint32_t col = 0; col < KEYBOARD_ROWS[row].size(); ++col)
+        {
+            bool is_highlighted = row == cursor_row && col == cursor_col;
+            const SDL_Color &bg = is_highlighted ? theme.highlight_background : theme.background;
+            const SDL_Color &fg = is_highlighted ? theme.highlight_text : theme.main_text;
+
+            SDL_Rect key_rect = {static_cast<Sint16>(col * key_w), y, key_w, key_h};
+            fill(key_rect, bg);
+
+            auto label = surface_unique_ptr { TTF_RenderUTF8_Shaded(font, KEYBOARD_ROWS[row][col], fg, bg) };
+            SDL_Rect label_rect = {
+                static_cast<Sint16>(key_rect.x + (key_w - label->w) / 2),
+                static_cast<Sint16>(key_rect.y + (key_h - label->h) / 2),
+                0, 0
+            };
+            SDL_BlitSurface(label.get(), nullptr, dest_surface, &label_rect);
+        }
+        y += key_h;
+    }
+
+    // Help
+    y += line_height;
+    draw_text("A: type  B: delete  Start: search", line_padding, y, theme.secondary_text, theme.background);
+
+    return true;
+}
+
+bool SearchView::is_done()
+{
+    return _is_done;
+}
+
+void SearchView::on_keypress(SDLKey key)
+{
+    switch (key)
+    {
+        case SW_BTN_UP:
+            move_cursor(-1, 0);
+            break;
+        case SW_BTN_DOWN:
+            move_cursor(1, 0);
+            break;
+        case SW_BTN_LEFT:
+            move_cursor(0, -1);
+            break;
+        case SW_BTN_RIGHT:
+            move_cursor(0, 1);
+            break;
+        case SW_BTN_A:
+            press_key();
+            break;
+        case SW_BTN_B:
+            if (query.empty())
+            {
+                _is_done = true;
+            }
+            else
+            {
+                query.pop_back();
+                needs_render = true;
+            }
+            break;
+        case SW_BTN_START:
+            search();
+            break;
+        case SW_BTN_SELECT:
+            _is_done = true;
+            break;
+        default:
+            break;
+    }
+}
+
+void SearchView::on_keyheld(SDLKey key, uint32_t held_time_ms)
+{
+    switch (key)
+    {
+        case SW_BTN_UP:
+        case SW_BTN_DOWN:
+        case SW_BTN_LEFT:
+        case SW_BTN_RIGHT:
+            if (scroll_throttle(held_time_ms))
+            {
+                on_keypress(key);
+            }
+            break;
+        case SW_BTN_B:
+            // Holding delete shouldn't close the view once the query is empty
+            if (!query.empty() && scroll_throttle(held_time_ms))
+            {
+                on_keypress(key);
+            }
+            break;
+        default:
+            break;
+    }
+}
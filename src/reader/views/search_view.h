@@ -0,0 +1,47 @@
+#ifndef SEARCH_VIEW_H_
+#define SEARCH_VIEW_H_
+
+#include "reader/view.h"
+#include "util/throttled.h"
+
+#include <functional>
+#include <string>
+
+struct SystemStyling;
+
+// On-screen keyboard for entering a search query
+class SearchView: public View
+{
+    bool needs_render = true;
+    bool _is_done = false;
+
+    std::string query;
+    uint32_t cursor_row = 0;
+    uint32_t cursor_col = 0;
+
+    SystemStyling &styling;
+    const uint32_t styling_sub_id;
+
+    const int line_padding = 4;
+    Throttled scroll_throttle;
+
+    std::function<void(const std::string &)> on_search;
+
+    void move_cursor(int d_row, int d_col);
+    void press_key();
+    void search();
+
+public:
+    SearchView(const std::string &query, SystemStyling &styling);
+    virtual ~SearchView();
+
+    void set_on_search(std::function<void(const std::string &)> callback);
+    void close();
+
+    bool render(SDL_Surface *dest_surface, bool force_render) override;
+    bool is_done() override;
+    void on_keypress(SDLKey key) override;
+    void on_keyheld(SDLKey key, uint32_t held_time_ms) override;
+};
+
+#endif
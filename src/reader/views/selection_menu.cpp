@@ -1,3 +1,4 @@
+#include <algorithm>
 #include <iostream>
 #include "./selection_menu.h"
 
@@ -17,6 +18,11 @@ uint32_t SelectionMenu::excess_pxl_y() const
     return SCREEN_HEIGHT - num_display_lines() * line_height;
 }
 
+int SelectionMenu::row_height() const
+{
+    return std::max(text_height, static_cast<int>(icon_height)) + line_padding;
+}
+
 SelectionMenu::SelectionMenu(SystemStyling &styling)
     : SelectionMenu({}, styling)
 {
@@ -27,20 +33,21 @@ SelectionMenu::SelectionMenu(std::vector<std::string> entries, SystemStyling &st
       styling(styling),
       styling_sub_id(styling.subscribe_to_changes([this](SystemStyling::ChangeId) {
           needs_render = true;
-          int new_line_height = detect_line_height(
+          text_height = detect_line_height(
               this->styling.get_font_name(),
               this->styling.get_font_size()
-          ) + line_padding;
-          if (new_line_height != line_height)
+          );
+          if (row_height() != line_height)
           {
-              line_height = new_line_height;
+              line_height = row_height();
               set_cursor_pos(cursor_pos);
           }
       })),
-      line_height(detect_line_height(
+      text_height(detect_line_height(
           styling.get_font_name(),
           styling.get_font_size()
-      ) + line_padding),
+      )),
+      line_height(text_height + line_padding),
       scroll_throttle(250, 100)
 {
 }
@@ -57,6 +64,15 @@ void SelectionMenu::set_entries(std::vector<std::string> new_entries)
     needs_render = true;
 }
 
+void SelectionMenu::set_entry(uint32_t index, std::string text)
+{
+    if (index < entries.size() && entries[index] != text)
+    {
+        entries[index] = std::move(text);
+        needs_render = true;
+    }
+}
+
 void SelectionMenu::set_on_selection(std::function<void(uint32_t)> callback)
 {
     on_selection = callback;
@@ -77,6 +93,15 @@ void SelectionMenu::set_close_on_select()
     close_on_select = true;
 }
 
+void SelectionMenu::set_entry_icons(uint16_t width, uint16_t height, std::function<void(uint32_t index, SDL_Surface *dest, SDL_Rect rect)> callback)
+{
+    icon_width = width;
+    icon_height = height;
+    draw_icon = callback;
+    line_height = row_height();
+    set_cursor_pos(cursor_pos);
+}
+
 void SelectionMenu::set_cursor_pos(const std::string &entry)
 {
     for (uint32_t i = 0; i < entries.size(); ++i)
@@ -115,6 +140,11 @@ void SelectionMenu::set_cursor_pos(uint32_t new_cursor_pos)
     needs_render = true;
 }
 
+uint32_t SelectionMenu::get_cursor_pos() const
+{
+    return cursor_pos;
+}
+
 void SelectionMenu::close()
 {
     _is_done = true;
@@ -169,11 +199,24 @@ bool SelectionMenu::render(SDL_Surface *dest_surface, bool force_render)
             SDL_FillRect(dest_surface, &rect, rect_highlight_color);
         }
 
+        Sint16 text_x = x;
+        if (draw_icon)
+        {
+            SDL_Rect icon_rect = {
+                x,
+                static_cast<Sint16>(y + (line_height - icon_height) / 2),
+                icon_width,
+                icon_height
+            };
+            draw_icon(global_i, dest_surface, icon_rect);
+            text_x += icon_width + line_padding;
+        }
+
         // Draw text
         {
             SDL_Rect rectMessage = {
-                x,
-                static_cast<Sint16>(y + line_padding / 2),
+                text_x,
+                static_cast<Sint16>(y + (line_height - text_height) / 2),
                 0, 0
             };
             auto message = surface_unique_ptr { TTF_RenderUTF8_Shaded(
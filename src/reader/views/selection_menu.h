@@ -25,7 +25,14 @@ class SelectionMenu: public View
     const uint32_t styling_sub_id;
 
     const int line_padding = 4;
+    int text_height;
     int line_height;
+    int row_height() const;
+
+    uint16_t icon_width = 0;
+    uint16_t icon_height = 0;
+    std::function<void(uint32_t, SDL_Surface *, SDL_Rect)> draw_icon;
+
     uint32_t num_display_lines() const;
     uint32_t excess_pxl_y() const;
 
@@ -47,14 +54,20 @@ public:
     virtual ~SelectionMenu();
 
     void set_entries(std::vector<std::string> new_entries);
+    // Change the text of one entry, keeping the cursor where it is
+    void set_entry(uint32_t index, std::string text);
     void set_on_selection(std::function<void(uint32_t)> callback);
     void set_on_focus(std::function<void(uint32_t)> callback);
     // Define fallback keypress handler
     void set_default_on_keypress(std::function<void(SDLKey, SelectionMenu &)> callback);
     void set_close_on_select();
+    // Reserve space left of every entry for an icon drawn by the callback,
+    // growing rows to fit it
+    void set_entry_icons(uint16_t width, uint16_t height, std::function<void(uint32_t index, SDL_Surface *dest, SDL_Rect rect)> draw_icon);
 
     void set_cursor_pos(const std::string &entry);
     void set_cursor_pos(uint32_t pos);
+    uint32_t get_cursor_pos() const;
 
     void close();
 
@@ -16,6 +16,7 @@ struct DisplayLine
 
     DocAddr address;
     Type type;
+    bool starts_token = false;  // First line laid out from its token
 
     DisplayLine(DocAddr address, Type type);
     virtual ~DisplayLine() = default;
@@ -3,11 +3,14 @@
 #include "doc_api/token_addressing.h"
 #include "reader/text_wrap.h"
 #include "sys/screen.h"
+#include "util/jpeg_decode.h"
 #include "util/sdl_utils.h"
 #include "util/str_utils.h"
 
 #include "extern/rotozoom/SDL_rotozoom.h"
 
+#include <algorithm>
+#include <cctype>
 #include <filesystem>
 #include <iostream>
 
@@ -16,6 +19,12 @@ namespace
 
 const std::string BULLET = "•";
 
+// Space held for an image that can't be sized until it is decoded
+ImageSize placeholder_image_size(uint32_t line_height_pixels)
+{
+    return ImageSize {static_cast<uint32_t>(SCREEN_WIDTH / 2), line_height_pixels * 4};
+}
+
 uint32_t get_line_for_address(const IndexedDequeue<std::unique_ptr<DisplayLine>> &lines, DocAddr address)
 {
     int best_line = lines.start_index();
@@ -48,17 +57,165 @@ float scale_to_fit_width(int w)
     return 1;
 }
 
+// Matches the output size of zoomSurface
+uint32_t scale_dimension(uint32_t size, float scale)
+{
+    if (scale == 1)
+    {
+        return size;
+    }
+    return std::max(1, static_cast<int>(static_cast<double>(size) * scale));
+}
+
+std::string image_format(const std::filesystem::path &path)
+{
+    std::string ext = path.extension().string();
+    return ext.empty() ? ext : ext.substr(1);
+}
+
+bool is_jpeg_format(std::string format)
+{
+    for (auto &c : format)
+    {
+        c = std::tolower(c);
+    }
+    return format == "jpg" || format == "jpeg";
+}
+
+// Large JPEGs are scaled by the decoder first, so the full resolution image
+// is never held in memory. The remaining scale matches the layout size.
+surface_unique_ptr decode_downscaled_jpeg(const ResourceData &img_data, ImageSize full_size)
+{
+    auto decoded = decode_jpeg_downscaled(img_data.data(), img_data.size(), SCREEN_WIDTH);
+    if (!decoded)
+    {
+        return nullptr;
+    }
+
+    auto img_surface = surface_unique_ptr { SDL_ConvertSurface(decoded.get(), get_render_surface_format(), 0) };
+    decoded.reset();
+    if (!img_surface)
+    {
+        return nullptr;
+    }
+
+    float scale = scale_to_fit_width(full_size.width);
+    double zoom_x = (scale_dimension(full_size.width, scale) + 0.5) / img_surface->w;
+    double zoom_y = (scale_dimension(full_size.height, scale) + 0.5) / img_surface->h;
+    return surface_unique_ptr { zoomSurface(img_surface.get(), zoom_x, zoom_y, 1) };
+}
+
+// Safe to call from a worker thread
+surface_unique_ptr decode_scaled_image(const ResourceData &img_data, const std::string &format)
+{
+    if (is_jpeg_format(format))
+    {
+        auto full_size = probe_image_size(img_data.data(), img_data.size());
+        if (full_size && full_size->width >= 2u * SCREEN_WIDTH)
+        {
+            auto surface = decode_downscaled_jpeg(img_data, *full_size);
+            if (surface)
+            {
+                return surface;
+            }
+        }
+    }
+
+    auto img_surface = load_surface_from_ptr(
+        img_data.data(),
+        img_data.size(),
+        format,
+        get_render_surface_format()
+    );
+    if (!img_surface)
+    {
+        return nullptr;
+    }
+
+    float scale = scale_to_fit_width(img_surface->w);
+    if (scale != 1)
+    {
+        return surface_unique_ptr { zoomSurface(img_surface.get(), scale, scale, 1) };
+    }
+    return img_surface;
+}
+
 } // namespace
 
-std::vector<std::unique_ptr<DisplayLine>> TokenLineScroller::image_to_display_lines(const ImageDocToken &token)
+std::optional<ImageSize> TokenLineScroller::get_scaled_image_size(const std::filesystem::path &path, DocAddr address, bool may_decode)
+{
+    auto it = scaled_image_sizes.find(path);
+    if (it != scaled_image_sizes.end())
+    {
+        return it->second;
+    }
+
+    auto size = reader->get_image_size(path);
+    if (size)
+    {
+        float scale = scale_to_fit_width(size->width);
+        size = ImageSize {scale_dimension(size->width, scale), scale_dimension(size->height, scale)};
+    }
+    else if (images_failed.count(path))
+    {
+        return std::nullopt;
+    }
+    else if (!may_decode)
+    {
+        return placeholder_image_size(line_height_pixels);
+    }
+    else if (run_in_background)
+    {
+        // Format without a known header layout. Hold space while it is decoded
+        // in the background, the line is laid out again once its size is known.
+        SDL_Surface *image = load_scaled_image(path, address);
+        if (!image)
+        {
+            if (images_failed.count(path))
+            {
+                return std::nullopt;
+            }
+            images_sized_on_load.insert(path);
+            return placeholder_image_size(line_height_pixels);
+        }
+        size = ImageSize {static_cast<uint32_t>(image->w), static_cast<uint32_t>(image->h)};
+    }
+    else
+    {
+        // Format without a known header layout, decode to find out
+        auto img_data = reader->load_resource_data(path);
+        SDL_Surface *image = nullptr;
+        if (!img_data.empty() && !image_format(path).empty())
+        {
+            auto surface = decode_scaled_image(img_data, image_format(path));
+            if (surface)
+            {
+                image = surface.get();
+                image_cache.put_image(path, std::move(surface), address);
+            }
+        }
+        if (!image)
+        {
+            std::cerr << "Failed to load image: " << path << std::endl;
+            return std::nullopt;
+        }
+        size = ImageSize {static_cast<uint32_t>(image->w), static_cast<uint32_t>(image->h)};
+    }
+
+    scaled_image_sizes.emplace(path, *size);
+    return size;
+}
+
+std::vector<std::unique_ptr<DisplayLine>> TokenLineScroller::image_to_display_lines(const DocToken &token, bool may_decode)
 {
-    SDL_Surface *image = load_scaled_image(token.path);
+    std::filesystem::path path = token.path();
+    auto size = get_scaled_image_size(path, token.address, may_decode);
 
     std::vector<std::unique_ptr<DisplayLine>> lines;
-    if (image && image->h)
+    if (size && size->width && size->height)
     {
-        int num_lines = (image->h + line_height_pixels - 1) / line_height_pixels;
-        lines.emplace_back(std::make_unique<ImageLine>(token.address, token.path, num_lines, image->w, image->h));
+        int num_lines = (size->height + line_height_pixels - 1) / line_height_pixels;
+        lines.emplace_back(std::make_unique<ImageLine>(token.address, path, num_lines, size->width, size->height));
         for (int i = 1; i < num_lines; ++i)
         {
             lines.emplace_back(std::make_unique<ImageRefLine>(token.address, i));
@@ -68,18 +225,18 @@ std::vector<std::unique_ptr<DisplayLine>> TokenLineScroller::image_to_display_li
     {
         // Fallback for error loading image
         lines.emplace_back(std::make_unique<TextLine>(token.address, ""));
-        lines.emplace_back(std::make_unique<TextLine>(token.address, "[Image " + token.path.string() + "]"));
+        lines.emplace_back(std::make_unique<TextLine>(token.address, "[Image " + path.string() + "]"));
         lines.emplace_back(std::make_unique<TextLine>(token.address, ""));
     }
     return lines;
 }
 
 
-std::vector<std::unique_ptr<DisplayLine>> TokenLineScroller::render_display_lines(const DocToken &token)
+std::vector<std::unique_ptr<DisplayLine>> TokenLineScroller::render_display_lines(const DocToken &token, bool may_decode)
 {
     if (token.type == TokenType::Image)
     {
-        return image_to_display_lines(static_cast<const ImageDocToken &>(token));
+        return image_to_display_lines(token, may_decode);
     }
     else
     {
@@ -88,22 +245,21 @@ std::vector<std::unique_ptr<DisplayLine>> TokenLineScroller::render_display_line
 
         if (token.type == TokenType::Text)
         {
-            text = static_cast<const TextDocToken &>(token).text;
+            text = token.text;
         }
         else if (token.type == TokenType::ListItem)
         {
-            const ListItemDocToken &list_token = static_cast<const ListItemDocToken &>(token);
-            int nest_level = list_token.nest_level;
+            int nest_level = token.nest_level;
             std::string prefix = std::string(
                 (nest_level > 1 ? nest_level - 1 : 0) * 2,
                 ' '
             ) + BULLET + " ";
-            text = prefix + list_token.text;
+            text = prefix + std::string(token.text);
             extra_text_width = get_address_width(prefix);
         }
         else if (token.type == TokenType::Header)
         {
-            text = static_cast<const HeaderDocToken &>(token).text;
+            text = token.text;
         }
         else
         {
@@ -112,7 +268,7 @@ std::vector<std::unique_ptr<DisplayLine>> TokenLineScroller::render_display_line
 
         DocAddr address = token.address;
         std::vector<std::unique_ptr<DisplayLine>> lines;
-        wrap_lines(text.c_str(), line_fits, [type=token.type, &lines, &address, extra_text_width](const char *str, uint32_t len) {
+        wrap_lines(text.c_str(), line_fits, line_probably_fits, [type=token.type, &lines, &address, extra_text_width](const char *str, uint32_t len) {
             std::string line_text(str, len);
             bool centered = type == TokenType::Header;
 
@@ -142,7 +298,12 @@ void TokenLineScroller::get_more_lines_forward(uint32_t num_lines)
             break;
         }
 
-        for (auto &line : render_display_lines(*token))
+        std::vector<std::unique_ptr<DisplayLine>> lines = render_display_lines(*token, true);
+        if (!lines.empty())
+        {
+            lines.front()->starts_token = true;
+        }
+        for (auto &line : lines)
         {
             lines_buf.append(std::move(line));
             if (num_lines > 0)
@@ -164,7 +325,11 @@ void TokenLineScroller::get_more_lines_backward(uint32_t num_lines)
             break;
         }
 
-        std::vector<std::unique_ptr<DisplayLine>> lines = render_display_lines(*token);
+        std::vector<std::unique_ptr<DisplayLine>> lines = render_display_lines(*token, true);
+        if (!lines.empty())
+        {
+            lines.front()->starts_token = true;
+        }
         for (auto it = lines.rbegin(); it != lines.rend(); ++it)
         {
             lines_buf.prepend(std::move(*it));
@@ -176,6 +341,70 @@ void TokenLineScroller::get_more_lines_backward(uint32_t num_lines)
     }
 }
 
+bool TokenLineScroller::drop_first_token()
+{
+    int token_end = lines_buf.start_index() + 1;
+    while (token_end < lines_buf.end_index() && !lines_buf[token_end]->starts_token)
+    {
+        ++token_end;
+    }
+
+    // Keep a margin of lines around the current line
+    if (token_end > current_line - static_cast<int>(max_buffered_lines / 4))
+    {
+        return false;
+    }
+
+    while (lines_buf.start_index() < token_end)
+    {
+        lines_buf.pop_front();
+    }
+    backward_it->read(1);
+    global_first_line = std::nullopt;
+    return true;
+}
+
+bool TokenLineScroller::drop_last_token()
+{
+    int token_start = lines_buf.end_index() - 1;
+    while (token_start > lines_buf.start_index() && !lines_buf[token_start]->starts_token)
+    {
+        --token_start;
+    }
+
+    if (token_start < current_line + static_cast<int>(max_buffered_lines / 4))
+    {
+        return false;
+    }
+
+    while (lines_buf.end_index() > token_start)
+    {
+        lines_buf.pop_back();
+    }
+    forward_it->read(-1);
+    global_end_line = std::nullopt;
+    return true;
+}
+
+void TokenLineScroller::trim_buffer()
+{
+    if (!max_buffered_lines)
+    {
+        return;
+    }
+
+    while (lines_buf.size() > max_buffered_lines)
+    {
+        int lines_before = current_line - lines_buf.start_index();
+        int lines_after = lines_buf.end_index() - current_line;
+        bool dropped = lines_before > lines_after ? drop_first_token() : drop_last_token();
+        if (!dropped)
+        {
+            break;
+        }
+    }
+}
+
 void TokenLineScroller::clear_buffer()
 {
     lines_buf.clear();
@@ -193,22 +422,35 @@ void TokenLineScroller::initialize_buffer_at(DocAddr address)
 
     materialize_line(0);
     current_line = get_line_for_address(lines_buf, address);
+    update_reading_position();
 }
 
 TokenLineScroller::TokenLineScroller(
     const std::shared_ptr<DocReader> reader,
     DocAddr address,
     std::function<bool(const char *, uint32_t)> line_fits,
-    uint32_t line_height_pixels
+    std::function<bool(const char *, uint32_t)> line_probably_fits,
+    uint32_t line_height_pixels,
+    background_func run_in_background
 ) : reader(reader),
     forward_it(nullptr),
     backward_it(nullptr),
     line_fits(line_fits),
-    line_height_pixels(line_height_pixels)
+    line_probably_fits(line_probably_fits),
+    line_height_pixels(line_height_pixels),
+    run_in_background(run_in_background)
 {
     initialize_buffer_at(address);
 }
 
+void TokenLineScroller::update_reading_position()
+{
+    if (current_line >= lines_buf.start_index() && current_line < lines_buf.end_index())
+    {
+        image_cache.set_reading_position(lines_buf[current_line]->address);
+    }
+}
+
 void TokenLineScroller::materialize_line(int line_num)
 {
     int forward_needed = line_num - lines_buf.end_index() + 1;
@@ -245,6 +487,8 @@ void TokenLineScroller::seek_lines_relative(int offset)
 {
     current_line += offset;
     materialize_line(current_line);
+    trim_buffer();
+    update_reading_position();
 }
 
 void TokenLineScroller::seek_to_address(DocAddr address)
@@ -268,6 +512,17 @@ void TokenLineScroller::set_line_height_pixels(uint32_t new_height)
     line_height_pixels = new_height;
 }
 
+void TokenLineScroller::set_max_buffered_lines(uint32_t max_lines)
+{
+    max_buffered_lines = max_lines;
+    trim_buffer();
+}
+
+std::vector<std::unique_ptr<DisplayLine>> TokenLineScroller::layout_token(const DocToken &token)
+{
+    return render_display_lines(token, false);
+}
+
 std::optional<int> TokenLineScroller::first_line_number() const
 {
     return global_first_line;
@@ -278,7 +533,7 @@ std::optional<int> TokenLineScroller::end_line_number() const
     return global_end_line;
 }
 
-SDL_Surface *TokenLineScroller::load_scaled_image(const std::filesystem::path &path)
+SDL_Surface *TokenLineScroller::load_scaled_image(const std::filesystem::path &path, DocAddr address)
 {
     {
         SDL_Surface *image = image_cache.get_image(path);
@@ -288,42 +543,90 @@ SDL_Surface *TokenLineScroller::load_scaled_image(const std::filesystem::path &p
         }
     }
 
-    auto img_data = reader->load_resource(path);
-    if (img_data.empty())
+    std::string key = path;
+    if (images_loading.count(key) || images_failed.count(key))
     {
-        std::cerr << "Failed to read image data: " << path << std::endl;
         return nullptr;
     }
 
-    std::string file_ext;
-    try
-    {
-        file_ext = path.extension().string().substr(1);
-    }
-    catch (const std::out_of_range &)
+    std::string format = image_format(path);
+    auto img_data = reader->load_resource_data(path);
+    if (img_data.empty() || format.empty())
     {
+        std::cerr << "Failed to read image data: " << path << std::endl;
+        images_failed.insert(key);
         return nullptr;
     }
 
-    auto img_surface = load_surface_from_ptr(
-        img_data.data(),
-        img_data.size(),
-        file_ext.c_str(),
-        get_render_surface_format()
-    );
-    if (!img_surface)
+    if (!run_in_background)
     {
-        std::cerr << "Failed to load image: " << path << std::endl;
-        return nullptr;
+        auto surface = decode_scaled_image(img_data, format);
+        if (!surface)
+        {
+            std::cerr << "Failed to load image: " << path << std::endl;
+            images_failed.insert(key);
+            return nullptr;
+        }
+        image_cache.put_image(key, std::move(surface), address);
+        return image_cache.get_image(key);
     }
 
-    float scale = scale_to_fit_width(img_surface->w);
-    image_cache.put_image(
-        path,
-        scale != 1 ? 
-            surface_unique_ptr { zoomSurface(img_surface.get(), scale, scale, 1) } :
-            std::move(img_surface)
+    images_loading.insert(key);
+
+    // Surface is created on the worker and handed over on completion
+    auto result = std::make_shared<surface_unique_ptr>();
+    run_in_background(
+        [img_data, format, result]() {
+            *result = decode_scaled_image(img_data, format);
+        },
+        [this, alive = std::weak_ptr<bool>(alive_token), key, address, result]() {
+            if (!alive.lock())
+            {
+                return;
+            }
+
+            images_loading.erase(key);
+            if (*result)
+            {
+                if (images_sized_on_load.count(key))
+                {
+                    scaled_image_sizes.emplace(key, ImageSize {static_cast<uint32_t>((*result)->w), static_cast<uint32_t>((*result)->h)});
+                }
+                image_cache.put_image(key, std::move(*result), address);
+            }
+            else
+            {
+                std::cerr << "Failed to load image: " << key << std::endl;
+                images_failed.insert(key);
+            }
+
+            // Replace the placeholder with the decoded size, or the failed image text
+            if (images_sized_on_load.erase(key))
+            {
+                reset_buffer();
+            }
+
+            if (on_image_loaded)
+            {
+                on_image_loaded();
+            }
+        }
     );
 
-    return image_cache.get_image(path);
+    return nullptr;
+}
+
+bool TokenLineScroller::image_failed(const std::filesystem::path &path) const
+{
+    return images_failed.count(path) > 0;
+}
+
+void TokenLineScroller::set_on_image_loaded(std::function<void()> callback)
+{
+    on_image_loaded = callback;
+}
+
+const ImageCacheStats &TokenLineScroller::get_image_cache_stats() const
+{
+    return image_cache.get_stats();
 }
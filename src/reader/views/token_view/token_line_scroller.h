@@ -5,12 +5,17 @@
 
 #include "doc_api/doc_addr.h"
 #include "doc_api/doc_reader.h"
+#include "util/image_probe.h"
 #include "util/indexed_dequeue.h"
 #include "util/sdl_image_cache.h"
 #include "util/sdl_pointer.h"
+#include "util/task_queue.h"
 
 #include <functional>
+#include <memory>
 #include <optional>
+#include <unordered_map>
+#include <unordered_set>
 
 // Lazy renders tokens into lines of text, and provides access to the lines
 // through an infinite-scroll type interface.
@@ -20,6 +25,7 @@ class TokenLineScroller
     std::shared_ptr<TokenIter> forward_it;
     std::shared_ptr<TokenIter> backward_it;
     std::function<bool(const char *, uint32_t)> line_fits;
+    std::function<bool(const char *, uint32_t)> line_probably_fits;
 
     std::optional<int> global_first_line;
     std::optional<int> global_end_line;
@@ -28,23 +34,42 @@ class TokenLineScroller
     int current_line = 0;
 
     IndexedDequeue<std::unique_ptr<DisplayLine>> lines_buf;
+    uint32_t max_buffered_lines = 0;    // 0 for unbounded
     SDLImageCache image_cache;
 
-    std::vector<std::unique_ptr<DisplayLine>> image_to_display_lines(const ImageDocToken &token);
-    std::vector<std::unique_ptr<DisplayLine>> render_display_lines(const DocToken &token);
+    // Images are laid out from their header dimensions and decoded in the
+    // background. Images without a readable header are laid out with a
+    // placeholder size until decoded.
+    background_func run_in_background;
+    std::function<void()> on_image_loaded;
+    std::unordered_map<std::string, ImageSize> scaled_image_sizes;
+    std::unordered_set<std::string> images_loading;
+    std::unordered_set<std::string> images_failed;
+    std::unordered_set<std::string> images_sized_on_load;
+    std::shared_ptr<bool> alive_token = std::make_shared<bool>(true);
+
+    std::optional<ImageSize> get_scaled_image_size(const std::filesystem::path &path, DocAddr address, bool may_decode);
+    std::vector<std::unique_ptr<DisplayLine>> image_to_display_lines(const DocToken &token, bool may_decode);
+    std::vector<std::unique_ptr<DisplayLine>> render_display_lines(const DocToken &token, bool may_decode);
 
     void get_more_lines_forward(uint32_t num);
     void get_more_lines_backward(uint32_t num);
     void clear_buffer();
     void initialize_buffer_at(DocAddr address);
     void materialize_line(int line_num);
+    void update_reading_position();
+    bool drop_first_token();
+    bool drop_last_token();
+    void trim_buffer();
 
 public:
     TokenLineScroller(
         const std::shared_ptr<DocReader> reader,
         DocAddr address,
         std::function<bool(const char *, uint32_t)> line_fits,
-        uint32_t line_height_pixels
+        std::function<bool(const char *, uint32_t)> line_probably_fits,
+        uint32_t line_height_pixels,
+        background_func run_in_background
     );
 
     const DisplayLine *get_line_relative(int offset);
@@ -53,11 +78,23 @@ public:
     void seek_to_address(DocAddr address);
     void reset_buffer();
     void set_line_height_pixels(uint32_t line_height_pixels);
+    // Lines far from the current line are dropped once the buffer exceeds this,
+    // and laid out again when scrolled back to.
+    void set_max_buffered_lines(uint32_t max_lines);
+
+    // Lines of a token outside the buffer, wrapped as the buffer's are. Images
+    // are sized from their headers or earlier decodes, but not decoded, so an
+    // image without a readable header takes the placeholder size.
+    std::vector<std::unique_ptr<DisplayLine>> layout_token(const DocToken &token);
 
     std::optional<int> first_line_number() const;
     std::optional<int> end_line_number() const;
 
-    SDL_Surface *load_scaled_image(const std::filesystem::path &path);
+    // Returns null while the image is being decoded in the background, or if it failed to load.
+    SDL_Surface *load_scaled_image(const std::filesystem::path &path, DocAddr address);
+    bool image_failed(const std::filesystem::path &path) const;
+    void set_on_image_loaded(std::function<void()> callback);
+    const ImageCacheStats &get_image_cache_stats() const;
 };
 
 #endif
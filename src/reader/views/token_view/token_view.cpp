@@ -4,16 +4,42 @@
 #include "./token_view_styling.h"
 
 #include "doc_api/doc_reader.h"
+#include "doc_api/token_arena.h"
+#include "reader/config.h"
+#include "reader/page_map.h"
 #include "reader/system_styling.h"
 #include "reader/shoulder_keymap.h"
 #include "sys/keymap.h"
 #include "sys/screen.h"
+#include "util/sdl_font_cache.h"
+#include "util/sdl_text_cache.h"
 #include "util/sdl_utils.h"
 #include "util/throttled.h"
 
+#include <cstdlib>
+#include <iostream>
 #include <stdexcept>
+
+#define DEBUG 0
+
 namespace {
 
+uint32_t count_words(const std::string &text)
+{
+    uint32_t num_words = 0;
+    bool in_word = false;
+    for (char c : text)
+    {
+        bool is_space = c == ' ' || c == '\t' || c == '\n';
+        if (!is_space && !in_word)
+        {
+            ++num_words;
+        }
+        in_word = !is_space;
+    }
+    return num_words;
+}
+
 bool line_fits_on_screen(TTF_Font *font, int avail_width, const char *s, uint32_t len)
 {
     int w = avail_width, h;
@@ -38,22 +64,50 @@ struct TokenViewState
     const uint32_t token_view_styling_sub_id;
 
     TTF_Font *current_font = nullptr;
+    TextWidthEstimator width_estimator;
 
     const int line_padding = 4;
     int line_height;
 
     TokenLineScroller line_scroller;
 
+    // Rendered lines, so scrolling only rasterizes newly exposed lines
+    SDLTextCache line_cache;
+
+    // Last full frame drawn, which render() updates in place when it can
+    SDL_Surface *rendered_surface = nullptr;
+    int rendered_line_number = 0;
+    bool rendered_images = false;
+    bool frame_valid = false;
+    std::vector<SDL_Rect> dirty_rects;
+
     bool needs_render = true;
 
     std::string title;
-    int title_progress_percent = 0;
+    std::string title_progress = "0%";
 
     std::function<void(DocAddr)> on_scroll;
 
     Throttled line_scroll_throttle;
     Throttled page_scroll_throttle;
 
+    // Whole book layout for page numbers, built by TokenView::build_page_map_step.
+    // Tokens are read in batches on a worker, apart from the reading caches,
+    // and wrapped on this thread as line_scroller wraps them.
+    std::shared_ptr<DocReader> reader;
+    background_func run_in_background;
+    DocReaderCache *page_map_cache = nullptr;
+    std::optional<PageMap> page_map;
+    std::shared_ptr<TokenIter> page_map_iter;
+    TokenArena page_map_tokens;
+    size_t page_map_next_token = 0;
+    bool page_map_batch_pending = false;
+    bool page_map_tokens_done = false;
+    std::vector<DocAddr> page_map_lines;
+    uint32_t page_map_words = 0;
+    std::function<void()> on_page_map_pending;
+    std::shared_ptr<bool> alive_token = std::make_shared<bool>(true);
+
     int num_display_lines() const
     {
         return SCREEN_HEIGHT / line_height;
@@ -80,51 +134,200 @@ struct TokenViewState
         return SCREEN_HEIGHT - line_height - excess_pxl_y() / 2;
     }
 
-    TokenViewState(std::shared_ptr<DocReader> reader, DocAddr address, SystemStyling &sys_styling, TokenViewStyling &token_view_styling)
+    bool line_fits(const char *s, uint32_t len) const
+    {
+        return line_fits_on_screen(current_font, SCREEN_WIDTH - line_padding * 2, s, len);
+    }
+
+    bool line_probably_fits(const char *s, uint32_t len)
+    {
+        return width_estimator.width(s, len) <= SCREEN_WIDTH - line_padding * 2;
+    }
+
+    // Line breaks depend on the font and wrap width, and image heights on the line height
+    std::string page_map_cache_key() const
+    {
+        return PAGE_MAP_CACHE_KEY_PREFIX + std::filesystem::path(sys_styling.get_font_name()).filename().string() +
+            "_" + std::to_string(sys_styling.get_font_size()) +
+            "_" + std::to_string(SCREEN_WIDTH - line_padding * 2) +
+            "_" + std::to_string(line_height);
+    }
+
+    // Cache the built map, dropping maps of earlier layouts
+    void store_page_map()
+    {
+        auto book_id = reader->get_id();
+        auto key = page_map_cache_key();
+        for (const auto &cached_key: page_map_cache->get_keys(book_id))
+        {
+            if (cached_key != key && cached_key.rfind(PAGE_MAP_CACHE_KEY_PREFIX, 0) == 0)
+            {
+                page_map_cache->erase(book_id, cached_key);
+            }
+        }
+        page_map_cache->write(book_id, key, page_map->encode());
+    }
+
+    // Load the page map for the current layout, or flag that it needs building
+    void reset_page_map()
+    {
+        page_map.reset();
+        page_map_iter.reset();
+        page_map_tokens.clear();
+        page_map_next_token = 0;
+        page_map_batch_pending = false;
+        page_map_tokens_done = false;
+        page_map_lines.clear();
+        page_map_words = 0;
+
+        if (!page_map_cache)
+        {
+            return;
+        }
+
+        auto encoded = page_map_cache->read(reader->get_id(), page_map_cache_key());
+        if (encoded)
+        {
+            page_map = PageMap::decode(*encoded);
+        }
+        if (!page_map && on_page_map_pending)
+        {
+            on_page_map_pending();
+        }
+    }
+
+    // Read the next batch of tokens for the page map, on a worker if possible
+    void read_page_map_batch()
+    {
+        page_map_batch_pending = true;
+
+        auto iter = page_map_iter;
+        auto batch = std::make_shared<TokenArena>();
+        task_func work = [iter, batch]() {
+            for (uint32_t i = 0; i < PAGE_MAP_TOKENS_PER_BATCH; ++i)
+            {
+                const DocToken *token = iter->read(1);
+                if (!token)
+                {
+                    break;
+                }
+                batch->push_back(*token);
+            }
+        };
+        task_func on_done = [this, alive=std::weak_ptr<bool>(alive_token), iter, batch]() {
+            // Dropped if the layout changed while reading
+            if (!alive.lock() || iter != page_map_iter)
+            {
+                return;
+            }
+            page_map_batch_pending = false;
+            page_map_tokens_done = batch->size() < PAGE_MAP_TOKENS_PER_BATCH;
+            page_map_tokens = std::move(*batch);
+            page_map_next_token = 0;
+            if (on_page_map_pending)
+            {
+                on_page_map_pending();
+            }
+        };
+
+        if (run_in_background)
+        {
+            run_in_background(work, on_done);
+        }
+        else
+        {
+            work();
+            on_done();
+        }
+    }
+
+    // Cache the built map and let go of the layout state
+    void finish_page_map()
+    {
+        page_map = PageMap(std::move(page_map_lines), page_map_words);
+        store_page_map();
+        page_map_iter.reset();
+        page_map_tokens.clear();
+        page_map_next_token = 0;
+        page_map_tokens_done = false;
+        page_map_lines.clear();
+        page_map_words = 0;
+
+        #if DEBUG
+        std::cerr << "Page map: " << page_map->num_lines() << " lines" << std::endl;
+        #endif
+    }
+
+    TokenViewState(std::shared_ptr<DocReader> reader, DocAddr address, SystemStyling &sys_styling, TokenViewStyling &token_view_styling, background_func run_in_background)
         : sys_styling(sys_styling),
           token_view_styling(token_view_styling),
           sys_styling_sub_id(sys_styling.subscribe_to_changes([this](SystemStyling::ChangeId change_id) {
               if (change_id == SystemStyling::ChangeId::FONT_SIZE || change_id == SystemStyling::ChangeId::FONT_NAME)
               {
                   current_font = this->sys_styling.get_loaded_font();
+                  width_estimator.set_font(current_font);
                   line_height = detect_line_height(current_font) + line_padding;
                   line_scroller.set_line_height_pixels(line_height);
                   line_scroller.reset_buffer();  // need to re-wrap lines if font-size changed
+                  reset_page_map();
               }
               needs_render = true;
+              frame_valid = false;
           })),
           token_view_styling_sub_id(token_view_styling.subscribe_to_changes([this]() {
               needs_render = true;
+              frame_valid = false;
           })),
           current_font(sys_styling.get_loaded_font()),
+          width_estimator(current_font),
           line_height(detect_line_height(sys_styling.get_font_name(), sys_styling.get_font_size()) + line_padding),
           line_scroller(
               reader,
               address,
               [this](const char *s, uint32_t len) {
-                  return line_fits_on_screen(
-                      current_font,
-                      SCREEN_WIDTH - line_padding * 2,
-                      s,
-                      len
-                  );
+                  return line_fits(s, len);
+              },
+              [this](const char *s, uint32_t len) {
+                  return line_probably_fits(s, len);
               },
-              line_height
+              line_height,
+              run_in_background
           ),
           line_scroll_throttle(250, 50),
-          page_scroll_throttle(750, 150)
+          page_scroll_throttle(750, 150),
+          reader(reader),
+          run_in_background(run_in_background)
     {
+        line_scroller.set_max_buffered_lines(MAX_BUFFERED_DISPLAY_LINES);
+        line_scroller.set_on_image_loaded([this]() {
+            needs_render = true;
+            frame_valid = false;
+        });
     }
 
     ~TokenViewState()
     {
+        #if DEBUG
+        const auto &stats = line_cache.get_stats();
+        std::cerr << "Line cache: hits=" << stats.hits
+                  << " misses=" << stats.misses
+                  << " evictions=" << stats.evictions
+                  << " bytes=" << stats.size_bytes << std::endl;
+        const auto &image_stats = line_scroller.get_image_cache_stats();
+        std::cerr << "Image cache: hits=" << image_stats.hits
+                  << " misses=" << image_stats.misses
+                  << " evictions=" << image_stats.evictions
+                  << " images=" << image_stats.num_images
+                  << " bytes=" << image_stats.size_bytes << std::endl;
+        #endif
+
         sys_styling.unsubscribe_from_changes(sys_styling_sub_id);
         token_view_styling.unsubscribe_from_changes(token_view_styling_sub_id);
     }
 };
 
-TokenView::TokenView(std::shared_ptr<DocReader> reader, DocAddr address, SystemStyling &sys_styling, TokenViewStyling &token_view_styling)
-    : state(std::make_unique<TokenViewState>(reader, address, sys_styling, token_view_styling))
+TokenView::TokenView(std::shared_ptr<DocReader> reader, DocAddr address, SystemStyling &sys_styling, TokenViewStyling &token_view_styling, background_func run_in_background)
+    : state(std::make_unique<TokenViewState>(reader, address, sys_styling, token_view_styling, run_in_background))
 {
 }
 
@@ -132,164 +335,332 @@ TokenView::~TokenView()
 {
 }
 
-bool TokenView::render(SDL_Surface *dest_surface, bool force_render)
+namespace
 {
-    if (!state->needs_render && !force_render)
+
+void fill_rect(SDL_Surface *dest_surface, SDL_Rect rect, const SDL_Color &color)
+{
+    SDL_FillRect(
+        dest_surface,
+        &rect,
+        SDL_MapRGB(dest_surface->format, color.r, color.g, color.b)
+    );
+}
+
+void draw_outline(SDL_Surface *dest_surface, SDL_Rect rect, const SDL_Color &color)
+{
+    if (rect.w < 2 || rect.h < 2)
     {
-        return false;
+        return;
     }
-    state->needs_render = false;
 
-    scroll(0);  // Will adjust scroll position if necessary for end of book
+    fill_rect(dest_surface, {rect.x, rect.y, rect.w, 1}, color);
+    fill_rect(dest_surface, {rect.x, static_cast<Sint16>(rect.y + rect.h - 1), rect.w, 1}, color);
+    fill_rect(dest_surface, {rect.x, rect.y, 1, rect.h}, color);
+    fill_rect(dest_surface, {static_cast<Sint16>(rect.x + rect.w - 1), rect.y, 1, rect.h}, color);
+}
 
-    TTF_Font *font = state->current_font;
-    const auto &theme = state->sys_styling.get_loaded_color_theme();
-    const int line_height = state->line_height;
-    const int line_padding = state->line_padding;
+// Screen area holding the text lines
+SDL_Rect text_area_rect(const TokenViewState &state)
+{
+    return {
+        0,
+        static_cast<Sint16>(state.excess_pxl_y() / 2),
+        static_cast<Uint16>(SCREEN_WIDTH),
+        static_cast<Uint16>(state.num_text_display_lines() * state.line_height)
+    };
+}
 
-    // Clear screen
-    {
-        SDL_Rect rect = {0, 0, SCREEN_WIDTH, SCREEN_HEIGHT};
-        const auto &bgcolor = theme.background;
+// Screen area below the text lines, holding the title bar
+SDL_Rect title_bar_rect(const TokenViewState &state)
+{
+    Sint16 y = state.excess_pxl_y() / 2 + state.num_text_display_lines() * state.line_height;
+    return {0, y, static_cast<Uint16>(SCREEN_WIDTH), static_cast<Uint16>(SCREEN_HEIGHT - y)};
+}
 
-        SDL_FillRect(
-            dest_surface,
-            &rect,
-            SDL_MapRGB(dest_surface->format, bgcolor.r, bgcolor.g, bgcolor.b)
-        );
-    }
+// Returns false if there is no line at index i.
+bool render_line(TokenViewState &state, SDL_Surface *dest_surface, int i, Sint16 line_y)
+{
+    TTF_Font *font = state.current_font;
+    const auto &theme = state.sys_styling.get_loaded_color_theme();
+    const int line_height = state.line_height;
+    const int line_padding = state.line_padding;
 
-    int num_text_display_lines = state->num_text_display_lines();
-    const Uint16 padding_y = state->excess_pxl_y() / 2;
-    Sint16 line_y = padding_y;
+    const DisplayLine *line = state.line_scroller.get_line_relative(i);
+    if (!line)
+    {
+        return false;
+    }
 
-    for (int i = 0; i < num_text_display_lines; ++i)
+    if (line->type == DisplayLine::Type::Text)
     {
-        const DisplayLine *line = state->line_scroller.get_line_relative(i);
-        if (line)
+        const auto *text_line = static_cast<const TextLine *>(line);
+        SDL_Surface *surface = state.line_cache.render_shaded(font, text_line->text, theme.main_text, theme.background);
+        if (surface)
         {
-            if (line->type == DisplayLine::Type::Text)
+            SDL_Rect dest_rect = {
+                static_cast<Sint16>(line_padding + (text_line->centered ? (SCREEN_WIDTH - 2 * line_padding - surface->w) /2 : 0)),
+                static_cast<Sint16>(line_y + line_padding / 2),
+                0, 0
+            };
+            SDL_BlitSurface(surface, nullptr, dest_surface, &dest_rect);
+        }
+    }
+    else if (line->type == DisplayLine::Type::Image || (line->type == DisplayLine::Type::ImageRef && i == 0))
+    {
+        const ImageLine *image_line = nullptr;
+        uint32_t line_offset = 0;
+
+        if (line->type == DisplayLine::Type::ImageRef)
+        {
+            line_offset = static_cast<const ImageRefLine *>(line)->offset;
+            const DisplayLine *ref_line = state.line_scroller.get_line_relative(i - line_offset);
+            if (ref_line)
             {
-                const auto *text_line = static_cast<const TextLine *>(line);
-                const char *s = text_line->text.c_str();
-                auto surface = surface_unique_ptr { TTF_RenderUTF8_Shaded(font, s, theme.main_text, theme.background) };
-                SDL_Rect dest_rect = {
-                    static_cast<Sint16>(line_padding + (text_line->centered ? (SCREEN_WIDTH - 2 * line_padding - surface->w) /2 : 0)),
-                    static_cast<Sint16>(line_y + line_padding / 2),
-                    0, 0
-                };
-                SDL_BlitSurface(surface.get(), nullptr, dest_surface, &dest_rect);
+                if (ref_line->type != DisplayLine::Type::Image)
+                {
+                    throw std::runtime_error("ImageRefLine points to non image");
+                }
+                image_line = static_cast<const ImageLine *>(ref_line);
             }
-            else if (line->type == DisplayLine::Type::Image || (line->type == DisplayLine::Type::ImageRef && i == 0))
+        }
+        else
+        {
+            image_line = static_cast<const ImageLine *>(line);
+        }
+
+        if (image_line)
+        {
+            auto *surface = state.line_scroller.load_scaled_image(image_line->image_path, image_line->address);
+
+            // Amount of line height not used by image
+            uint32_t img_excess_y = image_line->num_lines * line_height - image_line->height;
+            // Y coordinate of image in screen space
+            int screen_start_y = line_y + img_excess_y / 2 - line_height * line_offset;
+
+            // Crop off-screen part of image. Allow to extend to edge of screen.
+            Sint16 src_y = std::max(-screen_start_y, 0);
+            Sint16 dst_y = std::max(screen_start_y, 0);
+
+            if (src_y < (Sint16)image_line->height)
             {
-                const ImageLine *image_line = nullptr;
-                uint32_t line_offset = 0;
+                Uint16 width = image_line->width;
+                Uint16 height = image_line->height - src_y;
 
-                if (line->type == DisplayLine::Type::ImageRef)
+                // Crop bottom
+                auto dst_y_bottom = dst_y + height;
+                Uint16 y_limit = state.line_pxl_limit_y();
+                if (dst_y_bottom > y_limit)
                 {
-                    line_offset = static_cast<const ImageRefLine *>(line)->offset;
-                    const DisplayLine *ref_line = state->line_scroller.get_line_relative(i - line_offset);
-                    if (ref_line)
-                    {
-                        if (ref_line->type != DisplayLine::Type::Image)
-                        {
-                            throw std::runtime_error("ImageRefLine points to non image");
-                        }
-                        image_line = static_cast<const ImageLine *>(ref_line);
-                    }
+                    height -= dst_y_bottom - y_limit;
                 }
-                else
+
+                SDL_Rect src_rect = {0, src_y, width, height};
+                SDL_Rect dest_rect = {
+                    static_cast<Sint16>((SCREEN_WIDTH - width) / 2),
+                    dst_y,
+                    0,
+                    0
+                };
+                if (surface)
                 {
-                    image_line = static_cast<const ImageLine *>(line);
+                    SDL_BlitSurface(surface, &src_rect, dest_surface, &dest_rect);
                 }
-
-                if (image_line)
+                else
                 {
-                    auto *surface = state->line_scroller.load_scaled_image(image_line->image_path);
-
-                    // Amount of line height not used by image
-                    uint32_t img_excess_y = image_line->num_lines * line_height - image_line->height;
-                    // Y coordinate of image in screen space
-                    int screen_start_y = line_y + img_excess_y / 2 - line_height * line_offset;
+                    // Placeholder outline until the image is decoded
+                    draw_outline(dest_surface, {dest_rect.x, dest_rect.y, width, height}, theme.secondary_text);
 
-                    // Crop off-screen part of image. Allow to extend to edge of screen.
-                    Sint16 src_y = std::max(-screen_start_y, 0);
-                    Sint16 dst_y = std::max(screen_start_y, 0);
-
-                    if (surface && src_y < (Sint16)image_line->height)
+                    // Formats the decoder doesn't support keep their space, labelled
+                    if (state.line_scroller.image_failed(image_line->image_path) && src_y == 0)
                     {
-                        Uint16 width = image_line->width;
-                        Uint16 height = image_line->height - src_y;
-
-                        // Crop bottom
-                        auto dst_y_bottom = dst_y + height;
-                        Uint16 y_limit = state->line_pxl_limit_y();
-                        if (dst_y_bottom > y_limit)
+                        std::string label = "[Image " + image_line->image_path.string() + "]";
+                        SDL_Surface *label_surface = state.line_cache.render_shaded(font, label, theme.secondary_text, theme.background);
+                        if (label_surface)
                         {
-                            height -= dst_y_bottom - y_limit;
+                            SDL_Rect label_src_rect = {0, 0, static_cast<Uint16>(std::max(width - 2 * line_padding, 0)), static_cast<Uint16>(std::min<int>(label_surface->h, height))};
+                            SDL_Rect label_rect = {static_cast<Sint16>(dest_rect.x + line_padding), static_cast<Sint16>(dest_rect.y + line_padding), 0, 0};
+                            SDL_BlitSurface(label_surface, &label_src_rect, dest_surface, &label_rect);
                         }
-
-                        SDL_Rect src_rect = {0, src_y, width, height};
-                        SDL_Rect dest_rect = {
-                            static_cast<Sint16>((SCREEN_WIDTH - width) / 2),
-                            dst_y,
-                            0,
-                            0
-                        };
-                        SDL_BlitSurface(surface, &src_rect, dest_surface, &dest_rect);
                     }
                 }
             }
         }
-        else
+    }
+
+    return true;
+}
+
+void render_title_bar(TokenViewState &state, SDL_Surface *dest_surface)
+{
+    TTF_Font *font = state.current_font;
+    const auto &theme = state.sys_styling.get_loaded_color_theme();
+    const int line_height = state.line_height;
+    const int line_padding = state.line_padding;
+
+    Sint16 line_y = title_bar_rect(state).y;
+    SDL_Rect title_crop_rect = {0, 0, 0, (Uint16)line_height};
+
+    // Progress
+    {
+        std::string progress_str = " " + state.title_progress;
+        SDL_Surface *page_surface = TTF_RenderUTF8_Shaded(font, progress_str.c_str(), theme.secondary_text, theme.background);
+
+        SDL_Rect dest_rect = {
+            static_cast<Sint16>(SCREEN_WIDTH - page_surface->w - line_padding),
+            static_cast<Sint16>(line_y + line_padding / 2),
+            0, 0
+        };
+        title_crop_rect.w = SCREEN_WIDTH - line_padding * 2 - page_surface->w;
+
+        SDL_BlitSurface(page_surface, nullptr, dest_surface, &dest_rect);
+        SDL_FreeSurface(page_surface);
+    }
+
+    // Toc item
+    if (state.title.size() > 0)
+    {
+        SDL_Rect dest_rect = {
+            static_cast<Sint16>(line_padding),
+            static_cast<Sint16>(line_y + line_padding / 2),
+            0, 0
+        };
+        SDL_Surface *surface = TTF_RenderUTF8_Shaded(font, state.title.c_str(), theme.secondary_text, theme.background);
+        SDL_BlitSurface(surface, &title_crop_rect, dest_surface, &dest_rect);
+        SDL_FreeSurface(surface);
+    }
+}
+
+// Images span several lines and are cropped to the text area, so frames
+// showing them are always fully redrawn.
+bool has_visible_images(TokenViewState &state)
+{
+    for (int i = 0; i < state.num_text_display_lines(); ++i)
+    {
+        const DisplayLine *line = state.line_scroller.get_line_relative(i);
+        if (line && line->type != DisplayLine::Type::Text)
         {
-            break;
+            return true;
         }
+    }
+    return false;
+}
 
-        line_y += line_height;
+// Scroll the previous frame by one line, only drawing the line that came
+// into view.
+void render_scrolled_line(TokenViewState &state, SDL_Surface *dest_surface, int num_lines)
+{
+    const auto &theme = state.sys_styling.get_loaded_color_theme();
+    SDL_Rect text_rect = text_area_rect(state);
+    const int line_height = state.line_height;
+
+    int exposed_line = num_lines > 0 ? state.num_text_display_lines() - 1 : 0;
+    Sint16 exposed_y = text_rect.y + exposed_line * line_height;
+
+    if (num_lines > 0)
+    {
+        shift_surface_rows(dest_surface, text_rect.y + line_height, text_rect.h - line_height, -line_height);
     }
+    else
+    {
+        shift_surface_rows(dest_surface, text_rect.y, text_rect.h - line_height, line_height);
+    }
+
+    fill_rect(dest_surface, {0, exposed_y, static_cast<Uint16>(SCREEN_WIDTH), static_cast<Uint16>(line_height)}, theme.background);
+    render_line(state, dest_surface, exposed_line, exposed_y);
+}
 
-    if (state->token_view_styling.get_show_title_bar())
+} // namespace
+
+bool TokenView::render(SDL_Surface *dest_surface, bool force_render)
+{
+    if (!state->needs_render && !force_render)
     {
-        // Recompute for short book case
-        line_y = padding_y + num_text_display_lines * line_height;
-        SDL_Rect title_crop_rect = {0, 0, 0, (Uint16)line_height};
+        return false;
+    }
+    state->needs_render = false;
+
+    scroll(0);  // Will adjust scroll position if necessary for end of book
+
+    const auto &theme = state->sys_styling.get_loaded_color_theme();
+    const bool show_title_bar = state->token_view_styling.get_show_title_bar();
+
+    int line_number = state->line_scroller.get_line_number();
+    int num_lines_scrolled = line_number - state->rendered_line_number;
+    bool can_update_frame = (
+        !force_render &&
+        state->frame_valid &&
+        state->rendered_surface == dest_surface
+    );
 
-        // Progress
+    state->dirty_rects.clear();
+
+    if (can_update_frame && num_lines_scrolled == 0)
+    {
+        // Only the title bar can have changed
+        if (!show_title_bar)
         {
-            char percent_str[32];
-            snprintf(percent_str, sizeof(percent_str), " %d%%", state->title_progress_percent);
+            return false;
+        }
 
-            SDL_Surface *page_surface = TTF_RenderUTF8_Shaded(font, percent_str, theme.secondary_text, theme.background);
+        SDL_Rect title_rect = title_bar_rect(*state);
+        fill_rect(dest_surface, title_rect, theme.background);
+        render_title_bar(*state, dest_surface);
+        state->dirty_rects.push_back(title_rect);
+        return true;
+    }
 
-            SDL_Rect dest_rect = {
-                static_cast<Sint16>(SCREEN_WIDTH - page_surface->w - line_padding),
-                static_cast<Sint16>(line_y + line_padding / 2),
-                0, 0
-            };
-            title_crop_rect.w = SCREEN_WIDTH - line_padding * 2 - page_surface->w;
+    bool images_visible = has_visible_images(*state);
+    if (can_update_frame && std::abs(num_lines_scrolled) == 1 && !images_visible && !state->rendered_images)
+    {
+        render_scrolled_line(*state, dest_surface, num_lines_scrolled);
+        state->dirty_rects.push_back(text_area_rect(*state));
 
-            SDL_BlitSurface(page_surface, nullptr, dest_surface, &dest_rect);
-            SDL_FreeSurface(page_surface);
+        if (show_title_bar)
+        {
+            SDL_Rect title_rect = title_bar_rect(*state);
+            fill_rect(dest_surface, title_rect, theme.background);
+            render_title_bar(*state, dest_surface);
+            state->dirty_rects.push_back(title_rect);
         }
 
-        // Toc item
-        if (state->title.size() > 0)
+        state->rendered_line_number = line_number;
+        return true;
+    }
+
+    // Full redraw
+    fill_rect(dest_surface, {0, 0, static_cast<Uint16>(SCREEN_WIDTH), static_cast<Uint16>(SCREEN_HEIGHT)}, theme.background);
+
+    int num_text_display_lines = state->num_text_display_lines();
+    Sint16 line_y = text_area_rect(*state).y;
+
+    for (int i = 0; i < num_text_display_lines; ++i)
+    {
+        if (!render_line(*state, dest_surface, i, line_y))
         {
-            SDL_Rect dest_rect = {
-                static_cast<Sint16>(line_padding),
-                static_cast<Sint16>(line_y + line_padding / 2),
-                0, 0
-            };
-            SDL_Surface *surface = TTF_RenderUTF8_Shaded(font, state->title.c_str(), theme.secondary_text, theme.background);
-            SDL_BlitSurface(surface, &title_crop_rect, dest_surface, &dest_rect);
-            SDL_FreeSurface(surface);
+            break;
         }
+        line_y += state->line_height;
     }
 
+    if (show_title_bar)
+    {
+        render_title_bar(*state, dest_surface);
+    }
+
+    state->rendered_surface = dest_surface;
+    state->rendered_line_number = line_number;
+    state->rendered_images = images_visible;
+    state->frame_valid = true;
+
     return true;
 }
 
+const std::vector<SDL_Rect> &TokenView::get_dirty_rects() const
+{
+    return state->dirty_rects;
+}
+
 // Adjust scroll amount to avoid going beyond start or end of book.
 static int get_bounded_scroll_amount(TokenLineScroller &line_scroller, int num_display_lines, int num_lines)
 {
@@ -430,6 +801,7 @@ void TokenView::seek_to_address(DocAddr address)
 {
     state->line_scroller.seek_to_address(address);
     state->needs_render = true;
+    state->frame_valid = false;
 }
 
 void TokenView::set_title(const std::string &title)
@@ -441,15 +813,140 @@ void TokenView::set_title(const std::string &title)
     }
 }
 
-void TokenView::set_title_progress(int percent)
+void TokenView::set_title_progress(int percent, bool is_estimate)
+{
+    char progress_str[32];
+    snprintf(progress_str, sizeof(progress_str), is_estimate ? "~%d%%" : "%d%%", percent);
+    set_title_progress(progress_str);
+}
+
+void TokenView::set_title_progress(const PageProgress &progress)
+{
+    char progress_str[64];
+    if (progress.minutes_left >= 60)
+    {
+        snprintf(
+            progress_str,
+            sizeof(progress_str),
+            "%u/%u %uh%02um",
+            progress.page,
+            progress.num_pages,
+            progress.minutes_left / 60,
+            progress.minutes_left % 60
+        );
+    }
+    else
+    {
+        snprintf(progress_str, sizeof(progress_str), "%u/%u %um", progress.page, progress.num_pages, progress.minutes_left);
+    }
+    set_title_progress(std::string(progress_str));
+}
+
+void TokenView::set_title_progress(const std::string &progress)
 {
-    if (percent != state->title_progress_percent)
+    if (progress != state->title_progress)
     {
-        state->title_progress_percent = percent;
+        state->title_progress = progress;
         state->needs_render = true;
     }
 }
 
+void TokenView::enable_page_map(DocReaderCache &cache)
+{
+    state->page_map_cache = &cache;
+    state->reset_page_map();
+}
+
+void TokenView::disable_page_map()
+{
+    state->page_map_cache = nullptr;
+    state->reset_page_map();
+}
+
+void TokenView::set_on_page_map_pending(std::function<void()> callback)
+{
+    state->on_page_map_pending = callback;
+}
+
+bool TokenView::build_page_map_step()
+{
+    if (state->page_map || !state->page_map_cache || state->page_map_batch_pending)
+    {
+        return false;
+    }
+
+    if (!state->page_map_iter)
+    {
+        state->page_map_iter = state->reader->get_worker_iter();
+        if (!state->page_map_iter)
+        {
+            state->finish_page_map();
+            return false;
+        }
+        state->read_page_map_batch();
+        return !state->page_map_batch_pending;
+    }
+
+    uint32_t num_lines = 0;
+    while (num_lines < PAGE_MAP_LINES_PER_STEP && state->page_map_next_token < state->page_map_tokens.size())
+    {
+        DocToken token = state->page_map_tokens[state->page_map_next_token++];
+        for (const auto &line : state->line_scroller.layout_token(token))
+        {
+            state->page_map_lines.push_back(line->address);
+            if (line->type == DisplayLine::Type::Text)
+            {
+                state->page_map_words += count_words(static_cast<const TextLine *>(line.get())->text);
+            }
+            ++num_lines;
+        }
+    }
+
+    if (state->page_map_next_token < state->page_map_tokens.size())
+    {
+        return true;
+    }
+    if (state->page_map_tokens_done)
+    {
+        state->finish_page_map();
+        return false;
+    }
+
+    // Picked up again through on_page_map_pending once the batch is read
+    state->read_page_map_batch();
+    return !state->page_map_batch_pending;
+}
+
+std::optional<PageProgress> TokenView::get_page_progress(DocAddr address) const
+{
+    const auto &page_map = state->page_map;
+    if (!page_map || !page_map->num_lines())
+    {
+        return std::nullopt;
+    }
+
+    uint32_t lines_per_page = state->num_text_display_lines();
+    uint32_t line = page_map->line_for_address(address);
+
+    return PageProgress {
+        // Page of the bottom line, so the last screen shows the last page
+        page_map->page_for_line(line + lines_per_page - 1, lines_per_page) + 1,
+        page_map->num_pages(lines_per_page),
+        page_map->minutes_left(line, READING_WORDS_PER_MINUTE)
+    };
+}
+
+std::optional<DocAddr> TokenView::get_page_address(uint32_t page) const
+{
+    const auto &page_map = state->page_map;
+    uint32_t lines_per_page = state->num_text_display_lines();
+    if (!page_map || page == 0 || page > page_map->num_pages(lines_per_page))
+    {
+        return std::nullopt;
+    }
+    return page_map->page_address(page - 1, lines_per_page);
+}
+
 void TokenView::set_on_scroll(std::function<void(DocAddr)> callback)
 {
     state->on_scroll = callback;
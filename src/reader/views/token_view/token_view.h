@@ -3,17 +3,27 @@
 
 #include "reader/view.h"
 #include "doc_api/doc_addr.h"
+#include "util/task_queue.h"
 
 #include <functional>
 #include <memory>
+#include <optional>
 #include <string>
 #include <vector>
 
+class DocReaderCache;
 struct DocReader;
 struct SystemStyling;
 struct TokenViewState;
 struct TokenViewStyling;
 
+struct PageProgress
+{
+    uint32_t page;          // 1 based
+    uint32_t num_pages;
+    uint32_t minutes_left;
+};
+
 class TokenView: public View
 {
     std::unique_ptr<TokenViewState> state;
@@ -25,11 +35,13 @@ public:
         std::shared_ptr<DocReader> reader,
         DocAddr address,
         SystemStyling &sys_styling,
-        TokenViewStyling &token_view_styling
+        TokenViewStyling &token_view_styling,
+        background_func run_in_background
     );
     virtual ~TokenView();
 
     bool render(SDL_Surface *dest_surface, bool force_render) override;
+    const std::vector<SDL_Rect> &get_dirty_rects() const override;
     bool is_done() override;
     void on_keypress(SDLKey key) override;
     void on_keyheld(SDLKey key, uint32_t held_time_ms) override;
@@ -38,7 +50,22 @@ public:
     void seek_to_address(DocAddr address);
 
     void set_title(const std::string &title);
-    void set_title_progress(int percent);
+    void set_title_progress(int percent, bool is_estimate = false);
+    void set_title_progress(const PageProgress &progress);
+    void set_title_progress(const std::string &progress);
+
+    // Lay out the whole book in the background for page numbers. Layouts are cached per book.
+    void enable_page_map(DocReaderCache &cache);
+    void disable_page_map();
+    // Called when page map work is ready to run, e.g. after a font change or
+    // once a batch of tokens has been read
+    void set_on_page_map_pending(std::function<void()> callback);
+    // Lay out a batch of lines. Returns true if more work is ready to run.
+    bool build_page_map_step();
+    // Empty until the page map is built
+    std::optional<PageProgress> get_page_progress(DocAddr address) const;
+    // Start of a 1 based page, empty until the page map is built
+    std::optional<DocAddr> get_page_address(uint32_t page) const;
 
     void set_on_scroll(std::function<void(DocAddr)> callback);
 };
@@ -3,35 +3,115 @@
 #include "reader/config.h"
 #include "reader/ss_doc_reader_cache.h"
 #include "reader/state_store.h"
+#include "util/math.h"
+#include "util/task_queue.h"
 #include "util/timer.h"
 
+#include <chrono>
 #include <filesystem>
 #include <iostream>
 #include <list>
 #include <string>
+#include <thread>
 
 namespace
 {
 
+struct LoadTime
+{
+    std::string filename;
+    uint32_t open_ms;
+    uint32_t serial_ms;
+    uint32_t parallel_ms;
+};
+
 struct Stats
 {
-    std::list<std::pair<std::string, uint32_t>> load_times;
+    std::list<LoadTime> load_times;
 };
 
-void load_file(std::filesystem::path path, Stats &stats, DocReaderCache &cache)
+// Never returns cached values, so every load measures a cold open. Writes are
+// passed on when there is somewhere to keep them.
+class ColdCache : public DocReaderCache
 {
+    DocReaderCache *writes;
+public:
+    ColdCache(DocReaderCache *writes) : writes(writes) {}
+
+    std::optional<std::string> read(const std::string &, const std::string &) const override
+    {
+        return std::nullopt;
+    }
+
+    void write(const std::string &book_id, const std::string &key, const std::string &value) override
+    {
+        if (writes)
+        {
+            writes->write(book_id, key, value);
+        }
+    }
+};
+
+// Time computing widths one document at a time on this thread
+bool load_serial(const std::filesystem::path &path, uint32_t &open_ms, uint32_t &background_ms)
+{
+    ColdCache cache(nullptr);
     Timer t;
 
     auto reader = create_doc_reader(path);
     if (!reader || !reader->open(cache))
+    {
+        return false;
+    }
+    open_ms = t.elapsed_ms();
+
+    t.reset();
+    while (reader->run_background_task());
+    background_ms = t.elapsed_ms();
+
+    return true;
+}
+
+// Time computing widths spread across the worker threads
+bool load_parallel(const std::filesystem::path &path, TaskQueue &task_queue, DocReaderCache &store_cache, uint32_t &background_ms)
+{
+    ColdCache cache(&store_cache);
+
+    auto reader = create_doc_reader(path);
+    if (!reader || !reader->open(cache))
+    {
+        return false;
+    }
+    reader->set_background_func(
+        [&task_queue](task_func work, task_func on_done) { task_queue.submit_background(work, on_done); }
+    );
+
+    Timer t;
+    while (reader->run_background_task())
+    {
+        if (!task_queue.drain())
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+    }
+    background_ms = t.elapsed_ms();
+
+    return true;
+}
+
+void load_file(std::filesystem::path path, Stats &stats, TaskQueue &task_queue, DocReaderCache &store_cache)
+{
+    LoadTime load_time = {path.filename(), 0, 0, 0};
+    if (
+        !load_serial(path, load_time.open_ms, load_time.serial_ms) ||
+        !load_parallel(path, task_queue, store_cache, load_time.parallel_ms)
+    )
     {
         std::cerr << "Unable to open " << path.filename() << std::endl;
         return;
     }
 
-    stats.load_times.emplace_back(
-        path.filename(), t.elapsed_ms()
-    );
+    stats.load_times.push_back(load_time);
 }
 
 } // namespace
@@ -43,24 +123,37 @@ void bulk_load_test(std::string dir_path)
         StateStore store("store");
         SSDocReaderCache cache(store);
 
+        uint32_t num_workers = bound(std::thread::hardware_concurrency(), 1, MAX_WORKER_THREADS);
+        TaskQueue task_queue(num_workers);
+
         Stats stats;
 
         for (const auto& entry: std::filesystem::directory_iterator(dir_path))
         {
-            load_file(entry.path(), stats, cache);
+            load_file(entry.path(), stats, task_queue, cache);
         }
 
-        uint32_t total_load_time = 0;
-        for (const auto &[path, load_time]: stats.load_times)
+        uint32_t total_open_time = 0;
+        uint32_t total_serial_time = 0;
+        uint32_t total_parallel_time = 0;
+        for (const auto &[path, open_ms, serial_ms, parallel_ms]: stats.load_times)
         {
-            std::cerr << path << ", " << load_time << std::endl;
+            std::cerr << path << ", " << open_ms << ", " << serial_ms << ", " << parallel_ms << std::endl;
 
-            total_load_time += load_time;
+            total_open_time += open_ms;
+            total_serial_time += serial_ms;
+            total_parallel_time += parallel_ms;
         }
 
         std::cerr << std::endl;
         std::cerr << "Total files: " << stats.load_times.size() << std::endl;
-        std::cerr << "Total time: " << total_load_time << std::endl;
+        std::cerr << "Total open time: " << total_open_time << std::endl;
+        std::cerr << "Total background time, serial: " << total_serial_time << std::endl;
+        std::cerr << "Total background time, " << num_workers << " workers: " << total_parallel_time << std::endl;
+        if (total_parallel_time)
+        {
+            std::cerr << "Speedup: " << static_cast<double>(total_serial_time) / total_parallel_time << "x" << std::endl;
+        }
 
         {
             Timer t;
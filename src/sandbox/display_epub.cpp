@@ -1,9 +1,11 @@
 #include "doc_api/token_addressing.h"
+#include "filetypes/epub/epub_doc_index.h"
 #include "filetypes/epub/epub_reader.h"
 #include "./cli_render_lines.h"
 
 #include <iostream>
 #include <iomanip>
+#include <limits>
 #include <string>
 
 void display_epub(std::string path)
@@ -12,6 +14,8 @@ void display_epub(std::string path)
     std::cout << path << std::endl;
 
     EPubReader epub(path);
+    // Token views for the entire book are held below
+    epub.set_token_cache_budget(std::numeric_limits<size_t>::max());
     if (!epub.open())
     {
         std::cerr << "Unable to open epub" << std::endl;
@@ -19,7 +23,7 @@ void display_epub(std::string path)
     }
 
     // Read entire book
-    std::vector<const DocToken*> tokens;
+    std::vector<DocToken> tokens;
     {
         auto it = epub.get_iter();
         const DocToken *token = nullptr;
@@ -27,13 +31,12 @@ void display_epub(std::string path)
         {
             if (token->type == TokenType::Image)
             {
-                const auto *image_token = static_cast<const ImageDocToken*>(token);
-                if (!epub.load_resource(image_token->path).size())
+                if (!epub.load_resource(token->path()).size())
                 {
-                    std::cerr << "Unable to load image: " << image_token->path << std::endl;
+                    std::cerr << "Unable to load image: " << token->path() << std::endl;
                 }
             }
-            tokens.push_back(token);
+            tokens.push_back(*token);
         }
     }
 
@@ -51,7 +54,7 @@ void display_epub(std::string path)
             bool found_matching_addr = false;
             for (const auto &token : tokens)
             {
-                if (toc_addr == token->address)
+                if (toc_addr == token.address)
                 {
                     found_matching_addr = true;
                     break;
@@ -97,4 +100,10 @@ void display_epub(std::string path)
 
         ++line_count;
     }
+
+    const auto &cache_stats = epub.get_token_cache_stats();
+    std::cerr << "Token cache: " << cache_stats.hits << " hits, "
+              << cache_stats.misses << " misses, "
+              << cache_stats.evictions << " evictions, "
+              << cache_stats.size_bytes << " bytes" << std::endl;
 }
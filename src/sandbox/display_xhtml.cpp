@@ -12,16 +12,16 @@ void display_xhtml(std::string path)
     std::stringstream buffer;
     buffer << fp.rdbuf();
 
-    std::vector<std::unique_ptr<DocToken>> tokens;
+    TokenArena tokens;
     std::unordered_map<std::string, DocAddr> ids;
     parse_xhtml_tokens(buffer.str().c_str(), path, 0, tokens, ids);
 
-    auto token_ptrs = std::vector<const DocToken*>();
-    for (auto &token : tokens)
+    auto token_views = std::vector<DocToken>();
+    for (size_t i = 0; i < tokens.size(); ++i)
     {
-        token_ptrs.push_back(token.get());
+        token_views.push_back(tokens[i]);
     }
-    std::vector<Line> display_lines = cli_render_tokens(token_ptrs, 80);
+    std::vector<Line> display_lines = cli_render_tokens(token_views, 80);
 
     std::cout << path << std::endl;
     for (const auto &line: display_lines)
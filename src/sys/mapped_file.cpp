@@ -0,0 +1,95 @@
+#include "./mapped_file.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <iostream>
+#include <utility>
+
+MappedFile::MappedFile(MappedFile &&other)
+    : map_data(std::exchange(other.map_data, nullptr))
+    , map_size(std::exchange(other.map_size, 0))
+    , is_open(std::exchange(other.is_open, false))
+{
+}
+
+MappedFile &MappedFile::operator=(MappedFile &&other)
+{
+    if (this != &other)
+    {
+        close();
+        map_data = std::exchange(other.map_data, nullptr);
+        map_size = std::exchange(other.map_size, 0);
+        is_open = std::exchange(other.is_open, false);
+    }
+    return *this;
+}
+
+MappedFile::~MappedFile()
+{
+    close();
+}
+
+void MappedFile::close()
+{
+    if (map_data)
+    {
+        munmap(const_cast<char *>(map_data), map_size);
+    }
+    map_data = nullptr;
+    map_size = 0;
+    is_open = false;
+}
+
+bool MappedFile::open(const std::filesystem::path &path)
+{
+    close();
+
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+    {
+        return false;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0)
+    {
+        ::close(fd);
+        return false;
+    }
+
+    if (st.st_size > 0)
+    {
+        void *addr = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (addr == MAP_FAILED)
+        {
+            std::cerr << "Unable to map " << path << std::endl;
+            ::close(fd);
+            return false;
+        }
+        map_data = static_cast<const char *>(addr);
+        map_size = st.st_size;
+    }
+
+    // The mapping stays valid after the descriptor is closed
+    ::close(fd);
+    is_open = true;
+    return true;
+}
+
+bool MappedFile::good() const
+{
+    return is_open;
+}
+
+const char *MappedFile::data() const
+{
+    return map_data;
+}
+
+size_t MappedFile::size() const
+{
+    return map_size;
+}
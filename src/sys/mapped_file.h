@@ -0,0 +1,33 @@
+#ifndef MAPPED_FILE_H_
+#define MAPPED_FILE_H_
+
+#include <cstddef>
+#include <filesystem>
+
+// Read-only memory mapping of a whole file. Pages are loaded on access
+// and can be dropped by the kernel, so large files don't consume heap.
+class MappedFile
+{
+    const char *map_data = nullptr;
+    size_t map_size = 0;
+    bool is_open = false;
+
+    void close();
+
+public:
+    MappedFile() = default;
+    MappedFile(const MappedFile &) = delete;
+    MappedFile &operator=(const MappedFile &) = delete;
+    MappedFile(MappedFile &&other);
+    MappedFile &operator=(MappedFile &&other);
+    ~MappedFile();
+
+    bool open(const std::filesystem::path &path);
+    bool good() const;
+
+    // Empty files are valid and have no data
+    const char *data() const;
+    size_t size() const;
+};
+
+#endif
@@ -0,0 +1,60 @@
+#include "./atomic_file.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <iostream>
+
+bool write_file_atomically(const std::filesystem::path &path, const std::string &contents)
+{
+    std::filesystem::path tmp_path = path.string() + ".tmp";
+    int fd = ::open(tmp_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0)
+    {
+        std::cerr << "Unable to write " << tmp_path << std::endl;
+        return false;
+    }
+
+    const char *data = contents.data();
+    size_t remaining = contents.size();
+    bool ok = true;
+    while (ok && remaining)
+    {
+        ssize_t n = ::write(fd, data, remaining);
+        ok = n > 0;
+        if (ok)
+        {
+            data += n;
+            remaining -= n;
+        }
+    }
+    ok = ok && fsync(fd) == 0;
+    ok = (::close(fd) == 0) && ok;
+
+    std::error_code ec;
+    if (ok)
+    {
+        std::filesystem::rename(tmp_path, path, ec);
+        ok = !ec;
+    }
+    if (!ok)
+    {
+        std::cerr << "Unable to write " << path << std::endl;
+        std::filesystem::remove(tmp_path, ec);
+        return false;
+    }
+
+    sync_parent_directory(path);
+    return true;
+}
+
+void sync_parent_directory(const std::filesystem::path &path)
+{
+    auto dir = path.parent_path();
+    int fd = ::open(dir.empty() ? "." : dir.c_str(), O_RDONLY);
+    if (fd >= 0)
+    {
+        fsync(fd);
+        ::close(fd);
+    }
+}
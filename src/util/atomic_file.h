@@ -0,0 +1,14 @@
+#ifndef ATOMIC_FILE_H_
+#define ATOMIC_FILE_H_
+
+#include <filesystem>
+#include <string>
+
+// Replace the file through a synced temp file and rename, so a crash leaves
+// either the old or the new contents.
+bool write_file_atomically(const std::filesystem::path &path, const std::string &contents);
+
+// Make a rename or newly created file in the directory durable
+void sync_parent_directory(const std::filesystem::path &path);
+
+#endif
@@ -0,0 +1,35 @@
+#include "./checksum.h"
+
+#include <array>
+
+namespace
+{
+
+std::array<uint32_t, 256> make_crc32_table()
+{
+    std::array<uint32_t, 256> table;
+    for (uint32_t i = 0; i < table.size(); ++i)
+    {
+        uint32_t c = i;
+        for (int bit = 0; bit < 8; ++bit)
+        {
+            c = (c & 1) ? (0xEDB88320u ^ (c >> 1)) : (c >> 1);
+        }
+        table[i] = c;
+    }
+    return table;
+}
+
+} // namespace
+
+uint32_t crc32(const char *data, size_t size, uint32_t crc)
+{
+    static const std::array<uint32_t, 256> table = make_crc32_table();
+
+    crc = ~crc;
+    for (size_t i = 0; i < size; ++i)
+    {
+        crc = table[(crc ^ static_cast<uint8_t>(data[i])) & 0xFF] ^ (crc >> 8);
+    }
+    return ~crc;
+}
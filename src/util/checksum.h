@@ -0,0 +1,10 @@
+#ifndef CHECKSUM_H_
+#define CHECKSUM_H_
+
+#include <cstddef>
+#include <cstdint>
+
+// CRC-32 (IEEE). Pass the previous result as crc to continue a running checksum.
+uint32_t crc32(const char *data, size_t size, uint32_t crc = 0);
+
+#endif
@@ -0,0 +1,290 @@
+#include "./image_probe.h"
+
+#include <cctype>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <string_view>
+
+namespace
+{
+
+uint32_t read_u16_be(const uint8_t *p)
+{
+    return (p[0] << 8) | p[1];
+}
+
+uint32_t read_u16_le(const uint8_t *p)
+{
+    return p[0] | (p[1] << 8);
+}
+
+uint32_t read_u32_be(const uint8_t *p)
+{
+    return (static_cast<uint32_t>(p[0]) << 24) | (p[1] << 16) | (p[2] << 8) | p[3];
+}
+
+std::optional<ImageSize> probe_png(const uint8_t *data, size_t size)
+{
+    // Signature, then the IHDR chunk which must come first
+    if (size < 24 || memcmp(data + 12, "IHDR", 4) != 0)
+    {
+        return std::nullopt;
+    }
+    return ImageSize {read_u32_be(data + 16), read_u32_be(data + 20)};
+}
+
+std::optional<ImageSize> probe_gif(const uint8_t *data, size_t size)
+{
+    // Logical screen descriptor follows the 6 byte signature
+    if (size < 10)
+    {
+        return std::nullopt;
+    }
+    return ImageSize {read_u16_le(data + 6), read_u16_le(data + 8)};
+}
+
+bool is_jpeg_sof_marker(uint8_t marker)
+{
+    // SOF0-SOF15, excluding DHT (C4), JPG (C8) and DAC (CC)
+    return marker >= 0xc0 && marker <= 0xcf && marker != 0xc4 && marker != 0xc8 && marker != 0xcc;
+}
+
+std::optional<ImageSize> probe_jpeg(const uint8_t *data, size_t size)
+{
+    // Walk marker segments until the start of frame, which holds the dimensions
+    size_t pos = 2;
+    while (pos + 4 <= size)
+    {
+        if (data[pos] != 0xff)
+        {
+            return std::nullopt;
+        }
+
+        uint8_t marker = data[pos + 1];
+        if (marker == 0xff)
+        {
+            ++pos;  // fill byte
+            continue;
+        }
+        if (marker == 0x01 || (marker >= 0xd0 && marker <= 0xd8))
+        {
+            pos += 2;  // standalone marker
+            continue;
+        }
+        if (marker == 0xd9 || marker == 0xda)
+        {
+            return std::nullopt;  // end of image or start of scan before any frame
+        }
+
+        uint32_t segment_len = read_u16_be(data + pos + 2);
+        if (is_jpeg_sof_marker(marker))
+        {
+            if (pos + 9 > size)
+            {
+                return std::nullopt;
+            }
+            return ImageSize {read_u16_be(data + pos + 7), read_u16_be(data + pos + 5)};
+        }
+
+        pos += 2 + segment_len;
+    }
+
+    return std::nullopt;
+}
+
+std::optional<ImageSize> probe_bmp(const uint8_t *data, size_t size)
+{
+    // File header, then a DIB header whose size identifies its layout
+    if (size < 26)
+    {
+        return std::nullopt;
+    }
+
+    uint32_t dib_size = data[14] | (data[15] << 8) | (data[16] << 16) | (static_cast<uint32_t>(data[17]) << 24);
+    if (dib_size == 12)
+    {
+        return ImageSize {read_u16_le(data + 18), read_u16_le(data + 20)};
+    }
+
+    int32_t width = static_cast<int32_t>(read_u16_le(data + 18) | (read_u16_le(data + 20) << 16));
+    int32_t height = static_cast<int32_t>(read_u16_le(data + 22) | (read_u16_le(data + 24) << 16));
+    if (width < 0)
+    {
+        return std::nullopt;
+    }
+    // Negative height means rows are stored top-down
+    return ImageSize {static_cast<uint32_t>(width), static_cast<uint32_t>(std::abs(height))};
+}
+
+std::optional<std::string_view> svg_attribute(std::string_view tag, std::string_view name)
+{
+    size_t pos = 0;
+    while ((pos = tag.find(name, pos)) != std::string_view::npos)
+    {
+        bool starts_word = pos > 0 && std::isspace(static_cast<unsigned char>(tag[pos - 1]));
+        size_t eq = tag.find_first_not_of(" \t\r\n", pos + name.size());
+        pos += name.size();
+        if (!starts_word || eq == std::string_view::npos || tag[eq] != '=')
+        {
+            continue;
+        }
+
+        size_t quote = tag.find_first_not_of(" \t\r\n", eq + 1);
+        if (quote == std::string_view::npos || (tag[quote] != '"' && tag[quote] != '\''))
+        {
+            return std::nullopt;
+        }
+        size_t end = tag.find(tag[quote], quote + 1);
+        if (end == std::string_view::npos)
+        {
+            return std::nullopt;
+        }
+        return tag.substr(quote + 1, end - quote - 1);
+    }
+    return std::nullopt;
+}
+
+// Parse a length in pixels. Relative units can't be resolved without a viewport.
+std::optional<uint32_t> svg_length(std::string_view value)
+{
+    std::string str(value);
+    char *end = nullptr;
+    double number = std::strtod(str.c_str(), &end);
+    if (end == str.c_str() || number < 0)
+    {
+        return std::nullopt;
+    }
+
+    std::string_view unit(end);
+    if (!unit.empty() && unit != "px")
+    {
+        return std::nullopt;
+    }
+    return static_cast<uint32_t>(number + 0.5);
+}
+
+std::optional<ImageSize> probe_svg(const char *data, size_t size)
+{
+    std::string_view text(data, size);
+    size_t tag_start = text.find("<svg");
+    if (tag_start == std::string_view::npos)
+    {
+        return std::nullopt;
+    }
+    size_t tag_end = text.find('>', tag_start);
+    if (tag_end == std::string_view::npos)
+    {
+        return std::nullopt;
+    }
+    std::string_view tag = text.substr(tag_start, tag_end - tag_start);
+
+    auto width_attr = svg_attribute(tag, "width");
+    auto height_attr = svg_attribute(tag, "height");
+    if (width_attr && height_attr)
+    {
+        auto width = svg_length(*width_attr);
+        auto height = svg_length(*height_attr);
+        if (width && height)
+        {
+            return ImageSize {*width, *height};
+        }
+    }
+
+    // Fall back to the view box: "min-x min-y width height"
+    if (auto view_box = svg_attribute(tag, "viewBox"))
+    {
+        std::string values(*view_box);
+        for (auto &c : values)
+        {
+            c = c == ',' ? ' ' : c;
+        }
+
+        const char *pos = values.c_str();
+        char *end = nullptr;
+        std::strtod(pos, &end);
+        pos = end;
+        std::strtod(pos, &end);
+        pos = end;
+        double width = std::strtod(pos, &end);
+        pos = end;
+        double height = std::strtod(pos, &end);
+        if (end != pos && width > 0 && height > 0)
+        {
+            return ImageSize {static_cast<uint32_t>(width + 0.5), static_cast<uint32_t>(height + 0.5)};
+        }
+    }
+
+    return std::nullopt;
+}
+
+// SVG is XML, so the root element may follow a prolog, comments or a doctype
+bool looks_like_xml(const char *data, size_t size)
+{
+    std::string_view text(data, size);
+    size_t start = text.find_first_not_of(" \t\r\n\xef\xbb\xbf");
+    return start != std::string_view::npos && text[start] == '<';
+}
+
+bool has_known_signature(const uint8_t *bytes, size_t size)
+{
+    return (
+        (size >= 8 && memcmp(bytes, "\x89PNG\r\n\x1a\n", 8) == 0) ||
+        (size >= 6 && (memcmp(bytes, "GIF87a", 6) == 0 || memcmp(bytes, "GIF89a", 6) == 0)) ||
+        (size >= 3 && bytes[0] == 0xff && bytes[1] == 0xd8 && bytes[2] == 0xff) ||
+        (size >= 2 && bytes[0] == 'B' && bytes[1] == 'M')
+    );
+}
+
+} // namespace
+
+std::optional<ImageSize> probe_image_size(const char *data, size_t size)
+{
+    const uint8_t *bytes = reinterpret_cast<const uint8_t *>(data);
+
+    if (size >= 8 && memcmp(bytes, "\x89PNG\r\n\x1a\n", 8) == 0)
+    {
+        return probe_png(bytes, size);
+    }
+    if (size >= 6 && (memcmp(bytes, "GIF87a", 6) == 0 || memcmp(bytes, "GIF89a", 6) == 0))
+    {
+        return probe_gif(bytes, size);
+    }
+    if (size >= 3 && bytes[0] == 0xff && bytes[1] == 0xd8 && bytes[2] == 0xff)
+    {
+        return probe_jpeg(bytes, size);
+    }
+    if (size >= 2 && bytes[0] == 'B' && bytes[1] == 'M')
+    {
+        return probe_bmp(bytes, size);
+    }
+    if (looks_like_xml(data, size))
+    {
+        return probe_svg(data, size);
+    }
+
+    return std::nullopt;
+}
+
+std::optional<ImageSize> probe_image_size(std::function<std::vector<char>(size_t max_bytes)> read_prefix)
+{
+    for (size_t max_bytes : {4 * 1024, 64 * 1024, 1024 * 1024})
+    {
+        auto data = read_prefix(max_bytes);
+        auto size = probe_image_size(data.data(), data.size());
+        if (size)
+        {
+            return size;
+        }
+
+        const uint8_t *bytes = reinterpret_cast<const uint8_t *>(data.data());
+        bool read_everything = data.size() < max_bytes;
+        bool known_format = has_known_signature(bytes, data.size()) || looks_like_xml(data.data(), data.size());
+        if (read_everything || !known_format)
+        {
+            break;
+        }
+    }
+
+    return std::nullopt;
+}
@@ -0,0 +1,30 @@
+#ifndef IMAGE_PROBE_H_
+#define IMAGE_PROBE_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <optional>
+#include <vector>
+
+struct ImageSize
+{
+    uint32_t width = 0;
+    uint32_t height = 0;
+
+    bool operator==(const ImageSize &other) const
+    {
+        return width == other.width && height == other.height;
+    }
+};
+
+// Read image dimensions from the header of PNG, JPEG, GIF, BMP or SVG data
+// without decoding pixels. Empty if the format is not recognized or the header
+// is cut off.
+std::optional<ImageSize> probe_image_size(const char *data, size_t size);
+
+// Probe from a prefix of the data, reading a longer prefix only when the header
+// is cut off (e.g. JPEG frames behind large EXIF blocks).
+std::optional<ImageSize> probe_image_size(std::function<std::vector<char>(size_t max_bytes)> read_prefix);
+
+#endif
@@ -1,17 +1,43 @@
 #ifndef INDEXED_DEQUEUE_H_
 #define INDEXED_DEQUEUE_H_
 
+#include <cstdint>
 #include <memory>
 #include <stdexcept>
-#include <unordered_map>
+#include <vector>
 
+// Double ended queue addressed by signed index. Prepending extends the
+// range below the first index, so existing indices stay valid.
+// Items live in a contiguous ring buffer that doubles when full.
 template <typename T>
 class IndexedDequeue
 {
-    std::unordered_map<int, T> items;
+    std::vector<T> items;   // capacity is zero or a power of two
+    uint32_t head = 0;      // slot of _start_index
     int _start_index = 0;
     int _end_index = 0;
 
+    uint32_t slot(int index) const
+    {
+        return (head + static_cast<uint32_t>(index - _start_index)) & (items.size() - 1);
+    }
+
+    void grow_if_full()
+    {
+        if (size() < items.size())
+        {
+            return;
+        }
+
+        std::vector<T> grown(items.empty() ? 16 : items.size() * 2);
+        for (int i = _start_index; i < _end_index; ++i)
+        {
+            grown[i - _start_index] = std::move(items[slot(i)]);
+        }
+        items = std::move(grown);
+        head = 0;
+    }
+
 public:
 
     // First index
@@ -33,12 +59,11 @@ public:
 
     const T &operator[](int index) const
     {
-        auto it = items.find(index);
-        if (it == items.end())
+        if (index < _start_index || index >= _end_index)
         {
             throw std::out_of_range("Invalid item index");
         }
-        return it->second;
+        return items[slot(index)];
     }
 
     const T &back() const
@@ -48,17 +73,44 @@ public:
 
     void prepend(T item)
     {
-        items.emplace(--_start_index, std::move(item));
+        grow_if_full();
+        head = (head - 1) & (items.size() - 1);
+        items[head] = std::move(item);
+        --_start_index;
     }
 
     void append(T item)
     {
-        items.emplace(_end_index++, std::move(item));
+        grow_if_full();
+        items[slot(_end_index++)] = std::move(item);
+    }
+
+    // Drop the item at start_index, later indices are unchanged
+    void pop_front()
+    {
+        if (!size())
+        {
+            throw std::out_of_range("Pop from empty dequeue");
+        }
+        items[head] = T();
+        head = (head + 1) & (items.size() - 1);
+        ++_start_index;
+    }
+
+    // Drop the item at end_index - 1
+    void pop_back()
+    {
+        if (!size())
+        {
+            throw std::out_of_range("Pop from empty dequeue");
+        }
+        items[slot(--_end_index)] = T();
     }
 
     void clear()
     {
         items.clear();
+        head = 0;
         _start_index = 0;
         _end_index = 0;
     }
@@ -0,0 +1,97 @@
+#include "./jpeg_decode.h"
+
+#include <SDL/SDL.h>
+
+#include <csetjmp>
+#include <cstdio>
+#include <jpeglib.h>
+
+namespace
+{
+
+struct JpegErrorManager
+{
+    jpeg_error_mgr pub;
+    jmp_buf jump;
+};
+
+void on_jpeg_error(j_common_ptr cinfo)
+{
+    longjmp(reinterpret_cast<JpegErrorManager *>(cinfo->err)->jump, 1);
+}
+
+void ignore_jpeg_message(j_common_ptr)
+{
+}
+
+uint32_t scale_denominator(uint32_t width, uint32_t min_width)
+{
+    uint32_t denom = 1;
+    while (denom < 8 && (width + denom * 2 - 1) / (denom * 2) >= min_width)
+    {
+        denom *= 2;
+    }
+    return denom;
+}
+
+// Kept free of objects with destructors, since errors longjmp out of libjpeg
+SDL_Surface *decode(const char *data, size_t size, uint32_t min_width)
+{
+    jpeg_decompress_struct cinfo;
+    JpegErrorManager error_manager;
+    SDL_Surface *volatile surface = nullptr;
+
+    cinfo.err = jpeg_std_error(&error_manager.pub);
+    error_manager.pub.error_exit = on_jpeg_error;
+    error_manager.pub.output_message = ignore_jpeg_message;
+
+    if (setjmp(error_manager.jump))
+    {
+        jpeg_destroy_decompress(&cinfo);
+        if (surface)
+        {
+            SDL_FreeSurface(surface);
+        }
+        return nullptr;
+    }
+
+    jpeg_create_decompress(&cinfo);
+    jpeg_mem_src(&cinfo, reinterpret_cast<unsigned char *>(const_cast<char *>(data)), size);
+    jpeg_read_header(&cinfo, TRUE);
+
+    cinfo.out_color_space = JCS_RGB;
+    cinfo.scale_num = 1;
+    cinfo.scale_denom = scale_denominator(cinfo.image_width, min_width);
+    jpeg_start_decompress(&cinfo);
+
+#if SDL_BYTEORDER == SDL_LIL_ENDIAN
+    const Uint32 rmask = 0x0000ff, gmask = 0x00ff00, bmask = 0xff0000;
+#else
+    const Uint32 rmask = 0xff0000, gmask = 0x00ff00, bmask = 0x0000ff;
+#endif
+    surface = SDL_CreateRGBSurface(SDL_SWSURFACE, cinfo.output_width, cinfo.output_height, 24, rmask, gmask, bmask, 0);
+    if (!surface)
+    {
+        jpeg_destroy_decompress(&cinfo);
+        return nullptr;
+    }
+
+    // Scanlines are decoded straight into the surface rows
+    while (cinfo.output_scanline < cinfo.output_height)
+    {
+        JSAMPROW row = static_cast<JSAMPROW>(surface->pixels) + cinfo.output_scanline * surface->pitch;
+        jpeg_read_scanlines(&cinfo, &row, 1);
+    }
+
+    jpeg_finish_decompress(&cinfo);
+    jpeg_destroy_decompress(&cinfo);
+
+    return surface;
+}
+
+} // namespace
+
+surface_unique_ptr decode_jpeg_downscaled(const char *data, size_t size, uint32_t min_width)
+{
+    return surface_unique_ptr { decode(data, size, min_width) };
+}
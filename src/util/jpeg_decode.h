@@ -0,0 +1,14 @@
+#ifndef JPEG_DECODE_H_
+#define JPEG_DECODE_H_
+
+#include "./sdl_pointer.h"
+
+#include <cstddef>
+#include <cstdint>
+
+// Decode a JPEG at the smallest DCT scale (1, 1/2, 1/4 or 1/8) that is still
+// at least min_width wide, so memory is bounded by the output rather than the
+// source size. Returns a 24-bit RGB surface, or null if libjpeg can't decode it.
+surface_unique_ptr decode_jpeg_downscaled(const char *data, size_t size, uint32_t min_width);
+
+#endif
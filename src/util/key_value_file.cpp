@@ -1,17 +1,19 @@
 #include "./key_value_file.h"
 
+#include "util/atomic_file.h"
 #include "util/str_utils.h"
 
 #include <fstream>
+#include <sstream>
 
-void write_key_value(const std::filesystem::path &path, const std::unordered_map<std::string, std::string> &settings)
+bool write_key_value(const std::filesystem::path &path, const std::unordered_map<std::string, std::string> &settings)
 {
-    std::ofstream fp(path);
+    std::ostringstream ss;
     for (const auto& [key, value]: settings)
     {
-        fp << key << "=" << value << std::endl;
+        ss << key << "=" << value << std::endl;
     }
-    fp.close();
+    return write_file_atomically(path, ss.str());
 }
 
 std::unordered_map<std::string, std::string> load_key_value(const std::filesystem::path &path)
@@ -5,7 +5,8 @@
 #include <string>
 #include <unordered_map>
 
-void write_key_value(const std::filesystem::path &path, const std::unordered_map<std::string, std::string> &settings);
+// Written atomically, returns false if the file could not be replaced
+bool write_key_value(const std::filesystem::path &path, const std::unordered_map<std::string, std::string> &settings);
 std::unordered_map<std::string, std::string> load_key_value(const std::filesystem::path &path);
 
 #endif
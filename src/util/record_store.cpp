@@ -0,0 +1,548 @@
+#include "./record_store.h"
+#include "./atomic_file.h"
+#include "./checksum.h"
+#include "./string_serialization.h"
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cstring>
+#include <iostream>
+
+#define DEBUG 0
+
+namespace
+{
+
+constexpr char FILE_MAGIC[4] = {'P', 'X', 'R', 'S'};
+constexpr uint32_t FILE_VERSION = 1;
+constexpr uint32_t FILE_HEADER_SIZE = 8;
+
+// header checksum, value checksum, group size, key size, value size
+constexpr uint32_t RECORD_HEADER_SIZE = 20;
+constexpr uint32_t ERASED_VALUE_SIZE = 0xFFFFFFFF;
+constexpr uint32_t MAX_NAME_SIZE = 0xFFFF;
+
+// Compact once replaced records outweigh live ones in a file at least this large
+constexpr uint64_t COMPACT_MIN_FILE_SIZE = 64 * 1024;
+
+// Append a record to buf, returning the offset of its value within buf
+size_t append_record(std::string &buf, const std::string &group, const std::string &key, const std::string *value, uint32_t &value_checksum)
+{
+    value_checksum = value ? crc32(value->data(), value->size()) : 0;
+
+    size_t start = buf.size();
+    put_u32(buf, 0); // header checksum, filled below
+    put_u32(buf, value_checksum);
+    put_u32(buf, group.size());
+    put_u32(buf, key.size());
+    put_u32(buf, value ? value->size() : ERASED_VALUE_SIZE);
+    buf += group;
+    buf += key;
+
+    uint32_t header_checksum = crc32(buf.data() + start + 4, buf.size() - start - 4);
+    set_u32(buf.data() + start, header_checksum);
+
+    size_t value_offset = buf.size();
+    if (value)
+    {
+        buf += *value;
+    }
+    return value_offset;
+}
+
+bool read_exact(int fd, char *out, size_t size, uint64_t offset)
+{
+    while (size)
+    {
+        ssize_t n = pread(fd, out, size, offset);
+        if (n <= 0)
+        {
+            return false;
+        }
+        out += n;
+        size -= n;
+        offset += n;
+    }
+    return true;
+}
+
+bool write_exact(int fd, const char *data, size_t size, uint64_t offset)
+{
+    while (size)
+    {
+        ssize_t n = pwrite(fd, data, size, offset);
+        if (n <= 0)
+        {
+            return false;
+        }
+        data += n;
+        size -= n;
+        offset += n;
+    }
+    return true;
+}
+
+std::string file_header()
+{
+    std::string header(FILE_MAGIC, sizeof(FILE_MAGIC));
+    put_u32(header, FILE_VERSION);
+    return header;
+}
+
+} // namespace
+
+RecordStore::RecordStore(std::filesystem::path path)
+    : path(path)
+{
+    std::error_code ec;
+    std::filesystem::remove(path.string() + ".tmp", ec);
+
+    if (!open_log())
+    {
+        std::cerr << "Unable to open record store " << path << std::endl;
+    }
+}
+
+RecordStore::~RecordStore()
+{
+    close_log();
+}
+
+void RecordStore::close_log()
+{
+    if (fd >= 0)
+    {
+        ::close(fd);
+        fd = -1;
+    }
+}
+
+bool RecordStore::open_log()
+{
+    close_log();
+    index.clear();
+    file_size = 0;
+    live_bytes = 0;
+
+    fd = ::open(path.c_str(), O_RDWR | O_CREAT, 0644);
+    if (fd < 0)
+    {
+        return false;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0)
+    {
+        close_log();
+        return false;
+    }
+    uint64_t disk_size = st.st_size;
+
+    std::string expected_header = file_header();
+    if (disk_size > 0)
+    {
+        char header[FILE_HEADER_SIZE];
+        if (disk_size < FILE_HEADER_SIZE || !read_exact(fd, header, FILE_HEADER_SIZE, 0) || expected_header.compare(0, FILE_HEADER_SIZE, header, FILE_HEADER_SIZE) != 0)
+        {
+            // Keep the unreadable file around rather than overwrite it
+            std::cerr << "Unrecognized record store " << path << ", starting a new one" << std::endl;
+            close_log();
+            std::error_code ec;
+            std::filesystem::rename(path, path.string() + ".bad", ec);
+            fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+            if (fd < 0)
+            {
+                return false;
+            }
+            disk_size = 0;
+        }
+    }
+
+    if (disk_size == 0)
+    {
+        if (!write_exact(fd, expected_header.data(), expected_header.size(), 0) || fsync(fd) != 0)
+        {
+            close_log();
+            return false;
+        }
+        file_size = FILE_HEADER_SIZE;
+        return true;
+    }
+
+    // Index records up to the first one that is incomplete or corrupt
+    uint64_t offset = FILE_HEADER_SIZE;
+    std::string names;
+    while (offset + RECORD_HEADER_SIZE <= disk_size)
+    {
+        char header[RECORD_HEADER_SIZE];
+        if (!read_exact(fd, header, RECORD_HEADER_SIZE, offset))
+        {
+            break;
+        }
+
+        uint32_t header_checksum = get_u32(header);
+        uint32_t value_checksum = get_u32(header + 4);
+        uint32_t group_size = get_u32(header + 8);
+        uint32_t key_size = get_u32(header + 12);
+        uint32_t value_size = get_u32(header + 16);
+        bool erased = value_size == ERASED_VALUE_SIZE;
+
+        uint64_t names_offset = offset + RECORD_HEADER_SIZE;
+        uint64_t value_offset = names_offset + group_size + key_size;
+        if (group_size > MAX_NAME_SIZE || key_size > MAX_NAME_SIZE || value_offset + (erased ? 0 : value_size) > disk_size)
+        {
+            break;
+        }
+
+        names.resize(group_size + key_size);
+        if (!read_exact(fd, names.data(), names.size(), names_offset))
+        {
+            break;
+        }
+
+        uint32_t checksum = crc32(header + 4, RECORD_HEADER_SIZE - 4);
+        checksum = crc32(names.data(), names.size(), checksum);
+        if (checksum != header_checksum)
+        {
+            break;
+        }
+
+        uint32_t record_size = value_offset + (erased ? 0 : value_size) - offset;
+        auto &group = index[names.substr(0, group_size)];
+        auto key = names.substr(group_size);
+
+        auto it = group.find(key);
+        if (it != group.end())
+        {
+            live_bytes -= it->second.record_size;
+            group.erase(it);
+        }
+        if (!erased)
+        {
+            group[key] = {value_offset, value_size, value_checksum, record_size};
+            live_bytes += record_size;
+        }
+
+        offset += record_size;
+    }
+
+    if (offset < disk_size)
+    {
+        std::cerr << "Dropping " << (disk_size - offset) << " unreadable bytes from " << path << std::endl;
+        if (ftruncate(fd, offset) != 0)
+        {
+            close_log();
+            return false;
+        }
+    }
+    file_size = offset;
+
+#if DEBUG
+    std::cerr << "Record store " << path << ": " << file_size << " bytes, " << live_bytes << " live" << std::endl;
+#endif
+
+    return true;
+}
+
+std::optional<std::string> RecordStore::read_value(const Location &location) const
+{
+    std::string value(location.size, '\0');
+    if (fd < 0 || !read_exact(fd, value.data(), value.size(), location.offset))
+    {
+        return std::nullopt;
+    }
+    if (crc32(value.data(), value.size()) != location.checksum)
+    {
+        std::cerr << "Checksum mismatch in " << path << std::endl;
+        return std::nullopt;
+    }
+    return value;
+}
+
+std::optional<std::string> RecordStore::get(const std::string &group, const std::string &key) const
+{
+    auto pending_group = pending.find(group);
+    if (pending_group != pending.end())
+    {
+        auto it = pending_group->second.find(key);
+        if (it != pending_group->second.end())
+        {
+            return it->second;
+        }
+    }
+
+    auto index_group = index.find(group);
+    if (index_group != index.end())
+    {
+        auto it = index_group->second.find(key);
+        if (it != index_group->second.end())
+        {
+            return read_value(it->second);
+        }
+    }
+
+    return std::nullopt;
+}
+
+std::vector<std::string> RecordStore::get_groups() const
+{
+    std::vector<std::string> groups;
+    for (const auto &[group, entries] : index)
+    {
+        if (!get_keys(group).empty())
+        {
+            groups.push_back(group);
+        }
+    }
+    for (const auto &[group, entries] : pending)
+    {
+        if (!index.count(group) && !get_keys(group).empty())
+        {
+            groups.push_back(group);
+        }
+    }
+    return groups;
+}
+
+std::vector<std::string> RecordStore::get_keys(const std::string &group) const
+{
+    std::vector<std::string> keys;
+
+    auto pending_group = pending.find(group);
+    auto index_group = index.find(group);
+    if (index_group != index.end())
+    {
+        for (const auto &[key, location] : index_group->second)
+        {
+            if (pending_group == pending.end() || !pending_group->second.count(key))
+            {
+                keys.push_back(key);
+            }
+        }
+    }
+    if (pending_group != pending.end())
+    {
+        for (const auto &[key, value] : pending_group->second)
+        {
+            if (value)
+            {
+                keys.push_back(key);
+            }
+        }
+    }
+
+    return keys;
+}
+
+void RecordStore::put(const std::string &group, const std::string &key, const std::string &value)
+{
+    pending[group][key] = value;
+}
+
+void RecordStore::erase(const std::string &group, const std::string &key)
+{
+    auto index_group = index.find(group);
+    if (index_group != index.end() && index_group->second.count(key))
+    {
+        pending[group][key] = std::nullopt;
+    }
+    else
+    {
+        auto pending_group = pending.find(group);
+        if (pending_group != pending.end())
+        {
+            pending_group->second.erase(key);
+        }
+    }
+}
+
+bool RecordStore::flush()
+{
+    if (pending.empty())
+    {
+        return true;
+    }
+    if (fd < 0 && !open_log())
+    {
+        return false;
+    }
+
+    struct Written
+    {
+        const std::string *group;
+        const std::string *key;
+        bool erased;
+        Location location;
+    };
+
+    std::string buf;
+    std::vector<Written> written;
+    for (const auto &[group, entries] : pending)
+    {
+        for (const auto &[key, value] : entries)
+        {
+            size_t start = buf.size();
+            uint32_t checksum;
+            size_t value_offset = append_record(buf, group, key, value ? &*value : nullptr, checksum);
+
+            Location location = {
+                file_size + value_offset,
+                value ? static_cast<uint32_t>(value->size()) : 0,
+                checksum,
+                static_cast<uint32_t>(buf.size() - start)
+            };
+            written.push_back({&group, &key, !value, location});
+        }
+    }
+
+    if (!write_exact(fd, buf.data(), buf.size(), file_size) || fdatasync(fd) != 0)
+    {
+        std::cerr << "Unable to write " << path << std::endl;
+        // Drop any partial write so later records follow a readable one
+        if (ftruncate(fd, file_size) != 0)
+        {
+            close_log();
+        }
+        return false;
+    }
+    file_size += buf.size();
+
+    for (const auto &w : written)
+    {
+        auto &group = index[*w.group];
+        auto it = group.find(*w.key);
+        if (it != group.end())
+        {
+            live_bytes -= it->second.record_size;
+            group.erase(it);
+        }
+        if (!w.erased)
+        {
+            group[*w.key] = w.location;
+            live_bytes += w.location.record_size;
+        }
+    }
+    pending.clear();
+
+#if DEBUG
+    std::cerr << "Flushed " << written.size() << " records to " << path << std::endl;
+#endif
+
+    return true;
+}
+
+bool RecordStore::should_compact() const
+{
+    return fd >= 0 && file_size >= COMPACT_MIN_FILE_SIZE && live_bytes * 2 < file_size;
+}
+
+bool RecordStore::compact()
+{
+    if (fd < 0)
+    {
+        return false;
+    }
+
+    std::filesystem::path tmp_path = path.string() + ".tmp";
+    int tmp_fd = ::open(tmp_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (tmp_fd < 0)
+    {
+        std::cerr << "Unable to compact " << path << std::endl;
+        return false;
+    }
+
+    decltype(index) new_index;
+    uint64_t new_size = 0;
+    std::string buf = file_header();
+    bool ok = true;
+
+    for (const auto &[group, entries] : index)
+    {
+        for (const auto &[key, location] : entries)
+        {
+            auto value = read_value(location);
+            if (!value)
+            {
+                continue;
+            }
+
+            size_t start = buf.size();
+            uint32_t checksum;
+            size_t value_offset = append_record(buf, group, key, &*value, checksum);
+            new_index[group][key] = {
+                new_size + value_offset,
+                location.size,
+                checksum,
+                static_cast<uint32_t>(buf.size() - start)
+            };
+
+            // Write in chunks to bound memory use
+            if (buf.size() >= COMPACT_MIN_FILE_SIZE)
+            {
+                ok = ok && write_exact(tmp_fd, buf.data(), buf.size(), new_size);
+                new_size += buf.size();
+                buf.clear();
+            }
+        }
+    }
+    ok = ok && write_exact(tmp_fd, buf.data(), buf.size(), new_size);
+    new_size += buf.size();
+    ok = ok && fsync(tmp_fd) == 0;
+    ::close(tmp_fd);
+
+    std::error_code ec;
+    if (ok)
+    {
+        std::filesystem::rename(tmp_path, path, ec);
+        ok = !ec;
+    }
+    if (!ok)
+    {
+        std::cerr << "Unable to compact " << path << std::endl;
+        std::filesystem::remove(tmp_path, ec);
+        return false;
+    }
+    sync_parent_directory(path);
+
+#if DEBUG
+    std::cerr << "Compacted " << path << " from " << file_size << " to " << new_size << " bytes" << std::endl;
+#endif
+
+    close_log();
+    fd = ::open(path.c_str(), O_RDWR);
+    index = std::move(new_index);
+    file_size = new_size;
+    live_bytes = new_size - FILE_HEADER_SIZE;
+    return fd >= 0;
+}
+
+bool RecordStore::clear()
+{
+    pending.clear();
+    if (fd < 0)
+    {
+        return open_log();
+    }
+
+    if (ftruncate(fd, FILE_HEADER_SIZE) != 0 || fdatasync(fd) != 0)
+    {
+        std::cerr << "Unable to clear " << path << std::endl;
+        return false;
+    }
+    index.clear();
+    file_size = FILE_HEADER_SIZE;
+    live_bytes = 0;
+    return true;
+}
+
+bool RecordStore::has_pending_writes() const
+{
+    return !pending.empty();
+}
+
+uint64_t RecordStore::get_file_size() const
+{
+    return file_size;
+}
@@ -0,0 +1,71 @@
+#ifndef RECORD_STORE_H_
+#define RECORD_STORE_H_
+
+#include <cstdint>
+#include <filesystem>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Append-only binary file of (group, key) -> value records.
+//
+// Later records replace earlier ones. Every record is checksummed, so a write
+// torn by power loss is dropped on the next load instead of corrupting the
+// rest of the file. Only record offsets are kept in memory; values are read
+// from disk when requested. Compaction writes the live records to a temp file
+// and renames it over the log, so either the old or new file survives a crash.
+class RecordStore
+{
+    struct Location
+    {
+        uint64_t offset;    // of the value
+        uint32_t size;
+        uint32_t checksum;
+        uint32_t record_size;
+    };
+
+    std::filesystem::path path;
+    int fd = -1;
+    uint64_t file_size = 0;
+    uint64_t live_bytes = 0;
+
+    std::unordered_map<std::string, std::unordered_map<std::string, Location>> index;
+
+    // Unflushed writes, erased keys are nullopt
+    std::unordered_map<std::string, std::unordered_map<std::string, std::optional<std::string>>> pending;
+
+    bool open_log();
+    void close_log();
+    std::optional<std::string> read_value(const Location &location) const;
+
+public:
+    RecordStore(std::filesystem::path path);
+    RecordStore(const RecordStore &) = delete;
+    RecordStore &operator=(const RecordStore &) = delete;
+    ~RecordStore();
+
+    std::optional<std::string> get(const std::string &group, const std::string &key) const;
+    std::vector<std::string> get_groups() const;
+    std::vector<std::string> get_keys(const std::string &group) const;
+
+    // Buffered until flush
+    void put(const std::string &group, const std::string &key, const std::string &value);
+    void erase(const std::string &group, const std::string &key);
+
+    // Append buffered writes and sync them to disk. Returns false if the
+    // writes could not be saved.
+    bool flush();
+    // True once most of a large file is replaced records. Compacting rewrites
+    // the whole file, so is left to the owner to run at a quiet time.
+    bool should_compact() const;
+    bool compact();
+
+    // Drop all records, including unflushed ones
+    bool clear();
+
+    bool has_pending_writes() const;
+    uint64_t get_file_size() const;
+};
+
+#endif
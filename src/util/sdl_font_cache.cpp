@@ -1,12 +1,27 @@
 #include "./sdl_font_cache.h"
 #include "./sdl_pointer.h"
 
+#include <array>
 #include <iostream>
 #include <unordered_map>
 
 using fonts_lookup = std::unordered_map<std::string, ttf_font_unique_ptr>;
 static std::unordered_map<uint32_t, fonts_lookup> font_cache;
 
+struct GlyphAdvances
+{
+    std::array<int, 128> ascii;
+    std::unordered_map<uint16_t, int> other;
+
+    GlyphAdvances()
+    {
+        ascii.fill(-1);
+    }
+};
+
+// Loaded fonts are never freed, so font pointers are stable keys
+static std::unordered_map<TTF_Font *, GlyphAdvances> glyph_advance_cache;
+
 static TTF_Font *load_with_warning(const std::string &font, uint32_t size, FontLoadErrorOpt opt)
 {
     TTF_Font *font_ptr = TTF_OpenFont(font.c_str(), size);
@@ -35,3 +50,99 @@ TTF_Font *cached_load_font(const std::string &font_path, uint32_t size, FontLoad
 
     return it->second.get();
 }
+
+static int load_glyph_advance(TTF_Font *font, uint16_t ch)
+{
+    int minx, maxx, miny, maxy, advance;
+    if (TTF_GlyphMetrics(font, ch, &minx, &maxx, &miny, &maxy, &advance) != 0)
+    {
+        return 0;
+    }
+    return advance;
+}
+
+int cached_glyph_advance(TTF_Font *font, uint16_t ch)
+{
+    if (!font)
+    {
+        return 0;
+    }
+
+    auto &advances = glyph_advance_cache[font];
+    if (ch < advances.ascii.size())
+    {
+        int &advance = advances.ascii[ch];
+        if (advance < 0)
+        {
+            advance = load_glyph_advance(font, ch);
+        }
+        return advance;
+    }
+
+    auto it = advances.other.find(ch);
+    if (it == advances.other.end())
+    {
+        it = advances.other.emplace(ch, load_glyph_advance(font, ch)).first;
+    }
+    return it->second;
+}
+
+// Decode one character, replacing malformed sequences with U+FFFD
+static uint16_t decode_utf8(const char *&s, const char *end)
+{
+    unsigned char c = *s++;
+    if (c < 0x80)
+    {
+        return c;
+    }
+
+    int num_continuation = c >= 0xF0 ? 3 : c >= 0xE0 ? 2 : c >= 0xC0 ? 1 : -1;
+    if (num_continuation < 0)
+    {
+        return 0xFFFD;
+    }
+
+    uint32_t ch = c & (0x3F >> num_continuation);
+    for (int i = 0; i < num_continuation; ++i)
+    {
+        if (s >= end || (*s & 0xC0) != 0x80)
+        {
+            return 0xFFFD;
+        }
+        ch = (ch << 6) | (*s++ & 0x3F);
+    }
+    return ch <= 0xFFFF ? ch : 0xFFFD;
+}
+
+TextWidthEstimator::TextWidthEstimator(TTF_Font *font)
+    : font(font)
+{
+}
+
+void TextWidthEstimator::set_font(TTF_Font *new_font)
+{
+    font = new_font;
+    prefix_start = nullptr;
+    prefix_len = 0;
+    prefix_width = 0;
+}
+
+int TextWidthEstimator::width(const char *s, uint32_t len)
+{
+    if (s != prefix_start || len < prefix_len)
+    {
+        prefix_start = s;
+        prefix_len = 0;
+        prefix_width = 0;
+    }
+
+    const char *pos = s + prefix_len;
+    const char *end = s + len;
+    while (pos < end)
+    {
+        prefix_width += cached_glyph_advance(font, decode_utf8(pos, end));
+    }
+    prefix_len = len;
+
+    return prefix_width;
+}
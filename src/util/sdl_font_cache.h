@@ -2,6 +2,7 @@
 #define SDL_FONT_CACHE_H_
 
 #include <SDL/SDL_ttf.h>
+#include <cstdint>
 #include <string>
 
 enum class FontLoadErrorOpt
@@ -12,4 +13,24 @@ enum class FontLoadErrorOpt
 
 TTF_Font *cached_load_font(const std::string &font_path, uint32_t size, FontLoadErrorOpt opt = FontLoadErrorOpt::ThrowOnError);
 
+// Horizontal advance of a glyph in pixels, cached per font
+int cached_glyph_advance(TTF_Font *font, uint16_t ch);
+
+// Approximate width of a string prefix from cached glyph advances, ignoring
+// kerning. Extending the previously measured prefix only measures the new
+// characters, so growing a line word by word stays linear.
+class TextWidthEstimator
+{
+    TTF_Font *font = nullptr;
+    const char *prefix_start = nullptr;
+    uint32_t prefix_len = 0;
+    int prefix_width = 0;
+
+public:
+    TextWidthEstimator(TTF_Font *font = nullptr);
+
+    void set_font(TTF_Font *font);
+    int width(const char *s, uint32_t len);
+};
+
 #endif
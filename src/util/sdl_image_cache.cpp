@@ -3,34 +3,143 @@
 namespace
 {
 
-uint32_t surface_size_bytes(const SDL_Surface *surface)
+uint64_t default_budget_bytes = DEFAULT_IMAGE_CACHE_SIZE_BYTES;
+ImageCachePolicy default_policy = ImageCachePolicy::LeastRecentlyUsed;
+
+uint64_t surface_size_bytes(const SDL_Surface *surface)
+{
+    return static_cast<uint64_t>(surface->pitch) * surface->h;
+}
+
+uint64_t distance(uint64_t a, uint64_t b)
 {
-    return surface->pitch * surface->h;
+    return a > b ? a - b : b - a;
 }
 
 } // namespace
 
-void SDLImageCache::put_image(const std::string &key, surface_unique_ptr image)
+std::optional<ImageCachePolicy> image_cache_policy_from_string(const std::string &name)
 {
-    uint32_t surface_size = surface_size_bytes(image.get());
+    if (name == "lru")
+    {
+        return ImageCachePolicy::LeastRecentlyUsed;
+    }
+    if (name == "distance")
+    {
+        return ImageCachePolicy::FarthestFromPosition;
+    }
+    return std::nullopt;
+}
+
+void set_image_cache_defaults(uint64_t budget_bytes, ImageCachePolicy policy)
+{
+    default_budget_bytes = budget_bytes;
+    default_policy = policy;
+}
 
-    while (cache.size() && total_size_bytes + surface_size > IMAGE_CACHE_SIZE_BYTES)
+SDLImageCache::SDLImageCache()
+    : SDLImageCache(default_budget_bytes, default_policy)
+{
+}
+
+SDLImageCache::SDLImageCache(uint64_t budget_bytes, ImageCachePolicy policy)
+    : budget_bytes(budget_bytes), policy(policy)
+{
+}
+
+void SDLImageCache::unlink(Entry &entry)
+{
+    (entry.prev ? entry.prev->next : most_recent) = entry.next;
+    (entry.next ? entry.next->prev : least_recent) = entry.prev;
+    entry.prev = entry.next = nullptr;
+}
+
+void SDLImageCache::link_front(Entry &entry)
+{
+    entry.next = most_recent;
+    (most_recent ? most_recent->prev : least_recent) = &entry;
+    most_recent = &entry;
+}
+
+void SDLImageCache::erase(Entry &entry)
+{
+    unlink(entry);
+    stats.size_bytes -= entry.size_bytes;
+    --stats.num_images;
+    entries.erase(*entry.key);
+}
+
+SDLImageCache::Entry *SDLImageCache::eviction_candidate()
+{
+    if (policy == ImageCachePolicy::LeastRecentlyUsed)
+    {
+        return least_recent;
+    }
+
+    // Ties go to the least recently used
+    Entry *farthest = least_recent;
+    for (Entry *entry = least_recent; entry; entry = entry->prev)
+    {
+        if (distance(entry->position, reading_position) > distance(farthest->position, reading_position))
+        {
+            farthest = entry;
+        }
+    }
+    return farthest;
+}
+
+void SDLImageCache::put_image(const std::string &key, surface_unique_ptr image, uint64_t position)
+{
+    auto it = entries.find(key);
+    if (it != entries.end())
+    {
+        erase(it->second);
+    }
+
+    uint64_t size_bytes = surface_size_bytes(image.get());
+    while (stats.num_images && stats.size_bytes + size_bytes > budget_bytes)
     {
-        total_size_bytes -= surface_size_bytes(
-            cache.back_value().get()
-        );
-        cache.pop();
+        erase(*eviction_candidate());
+        ++stats.evictions;
     }
 
-    cache.put(key, std::move(image));
-    total_size_bytes += surface_size;
+    auto [entry_it, inserted] = entries.try_emplace(key);
+    Entry &entry = entry_it->second;
+    entry.surface = std::move(image);
+    entry.size_bytes = size_bytes;
+    entry.position = position;
+    entry.key = &entry_it->first;
+    link_front(entry);
+
+    stats.size_bytes += size_bytes;
+    ++stats.num_images;
 }
 
 SDL_Surface *SDLImageCache::get_image(const std::string &key)
 {
-    if (!cache.has(key))
+    auto it = entries.find(key);
+    if (it == entries.end())
     {
+        ++stats.misses;
         return nullptr;
     }
-    return cache[key].get();
+    ++stats.hits;
+
+    Entry &entry = it->second;
+    if (&entry != most_recent)
+    {
+        unlink(entry);
+        link_front(entry);
+    }
+    return entry.surface.get();
+}
+
+void SDLImageCache::set_reading_position(uint64_t position)
+{
+    reading_position = position;
+}
+
+const ImageCacheStats &SDLImageCache::get_stats() const
+{
+    return stats;
 }
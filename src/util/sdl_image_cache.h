@@ -1,21 +1,77 @@
 #ifndef SDL_IMAGE_CACHE_H_
 #define SDL_IMAGE_CACHE_H_
 
-#include "./lru_cache.h"
 #include "./sdl_pointer.h"
 
+#include <cstdint>
+#include <optional>
 #include <string>
+#include <unordered_map>
 
-#define IMAGE_CACHE_SIZE_BYTES (64 * 1024 * 1024)
+#define DEFAULT_IMAGE_CACHE_SIZE_BYTES (64 * 1024 * 1024)
 
+enum class ImageCachePolicy
+{
+    LeastRecentlyUsed,
+    FarthestFromPosition,   // evict images far from the reading position first
+};
+
+// Parse "lru" or "distance"
+std::optional<ImageCachePolicy> image_cache_policy_from_string(const std::string &name);
+
+struct ImageCacheStats
+{
+    uint32_t hits = 0;
+    uint32_t misses = 0;
+    uint32_t evictions = 0;
+    uint32_t num_images = 0;
+    uint64_t size_bytes = 0;    // pixel memory held by cached surfaces
+};
+
+// Decoded images within a memory budget. Entries live in a hash map and are
+// threaded on an intrusive recency list, so each key is stored once.
 class SDLImageCache
 {
-    LRUCache<std::string, surface_unique_ptr> cache;
-    uint32_t total_size_bytes = 0;
+    struct Entry
+    {
+        surface_unique_ptr surface;
+        uint64_t size_bytes = 0;
+        uint64_t position = 0;
+        const std::string *key = nullptr;
+        Entry *prev = nullptr;  // more recently used
+        Entry *next = nullptr;  // less recently used
+    };
+
+    std::unordered_map<std::string, Entry> entries;
+    Entry *most_recent = nullptr;
+    Entry *least_recent = nullptr;
+
+    uint64_t budget_bytes;
+    ImageCachePolicy policy;
+    uint64_t reading_position = 0;
+    ImageCacheStats stats;
+
+    void unlink(Entry &entry);
+    void link_front(Entry &entry);
+    void erase(Entry &entry);
+    Entry *eviction_candidate();
 
 public:
-    void put_image(const std::string &key, surface_unique_ptr image);
+    // Use the budget and policy configured with set_image_cache_defaults
+    SDLImageCache();
+    SDLImageCache(uint64_t budget_bytes, ImageCachePolicy policy);
+    SDLImageCache(const SDLImageCache &) = delete;
+    SDLImageCache &operator=(const SDLImageCache &) = delete;
+
+    // Position is where the image appears in the document, for distance based eviction
+    void put_image(const std::string &key, surface_unique_ptr image, uint64_t position = 0);
     SDL_Surface *get_image(const std::string &key);
+
+    void set_reading_position(uint64_t position);
+    const ImageCacheStats &get_stats() const;
 };
 
+// Budget and policy for caches created afterwards, e.g. from reader.cfg
+void set_image_cache_defaults(uint64_t budget_bytes, ImageCachePolicy policy);
+
 #endif
@@ -0,0 +1,74 @@
+#include "./sdl_text_cache.h"
+
+namespace
+{
+
+size_t surface_size_bytes(const SDL_Surface *surface)
+{
+    return static_cast<size_t>(surface->pitch) * surface->h;
+}
+
+std::string make_key(TTF_Font *font, const std::string &text, SDL_Color fg, SDL_Color bg)
+{
+    // Fonts are never freed by the font cache, so the pointer identifies font and size
+    const uint8_t colors[] = {fg.r, fg.g, fg.b, bg.r, bg.g, bg.b};
+
+    std::string key;
+    key.reserve(text.size() + sizeof(font) + sizeof(colors));
+    key.append(reinterpret_cast<const char *>(&font), sizeof(font));
+    key.append(reinterpret_cast<const char *>(colors), sizeof(colors));
+    key.append(text);
+    return key;
+}
+
+} // namespace
+
+SDLTextCache::SDLTextCache(size_t budget_bytes)
+    : budget_bytes(budget_bytes)
+{
+}
+
+SDL_Surface *SDLTextCache::render_shaded(TTF_Font *font, const std::string &text, SDL_Color fg, SDL_Color bg)
+{
+    std::string key = make_key(font, text, fg, bg);
+    if (cache.has(key))
+    {
+        stats.hits++;
+        return cache[key].get();
+    }
+    stats.misses++;
+
+    surface_unique_ptr surface {TTF_RenderUTF8_Shaded(font, text.c_str(), fg, bg)};
+    if (!surface)
+    {
+        return nullptr;
+    }
+
+    size_t size = surface_size_bytes(surface.get());
+    while (cache.size() && stats.size_bytes + size > budget_bytes)
+    {
+        stats.size_bytes -= surface_size_bytes(cache.back_value().get());
+        stats.evictions++;
+        cache.pop();
+    }
+
+    SDL_Surface *result = surface.get();
+    cache.put(key, std::move(surface));
+    stats.size_bytes += size;
+
+    return result;
+}
+
+void SDLTextCache::clear()
+{
+    while (cache.size())
+    {
+        cache.pop();
+    }
+    stats.size_bytes = 0;
+}
+
+const TextCacheStats &SDLTextCache::get_stats() const
+{
+    return stats;
+}
@@ -0,0 +1,40 @@
+#ifndef SDL_TEXT_CACHE_H_
+#define SDL_TEXT_CACHE_H_
+
+#include "./lru_cache.h"
+#include "./sdl_pointer.h"
+
+#include <SDL/SDL_ttf.h>
+#include <cstddef>
+#include <string>
+
+#define TEXT_CACHE_SIZE_BYTES (2 * 1024 * 1024)
+
+struct TextCacheStats
+{
+    uint32_t hits = 0;
+    uint32_t misses = 0;
+    uint32_t evictions = 0;
+    size_t size_bytes = 0;
+};
+
+// Rendered text surfaces keyed by text, font and colors, evicted LRU once
+// the byte budget is exceeded.
+class SDLTextCache
+{
+    LRUCache<std::string, surface_unique_ptr> cache;
+    size_t budget_bytes;
+    TextCacheStats stats;
+
+public:
+    SDLTextCache(size_t budget_bytes = TEXT_CACHE_SIZE_BYTES);
+
+    // Returns a cached surface, rendering it on a miss. The surface is owned
+    // by the cache and stays valid until the next call. Null if rendering fails.
+    SDL_Surface *render_shaded(TTF_Font *font, const std::string &text, SDL_Color fg, SDL_Color bg);
+
+    void clear();
+    const TextCacheStats &get_stats() const;
+};
+
+#endif
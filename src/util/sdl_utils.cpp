@@ -2,6 +2,8 @@
 #include "./sdl_font_cache.h"
 
 #include <SDL/SDL_image.h>
+#include <algorithm>
+#include <cstring>
 #include <iostream>
 
 int detect_line_height(TTF_Font *font)
@@ -19,6 +21,33 @@ int detect_line_height(const std::string &font, uint32_t size)
     return detect_line_height(cached_load_font(font, size));
 }
 
+void shift_surface_rows(SDL_Surface *surface, int y, int h, int dy)
+{
+    if (h <= 0 || dy == 0 || y < 0 || y + dy < 0 || std::max(y, y + dy) + h > surface->h)
+    {
+        return;
+    }
+
+    // Rows are contiguous, so the overlapping move is a single memmove rather
+    // than a self-blit, whose overlap handling depends on the blitter.
+    if (SDL_MUSTLOCK(surface))
+    {
+        SDL_LockSurface(surface);
+    }
+
+    uint8_t *pixels = static_cast<uint8_t *>(surface->pixels);
+    std::memmove(
+        pixels + (y + dy) * surface->pitch,
+        pixels + y * surface->pitch,
+        static_cast<size_t>(h) * surface->pitch
+    );
+
+    if (SDL_MUSTLOCK(surface))
+    {
+        SDL_UnlockSurface(surface);
+    }
+}
+
 surface_unique_ptr load_surface_from_ptr(const char *data, uint32_t size, const std::string &img_format, SDL_PixelFormat *surface_format)
 {
     char type_str[8];
@@ -8,6 +8,9 @@
 int detect_line_height(TTF_Font *font);
 int detect_line_height(const std::string &font, uint32_t size);
 
+// Move rows [y, y + h) of the surface by dy rows, in place.
+void shift_surface_rows(SDL_Surface *surface, int y, int h, int dy);
+
 surface_unique_ptr load_surface_from_ptr(const char *data, uint32_t size, const std::string &img_format, SDL_PixelFormat *surface_format);
 
 #endif
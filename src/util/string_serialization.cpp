@@ -47,3 +47,77 @@ std::string encode_uint_vector(const std::vector<uint32_t> &numbers)
 
     return ss.str();
 }
+
+void put_u32(std::string &buf, uint32_t value)
+{
+    for (int i = 0; i < 4; ++i)
+    {
+        buf.push_back(static_cast<char>((value >> (8 * i)) & 0xFF));
+    }
+}
+
+void put_u64(std::string &buf, uint64_t value)
+{
+    put_u32(buf, value & 0xFFFFFFFF);
+    put_u32(buf, value >> 32);
+}
+
+void set_u32(char *data, uint32_t value)
+{
+    for (int i = 0; i < 4; ++i)
+    {
+        data[i] = static_cast<char>((value >> (8 * i)) & 0xFF);
+    }
+}
+
+uint32_t get_u32(const char *data, int num_bytes)
+{
+    uint32_t value = 0;
+    for (int i = 0; i < num_bytes; ++i)
+    {
+        value |= static_cast<uint32_t>(static_cast<uint8_t>(data[i])) << (8 * i);
+    }
+    return value;
+}
+
+ByteReader::ByteReader(const char *pos, const char *end)
+    : pos(pos), end(end)
+{
+}
+
+ByteReader::ByteReader(std::string_view bytes)
+    : pos(bytes.data()), end(bytes.data() + bytes.size())
+{
+}
+
+bool ByteReader::has(size_t size)
+{
+    ok = ok && static_cast<size_t>(end - pos) >= size;
+    return ok;
+}
+
+uint64_t ByteReader::get(int num_bytes)
+{
+    if (!has(num_bytes))
+    {
+        return 0;
+    }
+    uint64_t value = 0;
+    for (int i = 0; i < num_bytes; ++i)
+    {
+        value |= static_cast<uint64_t>(static_cast<uint8_t>(pos[i])) << (8 * i);
+    }
+    pos += num_bytes;
+    return value;
+}
+
+std::string_view ByteReader::get_bytes(size_t size)
+{
+    if (!has(size))
+    {
+        return {};
+    }
+    std::string_view bytes(pos, size);
+    pos += size;
+    return bytes;
+}
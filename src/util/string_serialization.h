@@ -1,8 +1,11 @@
 #ifndef STRING_SERIALIZATION_H_
 #define STRING_SERIALIZATION_H_
 
+#include <cstddef>
+#include <cstdint>
 #include <optional>
 #include <string>
+#include <string_view>
 #include <vector>
 
 std::optional<uint32_t> try_decode_uint(const std::string &str);
@@ -10,4 +13,25 @@ std::optional<uint32_t> try_decode_uint(const std::string &str);
 bool try_decode_uint_vector(std::string encoded, std::vector<uint32_t> &out);
 std::string encode_uint_vector(const std::vector<uint32_t> &numbers);
 
+// Little endian integers, as used by the binary cache formats
+void put_u32(std::string &buf, uint32_t value);
+void put_u64(std::string &buf, uint64_t value);
+void set_u32(char *data, uint32_t value);
+uint32_t get_u32(const char *data, int num_bytes = 4);
+
+// Bounds checked little endian reads, failures stick
+struct ByteReader
+{
+    const char *pos;
+    const char *end;
+    bool ok = true;
+
+    ByteReader(const char *pos, const char *end);
+    ByteReader(std::string_view bytes);
+
+    bool has(size_t size);
+    uint64_t get(int num_bytes);
+    std::string_view get_bytes(size_t size);
+};
+
 #endif
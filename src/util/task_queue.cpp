@@ -1,26 +1,106 @@
 #include "./task_queue.h"
 
-TaskQueue::TaskQueue()
+TaskQueue::TaskQueue(uint32_t num_workers)
 {
+    for (uint32_t i = 0; i < num_workers; ++i)
+    {
+        workers.emplace_back([this]() { run_worker(); });
+    }
 }
 
 TaskQueue::~TaskQueue()
 {
+    stop_workers();
     drain();
 }
 
+void TaskQueue::stop_workers()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+        std::queue<std::pair<task_func, task_func>>().swap(background_queue);
+    }
+    work_available.notify_all();
+
+    for (auto &worker : workers)
+    {
+        worker.join();
+    }
+    workers.clear();
+}
+
+void TaskQueue::run_worker()
+{
+    while (true)
+    {
+        std::pair<task_func, task_func> task;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            work_available.wait(lock, [this]() { return stopping || !background_queue.empty(); });
+            if (stopping)
+            {
+                return;
+            }
+            task = std::move(background_queue.front());
+            background_queue.pop();
+        }
+
+        task.first();
+
+        if (task.second)
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            completed_queue.push(std::move(task.second));
+        }
+    }
+}
+
 void TaskQueue::submit(task_func task)
 {
     queue.push(task);
 }
 
+void TaskQueue::submit_background(task_func work, task_func on_done)
+{
+    if (workers.empty())
+    {
+        queue.push([work, on_done]() {
+            work();
+            if (on_done)
+            {
+                on_done();
+            }
+        });
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        background_queue.emplace(std::move(work), std::move(on_done));
+    }
+    work_available.notify_one();
+}
+
 bool TaskQueue::drain()
 {
-    bool ran_task = false;
+    std::queue<task_func> pending;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        std::swap(pending, completed_queue);
+    }
+
     while (!queue.empty())
     {
-        queue.front()();
+        pending.push(std::move(queue.front()));
         queue.pop();
+    }
+
+    bool ran_task = false;
+    while (!pending.empty())
+    {
+        pending.front()();
+        pending.pop();
         ran_task = true;
     }
 
@@ -1,23 +1,54 @@
 #ifndef TASK_QUEUE_H_
 #define TASK_QUEUE_H_
 
+#include <condition_variable>
+#include <cstdint>
 #include <functional>
+#include <mutex>
 #include <queue>
+#include <thread>
+#include <vector>
 
 using task_func = typename std::function<void()>;
 
+// Run work on another thread, then on_done on the thread that submitted it.
+using background_func = typename std::function<void(task_func work, task_func on_done)>;
+
+// Tasks run on the thread calling drain. Background work runs on a pool of
+// worker threads and its completion is queued to run on the next drain.
 class TaskQueue
 {
     std::queue<task_func> queue;
 
+    std::vector<std::thread> workers;
+    std::mutex mutex;
+    std::condition_variable work_available;
+    std::queue<std::pair<task_func, task_func>> background_queue;
+    std::queue<task_func> completed_queue;
+    bool stopping = false;
+
+    void run_worker();
+
 public:
 
-    TaskQueue();
+    // Without workers, background work runs inline on the next drain.
+    TaskQueue(uint32_t num_workers = 0);
+    TaskQueue(const TaskQueue &) = delete;
+    TaskQueue &operator=(const TaskQueue &) = delete;
     virtual ~TaskQueue();
 
     void submit(task_func task);
-    
-    // Return true if ran tasks
+
+    // Work must not touch state owned by the draining thread, on_done may.
+    void submit_background(task_func work, task_func on_done = nullptr);
+
+    // Stop worker threads, dropping background work that has not started.
+    // Completions of finished work still run on the next drain.
+    void stop_workers();
+
+    // Run tasks submitted before the call, and completions of background work
+    // finished before the call. Tasks submitted while draining run on the next
+    // drain. Return true if ran tasks.
     bool drain();
 };
 
@@ -0,0 +1,111 @@
+#include "../image_probe.h"
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+static std::optional<ImageSize> probe(const std::string &data)
+{
+    return probe_image_size(data.data(), data.size());
+}
+
+TEST(IMAGE_PROBE, png)
+{
+    std::string png(
+        "\x89PNG\r\n\x1a\n"
+        "\x00\x00\x00\x0d" "IHDR"
+        "\x00\x00\x02\x80"  // width 640
+        "\x00\x00\x01\xe0"  // height 480
+        "\x08\x02\x00\x00\x00",
+        29
+    );
+    ASSERT_EQ(probe(png), (ImageSize {640, 480}));
+    ASSERT_EQ(probe(png.substr(0, 20)), std::nullopt);
+}
+
+TEST(IMAGE_PROBE, gif)
+{
+    std::string gif("GIF89a" "\x2c\x01" "\xc8\x00" "\xf7\x00\x00", 13);
+    ASSERT_EQ(probe(gif), (ImageSize {300, 200}));
+    ASSERT_EQ(probe(gif.substr(0, 8)), std::nullopt);
+}
+
+TEST(IMAGE_PROBE, jpeg)
+{
+    std::string jpeg(
+        "\xff\xd8"
+        "\xff\xe0" "\x00\x10" "JFIF\x00\x01\x01\x00\x00\x01\x00\x01\x00\x00"  // APP0
+        "\xff\xff"                                                              // fill byte
+        "\xff\xdb" "\x00\x04" "\x00\x00"                                        // DQT (truncated table)
+        "\xff\xc2" "\x00\x11" "\x08" "\x0b\xb8" "\x0f\xa0" "\x03"               // progressive SOF, 4000x3000
+        "\x01\x22\x00\x02\x11\x01\x03\x11\x01",
+        47
+    );
+    ASSERT_EQ(probe(jpeg), (ImageSize {4000, 3000}));
+    ASSERT_EQ(probe(jpeg.substr(0, 34)), std::nullopt);
+}
+
+TEST(IMAGE_PROBE, unknown_format)
+{
+    ASSERT_EQ(probe(""), std::nullopt);
+    ASSERT_EQ(probe("BM not supported"), std::nullopt);
+    ASSERT_EQ(probe(std::string("\xff\xd8\xff\xda\x00\x02", 6)), std::nullopt);
+}
+
+TEST(IMAGE_PROBE, bmp)
+{
+    std::string bmp(
+        "BM" "\x46\x00\x00\x00" "\x00\x00\x00\x00" "\x36\x00\x00\x00"
+        "\x28\x00\x00\x00"   // BITMAPINFOHEADER
+        "\x20\x03\x00\x00"   // width 800
+        "\xa8\xfd\xff\xff",  // height -600 (top-down)
+        26
+    );
+    ASSERT_EQ(probe(bmp), (ImageSize {800, 600}));
+
+    std::string core_bmp(
+        "BM" "\x46\x00\x00\x00" "\x00\x00\x00\x00" "\x1a\x00\x00\x00"
+        "\x0c\x00\x00\x00"   // BITMAPCOREHEADER
+        "\x40\x00" "\x20\x00" "\x01\x00\x18\x00",
+        26
+    );
+    ASSERT_EQ(probe(core_bmp), (ImageSize {64, 32}));
+}
+
+TEST(IMAGE_PROBE, svg)
+{
+    ASSERT_EQ(
+        probe("<?xml version=\"1.0\"?>\n<svg xmlns=\"http://www.w3.org/2000/svg\" width=\"120px\" height='80'>"),
+        (ImageSize {120, 80})
+    );
+    ASSERT_EQ(
+        probe("<svg stroke-width=\"2\" width=\"50%\" viewBox=\"0 0 300.4 150\">"),
+        (ImageSize {300, 150})
+    );
+    ASSERT_EQ(probe("<svg width=\"10em\" height=\"5em\">"), std::nullopt);
+    ASSERT_EQ(probe("<html><body></body></html>"), std::nullopt);
+}
+
+TEST(IMAGE_PROBE, reads_longer_prefix_when_cut_off)
+{
+    std::string jpeg("\xff\xd8" "\xff\xe1" "\x7f\xff", 6);
+    jpeg += std::string(0x7fff - 2, 'x');  // large EXIF block
+    jpeg += std::string("\xff\xc0" "\x00\x11" "\x08" "\x00\x10" "\x00\x20" "\x03", 10);
+
+    std::vector<size_t> reads;
+    auto size = probe_image_size([&](size_t max_bytes) {
+        reads.push_back(max_bytes);
+        return std::vector<char>(jpeg.begin(), jpeg.begin() + std::min(max_bytes, jpeg.size()));
+    });
+    ASSERT_EQ(size, (ImageSize {32, 16}));
+    ASSERT_EQ(reads.size(), 2);
+
+    reads.clear();
+    ASSERT_EQ(probe_image_size([&](size_t max_bytes) {
+        reads.push_back(max_bytes);
+        return std::vector<char>(max_bytes, 'x');
+    }), std::nullopt);
+    ASSERT_EQ(reads.size(), 1);
+}
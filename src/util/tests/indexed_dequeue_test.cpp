@@ -0,0 +1,88 @@
+#include "../indexed_dequeue.h"
+
+#include <gtest/gtest.h>
+
+TEST(INDEXED_DEQUEUE, append_prepend_indices)
+{
+    IndexedDequeue<int> items;
+    items.append(0);
+    items.append(1);
+    items.prepend(-1);
+    items.prepend(-2);
+
+    ASSERT_EQ(items.start_index(), -2);
+    ASSERT_EQ(items.end_index(), 2);
+    ASSERT_EQ(items.size(), 4);
+    for (int i = -2; i < 2; ++i)
+    {
+        ASSERT_EQ(items[i], i);
+    }
+    ASSERT_EQ(items.back(), 1);
+}
+
+TEST(INDEXED_DEQUEUE, out_of_range)
+{
+    IndexedDequeue<int> items;
+    ASSERT_THROW(items[0], std::out_of_range);
+    ASSERT_THROW(items.pop_front(), std::out_of_range);
+
+    items.append(0);
+    ASSERT_THROW(items[1], std::out_of_range);
+    ASSERT_THROW(items[-1], std::out_of_range);
+}
+
+TEST(INDEXED_DEQUEUE, grows_across_wrap)
+{
+    IndexedDequeue<int> items;
+    for (int i = 0; i < 100; ++i)
+    {
+        items.append(i);
+        items.prepend(-i - 1);
+    }
+
+    ASSERT_EQ(items.size(), 200);
+    for (int i = -100; i < 100; ++i)
+    {
+        ASSERT_EQ(items[i], i);
+    }
+}
+
+TEST(INDEXED_DEQUEUE, pop_keeps_indices)
+{
+    IndexedDequeue<std::unique_ptr<int>> items;
+    for (int i = 0; i < 40; ++i)
+    {
+        items.append(std::make_unique<int>(i));
+    }
+
+    // Slide the window so the ring wraps around
+    for (int i = 40; i < 100; ++i)
+    {
+        items.pop_front();
+        items.append(std::make_unique<int>(i));
+    }
+    items.pop_back();
+
+    ASSERT_EQ(items.start_index(), 60);
+    ASSERT_EQ(items.end_index(), 99);
+    for (int i = 60; i < 99; ++i)
+    {
+        ASSERT_EQ(*items[i], i);
+    }
+
+    items.prepend(std::make_unique<int>(59));
+    ASSERT_EQ(*items[59], 59);
+}
+
+TEST(INDEXED_DEQUEUE, clear)
+{
+    IndexedDequeue<int> items;
+    items.append(0);
+    items.prepend(-1);
+    items.clear();
+
+    ASSERT_EQ(items.size(), 0);
+    ASSERT_EQ(items.start_index(), 0);
+    items.append(5);
+    ASSERT_EQ(items[0], 5);
+}
@@ -0,0 +1,195 @@
+#include "../record_store.h"
+#include "./temp_path.h"
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <fstream>
+
+namespace
+{
+
+std::filesystem::path fresh_store_path(const std::string &name)
+{
+    auto path = fresh_temp_path(name);
+    std::filesystem::remove(path.string() + ".bad");
+    return path;
+}
+
+void append_bytes(const std::filesystem::path &path, const std::string &bytes)
+{
+    std::ofstream file(path, std::ios::binary | std::ios::app);
+    file << bytes;
+}
+
+} // namespace
+
+TEST(RECORD_STORE, put_get_reopen)
+{
+    auto path = fresh_store_path("record_store_put_get");
+    {
+        RecordStore store(path);
+        store.put("book", "address", std::string("\0\x01\n=", 4));
+        store.put("book", "widths", "1,2,3");
+        store.put("other", "address", "7");
+
+        // Pending writes are visible before flush
+        ASSERT_EQ(store.get("book", "widths"), "1,2,3");
+        ASSERT_TRUE(store.flush());
+        ASSERT_FALSE(store.has_pending_writes());
+    }
+
+    RecordStore store(path);
+    ASSERT_EQ(store.get("book", "address"), std::string("\0\x01\n=", 4));
+    ASSERT_EQ(store.get("book", "widths"), "1,2,3");
+    ASSERT_EQ(store.get("other", "address"), "7");
+    ASSERT_EQ(store.get("other", "widths"), std::nullopt);
+
+    auto keys = store.get_keys("book");
+    std::sort(keys.begin(), keys.end());
+    ASSERT_EQ(keys, (std::vector<std::string>{"address", "widths"}));
+}
+
+TEST(RECORD_STORE, overwrite_and_erase)
+{
+    auto path = fresh_store_path("record_store_overwrite");
+    {
+        RecordStore store(path);
+        store.put("book", "a", "1");
+        store.put("book", "b", "2");
+        ASSERT_TRUE(store.flush());
+
+        store.put("book", "a", "3");
+        store.erase("book", "b");
+        ASSERT_EQ(store.get("book", "b"), std::nullopt);
+        ASSERT_EQ(store.get_keys("book"), std::vector<std::string>{"a"});
+        ASSERT_TRUE(store.flush());
+    }
+
+    RecordStore store(path);
+    ASSERT_EQ(store.get("book", "a"), "3");
+    ASSERT_EQ(store.get("book", "b"), std::nullopt);
+}
+
+TEST(RECORD_STORE, drops_torn_tail)
+{
+    auto path = fresh_store_path("record_store_torn");
+    uint64_t good_size;
+    {
+        RecordStore store(path);
+        store.put("book", "a", "1");
+        ASSERT_TRUE(store.flush());
+        good_size = store.get_file_size();
+    }
+
+    // A partial record header, as left by power loss mid-write
+    append_bytes(path, std::string("\x12\x34\x56\x78\x00\x00", 6));
+    {
+        RecordStore store(path);
+        ASSERT_EQ(store.get("book", "a"), "1");
+        ASSERT_EQ(store.get_file_size(), good_size);
+
+        // New records land after the last good one
+        store.put("book", "b", "2");
+        ASSERT_TRUE(store.flush());
+    }
+
+    RecordStore store(path);
+    ASSERT_EQ(store.get("book", "a"), "1");
+    ASSERT_EQ(store.get("book", "b"), "2");
+}
+
+TEST(RECORD_STORE, drops_corrupt_record)
+{
+    auto path = fresh_store_path("record_store_corrupt");
+    {
+        RecordStore store(path);
+        store.put("book", "a", "1");
+        ASSERT_TRUE(store.flush());
+        store.put("book", "b", "2");
+        ASSERT_TRUE(store.flush());
+    }
+
+    // Flip a byte in the key of the second record
+    auto size = std::filesystem::file_size(path);
+    {
+        std::fstream file(path, std::ios::binary | std::ios::in | std::ios::out);
+        file.seekp(size - 2);
+        file.put('x');
+    }
+
+    RecordStore store(path);
+    ASSERT_EQ(store.get("book", "a"), "1");
+    ASSERT_EQ(store.get("book", "b"), std::nullopt);
+}
+
+TEST(RECORD_STORE, replaces_unrecognized_file)
+{
+    auto path = fresh_store_path("record_store_unrecognized");
+    append_bytes(path, "address=1234\n");
+
+    RecordStore store(path);
+    ASSERT_EQ(store.get_keys("address"), std::vector<std::string>{});
+    ASSERT_TRUE(std::filesystem::exists(path.string() + ".bad"));
+
+    store.put("book", "a", "1");
+    ASSERT_TRUE(store.flush());
+}
+
+TEST(RECORD_STORE, compaction)
+{
+    auto path = fresh_store_path("record_store_compact");
+    std::string value(1000, 'v');
+    {
+        RecordStore store(path);
+        store.put("book", "keep", "kept");
+        for (int i = 0; i < 100; ++i)
+        {
+            value[0] = 'a' + i % 26;
+            store.put("book", "position", value);
+            ASSERT_TRUE(store.flush());
+        }
+
+        // Replaced records are dropped once they outweigh live ones, when
+        // the owner asks
+        ASSERT_GT(store.get_file_size(), 64 * 1024);
+        ASSERT_TRUE(store.should_compact());
+        ASSERT_TRUE(store.compact());
+        ASSERT_FALSE(store.should_compact());
+        ASSERT_LT(store.get_file_size(), 64 * 1024);
+        ASSERT_EQ(store.get("book", "position"), value);
+        ASSERT_FALSE(std::filesystem::exists(path.string() + ".tmp"));
+
+        store.put("book", "after", "compaction");
+        ASSERT_TRUE(store.flush());
+    }
+
+    RecordStore store(path);
+    ASSERT_EQ(store.get("book", "keep"), "kept");
+    ASSERT_EQ(store.get("book", "position"), value);
+    ASSERT_EQ(store.get("book", "after"), "compaction");
+}
+
+TEST(RECORD_STORE, groups_and_clear)
+{
+    auto path = fresh_store_path("record_store_clear");
+    {
+        RecordStore store(path);
+        store.put("book1", "a", "1");
+        store.put("book2", "a", "2");
+        ASSERT_TRUE(store.flush());
+        store.erase("book2", "a");
+        store.put("book3", "a", "3");
+
+        auto groups = store.get_groups();
+        std::sort(groups.begin(), groups.end());
+        ASSERT_EQ(groups, (std::vector<std::string>{"book1", "book3"}));
+
+        ASSERT_TRUE(store.clear());
+        ASSERT_EQ(store.get_groups(), std::vector<std::string>{});
+        ASSERT_FALSE(store.has_pending_writes());
+    }
+
+    RecordStore store(path);
+    ASSERT_EQ(store.get("book1", "a"), std::nullopt);
+}
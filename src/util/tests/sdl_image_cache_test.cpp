@@ -0,0 +1,95 @@
+#include "../sdl_image_cache.h"
+
+#include <gtest/gtest.h>
+
+// 100x10 at 32bpp is 4000 bytes of pixels
+static const uint64_t IMAGE_BYTES = 4000;
+
+static surface_unique_ptr make_image()
+{
+    return surface_unique_ptr {SDL_CreateRGBSurface(SDL_SWSURFACE, 100, 10, 32, 0, 0, 0, 0)};
+}
+
+TEST(SDL_IMAGE_CACHE, counts_size_and_hits)
+{
+    SDLImageCache cache(IMAGE_BYTES * 4, ImageCachePolicy::LeastRecentlyUsed);
+    cache.put_image("a", make_image());
+    cache.put_image("b", make_image());
+
+    ASSERT_NE(cache.get_image("a"), nullptr);
+    ASSERT_EQ(cache.get_image("c"), nullptr);
+
+    const auto &stats = cache.get_stats();
+    ASSERT_EQ(stats.num_images, 2);
+    ASSERT_EQ(stats.size_bytes, IMAGE_BYTES * 2);
+    ASSERT_EQ(stats.hits, 1);
+    ASSERT_EQ(stats.misses, 1);
+    ASSERT_EQ(stats.evictions, 0);
+}
+
+TEST(SDL_IMAGE_CACHE, replace_existing_key)
+{
+    SDLImageCache cache(IMAGE_BYTES * 4, ImageCachePolicy::LeastRecentlyUsed);
+    cache.put_image("a", make_image());
+    cache.put_image("a", make_image());
+
+    ASSERT_EQ(cache.get_stats().num_images, 1);
+    ASSERT_EQ(cache.get_stats().size_bytes, IMAGE_BYTES);
+}
+
+TEST(SDL_IMAGE_CACHE, lru_evicts_least_recently_used)
+{
+    SDLImageCache cache(IMAGE_BYTES * 3, ImageCachePolicy::LeastRecentlyUsed);
+    cache.put_image("a", make_image());
+    cache.put_image("b", make_image());
+    cache.put_image("c", make_image());
+    cache.get_image("a");
+    cache.put_image("d", make_image());
+
+    ASSERT_NE(cache.get_image("a"), nullptr);
+    ASSERT_EQ(cache.get_image("b"), nullptr);
+    ASSERT_NE(cache.get_image("c"), nullptr);
+    ASSERT_NE(cache.get_image("d"), nullptr);
+    ASSERT_EQ(cache.get_stats().evictions, 1);
+    ASSERT_EQ(cache.get_stats().size_bytes, IMAGE_BYTES * 3);
+}
+
+TEST(SDL_IMAGE_CACHE, distance_evicts_farthest_from_position)
+{
+    SDLImageCache cache(IMAGE_BYTES * 3, ImageCachePolicy::FarthestFromPosition);
+    cache.put_image("a", make_image(), 100);
+    cache.put_image("b", make_image(), 500);
+    cache.put_image("c", make_image(), 900);
+
+    cache.set_reading_position(850);
+    cache.put_image("d", make_image(), 1000);
+
+    ASSERT_EQ(cache.get_image("a"), nullptr);
+    ASSERT_NE(cache.get_image("b"), nullptr);
+    ASSERT_NE(cache.get_image("c"), nullptr);
+    ASSERT_NE(cache.get_image("d"), nullptr);
+
+    cache.set_reading_position(0);
+    cache.put_image("e", make_image(), 0);
+
+    ASSERT_EQ(cache.get_image("d"), nullptr);
+    ASSERT_NE(cache.get_image("b"), nullptr);
+}
+
+TEST(SDL_IMAGE_CACHE, keeps_image_larger_than_budget)
+{
+    SDLImageCache cache(IMAGE_BYTES / 2, ImageCachePolicy::LeastRecentlyUsed);
+    cache.put_image("a", make_image());
+    ASSERT_NE(cache.get_image("a"), nullptr);
+
+    cache.put_image("b", make_image());
+    ASSERT_EQ(cache.get_image("a"), nullptr);
+    ASSERT_NE(cache.get_image("b"), nullptr);
+}
+
+TEST(SDL_IMAGE_CACHE, parse_policy)
+{
+    ASSERT_EQ(image_cache_policy_from_string("lru"), ImageCachePolicy::LeastRecentlyUsed);
+    ASSERT_EQ(image_cache_policy_from_string("distance"), ImageCachePolicy::FarthestFromPosition);
+    ASSERT_EQ(image_cache_policy_from_string("fifo"), std::nullopt);
+}
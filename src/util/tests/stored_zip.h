@@ -0,0 +1,78 @@
+#ifndef STORED_ZIP_H_
+#define STORED_ZIP_H_
+
+#include "../checksum.h"
+#include "../string_serialization.h"
+
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+inline void put_u16(std::string &buf, uint16_t value)
+{
+    buf.push_back(value & 0xFF);
+    buf.push_back(value >> 8);
+}
+
+// Minimal zip with every entry stored uncompressed
+inline std::filesystem::path write_stored_zip(const std::string &name, const std::vector<std::pair<std::string, std::string>> &files)
+{
+    std::string zip, central;
+    for (const auto &[file_name, contents] : files)
+    {
+        uint32_t crc = crc32(contents.data(), contents.size());
+        uint32_t local_offset = zip.size();
+
+        put_u32(zip, 0x04034b50);
+        put_u16(zip, 10);               // version needed
+        put_u16(zip, 0);                // flags
+        put_u16(zip, 0);                // stored
+        put_u32(zip, 0);                // time, date
+        put_u32(zip, crc);
+        put_u32(zip, contents.size());
+        put_u32(zip, contents.size());
+        put_u16(zip, file_name.size());
+        put_u16(zip, 0);                // extra
+        zip += file_name;
+        zip += contents;
+
+        put_u32(central, 0x02014b50);
+        put_u16(central, 10);           // version made by
+        put_u16(central, 10);
+        put_u16(central, 0);
+        put_u16(central, 0);
+        put_u32(central, 0);
+        put_u32(central, crc);
+        put_u32(central, contents.size());
+        put_u32(central, contents.size());
+        put_u16(central, file_name.size());
+        put_u16(central, 0);            // extra
+        put_u16(central, 0);            // comment
+        put_u16(central, 0);            // disk
+        put_u16(central, 0);            // internal attributes
+        put_u32(central, 0);            // external attributes
+        put_u32(central, local_offset);
+        central += file_name;
+    }
+
+    uint32_t central_offset = zip.size();
+    zip += central;
+    put_u32(zip, 0x06054b50);
+    put_u16(zip, 0);
+    put_u16(zip, 0);
+    put_u16(zip, files.size());
+    put_u16(zip, files.size());
+    put_u32(zip, central.size());
+    put_u32(zip, central_offset);
+    put_u16(zip, 0);
+
+    auto path = std::filesystem::temp_directory_path() / name;
+    std::ofstream file(path, std::ios::binary);
+    file << zip;
+    return path;
+}
+
+#endif
@@ -57,3 +57,32 @@ TEST(ENCODE_UINT_VECTOR, encoding)
     ASSERT_EQ(encode_uint_vector(std::vector<uint32_t>{0}), "0");
     ASSERT_EQ(encode_uint_vector(std::vector<uint32_t>{0, 100, 200}), "0,100,200");
 }
+
+TEST(BYTE_READER, round_trip)
+{
+    std::string buf;
+    put_u32(buf, 0xDEADBEEF);
+    put_u64(buf, 0x0123456789ABCDEF);
+    buf += "abc";
+
+    ByteReader reader(buf);
+    EXPECT_EQ(reader.get(4), 0xDEADBEEF);
+    EXPECT_EQ(reader.get(8), 0x0123456789ABCDEF);
+    EXPECT_EQ(reader.get_bytes(3), "abc");
+    EXPECT_TRUE(reader.ok);
+    EXPECT_EQ(reader.pos, reader.end);
+}
+
+TEST(BYTE_READER, failures_stick)
+{
+    std::string buf;
+    put_u32(buf, 7);
+    set_u32(buf.data(), 9);
+    EXPECT_EQ(get_u32(buf.data()), 9);
+
+    ByteReader reader(buf);
+    EXPECT_EQ(reader.get(8), 0);
+    EXPECT_FALSE(reader.ok);
+    EXPECT_EQ(reader.get(4), 0);
+    EXPECT_EQ(reader.get_bytes(1), "");
+}
@@ -0,0 +1,91 @@
+#include "../task_queue.h"
+
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+TEST(TASK_QUEUE, drain_runs_submitted_tasks)
+{
+    TaskQueue queue;
+    int count = 0;
+
+    ASSERT_FALSE(queue.drain());
+
+    queue.submit([&count]() { ++count; });
+    queue.submit([&count]() { ++count; });
+    ASSERT_TRUE(queue.drain());
+    ASSERT_EQ(count, 2);
+
+    ASSERT_FALSE(queue.drain());
+}
+
+TEST(TASK_QUEUE, resubmitted_task_runs_on_next_drain)
+{
+    TaskQueue queue;
+    int count = 0;
+
+    std::function<void()> task = [&]() {
+        if (++count < 3)
+        {
+            queue.submit(task);
+        }
+    };
+    queue.submit(task);
+
+    ASSERT_TRUE(queue.drain());
+    ASSERT_EQ(count, 1);
+    ASSERT_TRUE(queue.drain());
+    ASSERT_EQ(count, 2);
+    ASSERT_TRUE(queue.drain());
+    ASSERT_EQ(count, 3);
+    ASSERT_FALSE(queue.drain());
+}
+
+TEST(TASK_QUEUE, background_without_workers_runs_on_drain)
+{
+    TaskQueue queue;
+    std::vector<int> order;
+
+    queue.submit_background(
+        [&order]() { order.push_back(1); },
+        [&order]() { order.push_back(2); }
+    );
+    ASSERT_TRUE(order.empty());
+
+    ASSERT_TRUE(queue.drain());
+    ASSERT_EQ(order, std::vector<int>({1, 2}));
+}
+
+TEST(TASK_QUEUE, background_completes_on_draining_thread)
+{
+    TaskQueue queue(2);
+    const auto drain_thread = std::this_thread::get_id();
+
+    std::atomic<int> num_worked = 0;
+    int num_done = 0;
+    bool done_on_drain_thread = true;
+
+    for (int i = 0; i < 8; ++i)
+    {
+        queue.submit_background(
+            [&num_worked]() { ++num_worked; },
+            [&]() {
+                ++num_done;
+                done_on_drain_thread = done_on_drain_thread && std::this_thread::get_id() == drain_thread;
+            }
+        );
+    }
+
+    for (int i = 0; i < 1000 && num_done < 8; ++i)
+    {
+        queue.drain();
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+
+    ASSERT_EQ(num_worked, 8);
+    ASSERT_EQ(num_done, 8);
+    ASSERT_TRUE(done_on_drain_thread);
+}
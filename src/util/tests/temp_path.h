@@ -0,0 +1,15 @@
+#ifndef TEMP_PATH_H_
+#define TEMP_PATH_H_
+
+#include <filesystem>
+#include <string>
+
+// Path in the temp directory, cleared of anything left by an earlier run
+inline std::filesystem::path fresh_temp_path(const std::string &name)
+{
+    auto path = std::filesystem::temp_directory_path() / name;
+    std::filesystem::remove_all(path);
+    return path;
+}
+
+#endif
@@ -0,0 +1,101 @@
+#include "../zip_archive.h"
+#include "./stored_zip.h"
+
+#include <gtest/gtest.h>
+
+#include <fstream>
+
+TEST(ZIP_ARCHIVE, read_stored_entries)
+{
+    auto path = write_stored_zip("zip_archive_read.zip", {
+        {"mimetype", "application/epub+zip"},
+        {"OEBPS/image.png", std::string("\x89PNG\0data", 9)},
+    });
+
+    ZipArchive archive;
+    ASSERT_TRUE(archive.open(path));
+    ASSERT_TRUE(archive.contains("mimetype"));
+    ASSERT_FALSE(archive.contains("missing"));
+    ASSERT_EQ(archive.file_size("OEBPS/image.png"), 9);
+
+    auto buffer = archive.read("mimetype");
+    ASSERT_EQ(std::string(buffer.data()), "application/epub+zip");
+    ASSERT_EQ(buffer.size(), 21);
+
+    ASSERT_EQ(archive.read_prefix("OEBPS/image.png", 4), std::vector<char>({'\x89', 'P', 'N', 'G'}));
+    ASSERT_TRUE(archive.read("missing").empty());
+}
+
+TEST(ZIP_ARCHIVE, view_stored_is_zero_copy)
+{
+    auto path = write_stored_zip("zip_archive_view.zip", {
+        {"a.txt", "first"},
+        {"b.txt", "second"},
+    });
+
+    ZipArchive archive;
+    ASSERT_TRUE(archive.open(path));
+
+    auto view = archive.view_stored("b.txt");
+    ASSERT_TRUE(view);
+    ASSERT_EQ(*view, "second");
+
+    // Both view the mapping in place: b's data follows a's data, then b's
+    // 30 byte local header and name
+    auto first = archive.view_stored("a.txt");
+    ASSERT_TRUE(first);
+    ASSERT_EQ(view->data(), first->data() + first->size() + 30 + 5);
+
+    ASSERT_FALSE(archive.view_stored("missing"));
+}
+
+TEST(ZIP_ARCHIVE, shared_mapping)
+{
+    auto path = write_stored_zip("zip_archive_shared.zip", {
+        {"a.txt", "shared"},
+    });
+
+    ZipArchive archive;
+    ASSERT_TRUE(archive.open(path));
+
+    ZipArchive other;
+    ASSERT_TRUE(other.open(archive.get_mapping()));
+    ASSERT_EQ(other.get_mapping(), archive.get_mapping());
+    ASSERT_EQ(other.view_stored("a.txt")->data(), archive.view_stored("a.txt")->data());
+    ASSERT_EQ(std::string(other.read("a.txt").data()), "shared");
+}
+
+TEST(ZIP_ARCHIVE, open_invalid)
+{
+    auto path = std::filesystem::temp_directory_path() / "zip_archive_invalid.zip";
+    {
+        std::ofstream file(path, std::ios::binary);
+        file << "not a zip";
+    }
+
+    ZipArchive archive;
+    ASSERT_FALSE(archive.open(path));
+    ASSERT_FALSE(archive.is_open());
+    ASSERT_FALSE(archive.open(std::filesystem::temp_directory_path() / "zip_archive_missing.zip"));
+}
+
+TEST(ZIP_ARCHIVE, stored_entry_past_end_not_viewed)
+{
+    auto path = write_stored_zip("zip_archive_past_end.zip", {
+        {"a.txt", "first"},
+        {"b.txt", "second"},
+    });
+
+    // Claim a local extra field running past the end of the file for a.txt
+    {
+        std::fstream file(path, std::ios::binary | std::ios::in | std::ios::out);
+        file.seekp(28);
+        file.put('\xFF');
+        file.put('\xFF');
+    }
+
+    ZipArchive archive;
+    ASSERT_TRUE(archive.open(path));
+    ASSERT_FALSE(archive.view_stored("a.txt"));
+    ASSERT_EQ(*archive.view_stored("b.txt"), "second");
+}
@@ -8,4 +8,11 @@ inline const char *utf8_step(const char *s)
     return s;
 }
 
+// Step to next character, without reading past end
+inline const char *utf8_step(const char *s, const char *end)
+{
+    while (++s < end && (*s & 0xC0) == 0x80);
+    return s;
+}
+
 #endif
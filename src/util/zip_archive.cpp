@@ -0,0 +1,318 @@
+#include "./zip_archive.h"
+
+#include "sys/mapped_file.h"
+
+#include <zip.h>
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include <string_view>
+
+#define DEBUG 0
+
+namespace
+{
+
+constexpr uint32_t EOCD_SIGNATURE = 0x06054b50;
+constexpr uint32_t CENTRAL_HEADER_SIGNATURE = 0x02014b50;
+constexpr uint32_t LOCAL_HEADER_SIGNATURE = 0x04034b50;
+constexpr size_t EOCD_SIZE = 22;
+constexpr size_t CENTRAL_HEADER_SIZE = 46;
+constexpr size_t LOCAL_HEADER_SIZE = 30;
+constexpr size_t MAX_ZIP_COMMENT_SIZE = 0xFFFF;
+
+uint16_t read_u16(const char *p)
+{
+    auto *u = reinterpret_cast<const uint8_t *>(p);
+    return u[0] | (u[1] << 8);
+}
+
+uint32_t read_u32(const char *p)
+{
+    auto *u = reinterpret_cast<const uint8_t *>(p);
+    return u[0] | (u[1] << 8) | (u[2] << 16) | (static_cast<uint32_t>(u[3]) << 24);
+}
+
+// Locate the data of stored entries by walking the central directory, keyed
+// by raw entry name. Zip64, encrypted, or out of bounds entries are skipped
+// and left to libzip. Offsets come from the file, so bounds are checked by
+// subtracting from size, which can't overflow.
+std::unordered_map<std::string, std::string_view> find_stored_entries(const char *data, size_t size)
+{
+    std::unordered_map<std::string, std::string_view> stored;
+    if (size < EOCD_SIZE)
+    {
+        return stored;
+    }
+
+    size_t eocd = size - EOCD_SIZE;
+    size_t search_end = size - EOCD_SIZE - std::min(size - EOCD_SIZE, MAX_ZIP_COMMENT_SIZE);
+    while (read_u32(data + eocd) != EOCD_SIGNATURE)
+    {
+        if (eocd == search_end)
+        {
+            return stored;
+        }
+        --eocd;
+    }
+
+    uint32_t num_entries = read_u16(data + eocd + 10);
+    size_t pos = read_u32(data + eocd + 16);
+    for (uint32_t i = 0; i < num_entries; ++i)
+    {
+        if (pos > size || size - pos < CENTRAL_HEADER_SIZE || read_u32(data + pos) != CENTRAL_HEADER_SIGNATURE)
+        {
+            break;
+        }
+
+        uint16_t flags = read_u16(data + pos + 8);
+        uint16_t method = read_u16(data + pos + 10);
+        uint32_t comp_size = read_u32(data + pos + 20);
+        uint32_t uncomp_size = read_u32(data + pos + 24);
+        size_t name_size = read_u16(data + pos + 28);
+        size_t extra_size = read_u16(data + pos + 30);
+        size_t comment_size = read_u16(data + pos + 32);
+        size_t local_offset = read_u32(data + pos + 42);
+
+        size_t header_size = CENTRAL_HEADER_SIZE + name_size + extra_size + comment_size;
+        if (size - pos < CENTRAL_HEADER_SIZE + name_size)
+        {
+            break;
+        }
+
+        bool encrypted = flags & 1;
+        bool zip64 = comp_size == 0xFFFFFFFF || local_offset == 0xFFFFFFFF;
+        if (method == ZIP_CM_STORE && !encrypted && !zip64 && comp_size == uncomp_size &&
+            local_offset < size && size - local_offset >= LOCAL_HEADER_SIZE &&
+            read_u32(data + local_offset) == LOCAL_HEADER_SIGNATURE)
+        {
+            size_t local_names_size = read_u16(data + local_offset + 26) + read_u16(data + local_offset + 28);
+            size_t data_room = size - local_offset - LOCAL_HEADER_SIZE;
+            if (local_names_size <= data_room && comp_size <= data_room - local_names_size)
+            {
+                size_t data_offset = local_offset + LOCAL_HEADER_SIZE + local_names_size;
+                stored.emplace(std::string(data + pos + CENTRAL_HEADER_SIZE, name_size), std::string_view(data + data_offset, comp_size));
+            }
+        }
+
+        if (size - pos < header_size)
+        {
+            break;
+        }
+        pos += header_size;
+    }
+
+    return stored;
+}
+
+} // namespace
+
+ZipArchive::~ZipArchive()
+{
+    close();
+}
+
+void ZipArchive::close()
+{
+    if (zip)
+    {
+        zip_close(zip);
+        zip = nullptr;
+    }
+    entries.clear();
+    mapping.reset();
+}
+
+bool ZipArchive::open(const std::filesystem::path &path)
+{
+    auto file = std::make_shared<MappedFile>();
+    if (!file->open(path))
+    {
+        std::cerr << "Unable to map " << path << std::endl;
+        return false;
+    }
+    return open(std::move(file));
+}
+
+bool ZipArchive::open(std::shared_ptr<const MappedFile> new_mapping)
+{
+    close();
+    if (!new_mapping || !new_mapping->good())
+    {
+        return false;
+    }
+
+    zip_error_t error;
+    zip_error_init(&error);
+    zip_source_t *source = zip_source_buffer_create(new_mapping->data(), new_mapping->size(), 0, &error);
+    zip_t *new_zip = source ? zip_open_from_source(source, ZIP_RDONLY, &error) : nullptr;
+    if (!new_zip)
+    {
+        std::cerr << "Unable to open zip: " << zip_error_strerror(&error) << std::endl;
+        if (source)
+        {
+            zip_source_free(source);
+        }
+        zip_error_fini(&error);
+        return false;
+    }
+    zip_error_fini(&error);
+
+    zip = new_zip;
+    mapping = std::move(new_mapping);
+
+    auto stored = find_stored_entries(mapping->data(), mapping->size());
+
+    zip_int64_t num_entries = zip_get_num_entries(zip, 0);
+    entries.reserve(num_entries > 0 ? num_entries : 0);
+    for (zip_int64_t i = 0; i < num_entries; ++i)
+    {
+        zip_stat_t stats;
+        if (zip_stat_index(zip, i, 0, &stats) != 0 || !(stats.valid & ZIP_STAT_NAME))
+        {
+            continue;
+        }
+
+        Entry entry = {static_cast<uint64_t>(i), 0, nullptr};
+        if (stats.valid & ZIP_STAT_SIZE)
+        {
+            entry.size = stats.size;
+        }
+
+        auto stored_it = stored.find(stats.name);
+        bool is_stored = (
+            (stats.valid & ZIP_STAT_COMP_METHOD) && stats.comp_method == ZIP_CM_STORE &&
+            (stats.valid & ZIP_STAT_SIZE)
+        );
+        // Only sizes checked against the mapping are trusted
+        if (is_stored && stored_it != stored.end() && stored_it->second.size() == entry.size)
+        {
+            entry.stored_data = stored_it->second.data();
+        }
+
+        // First entry wins for duplicate names, as with zip_name_locate
+        entries.emplace(stats.name, entry);
+    }
+
+#if DEBUG
+    std::cerr << "Indexed " << entries.size() << " zip entries, " << stored.size() << " stored" << std::endl;
+#endif
+
+    return true;
+}
+
+bool ZipArchive::is_open() const
+{
+    return zip != nullptr;
+}
+
+const std::shared_ptr<const MappedFile> &ZipArchive::get_mapping() const
+{
+    return mapping;
+}
+
+const ZipArchive::Entry *ZipArchive::find(const std::string &name) const
+{
+    auto it = entries.find(name);
+    return it == entries.end() ? nullptr : &it->second;
+}
+
+bool ZipArchive::contains(const std::string &name) const
+{
+    return find(name) != nullptr;
+}
+
+uint64_t ZipArchive::file_size(const std::string &name) const
+{
+    const Entry *entry = find(name);
+    return entry ? entry->size : 0;
+}
+
+std::optional<std::string_view> ZipArchive::view_stored(const std::string &name) const
+{
+    const Entry *entry = find(name);
+    if (!entry || !entry->stored_data)
+    {
+        return std::nullopt;
+    }
+    return std::string_view(entry->stored_data, entry->size);
+}
+
+bool ZipArchive::read(const std::string &name, std::vector<char> &buffer) const
+{
+    buffer.clear();
+
+    const Entry *entry = find(name);
+    if (!zip || !entry)
+    {
+        std::cerr << "Unable to find " << name << " in zip" << std::endl;
+        return false;
+    }
+
+    buffer.resize(entry->size + 1);
+    buffer[entry->size] = 0;
+
+    if (entry->stored_data)
+    {
+        std::memcpy(buffer.data(), entry->stored_data, entry->size);
+        return true;
+    }
+
+    zip_file_t *fp = zip_fopen_index(zip, entry->index, 0);
+    if (fp == nullptr)
+    {
+        std::cerr << "Unable to open " << name << " in zip" << std::endl;
+        buffer.clear();
+        return false;
+    }
+
+    auto read_size = zip_fread(fp, buffer.data(), entry->size);
+    zip_fclose(fp);
+    if (read_size < 0 || static_cast<uint64_t>(read_size) != entry->size)
+    {
+        std::cerr << "Read unexpected number of bytes for " << name << " in zip"
+            << " expected " << entry->size
+            << " got " << read_size
+            << std::endl;
+    }
+
+    return true;
+}
+
+std::vector<char> ZipArchive::read(const std::string &name) const
+{
+    std::vector<char> buffer;
+    read(name, buffer);
+    return buffer;
+}
+
+std::vector<char> ZipArchive::read_prefix(const std::string &name, size_t max_bytes) const
+{
+    const Entry *entry = find(name);
+    if (!zip || !entry)
+    {
+        std::cerr << "Unable to find " << name << " in zip" << std::endl;
+        return {};
+    }
+
+    if (entry->stored_data)
+    {
+        size_t size = std::min<uint64_t>(entry->size, max_bytes);
+        return std::vector<char>(entry->stored_data, entry->stored_data + size);
+    }
+
+    zip_file_t *fp = zip_fopen_index(zip, entry->index, 0);
+    if (fp == nullptr)
+    {
+        std::cerr << "Unable to open " << name << " in zip" << std::endl;
+        return {};
+    }
+
+    std::vector<char> buffer(max_bytes);
+    auto read_size = zip_fread(fp, buffer.data(), max_bytes);
+    zip_fclose(fp);
+
+    buffer.resize(read_size > 0 ? read_size : 0);
+    return buffer;
+}
@@ -0,0 +1,68 @@
+#ifndef ZIP_ARCHIVE_H_
+#define ZIP_ARCHIVE_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+class MappedFile;
+typedef struct zip zip_t;
+
+// Read-only zip archive over a memory mapping of the file.
+//
+// Entry names are indexed once on open, so lookups don't search the central
+// directory. Stored (uncompressed) entries can be viewed in place; compressed
+// entries are inflated through libzip. Not thread-safe; threads should each
+// open their own archive, which can share the mapping.
+class ZipArchive
+{
+    struct Entry
+    {
+        uint64_t index;
+        uint64_t size;
+        const char *stored_data;  // in the mapping, or null if compressed
+    };
+
+    std::shared_ptr<const MappedFile> mapping;
+    zip_t *zip = nullptr;
+    std::unordered_map<std::string, Entry> entries;
+
+    const Entry *find(const std::string &name) const;
+    void close();
+
+public:
+    ZipArchive() = default;
+    ZipArchive(const ZipArchive &) = delete;
+    ZipArchive &operator=(const ZipArchive &) = delete;
+    ~ZipArchive();
+
+    bool open(const std::filesystem::path &path);
+    // Open another handle on an already mapped archive
+    bool open(std::shared_ptr<const MappedFile> mapping);
+    bool is_open() const;
+
+    // Keeps views from view_stored valid
+    const std::shared_ptr<const MappedFile> &get_mapping() const;
+
+    bool contains(const std::string &name) const;
+    // Uncompressed size, or 0 if unknown
+    uint64_t file_size(const std::string &name) const;
+
+    // Contents of a stored entry without copying, or nullopt if compressed or missing
+    std::optional<std::string_view> view_stored(const std::string &name) const;
+
+    // Read an entry followed by a null terminator into buffer, reusing its capacity
+    bool read(const std::string &name, std::vector<char> &buffer) const;
+    // Null terminated contents, or empty on failure
+    std::vector<char> read(const std::string &name) const;
+    // At most max_bytes from the start of an entry, only inflating that much
+    std::vector<char> read_prefix(const std::string &name, size_t max_bytes) const;
+};
+
+#endif